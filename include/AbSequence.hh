@@ -116,9 +116,11 @@ public:
 
 
 private:
-	// IGBlastParser and SequenceRecord can directly set these params
+	// IGBlastParser and SequenceRecord can directly set these params,
+	// and RecordStore stores them as columns
 	friend class IGBlastParser;
 	friend class SequenceRecord;
+	friend class RecordStore;
 
 	// private subroutines that build sequence
 	void build_nt_sequence();
@@ -0,0 +1,128 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file BoundedQueue.hh
+@brief Queue of limited size that passes items between threads
+@details push waits while the queue is full and pop waits while it
+is empty, so a fast stage can't run ahead of a slow one and pile up
+items in memory. Closing the queue wakes every waiting thread.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef BOUNDEDQUEUE_HH_
+#define BOUNDEDQUEUE_HH_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+
+namespace errorx {
+
+using namespace std;
+
+template <typename T>
+class BoundedQueue {
+
+public:
+
+	/**
+		Constructor
+
+		@param capacity number of items the queue holds
+
+		@throws invalid_argument if capacity is below 1
+	*/
+	BoundedQueue( int capacity ) :
+		capacity_( capacity ),
+		closed_( false )
+	{
+		if ( capacity < 1 ) {
+			throw invalid_argument( "Error: a queue must hold at least one item" );
+		}
+	}
+
+	/**
+		Add an item, waiting while the queue is full
+
+		@param item item to add. Moved from only if it was added
+
+		@return false if the queue was closed, in which case
+		the item is not added
+	*/
+	bool push( T && item ) {
+		unique_lock<mutex> lock( lock_ );
+		not_full_.wait( lock, [this]{ return closed_ || (int)items_.size() < capacity_; });
+		if ( closed_ ) return false;
+
+		items_.push_back( move( item ));
+		lock.unlock();
+		not_empty_.notify_one();
+		return true;
+	}
+
+	/**
+		Take the oldest item, waiting while the queue is empty
+
+		@param item set to the item taken
+
+		@return false once the queue is closed and empty
+	*/
+	bool pop( T & item ) {
+		unique_lock<mutex> lock( lock_ );
+		not_empty_.wait( lock, [this]{ return closed_ || !items_.empty(); });
+		if ( items_.empty() ) return false;
+
+		item = move( items_.front() );
+		items_.pop_front();
+		lock.unlock();
+		not_full_.notify_one();
+		return true;
+	}
+
+	/**
+		Stop taking new items. Items already in the queue
+		can still be popped
+	*/
+	void close() {
+		{
+			lock_guard<mutex> lock( lock_ );
+			closed_ = true;
+		}
+		not_full_.notify_all();
+		not_empty_.notify_all();
+	}
+
+	/**
+		Close the queue and drop the items in it
+	*/
+	void clear() {
+		{
+			lock_guard<mutex> lock( lock_ );
+			closed_ = true;
+			items_.clear();
+		}
+		not_full_.notify_all();
+		not_empty_.notify_all();
+	}
+
+private:
+
+	BoundedQueue( BoundedQueue const & );
+	BoundedQueue & operator=( BoundedQueue const & );
+
+	int capacity_;
+	bool closed_;
+	deque<T> items_;
+
+	mutex lock_;
+	condition_variable not_full_;
+	condition_variable not_empty_;
+};
+
+} // namespace errorx
+
+
+#endif /* BOUNDEDQUEUE_HH_ */
@@ -34,8 +34,14 @@ then this class is used to make a NN prediction
 
 // #include "keras_model.hh"
 #include "keras/KerasModel.hh"
+#include "keras/ModelRegistry.hh"
+#include "keras/InferenceContext.hh"
+#include "keras/AlignedBuffer.hh"
+#include "keras/SparseBatch.hh"
 #include "ErrorXOptions.hh"
+#include "PredictionCache.hh"
 #include "SequenceFeatures.hh"
+#include "FeatureExtractor.hh"
 
 using namespace std;
 
@@ -50,10 +56,33 @@ public:
 	ErrorPredictor( ErrorXOptions const & options );
 
 	/**
-		Copy constructor
+		Copy constructor. The model itself is shared
 	*/	
 	ErrorPredictor( ErrorPredictor const & other );
 
+	/**
+		Scratch memory for predictions. Buffers only grow, so a
+		workspace that is reused across calls does no heap allocation
+		once it has seen the longest sequence. A predictor holds no
+		scratch memory of its own, so one predictor can be used by
+		many threads at once, as long as each has its own workspace
+	*/
+	struct Workspace {
+		keras::InferenceContext context;
+		keras::AlignedBuffer batch;
+		keras::AlignedBuffer predictions;
+		keras::AlignedFloatBuffer batch_f32;
+		keras::AlignedFloatBuffer predictions_f32;
+		keras::SparseBatch sparse_batch;
+		keras::AlignedBuffer screen_batch;
+		keras::AlignedBuffer screen_predictions;
+		vector<int> forwarded;
+		vector<double> validation;
+		vector<double> cache_row;
+		vector<int> uncached;
+		vector<PredictionCache::Key> cache_keys;
+	};
+
 	
 	/**
 		Applies neural network to features contained in
@@ -66,6 +95,11 @@ public:
 	*/
 	double apply_model( SequenceFeatures const & features ) const;
 
+	/**
+		Same as above, with scratch memory from a workspace
+	*/
+	double apply_model( SequenceFeatures const & features, Workspace & workspace ) const;
+
 	/**
 		Applies neural network to features contained in
 		a vector of double vectors. Expects 228 features per vector
@@ -77,10 +111,131 @@ public:
 	*/
 	vector<double> apply_model( vector<vector<double>> const features ) const;
 
+	/**
+		Applies neural network to every position of a sequence in 
+		a single batched call. Positions that match germline are not
+		sent to the network and get a prediction of 0, same as in
+		apply_model( SequenceFeatures const & )
+
+		@param features FeatureExtractor for the sequence
+
+		@return vector of doubles representing NN prediction for each position
+	*/
+	vector<double> apply_model_batch( FeatureExtractor const & features ) const;
+
+	/**
+		Same as above, but writes the predictions to caller-provided
+		memory
+
+		@param features FeatureExtractor for the sequence
+		@param output array of features.length() doubles
+	*/
+	void apply_model_batch( FeatureExtractor const & features, double * output ) const;
+
+	/**
+		Same as above, with scratch memory from a workspace. Reusing
+		the workspace across calls makes them allocation-free
+
+		@param features FeatureExtractor for the sequence
+		@param output array of features.length() doubles
+		@param workspace scratch memory, used by one thread at a time
+	*/
+	void apply_model_batch( FeatureExtractor const & features, double * output,
+		Workspace & workspace ) const;
+
+	/**
+		Positions handled by the screening model since the last
+		reset, summed over every predictor in the process
+	*/
+	struct CascadeCounts {
+		// called by the screen alone
+		long screened;
+		// passed on to the full network
+		long forwarded;
+		// screened positions also run through the full network,
+		// with ErrorXOptions::screen_validate
+		long validated;
+		// validated positions the full network calls differently
+		long disagreements;
+	};
+
+	/**
+		Get the cascade counts of this process
+
+		@return counts since the last reset_cascade_counts
+	*/
+	static CascadeCounts cascade_counts();
+
+	/**
+		Set the cascade counts back to zero
+	*/
+	static void reset_cascade_counts();
+
 private:
 
-	ErrorXOptions options_;
-	keras::KerasModel keras_model_;
+	/**
+		Runs the network on one row of features
+
+		@param row constants::N_FEATURES features of one position
+		@param workspace scratch memory
+
+		@return prediction for the position
+	*/
+	double predict_row( double const * row, Workspace & workspace ) const;
+
+	/**
+		Runs the screening model, if there is one, on some of the
+		positions of a sequence, then the full network on the
+		positions it leaves. Arguments as in predict_positions
+	*/
+	void predict_screened( FeatureExtractor const & features,
+		vector<int> const & positions, double * output, Workspace & workspace ) const;
+
+	/**
+		Runs the full network on some of the positions of a sequence
+		and writes their predictions to output. Other positions of
+		output are left alone
+
+		@param features FeatureExtractor for the sequence
+		@param positions non-germline positions to predict
+		@param output array of features.length() doubles
+		@param workspace scratch memory
+	*/
+	void predict_positions( FeatureExtractor const & features,
+		vector<int> const & positions, double * output, Workspace & workspace ) const;
+
+	// settings read while predicting. Kept instead of a copy of the
+	// ErrorXOptions, which can hold a whole FASTQ quality map, since
+	// every thread copies its predictor
+	double error_threshold_;
+	double screen_lower_;
+	double screen_upper_;
+	bool screen_validate_;
+
+	// loaded once per process through ModelRegistry and
+	// shared by every predictor
+	keras::KerasModelConstPtr keras_model_;
+	// int8 version of the same model, null unless precision is int8
+	keras::QuantizedModelConstPtr quantized_model_;
+	// cheap model run on every position first, null unless
+	// ErrorXOptions::screen_model is set
+	keras::KerasModelConstPtr screen_model_;
+	// shared with every predictor that has the same settings,
+	// null unless ErrorXOptions::prediction_cache is set
+	PredictionCachePtr cache_;
+
+	// run the network in float instead of double, from
+	// ErrorXOptions::precision(). Also true for int8, which
+	// takes float features
+	bool single_precision_;
+
+	// pass features to the model as sparse rows, so the first
+	// layer skips the zeros of the one-hot columns. Set when the
+	// model takes the standard feature layout
+	bool sparse_input_;
+	// run the double precision network through the model compiled
+	// into the library. Set when the model file holds the same model
+	bool embedded_;
 };
 
 typedef unique_ptr<ErrorPredictor> ErrorPredictorPtr;
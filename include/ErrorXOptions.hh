@@ -30,6 +30,7 @@ Code contained herein is proprietary and confidential.
 #include <unordered_map>
 
 #include "ProgressBar.hh"
+#include "Executor.hh"
 
 using namespace std;
 
@@ -102,6 +103,18 @@ public:
 	bool trial() const;
 	int num_queries() const;
 	bool allow_nonproductive() const;
+	string precision() const;
+	string activations() const;
+	string model_file() const;
+	string screen_model() const;
+	double screen_lower() const;
+	double screen_upper() const;
+	bool screen_validate() const;
+	bool prediction_cache() const;
+	int cache_size() const;
+	double cache_resolution() const;
+	ExecutorPtr executor() const;
+	int chunk_size() const;
 	function<void(int,int)> increment() const;
 	function<void(void)> reset() const;
 	function<void(void)> finish() const;
@@ -128,6 +141,18 @@ public:
 	void trial( bool const trial );
 	void num_queries( int const num_queries );
 	void allow_nonproductive( bool const allow_nonproductive );
+	void precision( string const & precision );
+	void activations( string const & activations );
+	void model_file( string const & model_file );
+	void screen_model( string const & screen_model );
+	void screen_lower( double const & screen_lower );
+	void screen_upper( double const & screen_upper );
+	void screen_validate( bool const screen_validate );
+	void prediction_cache( bool const prediction_cache );
+	void cache_size( int const cache_size );
+	void cache_resolution( double const & cache_resolution );
+	void executor( ExecutorPtr const & executor );
+	void chunk_size( int const chunk_size );
 	void increment( function<void(int,int)> const & increment ) ;
 	void reset( function<void(void)> const & reset ) ;
 	void finish( function<void(void)> const & finish ) ;
@@ -159,6 +184,30 @@ private:
 		are nonproductive. Default no
 		correction_: when ErrorX corrects a sequence it replaces the original base
 		with a new character. What character should be used? Default N
+		precision_: numeric precision for the neural network, either double,
+		single or int8. Single is faster but probabilities differ slightly
+		from the trained model. Int8 is faster still and differs more, it
+		needs model.calib next to model.nnet. Default double
+		activations_: how the neural network evaluates sigmoid, tanh and
+		softmax, either exact or fast. Fast uses a vectorized approximation
+		of exp, which changes probabilities by about 1e-14. Default exact
+		model_file_: neural network to use, e.g. a pruned copy of the
+		default. Default (errorx_base)/model.nnet
+		screen_model_: small model, e.g. from errorx_model screen, that scores
+		every position first. Only positions it scores between screen_lower_
+		and screen_upper_ go through the full network. Default none
+		screen_lower_: screen probability below which a base is called
+		correct without the full network. Default 0.05
+		screen_upper_: screen probability above which a base is called an
+		error without the full network. Default 1, i.e. never
+		screen_validate_: also run the full network on the positions the
+		screen called, and count how often the two calls disagree. Default no
+		executor_: thread pool that every parallel stage runs on. Copies of
+		these options share it. Default the process-wide pool with nthreads_
+		threads, see Executor::shared
+		chunk_size_: run_protocol_write streams the input through in chunks
+		of this many reads, so memory stays the same however large the
+		input is. 0 reads the whole input at once. Default 0
 	*/
 	string infile_;
 	string format_;
@@ -170,6 +219,18 @@ private:
 	double error_threshold_;
 	bool allow_nonproductive_;
 	char correction_;
+	string precision_;
+	string activations_;
+	string model_file_;
+	string screen_model_;
+	double screen_lower_;
+	double screen_upper_;
+	bool screen_validate_;
+	bool prediction_cache_;
+	int cache_size_;
+	double cache_resolution_;
+	ExecutorPtr executor_;
+	int chunk_size_;
 
 	/**
 		Automatically generated options:
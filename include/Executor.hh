@@ -0,0 +1,131 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file Executor.hh
+@brief Persistent pool of worker threads shared by every stage
+@details Threads are started once and then wait for jobs, so
+repeated calls to run_protocol on small batches don't pay for
+creating and joining threads each time. By default every call
+with the same number of threads shares one process-wide pool.
+A caller can supply its own through ErrorXOptions::executor.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef EXECUTOR_HH_
+#define EXECUTOR_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace errorx {
+
+using namespace std;
+
+class Executor;
+typedef shared_ptr<Executor> ExecutorPtr;
+
+class ERRORX_API Executor {
+
+public:
+
+	/**
+		Constructor. Starts the threads, which wait for jobs
+
+		@param nthreads number of threads
+
+		@throws invalid_argument if nthreads is below 1
+	*/
+	Executor( int nthreads );
+
+	/**
+		Destructor. Calls shutdown
+	*/
+	~Executor();
+
+	/**
+		Get the process-wide executor with this number of threads,
+		starting it on first use
+
+		@param nthreads number of threads
+
+		@return shared executor
+	*/
+	static ExecutorPtr shared( int nthreads );
+
+	/**
+		Shut down every process-wide executor. They're started
+		again the next time they're needed
+	*/
+	static void shutdown_shared();
+
+	/**
+		Queue a job to run on one of the threads
+
+		@param job function to run
+
+		@throws runtime_error if the executor has been shut down
+
+		@return future that is ready once the job has run, and
+		holds any exception it threw
+	*/
+	future<void> submit( function<void()> const & job );
+
+	/**
+		Run the jobs already queued, then stop and join the threads.
+		Safe to call more than once
+	*/
+	void shutdown();
+
+	/**
+		Getters
+	*/
+	int nthreads() const;
+	bool running() const;
+
+	/**
+		True on the threads of any executor, so a job can tell
+		whether it would have to wait on a job behind it
+	*/
+	static bool on_worker_thread();
+
+private:
+
+	Executor( Executor const & );
+	Executor & operator=( Executor const & );
+
+	void work();
+
+	int nthreads_;
+	vector<thread> threads_;
+	mutex shutdown_lock_;
+
+	mutable mutex lock_;
+	condition_variable ready_;
+	deque<shared_ptr<packaged_task<void()>>> jobs_;
+	bool stopping_;
+};
+
+} // namespace errorx
+
+
+#endif /* EXECUTOR_HH_ */
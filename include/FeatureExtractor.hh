@@ -0,0 +1,173 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file FeatureExtractor.hh
+@brief Calculates the features for every position of a sequence
+in a single pass
+@details SequenceFeatures computes the features for one position,
+re-reading the whole sequence each time. This class decodes the
+sequence and quality string once, computes the global metrics once,
+and uses prefix sums for the local windows, so the features for an
+entire read cost O(L). Output is identical to
+SequenceFeatures::get_feature_vector for every position.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef FEATUREEXTRACTOR_HH_
+#define FEATUREEXTRACTOR_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace keras {
+class SparseBatch;
+}
+
+namespace errorx {
+
+using namespace std;
+
+// forward declare to avoid circular dependencies
+class SequenceRecord;
+
+class ERRORX_API FeatureExtractor {
+
+public:
+
+	/**
+		Constructor that decodes a SequenceRecord so that the features
+		of any position can be extracted without recomputation
+
+		@param record SequenceRecord that contains sequence to be corrected
+
+		@throws invalid_argument if the PHRED string is not the same length
+		as the sequence, if the sequence is shorter than the window, or if
+		the sequence contains an invalid nucleotide
+	*/
+	FeatureExtractor( SequenceRecord const & record );
+
+	/**
+		Destructor - does nothing
+	*/
+	~FeatureExtractor();
+
+	/**
+		Write the features for one position into a row of
+		constants::N_FEATURES doubles, in the same order
+		as SequenceFeatures::get_feature_vector
+
+		@param position which position along sequence, 0-indexed
+		@param row pointer to at least constants::N_FEATURES doubles
+	*/
+	void fill_row( int position, double * row ) const;
+
+	/**
+		Same as above, rounded to single precision
+
+		@param position which position along sequence, 0-indexed
+		@param row pointer to at least constants::N_FEATURES floats
+	*/
+	void fill_row( int position, float * row ) const;
+
+	/**
+		Same as above, appending the row to a sparse batch. The
+		one-hot nucleotide columns only get an entry for the set
+		nucleotide, so a row has at most 34 entries instead of
+		constants::N_FEATURES values
+
+		@param position which position along sequence, 0-indexed
+		@param batch batch to add the row to
+	*/
+	void fill_row( int position, keras::SparseBatch & batch ) const;
+
+	/**
+		Get the features for one position
+
+		@param position which position along sequence, 0-indexed
+
+		@throws invalid_argument if position is out of bounds
+
+		@return vector of features for NN processing as doubles
+	*/
+	vector<double> get_feature_vector( int position ) const;
+
+	/**
+		Get the features for every position as a row-major
+		matrix of length() x constants::N_FEATURES
+
+		@param matrix output, resized to fit
+	*/
+	void get_feature_matrix( vector<double> & matrix ) const;
+
+	/**
+		Getters
+	*/
+	int length() const;
+	bool is_germline( int position ) const;
+
+	/**
+		Positions where the sequence does not match germline. Only these
+		need features, since germline positions are never predicted as errors
+
+		@return 0-indexed positions, in order
+	*/
+	vector<int> const & mismatch_positions() const;
+
+private:
+	/**
+		Metrics over the local window around a position, shared
+		by the dense and sparse rows
+	*/
+	void local_metrics( int position, double & local_gc,
+		double & local_quality, double & local_mutations ) const;
+
+	int length_;
+
+	// length of the local window. Kept as a runtime value so that local
+	// metrics are divided exactly like SequenceFeatures::calculate_metrics,
+	// instead of being folded into a reciprocal multiply under -Ofast
+	int window_length_;
+
+	// one-hot index of each nucleotide, padded by WINDOW on
+	// each side with -1, which encodes as all zeros
+	vector<int8_t> nt_index_;
+	vector<int8_t> gl_index_;
+
+	// decoded PHRED scores padded by WINDOW on each side with -1
+	vector<int> phred_;
+	// realspace transform of each padded PHRED score
+	vector<double> phred_realspace_;
+
+	// prefix sums of GC count, mutation count, and number of
+	// valid PHRED scores. Element i covers positions [0,i)
+	vector<int> gc_prefix_;
+	vector<int> mutation_prefix_;
+	vector<int> phred_count_prefix_;
+
+	vector<bool> is_germline_;
+	vector<int> mismatch_positions_;
+
+	double global_GC_pct_;
+	double global_SHM_;
+	double global_quality_avg_;
+};
+
+} // namespace errorx
+
+
+#endif /* FEATUREEXTRACTOR_HH_ */
@@ -49,8 +49,20 @@ public:
 
 		@param options ErrorXOptions that dictate what the input
 		and output files are 
+		@param progress show a progress bar while IGBlast runs. If
+		false, IGBlast runs on the calling thread
 	*/
-	void blast( ErrorXOptions & options );
+	void blast( ErrorXOptions & options, bool progress=true );
+
+	/**
+		Points IGBlast to its database with the IGDATA environmental
+		variable. The environment is only written when the value
+		changes, so if this is called before threads start, blast
+		can run on several of them at once
+
+		@param options ErrorXOptions with the ErrorX base directory
+	*/
+	static void set_environment( ErrorXOptions const & options );
 	
 	/**
 		Splits the IGBlast output file into chunks so that it
@@ -0,0 +1,164 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file PredictionCache.hh
+@brief Bounded, thread-safe cache of predictions by feature row
+@details Reads from the same clone share most of their feature rows,
+so ErrorPredictor looks each row up here before running the network.
+Rows are keyed by a 128-bit hash of their values, quantized to a
+configurable resolution, and spread over independently locked shards
+so threads rarely wait on each other. Each shard holds a fixed number
+of entries and evicts the oldest first.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef PREDICTIONCACHE_HH_
+#define PREDICTIONCACHE_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ErrorXOptions.hh"
+
+namespace errorx {
+
+using namespace std;
+
+class PredictionCache;
+typedef shared_ptr<PredictionCache> PredictionCachePtr;
+
+class ERRORX_API PredictionCache {
+
+public:
+
+	/**
+		Key of a feature row, two independent 64-bit hashes
+	*/
+	struct Key {
+		uint64_t first;
+		uint64_t second;
+		bool operator==( Key const & other ) const {
+			return first == other.first && second == other.second;
+		}
+	};
+
+	/**
+		Constructor
+
+		@param megabytes memory the cache may use
+		@param resolution feature values are rounded to a multiple of
+		this before hashing. 0 keys on the exact values
+
+		@throws invalid_argument if megabytes or resolution is negative
+	*/
+	PredictionCache( int megabytes, double resolution=0 );
+
+	/**
+		Get the cache shared by every predictor with the same model
+		and settings, creating it on first use
+
+		@param options ErrorXOptions object with the cache enabled
+
+		@return shared cache
+	*/
+	static PredictionCachePtr get( ErrorXOptions const & options );
+
+	/**
+		Drop every shared cache, like ModelRegistry::clear
+	*/
+	static void clear();
+
+	/**
+		Calculate the key of a feature row
+
+		@param row feature values
+		@param cols number of values
+
+		@return key for find and insert
+	*/
+	Key key( double const * row, int cols ) const;
+
+	/**
+		Look up a row
+
+		@param key key of the row
+		@param value set to the stored prediction on a hit
+
+		@return true on a hit
+	*/
+	bool find( Key const & key, double & value ) const;
+
+	/**
+		Store a prediction, evicting the oldest entry of its
+		shard if the shard is full
+
+		@param key key of the row
+		@param value prediction for the row
+	*/
+	void insert( Key const & key, double value );
+
+	/**
+		Hit and miss counters, and the number of stored entries
+	*/
+	long hits() const;
+	long misses() const;
+	double hit_rate() const;
+	size_t size() const;
+	size_t capacity() const;
+
+	/**
+		Approximate memory used by one entry, for sizing the cache
+	*/
+	static const size_t BYTES_PER_ENTRY;
+
+	/**
+		Number of independently locked shards
+	*/
+	static const int SHARDS = 64;
+
+private:
+
+	struct KeyHash {
+		size_t operator()( Key const & key ) const { return (size_t)key.first; }
+	};
+
+	struct Shard {
+		mutable mutex lock;
+		unordered_map<Key,double,KeyHash> entries;
+		// insertion order, oldest at next
+		vector<Key> order;
+		size_t next;
+	};
+
+	Shard & shard( Key const & key ) const;
+
+	double resolution_;
+	size_t shard_capacity_;
+	unique_ptr<Shard[]> shards_;
+
+	mutable atomic<long> hits_;
+	mutable atomic<long> misses_;
+};
+
+} // namespace errorx
+
+#endif /* PREDICTIONCACHE_HH_ */
@@ -0,0 +1,108 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file ReadEncoding.hh
+@brief Validates and encodes a whole read in one pass
+@details Reads are checked against the nucleotide alphabet and
+converted to compact codes once, before any features are computed,
+so an invalid read is rejected up front with the position of the
+offending character. Quality strings are decoded to PHRED scores and
+error probabilities in the same way. On x86 the passes handle 16
+characters at a time with SSE2, which every x86-64 CPU supports, so
+no runtime dispatch is needed. Other platforms use the lookup tables.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef READENCODING_HH_
+#define READENCODING_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include <string>
+#include <stdint.h>
+
+namespace errorx {
+namespace encoding {
+
+using namespace std;
+
+/**
+	Valid nucleotides, in the order of their codes. Matches the
+	one-hot encoding of SequenceFeatures::nt_to_binary
+*/
+const char NUCLEOTIDES[] = "ATCGN-";
+
+/**
+	Codes of the nucleotides, i.e. their index in NUCLEOTIDES
+*/
+enum NucleotideCode { NT_A, NT_T, NT_C, NT_G, NT_N, NT_GAP };
+
+/**
+	Code of a single nucleotide, read from a 256-entry lookup table
+
+	@param nt nucleotide
+
+	@return code in [0,6), or -1 if nt is not a valid nucleotide
+*/
+ERRORX_API int nt_code( char nt );
+
+/**
+	Validate and encode a whole sequence
+
+	@param sequence nucleotides to encode
+	@param length number of nucleotides
+	@param codes output, at least length codes
+
+	@return position of the first invalid nucleotide, or -1 if
+	the whole sequence is valid. Codes up to that position are written
+*/
+ERRORX_API int encode_nucleotides( char const * sequence, int length, int8_t * codes );
+
+/**
+	Same as above, throwing on an invalid nucleotide
+
+	@param sequence nucleotides to encode
+	@param codes output, at least sequence.size() codes
+	@param name what the sequence is, for the error message,
+	e.g. "germline sequence of read X"
+
+	@throws invalid_argument with the invalid nucleotide and its position
+*/
+ERRORX_API void encode_nucleotides( string const & sequence, int8_t * codes, string const & name );
+
+/**
+	Decode a quality string with an offset of 33, as used by Illumina
+
+	@param quality PHRED characters
+	@param length number of characters
+	@param phred output, at least length scores
+*/
+ERRORX_API void decode_phred( char const * quality, int length, int * phred );
+
+/**
+	Probability of an error for a PHRED score, equal to
+	util::phred_to_realspace but read from a table for printable scores
+
+	@param phred PHRED score, must be >= 0
+
+	@return error probability
+*/
+ERRORX_API double error_probability( int phred );
+
+} // namespace encoding
+} // namespace errorx
+
+
+#endif /* READENCODING_HH_ */
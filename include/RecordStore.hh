@@ -0,0 +1,275 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file RecordStore.hh
+@brief Column store that holds the data of many SequenceRecords
+@details Each field of a record is a column indexed by row. Text
+fields (sequences, quality strings, gene names) are kept in large
+shared blocks of bytes, and a column only holds where each value
+starts and how long it is. Numbers are kept in typed columns and
+flags in bitsets. Scans over one field of every record read one
+column instead of visiting each record's strings, and a record
+costs a few allocations per block instead of one per field.
+Columns of the same type share one array, so a store of a single
+row, like the one behind a standalone SequenceRecord, only takes a
+handful of allocations. SequenceRecord is a view of one row.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef RECORDSTORE_HH_
+#define RECORDSTORE_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AbSequence.hh"
+
+namespace errorx {
+
+using namespace std;
+
+class RecordStore;
+typedef shared_ptr<RecordStore> RecordStorePtr;
+
+class ERRORX_API RecordStore {
+
+public:
+
+	/**
+		Text columns. Values are stored as they are in AbSequence,
+		so "" and "N/A" are kept apart
+	*/
+	enum Text {
+		SEQUENCE_ID,
+		V_GENE, D_GENE, J_GENE,
+		V_GL_NTS, D_GL_NTS, J_GL_NTS,
+		CHAIN, STRAND,
+		PHRED, PHRED_TRIMMED,
+		FULL_NT, FULL_GL_NT, FULL_AA,
+		CDR1_NT, CDR1_AA, CDR2_NT, CDR2_AA, CDR3_NT, CDR3_AA,
+		FULL_NT_CORRECTED, FULL_AA_CORRECTED,
+		FAILURE_REASON,
+		N_TEXT
+	};
+
+	enum Number {
+		V_IDENTITY, D_IDENTITY, J_IDENTITY,
+		V_EVALUE, D_EVALUE, J_EVALUE,
+		N_NUMBER
+	};
+
+	enum Integer {
+		GL_START, TRANSLATION_FRAME, N_ERRORS,
+		N_INTEGER
+	};
+
+	enum Flag {
+		GOOD, PRODUCTIVE, HAS_V, HAS_D, HAS_J,
+		N_FLAG
+	};
+
+	/**
+		Empty constructor. The store starts with no rows
+	*/
+	RecordStore();
+
+	/**
+		Destructor. Frees every block of the arena
+	*/
+	~RecordStore();
+
+	/**
+		Add a row with the fields of an AbSequence. Its number
+		of errors is 0 and it has no predictions.
+
+		Rows must be added from one thread at a time, and not
+		while another thread reads or writes the store
+
+		@param sequence sequence to add
+
+		@return index of the new row
+	*/
+	int add( AbSequence const & sequence );
+
+	/**
+		Add a copy of a row of another store, or of this one
+
+		@param other store to copy from
+		@param row row of other to copy
+
+		@return index of the new row
+	*/
+	int add( RecordStore const & other, int row );
+
+	/**
+		Rebuild the AbSequence a row was added from. Fields that are
+		only used while IGBlast output is parsed are not stored, and
+		are left empty
+
+		@param row row to get
+
+		@return sequence held in the row
+	*/
+	AbSequence sequence( int row ) const;
+
+	/**
+		Get a text field
+
+		@return the value, or "N/A" if it's missing
+	*/
+	string text( Text column, int row ) const;
+
+	/**
+		Get the bytes of a text field without copying them
+
+		@return the first character, which is not null terminated.
+		Only valid for length() characters
+	*/
+	char const * data( Text column, int row ) const;
+
+	/**
+		Get the length of a text field
+
+		@return number of characters, or -1 if it's "N/A"
+	*/
+	int length( Text column, int row ) const;
+
+	double number( Number column, int row ) const;
+	int integer( Integer column, int row ) const;
+	bool flag( Flag column, int row ) const;
+
+	/**
+		Get the predicted probability of error for each base
+
+		@return one probability per position, or empty if the
+		row has not been corrected
+	*/
+	vector<double> predictions( int row ) const;
+
+	/**
+		Setters. Different threads can set fields of different rows
+		at the same time, except for flags, which share words with
+		the rows next to them. A text field that doesn't grow is
+		overwritten in place, so a value that's set again doesn't
+		take more space
+	*/
+	void text( Text column, int row, string const & value );
+	void number( Number column, int row, double value );
+	void integer( Integer column, int row, int value );
+	void flag( Flag column, int row, bool value );
+	void predictions( int row, vector<double> const & values );
+
+	/**
+		Number of rows
+	*/
+	int size() const;
+
+	/**
+		Bytes taken by the blocks of the arena
+	*/
+	size_t arena_bytes() const;
+
+private:
+
+	// a value in the arena. A text cell of length -1 is "N/A",
+	// which takes no bytes
+	struct Cell {
+		char * data;
+		int length;
+		int capacity;
+	};
+
+	RecordStore( RecordStore const & );
+	RecordStore & operator=( RecordStore const & );
+
+	/**
+		Reserve bytes in the arena. Blocks are never moved or freed
+		until the store is, so the bytes stay where they are
+
+		@param bytes number of bytes
+		@param align alignment of the first byte
+
+		@return first byte
+	*/
+	char * allocate( size_t bytes, size_t align );
+
+	/**
+		Make sure the next bytes reserved in the arena fit in one
+		block, so a row that is added doesn't start several blocks
+	*/
+	void reserve( size_t bytes );
+
+	/**
+		Start a new block of the arena with room for at least bytes.
+		Called with arena_lock_ held
+	*/
+	void add_block( size_t bytes );
+
+	/**
+		Add a row with every field empty, growing the columns if
+		they are full
+
+		@return index of the new row
+	*/
+	int add_row();
+
+	/**
+		Write bytes into a cell, reusing its space if they fit
+	*/
+	void assign( Cell & cell, char const * data, int length, size_t align );
+
+	/**
+		Cells of a text column, or of the predictions
+	*/
+	Cell & cell( int column, int row );
+	Cell const & cell( int column, int row ) const;
+
+	/**
+		Word of a flag column holding the bit of a row
+	*/
+	uint64_t & flag_word( Flag column, int row );
+	uint64_t flag_word( Flag column, int row ) const;
+
+	// the text columns then the predictions, whose length is the
+	// number of doubles
+	static const int PREDICTIONS = N_TEXT;
+
+	// each array holds its columns one after another, capacity_ rows
+	// each, so a column is still contiguous. Flag columns take
+	// capacity_/64 words each
+	vector<Cell> cells_;
+	vector<double> numbers_;
+	vector<int> integers_;
+	vector<uint64_t> flags_;
+
+	int size_;
+	int capacity_;
+
+	vector<unique_ptr<char[]>> blocks_;
+	size_t block_size_;
+	size_t block_used_;
+	size_t arena_bytes_;
+	mutable mutex arena_lock_;
+};
+
+} // namespace errorx
+
+
+#endif /* RECORDSTORE_HH_ */
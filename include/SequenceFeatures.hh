@@ -79,6 +79,17 @@ public:
 	*/
 	vector<double> get_feature_vector() const;
 
+	/**
+		Write the features into a row of constants::N_FEATURES values,
+		in the same order as get_feature_vector, without building
+		any intermediate vectors. Meant for filling batched inference
+		buffers in place
+
+		@param row pointer to at least constants::N_FEATURES values
+	*/
+	void fill_row( double * row ) const;
+	void fill_row( float * row ) const;
+
 	/**
 		Encode a single NT as a binary vector
 	
@@ -86,6 +97,16 @@ public:
 	*/
 	vector<int> nt_to_binary( char nt ) const;
 
+	/**
+		Index of a nucleotide in the binary encoding, following
+		encoding::nt_code
+
+		@throws invalid_argument if nt is not a valid nucleotide
+
+		@return index in [0,6), or -1 for X, which encodes as all zeros
+	*/
+	static int nt_index( char nt );
+
 	/**
 		Get window surrounding the position of interest. 
 		Two functions, either for a string or a vector of ints
@@ -123,13 +144,10 @@ public:
 
 private:
 	/**
-		Translates a character from a PHRED string 
-		to its integer counterpart. Assumes an offset
-		of 33, as used by Illumina.
-
-		@return int value corresponding to PHRED char
+		Shared body of the fill_row overloads
 	*/
-	int decode( char qual, int base );
+	template <typename T>
+	void fill( T * row ) const;
 
 	string sequence_window_;
 	string gl_sequence_window_;
@@ -6,7 +6,9 @@ Code contained herein is proprietary and confidential.
 @brief A record of one sequence to be error corrected
 @details Single nucleotide sequence to be fed to error
 correction. Can be initialized from a FASTQ file, TSV file,
-or directly from a SequenceQuery.
+or directly from a SequenceQuery. The data lives in a row of
+a RecordStore, which is shared by every record of a
+SequenceRecords object.
 @author Alex Sevy (alex@endeavorbio.com)
 */
 
@@ -32,6 +34,7 @@ or directly from a SequenceQuery.
 #include <memory>
 
 #include "AbSequence.hh"
+#include "RecordStore.hh"
 #include "SequenceQuery.hh"
 #include "ErrorXOptions.hh"
 #include "ErrorPredictor.hh"
@@ -56,12 +59,29 @@ public:
 	~SequenceRecord();
 	
 	/**
-		Copy constructor. Copies all member variables
+		Copy constructor. Copies the row into a store of its own
 	*/	
 	SequenceRecord( SequenceRecord const & copy );
 
 	/**
-		Constructs a SequenceRecord from an AbSequence object
+		Assignment. Copies the row into a store of its own
+	*/
+	SequenceRecord & operator=( SequenceRecord const & other );
+
+	/**
+		Constructs a view of a row that's already in a store
+
+		@param store store holding the record
+		@param row row of the record
+
+		@throws out_of_range if the store has no such row
+	*/
+	SequenceRecord( RecordStorePtr const & store, int row );
+
+	/**
+		Constructs a SequenceRecord from an AbSequence object.
+		This and the other constructors below put the record in
+		a store of its own
 
 		@param sequence AbSequence object
 	*/
@@ -117,6 +137,29 @@ public:
 	void correct_sequence( ErrorPredictor const & predictor, 
 						   ErrorXOptions const & options );
 
+	/**
+		Same as above, with scratch memory for the prediction
+		from a workspace that the caller reuses across records
+
+		@param predictor ErrorPredictor for prediction
+		@param workspace scratch memory, used by one thread at a time
+		@param options Options for processing
+	*/
+	void correct_sequence( ErrorPredictor const & predictor,
+						   ErrorPredictor::Workspace & workspace,
+						   ErrorXOptions const & options );
+
+	/**
+		Correct this SequenceRecord with the predictions already made
+		for another record with the same sequence, germline and quality.
+		The result is the same as correcting this record itself
+
+		@param duplicate corrected record with identical reads
+		@param options Options for processing
+	*/
+	void correct_sequence( SequenceRecord const & duplicate,
+						   ErrorXOptions const & options );
+
 
 	/**
 		Get the predicted probability of error for each base.
@@ -148,6 +191,29 @@ public:
 	vector<vector<double>> get_features( ErrorPredictor const & predictor,
 		ErrorXOptions const & options );
 
+	/**
+		Copy this record into a row of another store
+
+		@param store store to copy into
+
+		@return view of the new row
+	*/
+	shared_ptr<SequenceRecord> copy_to( RecordStorePtr const & store ) const;
+
+	/**
+		Copy this record into a row of another store and view that
+		row from now on. Every pointer to this record sees the move
+
+		@param store store to move into
+	*/
+	void move_to( RecordStorePtr const & store );
+
+	/**
+		Store holding this record, and its row in the store
+	*/
+	RecordStorePtr const & store() const;
+	int row() const;
+
 	/**
 		Getters and setters
 	*/
@@ -194,15 +260,29 @@ private:
 		this record in place. Wrapped by correct_sequence.
 
 		@param predictor ErrorPredictor for prediction
+		@param workspace scratch memory for the prediction
 		@param options Options for processing
 	*/
 	void predict_errors( ErrorPredictor const & predictor,
+			ErrorPredictor::Workspace & workspace,
 			ErrorXOptions const & options );
 
-	AbSequence sequence_;
+	/**
+		Replace the bases predicted as errors and count them.
+		Wrapped by correct_sequence.
+
+		@param options Options for processing
+	*/
+	void apply_predictions( ErrorXOptions const & options );
+
+	/**
+		Get a text field the way AbSequence shows it, with
+		empty fields as "N/A"
+	*/
+	string shown( RecordStore::Text column ) const;
 
-	int n_errors_;
-	vector<pair<int,double>> predicted_errors_all_;
+	RecordStorePtr store_;
+	int row_;
 
 };
 
@@ -35,9 +35,11 @@ settings for processing, and ErrorPredictor that does the error correction itsel
 
 #include "SequenceQuery.hh"
 #include "SequenceRecord.hh"
+#include "RecordStore.hh"
 #include "ErrorXOptions.hh"
 #include "ErrorPredictor.hh"
 #include "ClonotypeGroup.hh"
+#include "TaskScheduler.hh"
 #include "util.hh"
 
 using namespace std;
@@ -99,6 +101,20 @@ public:
 	*/
 	void import_from_tsv();
 
+	/**
+		Populates SequenceRecords object with lines of TSV from
+		a stream, in the same format as import_from_tsv
+
+		@param file stream to read from
+		@param max_records stop after this many records, or
+		read to the end if -1
+
+		@throws BadFileException if a line is not properly formatted
+
+		@return number of records read
+	*/
+	int import_from_tsv( istream & file, int max_records=-1 );
+
 	/**
 		Populates SequenceRecords object with elements from
 		a vector of SequenceQuery objects
@@ -118,12 +134,21 @@ public:
 
 	/**
 		Adds a SequenceRecord to the records_ member variable.
-		Does not copy the record, just assigns it
+		Does not copy the record, just assigns it. If the record
+		is held in another store it's moved into this one
 
 		@param record SequenceRecord to add to records_
 	*/
 	void add_record( SequenceRecordPtr & record );
 
+	/**
+		Adds a record built from an AbSequence, straight into
+		this object's store
+
+		@param sequence sequence to add
+	*/
+	void add_record( AbSequence const & sequence );
+
 	/**
 		Get the number of SequenceRecord objects held internally
 
@@ -197,6 +222,23 @@ public:
 	*/
 	void write_summary() const;
 
+	/**
+		Writes the column labels of the summary, as one line
+		of TSV
+
+		@param outfile stream to write to
+	*/
+	static void write_labels( ostream & outfile );
+
+	/**
+		Writes the summary of each good record as one line of
+		TSV, without the labels. Rows are written as they're
+		made, so the whole summary is never held in memory
+
+		@param outfile stream to write to
+	*/
+	void write_rows( ostream & outfile ) const;
+
 	/**
 		Runs "mock" error correction protocol. When given a FASTA file
 		I can't actually do error correction. So I just put the NT sequence
@@ -206,13 +248,32 @@ public:
 
 	/**
 		Runs error correction protocol on each SequenceRecord
-		object. Modifies "records" in-place. Static qualifier
-		allows it to be used easily in multi-threading.
+		object. Modifies "records" in-place. Threads take small
+		batches of records and steal batches from each other
+		when they run out, so uneven reads don't leave threads idle.
+		Reads with the same sequence, germline and quality are
+		only run through the network once, and share the result.
 
 		@param records Collection of SequenceRecord objects to be
 		error corrected
+		@param report show progress and thread stats. Callers that
+		correct a large input one chunk at a time report progress
+		themselves
 	*/
-	static void correct_sequences( unique_ptr<SequenceRecords> & records );
+	static void correct_sequences( unique_ptr<SequenceRecords> & records, bool report=true );
+
+	/**
+		Number of records per distinct read in the last call to
+		correct_sequences, 1 if no reads were collapsed or the
+		records have not been corrected
+	*/
+	double dedup_ratio() const;
+
+	/**
+		Busy and idle time of each thread in the last call to
+		correct_sequences, empty if the records have not been corrected
+	*/
+	vector<TaskScheduler::WorkerStats> const & worker_stats() const;
 	
 	/**
 		For debugging purposes. Gets features from each SequenceRecord 
@@ -225,6 +286,11 @@ public:
 	*/
 	ErrorXOptionsPtr get_options() const;
 
+	/**
+		Get the store that holds the data of every record
+	*/
+	RecordStorePtr store() const;
+
 	
 	/**
 		Group all SequenceRecord objects into clonotypes, where 
@@ -261,33 +327,42 @@ public:
 	
 private:
 	/**
-		Chunks the current SequenceRecords object into N parts,
-		where N is the number of threads used in multithreading.
-		Deep copies of each member variable are made, so the 
-		parent object can be safely deleted after chunking.
-	*/
-	vector<unique_ptr<SequenceRecords>> chunk_records();
-	
-	/**
-		Corrects a single SequenceRecords object in one thread.
+		Groups records with the same sequence, germline, quality
+		and annotation status, keeping the first of each group.
 
-		@param records SequenceRecords object to be corrected
-		@param update callback function to update progress that takes in
-		(done,total,mutex*)
-		@param m mutex* to keep track of threads
-		@param total total number of records over all threads
-	*/
-	static void correct_sequences_threaded( unique_ptr<SequenceRecords> & records, function<void(int,int)>* update, mutex* m, int total);
+		@param group set to the index in the returned vector of the
+		record that stands in for each record
 
+		@return one record per group, in order of first appearance
+	*/
+	vector<SequenceRecordPtr> collapse_duplicates( vector<int> & group ) const;
+	
 	/** 
 	============================= 
 		  Member variables
 	=============================
 	*/
 	vector<SequenceRecordPtr> records_;
+
+	/**
+		Columns holding the data of records_. Each record is a
+		view of one row
+	*/
+	RecordStorePtr store_;
+
 	ErrorXOptionsPtr options_;
 	ErrorPredictorPtr predictor_;
 
+	/**
+		Distinct reads found by correct_sequences, 0 before
+	*/
+	int unique_records_;
+
+	/**
+		Time each thread spent in the last call to correct_sequences
+	*/
+	vector<TaskScheduler::WorkerStats> worker_stats_;
+
 	/**
 		Holds the different clonotypes contained in the dataset
 	*/
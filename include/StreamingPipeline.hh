@@ -0,0 +1,195 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file StreamingPipeline.hh
+@brief Streams an input file through ErrorX one chunk at a time
+@details The input is read in chunks of ErrorXOptions::chunk_size
+reads. Each chunk goes through four stages: read, annotate (IGBlast,
+or parsing for TSV), correct and write. Stages run at the same time
+and pass chunks through BoundedQueues. The writer holds chunks that
+finish early in a reorder buffer, so the output keeps the input order.
+The number of chunks between the reader and the writer is capped, so
+memory stays the same however large the input is. To rename duplicate
+FASTQ IDs the reader also keeps the names it gave out, up to
+constants::STREAM_READ_IDS of them plus one chunk.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef STREAMINGPIPELINE_HH_
+#define STREAMINGPIPELINE_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "BoundedQueue.hh"
+#include "ErrorXOptions.hh"
+#include "SequenceRecords.hh"
+
+namespace errorx {
+
+using namespace std;
+
+class ERRORX_API StreamingPipeline {
+
+public:
+
+	/**
+		Constructor
+
+		@param options options to run with. infile, format and
+		outfile say what to read and write, and chunk_size how many
+		reads go in a chunk
+
+		@throws invalid_argument if chunk_size is 0
+	*/
+	StreamingPipeline( ErrorXOptions const & options );
+
+	/**
+		Read, correct and write the whole input
+
+		@throws BadFileException if the input can't be read or parsed,
+		and invalid_argument if the output can't be written. Any
+		exception thrown by a stage stops every stage and is rethrown
+		once they have all stopped
+	*/
+	void run();
+
+	/**
+		Read the next chunk of the input, as the first stage does.
+		FASTQ reads are turned into FASTA, and a read whose ID was
+		already seen gets a suffix, as ErrorXOptions::fastq_to_fasta
+		does. Names stay unique within a chunk, but the IDs seen are
+		forgotten once there are constants::STREAM_READ_IDS of them,
+		so past that a duplicate of a read from much earlier in the
+		file can get a different name than fastq_to_fasta gives it
+
+		@param file input in the format of the options
+		@param text set to the reads of the chunk
+		@param qualities set to the quality string of each FASTQ read
+
+		@return number of reads, 0 if there were none left
+
+		@throws BadFileException if a FASTQ read is malformed
+	*/
+	int read_chunk( istream & file, string & text, unordered_map<string,string> & qualities );
+
+	/**
+		Number of chunks and reads written by the last run
+	*/
+	int chunks() const;
+	int reads() const;
+
+	/**
+		Most chunks the writer held at once in the last run
+		while waiting on an earlier one
+	*/
+	int max_buffered() const;
+
+	/**
+		Most chunks that were read and not yet written at once
+	*/
+	int window() const;
+
+private:
+
+	struct Chunk {
+		int index;
+		int reads;
+		// raw TSV lines, or FASTA to give to IGBlast
+		string text;
+		unordered_map<string,string> qualities;
+		SequenceRecordsPtr records;
+	};
+	typedef unique_ptr<Chunk> ChunkPtr;
+
+	StreamingPipeline( StreamingPipeline const & );
+	StreamingPipeline & operator=( StreamingPipeline const & );
+
+	/**
+		Stages. Each one takes chunks from the queue before it
+		and passes them to the queue after it
+	*/
+	void read();
+	void annotate();
+	void correct();
+	void write( ostream & outfile );
+
+	/**
+		Fill a chunk with up to chunk_size reads from the input
+
+		@return false if there were no reads left
+	*/
+	bool read_chunk( istream & file, Chunk & chunk );
+
+	/**
+		Run IGBlast on a chunk and parse its output
+	*/
+	void blast_chunk( Chunk & chunk );
+
+	/**
+		Run a stage, and stop the others if it throws
+	*/
+	void run_stage( function<void()> const & stage );
+
+	/**
+		Wait until fewer than window_ chunks are in flight
+
+		@return false if a stage failed while waiting
+	*/
+	bool acquire_slot();
+	void release_slot();
+
+	ErrorXOptionsPtr options_;
+	int annotators_;
+	int window_;
+
+	BoundedQueue<ChunkPtr> read_queue_;
+	BoundedQueue<ChunkPtr> annotated_queue_;
+	BoundedQueue<ChunkPtr> corrected_queue_;
+	atomic<int> annotating_;
+
+	// FASTA header that was read past the end of the last chunk
+	string next_header_;
+
+	// FASTQ read names given out so far, each with the next suffix
+	// to try for it. Only the read stage uses it
+	unordered_map<string,int> read_ids_;
+
+	mutex slots_lock_;
+	condition_variable slot_free_;
+	int in_flight_;
+
+	atomic<bool> failed_;
+	exception_ptr error_;
+	mutex error_lock_;
+
+	int chunks_;
+	int reads_;
+	int max_buffered_;
+};
+
+} // namespace errorx
+
+
+#endif /* STREAMINGPIPELINE_HH_ */
@@ -0,0 +1,148 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file TaskScheduler.hh
+@brief Work-stealing scheduler for a range of independent items
+@details The items are cut into small batches. Each worker gets an
+equal, contiguous share of the batches in its own queue. A worker
+takes batches from the front of its own queue. When the queue is
+empty, it steals from the back of another worker's queue, so a worker
+that drew cheap items helps one that drew expensive ones. The calling
+thread is worker 0, and the others run as jobs on an Executor, or on
+threads of their own if none is given. Busy and idle time are recorded
+for every worker.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef TASKSCHEDULER_HH_
+#define TASKSCHEDULER_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Executor.hh"
+
+namespace errorx {
+
+using namespace std;
+
+class ERRORX_API TaskScheduler {
+
+public:
+
+	/**
+		Time and work done by one worker during run
+	*/
+	struct WorkerStats {
+		double busy_seconds;
+		double idle_seconds;
+		int batches;
+		int stolen;
+	};
+
+	/**
+		Constructor
+
+		@param nthreads number of workers, including the calling thread
+		@param batch_size number of items in a batch
+		@param executor pool to run the other workers on. If null,
+		each run starts and joins its own threads
+
+		@throws invalid_argument if nthreads or batch_size is below 1
+	*/
+	TaskScheduler( int nthreads, int batch_size, ExecutorPtr const & executor=ExecutorPtr() );
+
+	/**
+		Run a task over the items [0,items) and wait for it to finish.
+		Batches run in no particular order, so the task must only
+		touch the items it is given
+
+		@param items number of items
+		@param task called as task( worker, begin, end ) for each batch
+		of items [begin,end). worker is in [0,nthreads) and no two calls
+		with the same worker run at the same time
+
+		@throws the first exception thrown by the task, after every
+		worker has stopped. No new batches start once a task has thrown.
+		Workers whose job hasn't started on the executor by the time the
+		calling thread runs out of batches are skipped, so a busy or
+		small pool never blocks the run
+	*/
+	void run( int items, function<void(int,int,int)> const & task );
+
+	/**
+		Stats of each worker in the last run
+	*/
+	vector<WorkerStats> const & stats() const;
+
+	/**
+		Getters
+	*/
+	int nthreads() const;
+	int batch_size() const;
+
+private:
+
+	struct Batch {
+		int begin;
+		int end;
+	};
+
+	struct WorkerQueue {
+		mutex lock;
+		deque<Batch> batches;
+	};
+
+	/**
+		Runs batches until every queue is empty
+	*/
+	void work( int worker, function<void(int,int,int)> const & task );
+
+	/**
+		Run workers 1 and up as jobs on the executor
+	*/
+	void run_on_executor( function<void(int,int,int)> const & task );
+
+	/**
+		Take the next batch of a worker, first from its own queue
+		and then from the others
+
+		@return false once every queue is empty
+	*/
+	bool next_batch( int worker, Batch & batch, bool & stolen );
+
+	int nthreads_;
+	int batch_size_;
+	ExecutorPtr executor_;
+
+	unique_ptr<WorkerQueue[]> queues_;
+	vector<WorkerStats> stats_;
+
+	atomic<bool> failed_;
+	exception_ptr error_;
+	mutex error_lock_;
+};
+
+} // namespace errorx
+
+
+#endif /* TASKSCHEDULER_HH_ */
@@ -35,6 +35,40 @@ const std::vector<double> OPTIMIZED_THRESHOLD_VECTOR = {
 */
 const int WINDOW = 8;
 
+/**
+	Number of features calculated for each position,
+	i.e. the width of one row fed to the neural network
+*/
+const int N_FEATURES = 124;
+
+/**
+	Number of records a thread takes at a time when correcting.
+	Small so that threads can steal work from each other near the end
+*/
+const int RECORD_BATCH = 4;
+
+/**
+	Number of chunks each queue of the streaming pipeline
+	holds before the stage in front of it waits
+*/
+const int STREAM_QUEUE = 2;
+
+/**
+	Number of FASTQ read IDs the streaming pipeline remembers to
+	rename duplicates. Once this many are held they are forgotten at
+	the start of the next chunk, so at about 128 bytes a name for
+	Illumina IDs the reader keeps under 32 MB of them
+*/
+const int STREAM_READ_IDS = 250000;
+
+/**
+	Size in bytes of the first and largest blocks of a
+	RecordStore arena. Each block is twice the one before,
+	so a store of one record stays small
+*/
+const int ARENA_BLOCK_MIN = 256;
+const int ARENA_BLOCK_MAX = 1 << 20;
+
 /**
 	E value cutoffs when assigning V, D, and J genes
 */
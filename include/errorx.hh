@@ -79,6 +79,21 @@ ERRORX_API SequenceRecordsPtr run_protocol( vector<SequenceQuery> & queries, Err
 */
 ERRORX_API void run_protocol_write( ErrorXOptions & options );
 
+/**
+	Runs the ErrorX protocol on a file and writes the output
+	without holding all of the records in memory. The input is
+	read, annotated, corrected and written in chunks of
+	options.chunk_size() reads, see StreamingPipeline.
+	run_protocol_write calls this when chunk_size is set
+
+	@param options ErrorXOptions object with all necessary options for 
+	running the ErrorX protocol
+
+	@throws invalid_argument if either infile or format are not provided
+	in options, or chunk_size is 0
+*/
+ERRORX_API void run_protocol_stream( ErrorXOptions & options );
+
 /**
 	Debugging function to output features of input sequences as well as
 	the corrected sequences.
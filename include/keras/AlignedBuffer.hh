@@ -0,0 +1,110 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/AlignedBuffer.hh
+@brief Fixed-size array of values aligned to a cache line
+@details Used for weights and activations that are read by the
+SIMD kernels, so that every vector load is aligned and a buffer
+never shares a cache line with another one.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef ALIGNEDBUFFER_HH_
+#define ALIGNEDBUFFER_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace keras {
+
+template <typename T>
+class ERRORX_API AlignedArray {
+
+public:
+	/**
+		Alignment of the buffer in bytes
+	*/
+	static const size_t ALIGNMENT = 64;
+
+	/**
+		Empty constructor
+	*/
+	AlignedArray();
+
+	/**
+		Allocate a buffer of a fixed size, filled with zeros
+
+		@param size number of values
+	*/
+	explicit AlignedArray( size_t size );
+
+	/**
+		Copy constructor and assignment - deep copy
+	*/
+	AlignedArray( AlignedArray const & other );
+	AlignedArray & operator=( AlignedArray const & other );
+
+	/**
+		Destructor - frees the buffer
+	*/
+	~AlignedArray();
+
+	/**
+		Resize the buffer and fill it with a value. Existing
+		contents are discarded. Only reallocates if the buffer grows
+
+		@param size number of values
+		@param value fill value
+	*/
+	void assign( size_t size, T value );
+
+	/**
+		Resize the buffer without initializing it. Only reallocates
+		if the buffer grows, in which case existing contents are lost
+
+		@param size number of values
+	*/
+	void resize( size_t size );
+
+	/**
+		Getters
+	*/
+	T * data();
+	T const * data() const;
+	size_t size() const;
+
+	T & operator[]( size_t index );
+	T operator[]( size_t index ) const;
+
+private:
+	void allocate( size_t capacity );
+	void release();
+
+	T * data_;
+	size_t size_;
+	size_t capacity_;
+};
+
+/// instantiated in AlignedBuffer.cc
+typedef AlignedArray<double> AlignedBuffer;
+typedef AlignedArray<float> AlignedFloatBuffer;
+typedef AlignedArray<int8_t> AlignedInt8Buffer;
+typedef AlignedArray<int32_t> AlignedInt32Buffer;
+
+} // namespace keras
+
+#endif // ALIGNEDBUFFER_HH_
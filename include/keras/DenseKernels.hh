@@ -0,0 +1,531 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/DenseKernels.hh
+@brief Matrix kernels for dense layers, with SIMD variants
+selected at runtime
+@details Each variant lives in its own translation unit that is
+compiled for its instruction set, so a single binary carries all
+of them and picks the widest one the CPU supports. Every variant
+accumulates each output over the inputs in ascending order with a
+separate multiply and add, then adds the bias, so all variants give
+bit-identical results. Single-precision variants follow the same
+order, so they agree with each other but not with the double ones.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef DENSEKERNELS_HH_
+#define DENSEKERNELS_HH_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/// SIMD variants are only built for x86 with GCC or clang,
+/// everything else uses the generic kernel
+#if ( defined(__x86_64__) || defined(__i386__) ) && defined(__GNUC__)
+#define KERAS_X86_KERNELS
+#endif
+
+using namespace std;
+
+namespace keras {
+namespace kernels {
+
+/**
+	Number of neurons in one weight panel. Weights are packed so that
+	each panel holds PANEL_WIDTH consecutive neurons for every input,
+	i.e. panel p, input j, neuron p*PANEL_WIDTH+c is stored at
+	(p*inputs + j)*PANEL_WIDTH + c. A panel is 128 bytes per input,
+	so with an aligned buffer every vector load is aligned. The last
+	panel and the bias are padded with zeros
+*/
+const int PANEL_WIDTH = 16;
+
+/**
+	Activation functions, resolved from their names once when a model
+	is loaded. All but softmax are element-wise, so they can be fused
+	into a dense kernel and applied to each block of outputs as soon as
+	it's written. Softmax is normalized over a whole row and always runs
+	as its own layer
+*/
+enum Activation { LINEAR, RELU, SIGMOID, TANH, SOFTMAX };
+
+/**
+	Apply an element-wise activation in place. Shared by the kernels and
+	LayerActivation, so fused and separate activations round the same
+	way. Does nothing for LINEAR and SOFTMAX
+
+	@param y values to activate
+	@param n number of values
+	@param activation activation function
+*/
+void activate_block( double * y, int n, Activation activation );
+void activate_block( float * y, int n, Activation activation );
+
+/**
+	Number of neurons rounded up to a whole number of panels
+
+	@param neurons number of neurons
+
+	@return padded number of neurons
+*/
+int padded_neurons( int neurons );
+
+/**
+	Pack a row-major inputs x neurons weight matrix into panels
+
+	@param weights row-major matrix of inputs x neurons
+	@param inputs number of inputs
+	@param neurons number of neurons
+	@param packed output of inputs x padded_neurons( neurons ) doubles
+*/
+void pack_weights( double const * weights, int inputs, int neurons, double * packed );
+
+/**
+	Same as above, rounding the weights to single precision
+*/
+void pack_weights( double const * weights, int inputs, int neurons, float * packed );
+
+/**
+	Computes output = activation( input * weights + bias ) for a batch of rows
+
+	@param input row-major matrix of rows x inputs
+	@param rows number of rows in the batch
+	@param inputs number of inputs per row
+	@param weights weights packed by pack_weights, 64-byte aligned
+	@param bias zero-padded to padded_neurons( neurons ), 64-byte aligned
+	@param neurons number of outputs per row
+	@param output row-major matrix of rows x neurons, overwritten
+	@param activation element-wise activation, LINEAR for none
+*/
+typedef void (*DenseKernel)( double const * input, int rows, int inputs,
+	double const * weights, double const * bias, int neurons, double * output,
+	Activation activation );
+
+/**
+	Single-precision kernel, same arguments as DenseKernel
+*/
+typedef void (*DenseKernelF)( float const * input, int rows, int inputs,
+	float const * weights, float const * bias, int neurons, float * output,
+	Activation activation );
+
+/**
+	Portable kernels
+*/
+void dense_generic( double const * input, int rows, int inputs,
+	double const * weights, double const * bias, int neurons, double * output,
+	Activation activation );
+void dense_generic_f32( float const * input, int rows, int inputs,
+	float const * weights, float const * bias, int neurons, float * output,
+	Activation activation );
+
+#ifdef KERAS_X86_KERNELS
+void dense_sse42( double const * input, int rows, int inputs,
+	double const * weights, double const * bias, int neurons, double * output,
+	Activation activation );
+void dense_avx2( double const * input, int rows, int inputs,
+	double const * weights, double const * bias, int neurons, double * output,
+	Activation activation );
+void dense_avx512( double const * input, int rows, int inputs,
+	double const * weights, double const * bias, int neurons, double * output,
+	Activation activation );
+
+void dense_sse42_f32( float const * input, int rows, int inputs,
+	float const * weights, float const * bias, int neurons, float * output,
+	Activation activation );
+void dense_avx2_f32( float const * input, int rows, int inputs,
+	float const * weights, float const * bias, int neurons, float * output,
+	Activation activation );
+void dense_avx512_f32( float const * input, int rows, int inputs,
+	float const * weights, float const * bias, int neurons, float * output,
+	Activation activation );
+#endif
+
+/**
+	Kernel for the widest instruction set this CPU supports.
+	Selected from cpuid on first use
+
+	@return dense kernel
+*/
+DenseKernel dense_kernel();
+
+/**
+	Name of the instruction set used by dense_kernel()
+
+	@return one of "avx512", "avx2", "sse4.2", "generic"
+*/
+string dense_kernel_name();
+
+/**
+	Kernel for a given instruction set, if this CPU supports it
+
+	@param name one of "avx512", "avx2", "sse4.2", "generic"
+
+	@return dense kernel, or nullptr if not supported
+*/
+DenseKernel dense_kernel( string const & name );
+
+/**
+	Single-precision versions of dense_kernel(), using the
+	same instruction set names
+*/
+DenseKernelF dense_kernel_f32();
+DenseKernelF dense_kernel_f32( string const & name );
+
+/**
+	Names of all instruction sets supported by this CPU,
+	widest first
+
+	@return list of names accepted by dense_kernel( name )
+*/
+vector<string> supported_dense_kernels();
+
+/**
+	===========================================================
+	                    Sparse input kernels
+	===========================================================
+
+	For inputs that are mostly zeros, e.g. one-hot encodings, rows are
+	given in compressed sparse row form and each output is the sum of
+	the weight rows of the listed inputs. Entries of a row must be in
+	ascending column order. Inputs that aren't listed are zero and
+	would add nothing, so results are bit-identical to the dense kernels
+*/
+
+/**
+	Computes output = activation( input * weights + bias ) for a batch
+	of sparse rows
+
+	@param row_start row r has entries row_start[r] to row_start[r+1]-1
+	@param columns input index of each entry, ascending within a row
+	@param values value of each entry
+	@param rows number of rows in the batch
+	@param inputs number of inputs of the layer
+	@param weights weights packed by pack_weights, 64-byte aligned
+	@param bias zero-padded to padded_neurons( neurons ), 64-byte aligned
+	@param neurons number of outputs per row
+	@param output row-major matrix of rows x neurons, overwritten
+	@param activation element-wise activation, LINEAR for none
+*/
+typedef void (*SparseDenseKernel)( int const * row_start, int const * columns,
+	double const * values, int rows, int inputs, double const * weights,
+	double const * bias, int neurons, double * output,
+	Activation activation );
+
+void sparse_dense_generic( int const * row_start, int const * columns,
+	double const * values, int rows, int inputs, double const * weights,
+	double const * bias, int neurons, double * output,
+	Activation activation );
+
+#ifdef KERAS_X86_KERNELS
+void sparse_dense_avx2( int const * row_start, int const * columns,
+	double const * values, int rows, int inputs, double const * weights,
+	double const * bias, int neurons, double * output,
+	Activation activation );
+void sparse_dense_avx512( int const * row_start, int const * columns,
+	double const * values, int rows, int inputs, double const * weights,
+	double const * bias, int neurons, double * output,
+	Activation activation );
+#endif
+
+/**
+	Sparse kernel for the instruction set used by dense_kernel()
+
+	@return sparse dense kernel
+*/
+SparseDenseKernel sparse_dense_kernel();
+
+/**
+	Sparse kernel for a given instruction set, if this CPU supports
+	it. There is no SSE4.2 variant, "sse4.2" gives the generic kernel
+
+	@param name one of "avx512", "avx2", "sse4.2", "generic"
+
+	@return sparse dense kernel, or nullptr if not supported
+*/
+SparseDenseKernel sparse_dense_kernel( string const & name );
+
+/**
+	===========================================================
+	                    Block-sparse weights
+	===========================================================
+
+	For pruned layers, weights are kept in block compressed sparse row
+	form. A block is one input's weights for one panel, PANEL_WIDTH
+	values, and blocks that are all zero are left out. Panel p has
+	blocks block_start[p] to block_start[p+1]-1, in ascending input
+	order, and block b holds the weights of input block_inputs[b] at
+	blocks + b*PANEL_WIDTH. Each output sums the stored blocks in the
+	same order as the dense kernels, and a missing block would only
+	have added zeros, so results are identical to the dense kernels
+*/
+
+/**
+	Number of blocks of packed weights that aren't all zero
+
+	@param packed weights packed by pack_weights
+	@param inputs number of inputs
+	@param neurons number of neurons
+
+	@return number of stored blocks
+*/
+int count_blocks( double const * packed, int inputs, int neurons );
+
+/**
+	Copy the blocks that aren't all zero out of packed weights
+
+	@param packed weights packed by pack_weights
+	@param inputs number of inputs
+	@param neurons number of neurons
+	@param block_start padded_neurons( neurons )/PANEL_WIDTH + 1 values
+	@param block_inputs count_blocks() values
+	@param blocks count_blocks()*PANEL_WIDTH values, 64-byte aligned
+*/
+void pack_blocks( double const * packed, int inputs, int neurons,
+	int * block_start, int * block_inputs, double * blocks );
+
+/**
+	Computes output = activation( input * weights + bias ) for a batch
+	of rows, reading only the stored blocks of the weights
+
+	@param input row-major matrix of rows x inputs
+	@param rows number of rows in the batch
+	@param inputs number of inputs per row
+	@param block_start first block of each panel, see pack_blocks
+	@param block_inputs input of each block
+	@param blocks weights of each block, 64-byte aligned
+	@param bias zero-padded to padded_neurons( neurons ), 64-byte aligned
+	@param neurons number of outputs per row
+	@param output row-major matrix of rows x neurons, overwritten
+	@param activation element-wise activation, LINEAR for none
+*/
+typedef void (*BlockSparseKernel)( double const * input, int rows, int inputs,
+	int const * block_start, int const * block_inputs, double const * blocks,
+	double const * bias, int neurons, double * output, Activation activation );
+
+void block_sparse_generic( double const * input, int rows, int inputs,
+	int const * block_start, int const * block_inputs, double const * blocks,
+	double const * bias, int neurons, double * output, Activation activation );
+
+#ifdef KERAS_X86_KERNELS
+void block_sparse_avx2( double const * input, int rows, int inputs,
+	int const * block_start, int const * block_inputs, double const * blocks,
+	double const * bias, int neurons, double * output, Activation activation );
+void block_sparse_avx512( double const * input, int rows, int inputs,
+	int const * block_start, int const * block_inputs, double const * blocks,
+	double const * bias, int neurons, double * output, Activation activation );
+#endif
+
+/**
+	Block-sparse kernel for the instruction set used by dense_kernel()
+
+	@return block-sparse kernel
+*/
+BlockSparseKernel block_sparse_kernel();
+
+/**
+	Block-sparse kernel for a given instruction set, if this CPU
+	supports it. There is no SSE4.2 variant, "sse4.2" gives the
+	generic kernel
+
+	@param name one of "avx512", "avx2", "sse4.2", "generic"
+
+	@return block-sparse kernel, or nullptr if not supported
+*/
+BlockSparseKernel block_sparse_kernel( string const & name );
+
+/**
+	===========================================================
+	                    Fast activations
+	===========================================================
+
+	activate_block calls libm for every value, which is exact but
+	scalar. The fast kernels replace exp with a polynomial that
+	vectorizes, and build sigmoid, tanh and softmax from it. relu is
+	the same in both modes. Every variant evaluates the same
+	operations in the same order, so they agree with each other
+	bit for bit, and agree with libm to within FAST_EXP_DEGREE terms
+	of the Taylor series, about 1e-14 relative in double precision
+	and 1e-7 in single
+*/
+enum ActivationMode { EXACT, FAST };
+
+/**
+	Constants of the fast exp. Inputs are clamped to +-FAST_EXP_MAX so
+	2^n stays a normal number, n is chosen so that the remainder
+	r = x - n*ln2 is within +-ln2/2, with ln2 split in two so r is
+	exact, and exp(r) is a Taylor polynomial of degree FAST_EXP_DEGREE
+*/
+const double FAST_EXP_MAX = 708;
+const double FAST_EXP_LOG2E = 1.44269504088896340736;
+const double FAST_EXP_LN2_HI = 6.93147180369123816490e-01;
+const double FAST_EXP_LN2_LO = 1.90821492927058770002e-10;
+const int FAST_EXP_DEGREE = 11;
+
+const float FAST_EXPF_MAX = 87;
+const float FAST_EXPF_LOG2E = 1.44269504f;
+const float FAST_EXPF_LN2_HI = 0.693359375f;
+const float FAST_EXPF_LN2_LO = -2.12194440e-4f;
+const int FAST_EXPF_DEGREE = 6;
+
+/**
+	1/k! for k = 0 to 11, the Taylor coefficients of exp
+*/
+const double FAST_EXP_COEFFS[] = { 1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120,
+	1.0/720, 1.0/5040, 1.0/40320, 1.0/362880, 1.0/3628800, 1.0/39916800 };
+
+/**
+	Applies an activation in place to a row-major block of rows x cols
+	values, using the fast exp. Softmax is normalized within each row,
+	the rest are element-wise, and LINEAR does nothing
+
+	@param y row-major matrix of rows x cols, overwritten
+	@param rows number of rows
+	@param cols number of values per row
+	@param activation activation function
+*/
+typedef void (*FastActivationKernel)( double * y, int rows, int cols,
+	Activation activation );
+typedef void (*FastActivationKernelF)( float * y, int rows, int cols,
+	Activation activation );
+
+/**
+	Divide each row by its sum, the last step of softmax. Shared by
+	the fast kernels so every variant sums in the same order
+
+	@param y row-major matrix of rows x cols, overwritten
+	@param rows number of rows
+	@param cols number of values per row
+*/
+void normalize_rows( double * y, int rows, int cols );
+void normalize_rows( float * y, int rows, int cols );
+
+void fast_activation_generic( double * y, int rows, int cols, Activation activation );
+void fast_activation_generic_f32( float * y, int rows, int cols, Activation activation );
+
+#ifdef KERAS_X86_KERNELS
+void fast_activation_avx2( double * y, int rows, int cols, Activation activation );
+void fast_activation_avx2_f32( float * y, int rows, int cols, Activation activation );
+void fast_activation_avx512( double * y, int rows, int cols, Activation activation );
+void fast_activation_avx512_f32( float * y, int rows, int cols, Activation activation );
+#endif
+
+/**
+	Fast activation kernel for the instruction set used by dense_kernel()
+
+	@return fast activation kernel
+*/
+FastActivationKernel fast_activation_kernel();
+FastActivationKernelF fast_activation_kernel_f32();
+
+/**
+	Fast activation kernel for a given instruction set, if this CPU
+	supports it. There is no SSE4.2 variant, "sse4.2" gives the
+	generic kernel
+
+	@param name one of "avx512", "avx2", "sse4.2", "generic"
+
+	@return fast activation kernel, or nullptr if not supported
+*/
+FastActivationKernel fast_activation_kernel( string const & name );
+FastActivationKernelF fast_activation_kernel_f32( string const & name );
+
+/**
+	===========================================================
+	                    Int8 kernels
+	===========================================================
+
+	Quantized weights are packed in the same 16-neuron panels, but
+	inputs are taken in groups of INT8_GROUP so that each 32-bit lane
+	holds one neuron's weights for four consecutive inputs, which
+	is the layout VNNI dot products read. Panel p, input group g,
+	neuron p*PANEL_WIDTH+c, input 4*g+t is stored at
+	((p*groups + g)*PANEL_WIDTH + c)*INT8_GROUP + t. Products are
+	summed in 32-bit integers, which is exact, so every variant gives
+	identical results
+*/
+const int INT8_GROUP = 4;
+
+/**
+	Number of inputs rounded up to a whole number of groups.
+	Quantized input rows are this wide, padded with zeros
+
+	@param inputs number of inputs
+
+	@return padded number of inputs
+*/
+int padded_inputs_int8( int inputs );
+
+/**
+	Pack a row-major inputs x neurons matrix of quantized weights
+
+	@param weights row-major matrix of inputs x neurons
+	@param inputs number of inputs
+	@param neurons number of neurons
+	@param packed output of padded_inputs_int8( inputs ) x
+	padded_neurons( neurons ) values
+*/
+void pack_weights_int8( int8_t const * weights, int inputs, int neurons, int8_t * packed );
+
+/**
+	Computes output = ( input * weights ) * scale + bias for a batch
+	of quantized rows
+
+	@param input row-major matrix of rows x inputs, in [-127,127]
+	@param rows number of rows in the batch
+	@param inputs number of inputs per row, a multiple of INT8_GROUP
+	@param weights weights packed by pack_weights_int8, 64-byte aligned
+	@param weight_sums sum of each neuron's weights, padded like bias
+	@param scale dequantization factor for each neuron, padded like bias
+	@param bias zero-padded to padded_neurons( neurons ), 64-byte aligned
+	@param neurons number of outputs per row
+	@param output row-major matrix of rows x neurons, overwritten
+*/
+typedef void (*DenseKernelInt8)( int8_t const * input, int rows, int inputs,
+	int8_t const * weights, int32_t const * weight_sums, float const * scale,
+	float const * bias, int neurons, float * output );
+
+void dense_int8_generic( int8_t const * input, int rows, int inputs,
+	int8_t const * weights, int32_t const * weight_sums, float const * scale,
+	float const * bias, int neurons, float * output );
+
+#ifdef KERAS_X86_KERNELS
+void dense_int8_avx2( int8_t const * input, int rows, int inputs,
+	int8_t const * weights, int32_t const * weight_sums, float const * scale,
+	float const * bias, int neurons, float * output );
+void dense_int8_vnni( int8_t const * input, int rows, int inputs,
+	int8_t const * weights, int32_t const * weight_sums, float const * scale,
+	float const * bias, int neurons, float * output );
+#endif
+
+/**
+	Int8 kernel for the widest instruction set this CPU supports
+
+	@return int8 dense kernel
+*/
+DenseKernelInt8 dense_int8_kernel();
+
+/**
+	Int8 kernel for a given instruction set, if this CPU supports it
+
+	@param name one of "avx512vnni", "avx2", "generic"
+
+	@return int8 dense kernel, or nullptr if not supported
+*/
+DenseKernelInt8 dense_int8_kernel( string const & name );
+
+/**
+	Names of the int8 instruction sets supported by this CPU,
+	widest first
+
+	@return list of names accepted by dense_int8_kernel( name )
+*/
+vector<string> supported_int8_kernels();
+
+} // namespace kernels
+} // namespace keras
+
+#endif // DENSEKERNELS_HH_
@@ -0,0 +1,128 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/EmbeddedModel.hh
+@brief Production model compiled into the library
+@details With make embedded, the weights of model.nnet are written out
+as C++ arrays by errorx_model embed and compiled into the library, with
+each dense layer a kernel specialized on its size (see FixedDense.hh).
+The kernels are built for each instruction set and picked at runtime,
+like the dynamic ones (see EmbeddedModelKernels.hh).
+The library then runs without model.nnet, and predictions for the
+embedded model skip the generic layer code. A regular build has no
+embedded model, and available() is false.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef EMBEDDEDMODEL_HH_
+#define EMBEDDEDMODEL_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include "keras/KerasModel.hh"
+#include "keras/InferenceContext.hh"
+#include "keras/SparseBatch.hh"
+
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+namespace keras {
+
+class ERRORX_API EmbeddedModel {
+
+public:
+	/**
+		Whether this build has a model compiled in
+	*/
+	static bool available();
+
+	/**
+		Layer sizes of the embedded model, e.g. 124-256-128-64-1,
+		or an empty string if there isn't one
+	*/
+	static string layout();
+
+	/**
+		Instruction set of the kernels that run the embedded model:
+		avx512, avx2 or generic. The same cpuid check picks it as
+		picks the dynamic kernels, so the embedded model is never
+		built for a lower instruction set than they use
+
+		@return the instruction set, or an empty string if there
+		isn't an embedded model
+	*/
+	static string isa();
+
+	/**
+		The embedded model as a regular KerasModel, for the code
+		paths that don't have a specialized version. Built once
+
+		@return shared read-only model
+
+		@throws ObjectNotInitialized if there's no embedded model
+	*/
+	static KerasModelConstPtr model();
+
+	/**
+		Check whether a model is the embedded one, layer for layer
+		with identical weights and exact activations
+
+		@param model model to check
+
+		@return false if it differs or there's no embedded model
+	*/
+	static bool matches( KerasModel const & model );
+
+	/**
+		Run the embedded model over a batch of samples. Same contract
+		and same results as KerasModel::compute_output_batch
+
+		@param input row-major block of rows x input values
+		@param rows number of samples in the block
+		@param output row-major block of rows x output values
+		@param context scratch buffers, reused across calls by one thread
+
+		@throws ObjectNotInitialized if there's no embedded model
+	*/
+	static void compute_output_batch( double const * input, int rows,
+		double * output, InferenceContext & context );
+
+	/**
+		Same as above for input given as sparse rows
+	*/
+	static void compute_output_batch( SparseBatch const & input,
+		double * output, InferenceContext & context );
+
+	/**
+		Write a model as the C++ source that embeds it, see
+		src/keras/EmbeddedModel.cc for how it's included
+
+		@param model model to write
+		@param out output stream
+
+		@throws InvalidLayer if the model isn't made of dense layers,
+		each followed by at most one element-wise activation
+	*/
+	static void write_source( KerasModel const & model, ostream & out );
+
+private:
+	EmbeddedModel();
+};
+
+} // namespace keras
+
+#endif // EMBEDDEDMODEL_HH_
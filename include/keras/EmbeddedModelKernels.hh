@@ -0,0 +1,64 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/EmbeddedModelKernels.hh
+@brief Variants of the embedded model for each instruction set
+@details The generated EmbeddedModelData.inc is compiled once for each
+instruction set, like the dynamic kernels in DenseKernels.hh, and
+EmbeddedModel picks the variant for the ISA that dense_kernel_name()
+reports. The weights are defined once, in EmbeddedModel.cc, and shared
+by every variant. Only used inside the library.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef EMBEDDEDMODELKERNELS_HH_
+#define EMBEDDEDMODELKERNELS_HH_
+
+#include "keras/DenseKernels.hh"
+#include "keras/SparseBatch.hh"
+
+namespace keras {
+namespace embedded {
+
+/**
+	One dense layer of the embedded model
+*/
+struct EmbeddedLayer {
+	int inputs;
+	int neurons;
+	double const * weights; // row-major inputs x neurons
+	double const * bias;
+	char const * activation; // empty for none
+};
+
+/**
+	Run the whole embedded model over a batch. Layers alternate
+	between the two buffers, which hold rows x MAX_WIDTH values
+*/
+typedef void (*DenseRun)( double const * input, int rows, double * output,
+	double * buffer0, double * buffer1 );
+typedef void (*SparseRun)( SparseBatch const & input, int rows, double * output,
+	double * buffer0, double * buffer1 );
+
+void run_dense_generic( double const * input, int rows, double * output,
+	double * buffer0, double * buffer1 );
+void run_sparse_generic( SparseBatch const & input, int rows, double * output,
+	double * buffer0, double * buffer1 );
+
+#ifdef KERAS_X86_KERNELS
+void run_dense_avx2( double const * input, int rows, double * output,
+	double * buffer0, double * buffer1 );
+void run_sparse_avx2( SparseBatch const & input, int rows, double * output,
+	double * buffer0, double * buffer1 );
+void run_dense_avx512( double const * input, int rows, double * output,
+	double * buffer0, double * buffer1 );
+void run_sparse_avx512( SparseBatch const & input, int rows, double * output,
+	double * buffer0, double * buffer1 );
+#endif
+
+} // namespace embedded
+} // namespace keras
+
+#endif // EMBEDDEDMODELKERNELS_HH_
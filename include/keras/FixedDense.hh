@@ -0,0 +1,207 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/FixedDense.hh
+@brief Dense layer kernels specialized on the layer size at compile time
+@details Used by the embedded model, whose layer sizes are known when
+the library is built. With every loop bound a constant the compiler can
+unroll and vectorize the loops for the target CPU without the panel
+packing and runtime dispatch of DenseKernels.hh. Weights are row-major,
+inputs x neurons. Each output is summed in the same order as the dynamic
+kernels, so results are identical to them. The kernels are in an
+unnamed namespace, so the copies in objects built for different
+instruction sets (see EmbeddedModelKernels.hh) are never mixed up
+by the linker.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef FIXEDDENSE_HH_
+#define FIXEDDENSE_HH_
+
+#include "keras/DenseKernels.hh"
+#include "keras/SparseBatch.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace keras {
+namespace kernels {
+namespace {
+
+/**
+	Apply an activation known at compile time. relu is inlined,
+	the rest share activate_block with the dynamic kernels
+*/
+template <Activation ACTIVATION>
+inline void fixed_activate( double * y, int n ) {
+	if ( ACTIVATION == RELU ) {
+		for ( int c = 0; c < n; ++c ) {
+			if ( y[c] < 0 ) y[c] = 0;
+		}
+	} else if ( ACTIVATION != LINEAR ) {
+		activate_block( y, n, ACTIVATION );
+	}
+}
+
+/**
+	One block of BLOCK neurons starting at k0, for four rows and for
+	one row. BLOCK is a constant, so the accumulators stay in registers.
+	The simd pragmas keep the compiler vectorizing across neurons: left
+	alone it vectorizes across inputs instead, with a shuffle per load
+*/
+template <int INPUTS, int NEURONS, Activation ACTIVATION, int BLOCK>
+inline void fixed_dense_block4( double const * input, double const * weights,
+	double const * bias, double * output, int k0 ) {
+
+	double acc0[ BLOCK ] = {}, acc1[ BLOCK ] = {}, acc2[ BLOCK ] = {}, acc3[ BLOCK ] = {};
+	double const * x0 = input;
+	double const * x1 = input + INPUTS;
+	double const * x2 = input + 2*INPUTS;
+	double const * x3 = input + 3*INPUTS;
+
+	for ( int j = 0; j < INPUTS; ++j ) {
+		double const * w = weights + (size_t)j*NEURONS + k0;
+		double p0 = x0[j], p1 = x1[j], p2 = x2[j], p3 = x3[j];
+#pragma omp simd
+		for ( int c = 0; c < BLOCK; ++c ) {
+			acc0[c] += w[c] * p0;
+			acc1[c] += w[c] * p1;
+			acc2[c] += w[c] * p2;
+			acc3[c] += w[c] * p3;
+		}
+	}
+
+	double * acc[] = { acc0, acc1, acc2, acc3 };
+	for ( int m = 0; m < 4; ++m ) {
+		double * y = output + (size_t)m*NEURONS + k0;
+		for ( int c = 0; c < BLOCK; ++c ) y[c] = acc[m][c] + bias[k0+c];
+		fixed_activate<ACTIVATION>( y, BLOCK );
+	}
+}
+
+template <int INPUTS, int NEURONS, Activation ACTIVATION, int BLOCK>
+inline void fixed_dense_block1( double const * input, double const * weights,
+	double const * bias, double * output, int k0 ) {
+
+	double acc[ BLOCK ] = {};
+	for ( int j = 0; j < INPUTS; ++j ) {
+		double const * w = weights + (size_t)j*NEURONS + k0;
+		double p = input[j];
+#pragma omp simd
+		for ( int c = 0; c < BLOCK; ++c ) acc[c] += w[c] * p;
+	}
+
+	double * y = output + k0;
+	for ( int c = 0; c < BLOCK; ++c ) y[c] = acc[c] + bias[k0+c];
+	fixed_activate<ACTIVATION>( y, BLOCK );
+}
+
+/**
+	Computes output = activation( input * weights + bias ) for a batch
+	of rows, for a layer of a size fixed at compile time
+
+	@param input row-major matrix of rows x INPUTS
+	@param rows number of rows
+	@param weights row-major INPUTS x NEURONS matrix
+	@param bias NEURONS values
+	@param output row-major matrix of rows x NEURONS, overwritten
+*/
+template <int INPUTS, int NEURONS, Activation ACTIVATION>
+void fixed_dense( double const * input, int rows, double const * weights,
+	double const * bias, double * output ) {
+
+	const int BLOCK = ( NEURONS < 16 ) ? NEURONS : 16;
+	const int FULL = NEURONS / BLOCK * BLOCK;
+	const int TAIL = ( NEURONS % BLOCK ) ? NEURONS % BLOCK : BLOCK; // unused when FULL == NEURONS
+	const int MR = 4;
+	const int row_tile = 64;
+
+	// same tiling as the dynamic kernels, so a block of weights
+	// stays in cache while a tile of rows goes past it
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < NEURONS; k0 += BLOCK ) {
+			int r = r0;
+			if ( k0 < FULL ) {
+				for ( ; r+MR <= r_end; r += MR ) {
+					fixed_dense_block4<INPUTS,NEURONS,ACTIVATION,BLOCK>( input + (size_t)r*INPUTS,
+						weights, bias, output + (size_t)r*NEURONS, k0 );
+				}
+				for ( ; r < r_end; ++r ) {
+					fixed_dense_block1<INPUTS,NEURONS,ACTIVATION,BLOCK>( input + (size_t)r*INPUTS,
+						weights, bias, output + (size_t)r*NEURONS, k0 );
+				}
+			} else {
+				for ( ; r < r_end; ++r ) {
+					fixed_dense_block1<INPUTS,NEURONS,ACTIVATION,TAIL>( input + (size_t)r*INPUTS,
+						weights, bias, output + (size_t)r*NEURONS, k0 );
+				}
+			}
+		}
+	}
+}
+
+/**
+	Same as above for a batch of sparse rows. Only the weights of
+	the stored inputs are read
+*/
+template <int INPUTS, int NEURONS, Activation ACTIVATION>
+void fixed_dense( SparseBatch const & input, int rows, double const * weights,
+	double const * bias, double * output ) {
+
+	// four blocks of neurons per pass over a row's inputs, so each
+	// input feeds several independent accumulators
+	const int BLOCK = ( NEURONS < 16 ) ? NEURONS : 16;
+	const int WIDE = 4*BLOCK;
+	const int FULL = NEURONS / WIDE * WIDE;
+
+	int const * row_start = input.row_start();
+	int const * columns = input.columns();
+	double const * values = input.values();
+
+	for ( int r = 0; r < rows; ++r ) {
+		int begin = row_start[r], end = row_start[r+1];
+		double * y = output + (size_t)r*NEURONS;
+
+		for ( int k0 = 0; k0 < FULL; k0 += WIDE ) {
+			double acc0[ BLOCK ] = {}, acc1[ BLOCK ] = {}, acc2[ BLOCK ] = {}, acc3[ BLOCK ] = {};
+			for ( int e = begin; e < end; ++e ) {
+				double const * w = weights + (size_t)columns[e]*NEURONS + k0;
+				double p = values[e];
+#pragma omp simd
+				for ( int c = 0; c < BLOCK; ++c ) {
+					acc0[c] += w[c] * p;
+					acc1[c] += w[BLOCK+c] * p;
+					acc2[c] += w[2*BLOCK+c] * p;
+					acc3[c] += w[3*BLOCK+c] * p;
+				}
+			}
+
+			double * acc[] = { acc0, acc1, acc2, acc3 };
+			for ( int b = 0; b < 4; ++b ) {
+				for ( int c = 0; c < BLOCK; ++c ) y[k0+b*BLOCK+c] = acc[b][c] + bias[k0+b*BLOCK+c];
+			}
+			fixed_activate<ACTIVATION>( y+k0, WIDE );
+		}
+
+		// leftover neurons, one at a time
+		for ( int k = FULL; k < NEURONS; ++k ) {
+			double acc = 0;
+			for ( int e = begin; e < end; ++e ) {
+				acc += weights[ (size_t)columns[e]*NEURONS + k ] * values[e];
+			}
+			y[k] = acc + bias[k];
+			fixed_activate<ACTIVATION>( y+k, 1 );
+		}
+	}
+}
+
+} // namespace
+} // namespace kernels
+} // namespace keras
+
+#endif // FIXEDDENSE_HH_
@@ -0,0 +1,84 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/InferenceContext.hh
+@brief Reusable scratch memory for running a KerasModel
+@details Layers alternate between two buffers, each sized for the
+widest layer in the model. Double and single precision inference
+each have their own pair, and int8 inference adds one buffer for
+the quantized input of the current layer. Buffers only grow, so once a context has
+seen its largest batch, inference does no heap allocation. A context
+must not be used by two threads at once; give each thread its own.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef INFERENCECONTEXT_HH_
+#define INFERENCECONTEXT_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include "keras/AlignedBuffer.hh"
+
+#include <cstddef>
+
+namespace keras {
+
+class ERRORX_API InferenceContext {
+
+public:
+	/**
+		Empty constructor - buffers are allocated on first use
+	*/
+	InferenceContext();
+
+	/**
+		Make sure each buffer holds at least a number of values.
+		Only allocates if it's more than any previous request
+
+		@param values number of doubles per buffer
+	*/
+	void reserve( size_t values );
+	void reserve_f32( size_t values );
+	void reserve_int8( size_t values );
+
+	/**
+		Get one of the two buffers
+
+		@param index 0 or 1
+
+		@return pointer to the start of the buffer
+	*/
+	double * buffer( int index );
+	float * buffer_f32( int index );
+
+	/**
+		Get the buffer for quantized layer inputs
+	*/
+	int8_t * buffer_int8();
+
+	/**
+		Number of values each buffer can hold without reallocating
+	*/
+	size_t capacity() const;
+
+private:
+	AlignedBuffer buffers_[ 2 ];
+	AlignedFloatBuffer buffers_f32_[ 2 ];
+	AlignedInt8Buffer buffer_int8_;
+};
+
+} // namespace keras
+
+#endif // INFERENCECONTEXT_HH_
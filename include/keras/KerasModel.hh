@@ -25,18 +25,26 @@ Code contained herein is proprietary and confidential.
 #include "ErrorXOptions.hh"
 #include "keras/DataChunk.hh"
 #include "keras/Layer.hh"
+#include "keras/InferenceContext.hh"
+#include "keras/SparseBatch.hh"
+#include "keras/DenseKernels.hh"
+
+#include <memory>
 
 using namespace std;
 typedef unsigned int uint;
 
 namespace keras {
 
+class LayerDense;
+
 class ERRORX_API KerasModel {
 
 public:
 	/**
 		Initialize a Keras model based on an ErrorXOptions object
-		Model file is assumed to be located at (errorx_base)/model.nnet
+		Model file is ErrorXOptions::model_file(), by default
+		(errorx_base)/model.nnet
 
 		@param options ErrorXOptions object
 	*/	
@@ -46,12 +54,76 @@ public:
 
 	KerasModel();
 
+	/**
+		Copy constructor and assignment - deep copy, each model
+		owns its own layers
+	*/
 	KerasModel( KerasModel const & other );
+	KerasModel & operator=( KerasModel const & other );
 
 	~KerasModel();
 
 	vector<double> compute_output( DataChunk* dc ) const;
 
+	/**
+		Run the model over a batch of samples in one pass. Each layer
+		processes the whole batch at once, so dense layers run as a
+		matrix-matrix product instead of one matrix-vector product
+		per sample.
+
+		@param input row-major block of rows x get_input_cols() values
+		@param rows number of samples in the block
+
+		@return row-major block of rows x get_output_length() values
+
+		@throws BadModel if input is not rows x get_input_cols()
+	*/
+	vector<double> compute_output_batch( vector<double> const & input, int rows ) const;
+
+	/**
+		Run the model over a batch of samples using preallocated
+		scratch memory, writing the result to caller-provided memory.
+		Once the context has grown to fit the batch this does no
+		heap allocation.
+
+		@param input row-major block of rows x get_input_cols() values
+		@param rows number of samples in the block
+		@param output row-major block of rows x get_output_length() values
+		@param context scratch buffers, reused across calls by one thread
+	*/
+	void compute_output_batch( double const * input, int rows,
+		double * output, InferenceContext & context ) const;
+
+	/**
+		Same as above in single precision. Weights are rounded to
+		float when the model is loaded, so results are close to but
+		not the same as the double precision version
+	*/
+	void compute_output_batch( float const * input, int rows,
+		float * output, InferenceContext & context ) const;
+
+	/**
+		Same as above for input given as sparse rows, e.g. one-hot
+		encodings. The first layer only reads the weights of the
+		stored inputs, and the result is identical to passing the
+		same rows in dense form
+
+		@param input batch of rows with get_input_cols() inputs
+		@param output row-major block of input.rows() x get_output_length() values
+		@param context scratch buffers, reused across calls by one thread
+
+		@throws BadModel if the first layer isn't dense
+	*/
+	void compute_output_batch( SparseBatch const & input,
+		double * output, InferenceContext & context ) const;
+
+	/**
+		Whether the first layer can take sparse input
+
+		@return true if the first layer is dense
+	*/
+	bool sparse_input() const;
+
 	uint get_input_rows() const;
 	uint get_input_cols() const;
 	int get_output_length() const;
@@ -59,9 +131,53 @@ public:
 	Layer* layer( int index ) const;
 	int no_layers() const;
 
+	/**
+		Number of steps the layers run as, after each element-wise
+		activation is fused into the dense layer before it
+	*/
+	int no_steps() const;
+
+	/**
+		Load a model from a file or a string. Either may hold the
+		text format or the binary format from ModelFile.hh, which
+		is detected automatically
+	*/
 	void load_weights( string const & input_fname );
 	void load_weights_from_string( string const & input_fname );
 
+	/**
+		Load a model in the binary format from memory. The memory
+		is only read during the call
+
+		@param data start of the model
+		@param size size of the model in bytes
+
+		@throws BadModel if the data is not a valid binary model
+	*/
+	void load_weights_from_buffer( char const * data, size_t size );
+
+	/**
+		Replace the model with layers built elsewhere, e.g. from
+		weights compiled into the library
+
+		@param layers newly allocated layers, owned by the model
+		from here on
+	*/
+	void set_layers( vector<Layer*> const & layers );
+
+	/**
+		How activation layers take exp. EXACT, the default, calls libm
+		and matches previous results exactly. FAST uses the vectorized
+		approximation from DenseKernels.hh, which agrees to about 1e-14.
+		Set before sharing the model, as it changes every activation
+		layer. Only relu, which is the same either way, is fused into
+		a dense layer in FAST mode
+
+		@param mode activation mode
+	*/
+	kernels::ActivationMode activation_mode() const;
+	void activation_mode( kernels::ActivationMode mode );
+
 	int verbose() const;
 	void verbose( int verbose );
 
@@ -69,12 +185,39 @@ private:
 	void load_weights_from_stream( istream & fin );
 	Layer* create_layer( string const & layer_name );
 
+	/**
+		Build the execution plan from the loaded layers. Activation
+		types are resolved once here rather than for every batch
+	*/
+	void compile();
+
+	template <typename T>
+	void run_plan( int first, T const * input, int rows, int cols,
+		T * output, T * buffer0, T * buffer1 ) const;
+
+	// one step of the plan: a layer, or a dense layer with
+	// the activation after it fused in
+	struct Step {
+		Layer const * layer;
+		LayerDense const * dense; // null unless layer is dense
+		kernels::Activation activation; // fused into dense
+		bool in_place;
+		int output_units;
+	};
+
 	int layers_cnt_; // number of layers
 	vector<Layer*> layers_; // container with layers
+	vector<Step> plan_; // what compute_output_batch runs
+	int max_width_; // widest layer input or output, for scratch buffers
+	kernels::ActivationMode activation_mode_;
 	int verbose_;
 
 };
 
+/// models are immutable once loaded, so one copy can be
+/// shared by every predictor and thread
+typedef shared_ptr<KerasModel const> KerasModelConstPtr;
+
 } // namespace keras
 
 #endif // KERASMODEL_HH_
\ No newline at end of file
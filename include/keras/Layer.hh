@@ -14,6 +14,7 @@ Code contained herein is proprietary and confidential.
 #include "keras/DataChunk.hh"
 
 #include <string>
+#include <vector>
 
 using namespace std;
 typedef unsigned int uint;
@@ -30,7 +31,7 @@ public:
 
 	virtual ~Layer() {}
 
-	string get_name() { return name_; }
+	string get_name() const { return name_; }
 
 	/**
 	===========================================================
@@ -44,6 +45,14 @@ public:
 	*/
 	virtual void load_weights( istream & fin ) = 0;
 
+	/**
+		Make a deep copy of this layer, including its weights.
+		Used by KerasModel to copy models without sharing layers
+
+		@return newly allocated copy, owned by the caller
+	*/
+	virtual Layer* clone() const = 0;
+
 	/**
 		Compute the output for this layer for an input data chunk
 
@@ -51,6 +60,31 @@ public:
 	*/
 	virtual keras::DataChunk* compute_output( DataChunk* dc ) = 0;
 
+	/**
+		Compute the output for a batch of samples at once into
+		caller-provided memory. Input and output are row-major
+		blocks with one sample per row.
+
+		@param input block of rows x cols values
+		@param output block of rows x (output width) values
+		@param rows number of samples in the batch
+		@param cols width of each input row
+	*/
+	virtual void compute_output_batch( double const * input, double * output,
+		int rows, int cols ) const = 0;
+
+	/**
+		Same as above in single precision
+	*/
+	virtual void compute_output_batch( float const * input, float * output,
+		int rows, int cols ) const = 0;
+
+	/**
+		Whether compute_output_batch accepts input == output, so
+		the layer can run in place without its own buffer
+	*/
+	virtual bool in_place() const { return false; }
+
 	/**
 		Get description of the layer architecture
 	*/	
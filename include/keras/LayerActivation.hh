@@ -13,6 +13,7 @@ Code contained herein is proprietary and confidential.
 
 #include "keras/Layer.hh"
 #include "keras/DataChunk.hh"
+#include "keras/DenseKernels.hh"
 
 using namespace std;
 
@@ -24,19 +25,50 @@ class LayerActivation : public Layer {
 public:
 	LayerActivation();
 
+	/**
+		Create an activation layer of a given type, e.g. relu
+
+		@param activation_type name of the activation function
+
+		@throws InvalidLayer if the activation isn't supported
+	*/
+	explicit LayerActivation( string const & activation_type );
+
+	/**
+		Getters. The activation is resolved from its name when the
+		layer is created or loaded
+	*/
+	string const & activation_type() const;
+	kernels::Activation activation() const;
+
+	/**
+		Whether exp is taken with libm (EXACT, the default) or the
+		vectorized approximation (FAST), see DenseKernels.hh
+	*/
+	kernels::ActivationMode mode() const;
+	void mode( kernels::ActivationMode mode );
+
 	/**
 	===========================================================
 	                    Pure virtual functions 
 	===========================================================
 	*/
 	void load_weights( istream & fin );
+	Layer* clone() const;
 	DataChunk* compute_output( DataChunk* dc );
+	void compute_output_batch( double const * input, double * output,
+		int rows, int cols ) const;
+	void compute_output_batch( float const * input, float * output,
+		int rows, int cols ) const;
+	bool in_place() const;
 	uint get_input_rows() const;
 	uint get_input_cols() const;
 	uint get_output_units() const;
 
 private:
 	string activation_type_;
+	kernels::Activation activation_;
+	kernels::ActivationMode mode_;
 
 };
 
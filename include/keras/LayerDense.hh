@@ -4,6 +4,16 @@ Code contained herein is proprietary and confidential.
 
 @file keras/LayerDense.hh
 @brief Dense layer for a neural network
+@details In model.nnet a dense layer is its size, one [ ... ] row of
+weights per input and a [ ... ] row of biases. A pruned layer may
+instead list only the blocks that aren't all zero:
+
+	inputs neurons blocks N
+	input panel [ weights of neurons panel*16 to panel*16+15 ]
+	... N lines in all, the last panel cut short at neurons ...
+	[ biases ]
+
+Weights that aren't listed are zero.
 @author Alex Sevy (alex@endeavorbio.com)
 */
 
@@ -13,6 +23,9 @@ Code contained herein is proprietary and confidential.
 
 #include "Layer.hh"
 #include "DataChunk.hh"
+#include "AlignedBuffer.hh"
+#include "SparseBatch.hh"
+#include "DenseKernels.hh"
 
 using namespace std;
 
@@ -21,25 +34,117 @@ namespace keras {
 class LayerDense : public Layer {
 
 public:
+	/**
+		Read-only view of a weight matrix stored in the
+		panel-packed layout used by the dense kernels
+	*/
+	class WeightsView {
+	public:
+		WeightsView( double const * packed, int inputs, int neurons );
+
+		/**
+			Weight connecting an input to a neuron
+		*/
+		double operator()( int input, int neuron ) const;
+
+		int inputs() const;
+		int neurons() const;
+
+	private:
+		double const * packed_;
+		int inputs_;
+		int neurons_;
+	};
+
 	LayerDense();
 
 	void print_weights();
 
+	/**
+		Getters for weights and biases
+	*/
+	WeightsView weights() const;
+	double bias( int neuron ) const;
+
+	/**
+		Fraction of weight blocks that aren't all zero, see the block-sparse
+		kernels in DenseKernels.hh. Pruned layers at or below
+		MAX_BLOCK_DENSITY run with a kernel that skips the zero blocks
+	*/
+	double block_density() const;
+	bool block_sparse() const;
+	static const double MAX_BLOCK_DENSITY;
+
+	/**
+		Set weights and biases directly, packing them for the kernels
+
+		@param weights row-major inputs x neurons matrix
+		@param bias one value per neuron
+		@param inputs number of inputs
+		@param neurons number of neurons
+	*/
+	void set_weights( double const * weights, double const * bias,
+		int inputs, int neurons );
+
+	/**
+		Same as compute_output_batch, with an element-wise activation
+		applied to each block of outputs as soon as it's computed
+		instead of in a separate pass. Gives the same result as this
+		layer followed by a LayerActivation
+
+		@param input row-major block of rows x get_input_cols() values
+		@param output row-major block of rows x get_output_units() values
+		@param rows number of samples in the block
+		@param activation activation to fuse, LINEAR for none
+	*/
+	void compute_output_fused( double const * input, double * output,
+		int rows, kernels::Activation activation ) const;
+	void compute_output_fused( float const * input, float * output,
+		int rows, kernels::Activation activation ) const;
+
+	/**
+		Same as compute_output_fused, for a batch of sparse rows.
+		Only the weights of the stored inputs are read, and the
+		result is identical to the dense version
+
+		@param input batch with columns less than get_input_cols()
+		@param output block of input.rows() x get_output_units() values
+		@param activation activation to fuse, LINEAR for none
+	*/
+	void compute_output_sparse( SparseBatch const & input, double * output,
+		kernels::Activation activation=kernels::LINEAR ) const;
+
 	/**
 	===========================================================
 	                    Pure virtual functions 
 	===========================================================
 	*/
 	void load_weights( istream & fin );
+	Layer* clone() const;
 
 	DataChunk* compute_output( DataChunk* dc );
+	void compute_output_batch( double const * input, double * output,
+		int rows, int cols ) const;
+	void compute_output_batch( float const * input, float * output,
+		int rows, int cols ) const;
 	uint get_input_rows() const;
 	uint get_input_cols() const;
 	uint get_output_units() const;
 
 private:
-	vector<vector<double>> weights_; //input, neuron
-	vector<double> bias_; // neuron
+	// weights packed into panels for the dense kernels, see
+	// kernels::pack_weights. Bias is padded to a whole panel
+	AlignedBuffer weights_;
+	AlignedBuffer bias_;
+	// the same, rounded to single precision
+	AlignedFloatBuffer weights_f32_;
+	AlignedFloatBuffer bias_f32_;
+	// the blocks of weights_ that aren't all zero, filled in
+	// when the layer is sparse enough to use them
+	vector<int> block_start_;
+	vector<int> block_inputs_;
+	AlignedBuffer blocks_;
+	int stored_blocks_;
 	int input_cnt_;
 	int neurons_;
 
@@ -0,0 +1,158 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/ModelFile.hh
+@brief Binary container for Keras models
+@details Reading model.nnet means parsing every weight from text, which
+is a large part of startup time. The binary format stores the same
+weights as raw little-endian values, so loading is a memory map, a
+checksum and a copy. All integers are little-endian.
+
+Header, 64 bytes:
+	0   char[8]  magic "ERRXNNB\0"
+	8   uint32   format version
+	12  uint32   number of layers
+	16  uint64   total file size in bytes
+	24  uint32   CRC-32 of the layer table
+	28  zero padding
+
+Layer table, 64 bytes per layer, directly after the header:
+	0   uint32   layer type, 1 = Dense, 2 = Activation
+	4   uint32   bytes per value, 8 = double, 4 = float, 0 = no data
+	8   uint32   number of inputs
+	12  uint32   number of neurons
+	16  uint64   offset of the layer data, a multiple of 64
+	24  uint64   size of the layer data in bytes
+	32  uint32   CRC-32 of the layer data
+	36  char[28] activation name, zero padded
+
+Dense layer data is the row-major inputs x neurons weight matrix
+followed by one bias per neuron.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef MODELFILE_HH_
+#define MODELFILE_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include "keras/Layer.hh"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+
+namespace keras {
+
+class KerasModel;
+
+namespace model_file {
+
+const unsigned VERSION = 1;
+const size_t ALIGNMENT = 64;
+const size_t HEADER_SIZE = 64;
+const size_t ENTRY_SIZE = 64;
+
+const unsigned DENSE = 1;
+const unsigned ACTIVATION = 2;
+
+/**
+	Check whether a block of memory starts like a binary model
+
+	@param data start of the block
+	@param size size of the block in bytes
+
+	@return true if the magic bytes match
+*/
+ERRORX_API bool is_binary( char const * data, size_t size );
+
+/**
+	Check whether a file is a binary model, by its first bytes
+
+	@param file path to the file
+
+	@return true if the file exists and is a binary model
+*/
+ERRORX_API bool is_binary_file( string const & file );
+
+/**
+	Read the layers of a binary model, checking the header,
+	bounds and checksums first
+
+	@param data start of the model
+	@param size size of the model in bytes
+
+	@return newly allocated layers, owned by the caller
+
+	@throws BadModel if the data is not a valid binary model
+*/
+ERRORX_API vector<Layer*> read( char const * data, size_t size );
+
+/**
+	Write a model in the binary format
+
+	@param model model to write
+	@param out binary output stream
+	@param value_bytes 8 to store doubles, 4 to store floats
+
+	@throws invalid_argument if value_bytes is not 4 or 8
+	@throws InvalidLayer if the model has a layer with no binary form
+*/
+ERRORX_API void write( KerasModel const & model, ostream & out, int value_bytes=8 );
+
+/**
+	Same as above, writing to a file
+*/
+ERRORX_API void write( KerasModel const & model, string const & file, int value_bytes=8 );
+
+} // namespace model_file
+
+/**
+	Read-only view of a whole file. Memory mapped where the
+	platform supports it, read into memory otherwise
+*/
+class ERRORX_API MappedFile {
+
+public:
+	/**
+		Map a file
+
+		@param file path to the file
+
+		@throws invalid_argument if the file can't be opened
+	*/
+	explicit MappedFile( string const & file );
+
+	~MappedFile();
+
+	char const * data() const;
+	size_t size() const;
+
+private:
+	MappedFile( MappedFile const & );
+	MappedFile & operator=( MappedFile const & );
+
+	char const * data_;
+	size_t size_;
+	bool mapped_;
+	vector<char> contents_; // used when mapping isn't available
+};
+
+} // namespace keras
+
+#endif // MODELFILE_HH_
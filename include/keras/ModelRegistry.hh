@@ -0,0 +1,101 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/ModelRegistry.hh
+@brief Process-wide cache of loaded Keras models
+@details Each model file is parsed once and shared as an immutable
+KerasModel by everything that asks for it. Inference on a shared
+model is thread-safe as long as each thread uses its own
+InferenceContext.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef MODELREGISTRY_HH_
+#define MODELREGISTRY_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include "ErrorXOptions.hh"
+#include "keras/KerasModel.hh"
+#include "keras/QuantizedModel.hh"
+
+#include <string>
+
+using namespace std;
+
+namespace keras {
+
+class ERRORX_API ModelRegistry {
+
+public:
+	/**
+		Get the model stored in a file, loading it on first use.
+		Paths that resolve to the same file share one model
+
+		@param file path to the model file
+		@param verbose verbosity used while reading the file
+
+		@return shared read-only model
+
+		@throws invalid_argument if the file does not exist
+		@throws BadModel if the file is malformed
+	*/
+	static KerasModelConstPtr get( string const & file, int verbose=1 );
+
+	/**
+		Get the model for a set of options, by default located
+		at (errorx_base)/model.nnet. If the file is missing and
+		the library has an embedded model, that's used instead
+		With fast activations the result is a copy of that model
+		in kernels::FAST mode, made once and shared like the rest
+
+		@param options ErrorXOptions object
+
+		@return shared read-only model
+	*/
+	static KerasModelConstPtr get( errorx::ErrorXOptions const & options );
+
+	/**
+		Get the int8 version of the default model, quantized with
+		the calibration in (errorx_base)/model.calib
+
+		@param options ErrorXOptions object
+
+		@return shared read-only quantized model
+
+		@throws invalid_argument if the calibration file does not exist
+	*/
+	static QuantizedModelConstPtr get_quantized( errorx::ErrorXOptions const & options );
+
+	/**
+		Number of models currently loaded, not counting
+		quantized or fast-activation versions
+	*/
+	static int size();
+
+	/**
+		Drop all cached models so the next call to get reads
+		from disk again. Models still held elsewhere stay alive
+		until their last owner releases them
+	*/
+	static void clear();
+
+private:
+	ModelRegistry();
+};
+
+} // namespace keras
+
+#endif // MODELREGISTRY_HH_
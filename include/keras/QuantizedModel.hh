@@ -0,0 +1,141 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/QuantizedModel.hh
+@brief Int8 quantized version of a KerasModel
+@details Dense layer weights are rounded to int8 with one scale per
+neuron, and the input to each dense layer is rounded to int8 with one
+scale per layer. The input scales come from a calibration run over real
+feature rows, stored next to the model as model.calib. Products are
+summed in 32-bit integers and converted back to float for the bias and
+activations, which run as in single precision.
+
+Calibration file, text:
+	calibration <number of dense layers>
+	dense <n> <largest expected absolute input to the nth dense layer>
+	...
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef QUANTIZEDMODEL_HH_
+#define QUANTIZEDMODEL_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include "keras/KerasModel.hh"
+#include "keras/AlignedBuffer.hh"
+#include "keras/DenseKernels.hh"
+#include "keras/InferenceContext.hh"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace keras {
+
+class ERRORX_API QuantizedModel {
+
+public:
+	/**
+		Quantize a model
+
+		@param model model to quantize, kept alive by this object
+		@param ranges largest expected absolute input of each dense
+		layer, in layer order, e.g. from calibrate or read_calibration
+
+		@throws BadModel if there isn't one range per dense layer
+	*/
+	QuantizedModel( KerasModelConstPtr model, vector<float> const & ranges );
+
+	/**
+		Run the model over a batch of samples. Same contract as
+		the float KerasModel::compute_output_batch
+
+		@param input row-major block of rows x get_input_cols() values
+		@param rows number of samples in the block
+		@param output row-major block of rows x get_output_length() values
+		@param context scratch buffers, reused across calls by one thread
+	*/
+	void compute_output_batch( float const * input, int rows,
+		float * output, InferenceContext & context ) const;
+
+	int get_input_cols() const;
+	int get_output_length() const;
+
+	/**
+		Getters
+	*/
+	KerasModelConstPtr model() const;
+	vector<float> const & ranges() const;
+
+	/**
+		Find the input range of each dense layer by running the model
+		in double precision over a sample of feature rows. Values above
+		the percentile are clipped at inference time, so one outlier
+		doesn't cost every other value its resolution
+
+		@param model model to calibrate
+		@param input row-major block of rows x get_input_cols() values
+		@param rows number of samples in the block
+		@param percentile percentile of absolute input values to keep,
+		between 0 and 100
+
+		@return one range per dense layer
+
+		@throws invalid_argument if percentile is out of range or
+		there are no rows
+	*/
+	static vector<float> calibrate( KerasModel const & model,
+		vector<double> const & input, int rows, double percentile=99.99 );
+
+	/**
+		Read and write calibration files
+
+		@throws invalid_argument if the file can't be opened
+		@throws BadModel if the file is malformed
+	*/
+	static vector<float> read_calibration( string const & file );
+	static void write_calibration( vector<float> const & ranges, string const & file );
+
+private:
+	// quantized form of one dense layer, empty for other layers
+	struct DenseLayer {
+		DenseLayer();
+
+		AlignedInt8Buffer weights; // see kernels::pack_weights_int8
+		AlignedInt32Buffer weight_sums;
+		AlignedFloatBuffer scale; // input scale * weight scale, per neuron
+		AlignedFloatBuffer bias;
+		float input_scale; // multiplier that maps the input range to 127
+		int inputs;
+		int padded_inputs;
+		int neurons;
+	};
+
+	KerasModelConstPtr model_;
+	vector<float> ranges_;
+	vector<DenseLayer> dense_; // one per layer of model_
+	kernels::DenseKernelInt8 kernel_;
+	int max_width_;
+	int max_padded_;
+};
+
+typedef shared_ptr<QuantizedModel const> QuantizedModelConstPtr;
+
+} // namespace keras
+
+#endif // QUANTIZEDMODEL_HH_
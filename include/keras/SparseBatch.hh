@@ -0,0 +1,79 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/SparseBatch.hh
+@brief Batch of mostly-zero input rows in compressed sparse row form
+@details Only the non-zero inputs of each row are stored, as a column
+index and a value, in ascending column order. Clearing keeps the
+memory, so a batch reused across calls stops allocating once it has
+seen its largest input.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+
+#ifndef SPARSEBATCH_HH_
+#define SPARSEBATCH_HH_
+
+/// manages dllexport and import for windows
+/// does nothing on Mac/Linux
+#if defined(_WIN32) || defined(_WIN64)
+#ifdef ERRORX_EXPORTS
+#define ERRORX_API __declspec(dllexport)
+#else
+#define ERRORX_API __declspec(dllimport)
+#endif
+#else
+#define ERRORX_API
+#endif
+
+#include <vector>
+
+using namespace std;
+
+namespace keras {
+
+class ERRORX_API SparseBatch {
+
+public:
+	/**
+		Empty constructor - a batch with no rows
+	*/
+	SparseBatch();
+
+	/**
+		Remove all rows, keeping the allocated memory
+	*/
+	void clear();
+
+	/**
+		Add an entry to the row being built. Columns must be
+		added in ascending order
+
+		@param column input index
+		@param value input value
+	*/
+	void add( int column, double value );
+
+	/**
+		Finish the row being built and start the next one
+	*/
+	void end_row();
+
+	/**
+		Getters. Row r has entries row_start()[r] to row_start()[r+1]-1
+	*/
+	int rows() const;
+	int const * row_start() const;
+	int const * columns() const;
+	double const * values() const;
+
+private:
+	vector<int> row_start_;
+	vector<int> columns_;
+	vector<double> values_;
+};
+
+} // namespace keras
+
+#endif // SPARSEBATCH_HH_
@@ -243,6 +243,28 @@ ERRORX_API boost::filesystem::path get_root_path();
 */
 ERRORX_API double phred_avg_realspace( vector<int> const & phred_arr );
 
+/**
+	Transform a single PHRED quality score into realspace.
+	Used by phred_avg_realspace, exposed so callers that
+	average many windows can transform each score once
+
+	@param phred PHRED quality score, should be >= 0
+
+	@return error probability corresponding to the score
+*/
+ERRORX_API double phred_to_realspace( int phred );
+
+/**
+	Transform a sum of realspace PHRED scores back to an
+	average in log space. Used by phred_avg_realspace
+
+	@param sum sum of realspace values from phred_to_realspace
+	@param count number of values in the sum
+
+	@return average PHRED score in log space
+*/
+ERRORX_API double phred_avg_from_realspace( double sum, int count );
+
 /**
 	Counts the number of lines in a file
 
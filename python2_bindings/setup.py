@@ -12,6 +12,7 @@ setup(name='ErrorX',
 			 'errorx_lib.pyd',
 			 'errorx_lib.so',
 			 'model.nnet',
+			 'model.calib',
 			 'bin/*',
 			 'database/Ig/human/*',
 			 'database/TCR/human/*',
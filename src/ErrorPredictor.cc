@@ -12,60 +12,334 @@ then this class is used to make a NN prediction
 #include "ErrorPredictor.hh"
 #include "ErrorXOptions.hh"
 #include "SequenceFeatures.hh"
+#include "FeatureExtractor.hh"
 #include "keras/KerasModel.hh"
-#include "keras/DataChunkFlat.hh"
+#include "keras/ModelRegistry.hh"
+#include "keras/EmbeddedModel.hh"
+#include "PredictionCache.hh"
 
 #include "util.hh"
+#include "constants.hh"
+#include "exceptions.hh"
+
+#include <atomic>
 
 using namespace std;
 
 namespace errorx {
 
+namespace {
+
+// shared by every predictor, like the models in ModelRegistry
+struct AtomicCascadeCounts {
+	atomic<long> screened;
+	atomic<long> forwarded;
+	atomic<long> validated;
+	atomic<long> disagreements;
+};
+
+AtomicCascadeCounts & cascade() {
+	static AtomicCascadeCounts counts = {};
+	return counts;
+}
+
+} // namespace
+
 ErrorPredictor::ErrorPredictor( ErrorXOptions const & options ) :
-		options_( options ),
-		keras_model_( options )
-{}
+		error_threshold_( options.error_threshold() ),
+		screen_lower_( options.screen_lower() ),
+		screen_upper_( options.screen_upper() ),
+		screen_validate_( options.screen_validate() ),
+		keras_model_( keras::ModelRegistry::get( options )),
+		quantized_model_( options.precision() == "int8" ?
+			keras::ModelRegistry::get_quantized( options ) : keras::QuantizedModelConstPtr() ),
+		single_precision_( options.precision() != "double" ),
+		sparse_input_( keras_model_->sparse_input() &&
+			keras_model_->get_input_cols() == constants::N_FEATURES ),
+		embedded_( !single_precision_ && keras::EmbeddedModel::matches( *keras_model_ ))
+{
+	if ( options.prediction_cache() ) cache_ = PredictionCache::get( options );
+	if ( options.screen_model().empty() ) return;
+
+	screen_model_ = keras::ModelRegistry::get( options.screen_model(), options.verbose() );
+	if ( screen_model_->get_input_cols() != constants::N_FEATURES || screen_model_->get_output_length() != 1 ) {
+		throw keras::BadModel( "Error: screening model "+options.screen_model()+" must take "+
+			to_string( constants::N_FEATURES )+" features and give one probability" );
+	}
+	if ( options.screen_lower() > options.screen_upper() ) {
+		throw invalid_argument( "Error: screen_lower must not be above screen_upper" );
+	}
+}
 
 ErrorPredictor::ErrorPredictor( ErrorPredictor const & other ) :
-		options_( other.options_ ),
-		keras_model_( other.options_ )
+		error_threshold_( other.error_threshold_ ),
+		screen_lower_( other.screen_lower_ ),
+		screen_upper_( other.screen_upper_ ),
+		screen_validate_( other.screen_validate_ ),
+		keras_model_( other.keras_model_ ),
+		quantized_model_( other.quantized_model_ ),
+		screen_model_( other.screen_model_ ),
+		cache_( other.cache_ ),
+		single_precision_( other.single_precision_ ),
+		sparse_input_( other.sparse_input_ ),
+		embedded_( other.embedded_ )
 {}
 
 
 
 double ErrorPredictor::apply_model( SequenceFeatures const & features ) const {
-	using namespace keras;
+	Workspace workspace;
+	return apply_model( features, workspace );
+}
+
+double ErrorPredictor::apply_model( SequenceFeatures const & features, Workspace & workspace ) const {
 	if ( features.is_germline() ) return 0.0;
 
-	const vector<double> feature_vector = features.get_feature_vector();
+	double row[ constants::N_FEATURES ];
+	features.fill_row( row );
 
-	DataChunkFlat* data = new DataChunkFlat();
+	PredictionCache::Key key;
+	double cached;
+	if ( cache_ ) {
+		key = cache_->key( row, constants::N_FEATURES );
+		if ( cache_->find( key, cached )) return cached;
+	}
 
-	data->set_data( feature_vector );
+	double output = predict_row( row, workspace );
+	if ( cache_ ) cache_->insert( key, output );
+	return output;
+}
+
+double ErrorPredictor::predict_row( double const * row, Workspace & workspace ) const {
+	keras::InferenceContext & context = workspace.context;
+	keras::AlignedFloatBuffer & batch_f32 = workspace.batch_f32;
 
-	vector<double> output = keras_model_.compute_output( data );
-	
-	return output[0];
-	
+	if ( single_precision_ ) {
+		batch_f32.resize( constants::N_FEATURES );
+		copy( row, row + constants::N_FEATURES, batch_f32.data() );
+
+		float output;
+		if ( quantized_model_ ) {
+			quantized_model_->compute_output_batch( batch_f32.data(), 1, &output, context );
+		} else {
+			keras_model_->compute_output_batch( batch_f32.data(), 1, &output, context );
+		}
+		return output;
+	}
+
+	double output;
+	if ( embedded_ ) {
+		keras::EmbeddedModel::compute_output_batch( row, 1, &output, context );
+	} else {
+		keras_model_->compute_output_batch( row, 1, &output, context );
+	}
+
+	return output;
 }
 
 vector<double> ErrorPredictor::apply_model( vector<vector<double>> const feature_vector ) const {
-	using namespace keras;
 
-	DataChunkFlat* data = new DataChunkFlat();
+	if ( feature_vector.empty() ) return vector<double>();
 
-	vector<double> output;
+	int rows = feature_vector.size();
+	int cols = feature_vector[0].size();
 
-	for ( int ii = 0; ii < feature_vector.size(); ++ii ) {
-		vector<double> const scaled_data = feature_vector[ii];
-		data->set_data( scaled_data );
-		vector<double> out = keras_model_.compute_output( data );
-		output.push_back( out[0] );
+	vector<double> batch;
+	batch.reserve( (size_t)rows*cols );
+	for ( int ii = 0; ii < rows; ++ii ) {
+		batch.insert( batch.end(), feature_vector[ii].begin(), feature_vector[ii].end() );
 	}
 
-	delete data;
+	return keras_model_->compute_output_batch( batch, rows );
+}
 
+vector<double> ErrorPredictor::apply_model_batch( FeatureExtractor const & features ) const {
+	vector<double> output( features.length() );
+	apply_model_batch( features, output.data() );
 	return output;
 }
 
+void ErrorPredictor::apply_model_batch( FeatureExtractor const & features, double * output ) const {
+	Workspace workspace;
+	apply_model_batch( features, output, workspace );
+}
+
+void ErrorPredictor::apply_model_batch( FeatureExtractor const & features, double * output,
+		Workspace & workspace ) const {
+
+	fill( output, output+features.length(), 0.0 );
+
+	// only non-germline positions get features and go through
+	// the network, the rest are never predicted as errors
+	vector<int> const & positions = features.mismatch_positions();
+	if ( positions.empty() ) return;
+
+	if ( !cache_ ) {
+		predict_screened( features, positions, output, workspace );
+		return;
+	}
+
+	// rows seen before take the stored prediction, the rest are
+	// predicted together and stored
+	int cols = constants::N_FEATURES;
+	vector<double> & cache_row = workspace.cache_row;
+	vector<int> & uncached = workspace.uncached;
+	vector<PredictionCache::Key> & cache_keys = workspace.cache_keys;
+	cache_row.resize( cols );
+	uncached.clear();
+	cache_keys.clear();
+	for ( int ii = 0; ii < positions.size(); ++ii ) {
+		features.fill_row( positions[ii], cache_row.data() );
+		PredictionCache::Key key = cache_->key( cache_row.data(), cols );
+		if ( !cache_->find( key, output[ positions[ii] ] )) {
+			uncached.push_back( positions[ii] );
+			cache_keys.push_back( key );
+		}
+	}
+	if ( uncached.empty() ) return;
+
+	predict_screened( features, uncached, output, workspace );
+	for ( int ii = 0; ii < uncached.size(); ++ii ) {
+		cache_->insert( cache_keys[ii], output[ uncached[ii] ] );
+	}
+}
+
+void ErrorPredictor::predict_screened( FeatureExtractor const & features,
+		vector<int> const & positions, double * output, Workspace & workspace ) const {
+
+	if ( !screen_model_ ) {
+		predict_positions( features, positions, output, workspace );
+		return;
+	}
+
+	keras::AlignedBuffer & screen_batch = workspace.screen_batch;
+	keras::AlignedBuffer & screen_predictions = workspace.screen_predictions;
+	vector<int> & forwarded = workspace.forwarded;
+	vector<double> & validation = workspace.validation;
+
+	// the screen scores every position, and the full network
+	// only sees the ones it can't call confidently
+	int rows = positions.size();
+	int cols = constants::N_FEATURES;
+	screen_batch.resize( (size_t)rows*cols );
+	screen_predictions.resize( rows );
+	for ( int ii = 0; ii < rows; ++ii ) {
+		features.fill_row( positions[ii], screen_batch.data() + (size_t)ii*cols );
+	}
+	screen_model_->compute_output_batch( screen_batch.data(), rows, screen_predictions.data(), workspace.context );
+
+	forwarded.clear();
+	for ( int ii = 0; ii < rows; ++ii ) {
+		double probability = screen_predictions[ ii ];
+		if ( probability < screen_lower_ || probability > screen_upper_ ) {
+			output[ positions[ii] ] = probability;
+		} else {
+			forwarded.push_back( positions[ii] );
+		}
+	}
+	if ( !forwarded.empty() ) predict_positions( features, forwarded, output, workspace );
+
+	cascade().screened += rows - forwarded.size();
+	cascade().forwarded += forwarded.size();
+
+	if ( !screen_validate_ || (int)forwarded.size() == rows ) return;
+
+	validation.assign( features.length(), 0.0 );
+	predict_positions( features, positions, validation.data(), workspace );
+
+	double threshold = error_threshold_;
+	long disagreements = 0;
+	for ( int ii = 0; ii < rows; ++ii ) {
+		int position = positions[ii];
+		if (( output[ position ] > threshold ) != ( validation[ position ] > threshold )) ++disagreements;
+	}
+	cascade().validated += rows - forwarded.size();
+	cascade().disagreements += disagreements;
+}
+
+void ErrorPredictor::predict_positions( FeatureExtractor const & features,
+		vector<int> const & positions, double * output, Workspace & workspace ) const {
+
+	int rows = positions.size();
+	int cols = constants::N_FEATURES;
+	keras::InferenceContext & context = workspace.context;
+	keras::AlignedBuffer & batch = workspace.batch;
+	keras::AlignedBuffer & predictions = workspace.predictions;
+	keras::AlignedFloatBuffer & batch_f32 = workspace.batch_f32;
+	keras::AlignedFloatBuffer & predictions_f32 = workspace.predictions_f32;
+	keras::SparseBatch & sparse_batch = workspace.sparse_batch;
+
+	if ( single_precision_ ) {
+		batch_f32.resize( (size_t)rows*cols );
+		predictions_f32.resize( rows );
+
+		for ( int ii = 0; ii < rows; ++ii ) {
+			features.fill_row( positions[ii], batch_f32.data() + (size_t)ii*cols );
+		}
+
+		if ( quantized_model_ ) {
+			quantized_model_->compute_output_batch( batch_f32.data(), rows, predictions_f32.data(), context );
+		} else {
+			keras_model_->compute_output_batch( batch_f32.data(), rows, predictions_f32.data(), context );
+		}
+
+		for ( int ii = 0; ii < rows; ++ii ) {
+			output[ positions[ii] ] = predictions_f32[ ii ];
+		}
+		return;
+	}
+
+	predictions.resize( rows );
+
+	if ( sparse_input_ ) {
+		sparse_batch.clear();
+		for ( int ii = 0; ii < rows; ++ii ) {
+			features.fill_row( positions[ii], sparse_batch );
+		}
+
+		if ( embedded_ ) {
+			keras::EmbeddedModel::compute_output_batch( sparse_batch, predictions.data(), context );
+		} else {
+			keras_model_->compute_output_batch( sparse_batch, predictions.data(), context );
+		}
+
+		for ( int ii = 0; ii < rows; ++ii ) {
+			output[ positions[ii] ] = predictions[ ii ];
+		}
+		return;
+	}
+
+	batch.resize( (size_t)rows*cols );
+
+	for ( int ii = 0; ii < rows; ++ii ) {
+		features.fill_row( positions[ii], batch.data() + (size_t)ii*cols );
+	}
+
+	if ( embedded_ ) {
+		keras::EmbeddedModel::compute_output_batch( batch.data(), rows, predictions.data(), context );
+	} else {
+		keras_model_->compute_output_batch( batch.data(), rows, predictions.data(), context );
+	}
+
+	for ( int ii = 0; ii < rows; ++ii ) {
+		output[ positions[ii] ] = predictions[ ii ];
+	}
+}
+
+ErrorPredictor::CascadeCounts ErrorPredictor::cascade_counts() {
+	CascadeCounts counts;
+	counts.screened = cascade().screened;
+	counts.forwarded = cascade().forwarded;
+	counts.validated = cascade().validated;
+	counts.disagreements = cascade().disagreements;
+	return counts;
+}
+
+void ErrorPredictor::reset_cascade_counts() {
+	cascade().screened = 0;
+	cascade().forwarded = 0;
+	cascade().validated = 0;
+	cascade().disagreements = 0;
+}
+
 } // namespace errorx
@@ -38,6 +38,17 @@ ErrorXOptions::ErrorXOptions() :
 	error_threshold_( constants::OPTIMIZED_THRESHOLD ),
 	allow_nonproductive_(0),
 	correction_('N'),
+	precision_("double"),
+	activations_("exact"),
+	model_file_(""),
+	screen_model_(""),
+	screen_lower_(0.05),
+	screen_upper_(1),
+	screen_validate_(0),
+	prediction_cache_(0),
+	cache_size_(64),
+	cache_resolution_(0),
+	chunk_size_(0),
 	infasta_(""),
 	igblast_output_(""),
 	trial_(0),
@@ -63,6 +74,18 @@ ErrorXOptions & ErrorXOptions::operator=( ErrorXOptions const & other ) {
 	error_threshold_ = other.error_threshold_;
 	allow_nonproductive_ = other.allow_nonproductive_;
 	correction_ = other.correction_;
+	precision_ = other.precision_;
+	activations_ = other.activations_;
+	model_file_ = other.model_file_;
+	screen_model_ = other.screen_model_;
+	screen_lower_ = other.screen_lower_;
+	screen_upper_ = other.screen_upper_;
+	screen_validate_ = other.screen_validate_;
+	prediction_cache_ = other.prediction_cache_;
+	cache_size_ = other.cache_size_;
+	cache_resolution_ = other.cache_resolution_;
+	executor_ = other.executor_;
+	chunk_size_ = other.chunk_size_;
 	infasta_ = other.infasta_;
 	igblast_output_ = other.igblast_output_;
 	errorx_base_ = other.errorx_base_;
@@ -84,6 +107,17 @@ ErrorXOptions::ErrorXOptions( string input_file, string file_format ) :
 	error_threshold_( constants::OPTIMIZED_THRESHOLD ),
 	allow_nonproductive_(0),
 	correction_('N'),
+	precision_("double"),
+	activations_("exact"),
+	model_file_(""),
+	screen_model_(""),
+	screen_lower_(0.05),
+	screen_upper_(1),
+	screen_validate_(0),
+	prediction_cache_(0),
+	cache_size_(64),
+	cache_resolution_(0),
+	chunk_size_(0),
 	infasta_(""),
 	igblast_output_(""),
 	trial_(0),
@@ -108,6 +142,18 @@ ErrorXOptions::ErrorXOptions( ErrorXOptions const & other ) :
 	error_threshold_(other.error_threshold_),
 	allow_nonproductive_(other.allow_nonproductive_),
 	correction_(other.correction_),
+	precision_(other.precision_),
+	activations_(other.activations_),
+	model_file_(other.model_file_),
+	screen_model_(other.screen_model_),
+	screen_lower_(other.screen_lower_),
+	screen_upper_(other.screen_upper_),
+	screen_validate_(other.screen_validate_),
+	prediction_cache_(other.prediction_cache_),
+	cache_size_(other.cache_size_),
+	cache_resolution_(other.cache_resolution_),
+	executor_(other.executor_),
+	chunk_size_(other.chunk_size_),
 	infasta_(other.infasta_),
 	igblast_output_(other.igblast_output_),
 	errorx_base_(other.errorx_base_),
@@ -349,6 +395,64 @@ void ErrorXOptions::igtype( string const & igtype ) {
 	igtype_ = igtype; 
 }
 
+void ErrorXOptions::precision( string const & precision ) { 
+	vector<string> valid_precisions = {"double", "single", "int8"};
+
+	if ( find( valid_precisions.begin(), valid_precisions.end(), precision )
+			== valid_precisions.end() ) {
+		string out_msg = "Error: invalid precision. Precision must be one of the following:\n";
+		for ( int ii = 0; ii < valid_precisions.size(); ++ii ) {
+			out_msg += valid_precisions[ii];
+			out_msg += " ";
+		}
+		throw invalid_argument(out_msg);
+	}
+	precision_ = precision; 
+}
+
+void ErrorXOptions::activations( string const & activations ) { 
+	vector<string> valid_activations = {"exact", "fast"};
+
+	if ( find( valid_activations.begin(), valid_activations.end(), activations )
+			== valid_activations.end() ) {
+		string out_msg = "Error: invalid activations. Activations must be one of the following:\n";
+		for ( int ii = 0; ii < valid_activations.size(); ++ii ) {
+			out_msg += valid_activations[ii];
+			out_msg += " ";
+		}
+		throw invalid_argument(out_msg);
+	}
+	activations_ = activations; 
+}
+
+void ErrorXOptions::screen_lower( double const & screen_lower ) {
+	if ( screen_lower < 0 || screen_lower > 1 ) {
+		throw invalid_argument("Error: screen_lower must be a probability between 0 and 1");
+	}
+	screen_lower_ = screen_lower;
+}
+
+void ErrorXOptions::screen_upper( double const & screen_upper ) {
+	if ( screen_upper < 0 || screen_upper > 1 ) {
+		throw invalid_argument("Error: screen_upper must be a probability between 0 and 1");
+	}
+	screen_upper_ = screen_upper;
+}
+
+void ErrorXOptions::cache_size( int const cache_size ) {
+	if ( cache_size < 1 ) {
+		throw invalid_argument("Error: cache_size must be a positive number of megabytes");
+	}
+	cache_size_ = cache_size;
+}
+
+void ErrorXOptions::cache_resolution( double const & cache_resolution ) {
+	if ( cache_resolution < 0 ) {
+		throw invalid_argument("Error: cache_resolution cannot be negative");
+	}
+	cache_resolution_ = cache_resolution;
+}
+
 void ErrorXOptions::nthreads( int const nthreads ) { 
 	if ( nthreads == -1 ) nthreads_ = thread::hardware_concurrency();
 	else if ( nthreads < 1) {
@@ -358,6 +462,15 @@ void ErrorXOptions::nthreads( int const nthreads ) {
 
 }
 
+void ErrorXOptions::executor( ExecutorPtr const & executor ) { executor_ = executor; }
+
+void ErrorXOptions::chunk_size( int const chunk_size ) {
+	if ( chunk_size < 0 ) {
+		throw invalid_argument("Error: chunk_size cannot be negative");
+	}
+	chunk_size_ = chunk_size;
+}
+
 void ErrorXOptions::increment( function<void(int,int)> const & increment ) {
 	increment_ = increment;
 }
@@ -389,6 +502,24 @@ char ErrorXOptions::correction() const { return correction_; }
 bool ErrorXOptions::trial() const { return trial_; }
 int ErrorXOptions::num_queries() const { return num_queries_; }
 bool ErrorXOptions::allow_nonproductive() const { return allow_nonproductive_; }
+string ErrorXOptions::precision() const { return precision_; }
+string ErrorXOptions::activations() const { return activations_; }
+string ErrorXOptions::model_file() const {
+	if ( !model_file_.empty() ) return model_file_;
+	return ( boost::filesystem::path( errorx_base_ ) / "model.nnet" ).string();
+}
+string ErrorXOptions::screen_model() const { return screen_model_; }
+double ErrorXOptions::screen_lower() const { return screen_lower_; }
+double ErrorXOptions::screen_upper() const { return screen_upper_; }
+bool ErrorXOptions::screen_validate() const { return screen_validate_; }
+bool ErrorXOptions::prediction_cache() const { return prediction_cache_; }
+int ErrorXOptions::cache_size() const { return cache_size_; }
+double ErrorXOptions::cache_resolution() const { return cache_resolution_; }
+ExecutorPtr ErrorXOptions::executor() const {
+	if ( executor_ ) return executor_;
+	return Executor::shared( nthreads_ );
+}
+int ErrorXOptions::chunk_size() const { return chunk_size_; }
 function<void(int,int)> ErrorXOptions::increment() const { return increment_; }
 function<void(void)> ErrorXOptions::reset() const { return reset_; }
 function<void(void)> ErrorXOptions::finish() const { return finish_; }
@@ -399,6 +530,10 @@ void ErrorXOptions::infile( string const & infile ) { infile_ = infile; }
 void ErrorXOptions::infasta( string const & infasta ) { infasta_ = infasta; }
 void ErrorXOptions::igblast_output( string const & igblast_output ) { igblast_output_ = igblast_output; }
 void ErrorXOptions::errorx_base( string const & errorx_base ) { errorx_base_ = errorx_base; }
+void ErrorXOptions::model_file( string const & model_file ) { model_file_ = model_file; }
+void ErrorXOptions::screen_model( string const & screen_model ) { screen_model_ = screen_model; }
+void ErrorXOptions::screen_validate( bool const screen_validate ) { screen_validate_ = screen_validate; }
+void ErrorXOptions::prediction_cache( bool const prediction_cache ) { prediction_cache_ = prediction_cache; }
 void ErrorXOptions::verbose( int const verbose ) { 
 	verbose_ = verbose; 
 	initialize_callback();
@@ -0,0 +1,136 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file Executor.cc
+@brief Persistent pool of worker threads shared by every stage
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "Executor.hh"
+
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+
+namespace errorx {
+
+namespace {
+
+// function-local statics, as in ModelRegistry
+mutex & executors_mutex() {
+	static mutex m;
+	return m;
+}
+
+map<int,ExecutorPtr> & executors() {
+	static map<int,ExecutorPtr> shared;
+	return shared;
+}
+
+thread_local bool worker_thread = false;
+
+} // namespace
+
+Executor::Executor( int nthreads ) :
+	nthreads_( nthreads ),
+	stopping_( false )
+{
+	if ( nthreads < 1 ) {
+		throw invalid_argument( "Error: an executor needs at least one thread" );
+	}
+	for ( int ii = 0; ii < nthreads_; ++ii ) {
+		threads_.push_back( thread( &Executor::work, this ));
+	}
+}
+
+Executor::~Executor() {
+	shutdown();
+}
+
+ExecutorPtr Executor::shared( int nthreads ) {
+	lock_guard<mutex> lock( executors_mutex() );
+	map<int,ExecutorPtr> & shared = executors();
+
+	map<int,ExecutorPtr>::const_iterator it = shared.find( nthreads );
+	if ( it != shared.end() ) return it->second;
+
+	ExecutorPtr executor( new Executor( nthreads ));
+	shared[ nthreads ] = executor;
+	return executor;
+}
+
+void Executor::shutdown_shared() {
+	map<int,ExecutorPtr> stopped;
+	{
+		lock_guard<mutex> lock( executors_mutex() );
+		stopped.swap( executors() );
+	}
+
+	// join outside the lock, since a job may still need a shared executor
+	for ( map<int,ExecutorPtr>::iterator it = stopped.begin(); it != stopped.end(); ++it ) {
+		it->second->shutdown();
+	}
+}
+
+future<void> Executor::submit( function<void()> const & job ) {
+	shared_ptr<packaged_task<void()>> task( new packaged_task<void()>( job ));
+	future<void> result = task->get_future();
+	{
+		lock_guard<mutex> lock( lock_ );
+		if ( stopping_ ) {
+			throw runtime_error( "Error: cannot submit a job to an executor that has been shut down" );
+		}
+		jobs_.push_back( task );
+	}
+	ready_.notify_one();
+	return result;
+}
+
+void Executor::shutdown() {
+	// held throughout, so two callers don't both join the threads
+	lock_guard<mutex> joining( shutdown_lock_ );
+	{
+		lock_guard<mutex> lock( lock_ );
+		stopping_ = true;
+	}
+	ready_.notify_all();
+
+	for ( int ii = 0; ii < threads_.size(); ++ii ) {
+		// a job that shuts down its own executor can't join itself
+		if ( threads_[ ii ].get_id() == this_thread::get_id() ) threads_[ ii ].detach();
+		else threads_[ ii ].join();
+	}
+	threads_.clear();
+}
+
+void Executor::work() {
+	worker_thread = true;
+
+	while ( true ) {
+		shared_ptr<packaged_task<void()>> task;
+		{
+			unique_lock<mutex> lock( lock_ );
+			ready_.wait( lock, [this]{ return stopping_ || !jobs_.empty(); });
+
+			// queued jobs still run after shutdown, so no future is left hanging
+			if ( jobs_.empty() ) return;
+			task = jobs_.front();
+			jobs_.pop_front();
+		}
+		// exceptions are stored in the future
+		(*task)();
+	}
+}
+
+int Executor::nthreads() const { return nthreads_; }
+
+bool Executor::running() const {
+	lock_guard<mutex> lock( lock_ );
+	return !stopping_;
+}
+
+bool Executor::on_worker_thread() { return worker_thread; }
+
+} // namespace errorx
@@ -0,0 +1,253 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file FeatureExtractor.cc
+@brief Calculates the features for every position of a sequence
+in a single pass
+@details SequenceFeatures computes the features for one position,
+re-reading the whole sequence each time. This class decodes the
+sequence and quality string once, computes the global metrics once,
+and uses prefix sums for the local windows, so the features for an
+entire read cost O(L). Output is identical to
+SequenceFeatures::get_feature_vector for every position.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "FeatureExtractor.hh"
+#include "ReadEncoding.hh"
+#include "SequenceRecord.hh"
+#include "util.hh"
+#include "constants.hh"
+#include "keras/SparseBatch.hh"
+
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+namespace errorx {
+
+FeatureExtractor::FeatureExtractor( SequenceRecord const & record ) {
+
+	int window = constants::WINDOW;
+
+	string full_nt_sequence = record.full_nt_sequence();
+	string full_gl_nt_sequence = record.full_gl_nt_sequence();
+	string phred_string = record.quality_string();
+
+	length_ = full_nt_sequence.size();
+	window_length_ = 2*window + 1;
+
+	if ( full_nt_sequence.size() != phred_string.size() ) {
+		throw invalid_argument(
+			"Internal error: NT sequence is not the same length as phred array "
+			"for sequence ID " + record.sequenceID()
+			);
+	}
+
+	if ( full_nt_sequence.size() != full_gl_nt_sequence.size() ) {
+		throw invalid_argument(
+			"Internal error: NT sequence is not the same length as germline sequence "
+			"for sequence ID " + record.sequenceID()
+			);
+	}
+
+	// an empty sequence has no positions to compute features for
+	if ( length_ > 0 && length_ < window ) {
+		throw invalid_argument("Error: sequence is too short for the window you requested");
+	}
+
+	int padded = length_ + 2*window;
+	nt_index_ = vector<int8_t>( padded, -1 );
+	gl_index_ = vector<int8_t>( padded, -1 );
+	phred_    = vector<int>( padded, -1 );
+	phred_realspace_ = vector<double>( padded, 0.0 );
+
+	gc_prefix_          = vector<int>( length_+1, 0 );
+	mutation_prefix_    = vector<int>( length_+1, 0 );
+	phred_count_prefix_ = vector<int>( length_+1, 0 );
+	is_germline_        = vector<bool>( length_, true );
+
+	// validate and decode the whole read up front, so an invalid
+	// read is rejected before any features are computed
+	encoding::encode_nucleotides( full_nt_sequence, &nt_index_[ window ],
+		"sequence of read "+record.sequenceID() );
+	encoding::encode_nucleotides( full_gl_nt_sequence, &gl_index_[ window ],
+		"germline sequence of read "+record.sequenceID() );
+	encoding::decode_phred( phred_string.data(), length_, &phred_[ window ] );
+
+	double quality_sum = 0;
+	int quality_count = 0;
+
+	for ( int ii = 0; ii < length_; ++ii ) {
+		int nt = nt_index_[ ii+window ];
+		int gl = gl_index_[ ii+window ];
+		int phred = phred_[ ii+window ];
+
+		if ( nt != gl ) {
+			is_germline_[ ii ] = false;
+			mismatch_positions_.push_back( ii );
+		}
+
+		bool mutation = ( nt != gl && gl != encoding::NT_GAP );
+		bool gc = ( nt == encoding::NT_G || nt == encoding::NT_C );
+
+		gc_prefix_[ ii+1 ]       = gc_prefix_[ ii ] + gc;
+		mutation_prefix_[ ii+1 ] = mutation_prefix_[ ii ] + mutation;
+		phred_count_prefix_[ ii+1 ] = phred_count_prefix_[ ii ] + ( phred >= 0 );
+
+		if ( phred >= 0 ) {
+			phred_realspace_[ ii+window ] = encoding::error_probability( phred );
+			quality_sum += phred_realspace_[ ii+window ];
+			quality_count++;
+		}
+	}
+
+	global_GC_pct_ = (double)gc_prefix_[ length_ ]/(double)length_;
+	global_SHM_    = (double)mutation_prefix_[ length_ ]/(double)length_;
+	global_quality_avg_ = util::phred_avg_from_realspace( quality_sum, quality_count );
+}
+
+FeatureExtractor::~FeatureExtractor() {}
+
+void FeatureExtractor::local_metrics( int position, double & local_gc,
+		double & local_quality, double & local_mutations ) const {
+
+	int window = constants::WINDOW;
+
+	// local window covers [position-window, position+window], clipped
+	// to the sequence. Positions past either end don't count towards
+	// the totals but still count towards the window length
+	int start = max( 0, position-window );
+	int end   = min( length_, position+window+1 );
+
+	int gc_count = gc_prefix_[ end ] - gc_prefix_[ start ];
+	int mutation_count = mutation_prefix_[ end ] - mutation_prefix_[ start ];
+	int local_count = phred_count_prefix_[ end ] - phred_count_prefix_[ start ];
+
+	// realspace values are summed in window order so the
+	// result rounds exactly like util::phred_avg_realspace
+	double local_sum = 0;
+	for ( int ii = start; ii < end; ++ii ) {
+		if ( phred_[ ii+window ] >= 0 ) local_sum += phred_realspace_[ ii+window ];
+	}
+
+	local_gc = (double)gc_count/(double)window_length_;
+	local_quality = util::phred_avg_from_realspace( local_sum, local_count );
+	local_mutations = (double)mutation_count/(double)window_length_;
+}
+
+void FeatureExtractor::fill_row( int position, double * row ) const {
+
+	int window = constants::WINDOW;
+
+	double local_gc, local_quality_avg, local_mutations;
+	local_metrics( position, local_gc, local_quality_avg, local_mutations );
+
+	row[ 0 ] = global_GC_pct_;
+	row[ 1 ] = local_gc;
+	row[ 2 ] = global_quality_avg_ / 40.0;
+	row[ 3 ] = local_quality_avg / 40.0;
+
+	// the innermost 9 positions of the window, i.e. position-4 to position+4,
+	// are one-hot encoded for the sequence and germline, and their
+	// quality scores are normalized
+	int inner = 4;
+	double * nt_row = row + 4;
+	double * phred_row = row + 58;
+	double * gl_row = row + 67;
+	fill( nt_row, nt_row+54, 0.0 );
+	fill( gl_row, gl_row+54, 0.0 );
+
+	for ( int ii = 0; ii < 2*inner+1; ++ii ) {
+		// index into the padded arrays
+		int padded = position + window - inner + ii;
+
+		if ( nt_index_[ padded ] >= 0 ) nt_row[ ii*6 + nt_index_[ padded ] ] = 1;
+		if ( gl_index_[ padded ] >= 0 ) gl_row[ ii*6 + gl_index_[ padded ] ] = 1;
+
+		// if the window extends before the beginning or after the end
+		// of the sequence, its placeholder value is -1
+		int phred = phred_[ padded ];
+		if ( phred >= 0 ) {
+			phred_row[ ii ] = phred / 40.0;
+		} else {
+			phred_row[ ii ] = phred;
+		}
+	}
+
+	row[ 121 ] = is_germline_[ position ];
+	row[ 122 ] = local_mutations;
+	row[ 123 ] = global_SHM_;
+}
+
+void FeatureExtractor::fill_row( int position, keras::SparseBatch & batch ) const {
+
+	int window = constants::WINDOW;
+	int inner = 4;
+	int first = position + window - inner; // padded index of the inner window
+
+	double local_gc, local_quality_avg, local_mutations;
+	local_metrics( position, local_gc, local_quality_avg, local_mutations );
+
+	// same columns as the dense row, in ascending order, leaving
+	// out the zeros of the one-hot encodings
+	batch.add( 0, global_GC_pct_ );
+	batch.add( 1, local_gc );
+	batch.add( 2, global_quality_avg_ / 40.0 );
+	batch.add( 3, local_quality_avg / 40.0 );
+
+	for ( int ii = 0; ii < 2*inner+1; ++ii ) {
+		int nt = nt_index_[ first+ii ];
+		if ( nt >= 0 ) batch.add( 4 + ii*6 + nt, 1 );
+	}
+
+	for ( int ii = 0; ii < 2*inner+1; ++ii ) {
+		int phred = phred_[ first+ii ];
+		batch.add( 58 + ii, ( phred >= 0 ) ? phred / 40.0 : phred );
+	}
+
+	for ( int ii = 0; ii < 2*inner+1; ++ii ) {
+		int gl = gl_index_[ first+ii ];
+		if ( gl >= 0 ) batch.add( 67 + ii*6 + gl, 1 );
+	}
+
+	batch.add( 121, is_germline_[ position ] );
+	batch.add( 122, local_mutations );
+	batch.add( 123, global_SHM_ );
+	batch.end_row();
+}
+
+void FeatureExtractor::fill_row( int position, float * row ) const {
+	// computed in double and rounded once, so a float row always
+	// matches the double row
+	double full[ constants::N_FEATURES ];
+	fill_row( position, full );
+	for ( int ii = 0; ii < constants::N_FEATURES; ++ii ) row[ ii ] = (float)full[ ii ];
+}
+
+vector<double> FeatureExtractor::get_feature_vector( int position ) const {
+	if ( position < 0 || position >= length_ ) {
+		throw invalid_argument(
+			"Error: position "+to_string(position)+" is out of bounds."
+			);
+	}
+
+	vector<double> feature_vector( constants::N_FEATURES );
+	fill_row( position, feature_vector.data() );
+	return feature_vector;
+}
+
+void FeatureExtractor::get_feature_matrix( vector<double> & matrix ) const {
+	matrix.resize( (size_t)length_*constants::N_FEATURES );
+	for ( int ii = 0; ii < length_; ++ii ) {
+		fill_row( ii, &matrix[ (size_t)ii*constants::N_FEATURES ] );
+	}
+}
+
+int FeatureExtractor::length() const { return length_; }
+bool FeatureExtractor::is_germline( int position ) const { return is_germline_[ position ]; }
+vector<int> const & FeatureExtractor::mismatch_positions() const { return mismatch_positions_; }
+
+} // namespace errorx
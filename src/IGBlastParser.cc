@@ -14,13 +14,16 @@ heavy lifting in terms of turning that output into a SequenceRecord object
 #include <fstream>
 #include <vector>
 #include <thread>
+#include <future>
 #include <chrono>
+#include <cstdlib> // getenv
 #include <regex> // regex_replace
 
 #include "IGBlastParser.hh"
 #include "SequenceRecords.hh"
 #include "SequenceRecord.hh"
 #include "ErrorXOptions.hh"
+#include "Executor.hh"
 #include "util.hh"
 #include "constants.hh"
 
@@ -36,7 +39,7 @@ IGBlastParser::IGBlastParser() :
 	thread_finished_(false)
 {}
 
-void IGBlastParser::blast( ErrorXOptions & options ) {
+void IGBlastParser::blast( ErrorXOptions & options, bool progress/*=true*/ ) {
 
 	namespace fs = boost::filesystem;
 
@@ -80,18 +83,42 @@ void IGBlastParser::blast( ErrorXOptions & options ) {
 	infile.close();
     if ( exists ) remove( options.igblast_output().c_str() );
 
-    // IGBlast needs an environmental variable called IGDATA pointing 
-    // to the path to database
-	util::set_env( "IGDATA", root.string() );
+	set_environment( options );
+
+	// nothing to track, so there's no need for a second thread
+	if ( !progress ) {
+		util::run_command( command );
+		return;
+	}
 
 	// TODO: FIGURE out a better way to capture output, since this doesn't work
 	thread_finished_ = false;
 
-	thread worker_thread = thread( &IGBlastParser::exec_in_thread, this, command );
-	
+	// a job on an executor thread can't queue IGBlast behind itself,
+	// since a pool of one thread would never reach it
+	if ( Executor::on_worker_thread() ) {
+		thread worker_thread = thread( &IGBlastParser::exec_in_thread, this, command );
+		track_progress( options );
+		worker_thread.join();
+		return;
+	}
+
+	future<void> igblast = options.executor()->submit(
+		bind( &IGBlastParser::exec_in_thread, this, command ));
+
 	track_progress( options );
-	
-	worker_thread.join();
+
+	igblast.get();
+}
+
+void IGBlastParser::set_environment( ErrorXOptions const & options ) {
+	// IGBlast needs an environmental variable called IGDATA pointing 
+	// to the path to database. setenv is not thread-safe, so it's
+	// skipped when the value is already right
+	string root = boost::filesystem::path( options.errorx_base() ).string();
+	char const * current = getenv( "IGDATA" );
+	if ( current && root == current ) return;
+	util::set_env( "IGDATA", root );
 }
 
 SequenceRecordsPtr IGBlastParser::parse_output( ErrorXOptions const & options  ) {
@@ -118,9 +145,7 @@ SequenceRecordsPtr IGBlastParser::parse_output( ErrorXOptions const & options  )
 
 
 		AbSequence sequence = parse_line( tokens, options );
-		SequenceRecordPtr record( new SequenceRecord( sequence ));
-
-		records->add_record( record );	
+		records->add_record( sequence );
 	}
 
 	return records;
@@ -167,7 +192,13 @@ void IGBlastParser::track_progress( ErrorXOptions const & options ) {
 void IGBlastParser::exec_in_thread( string command ) {
 	// TODO: come up with a more robust way to capture the output of this command
 	// system( command.c_str() );
-	util::run_command( command );
+	try {
+		util::run_command( command );
+	} catch ( ... ) {
+		// let track_progress return before the error is rethrown
+		thread_finished_ = true;
+		throw;
+	}
 	thread_finished_ = true;
 }
 
@@ -0,0 +1,172 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file PredictionCache.cc
+@brief Bounded, thread-safe cache of predictions by feature row
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "PredictionCache.hh"
+#include "ErrorXOptions.hh"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace errorx {
+
+namespace {
+
+// splitmix64 finalizer, spreads every input bit over the output
+inline uint64_t mix( uint64_t x ) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+// function-local statics, as in ModelRegistry
+mutex & caches_mutex() {
+	static mutex m;
+	return m;
+}
+
+map<string,PredictionCachePtr> & caches() {
+	static map<string,PredictionCachePtr> shared;
+	return shared;
+}
+
+// everything that changes a prediction, so predictors only
+// share a cache when they would compute the same values
+string signature( ErrorXOptions const & options ) {
+	ostringstream out;
+	out.precision( numeric_limits<double>::max_digits10 );
+	out << options.model_file() << "\n" << options.errorx_base() << "\n"
+		<< options.precision() << "\n" << options.activations() << "\n"
+		<< options.screen_model() << "\n" << options.screen_lower() << "\n"
+		<< options.screen_upper() << "\n" << options.cache_resolution();
+	return out.str();
+}
+
+} // namespace
+
+const size_t PredictionCache::BYTES_PER_ENTRY = 96;
+
+PredictionCache::PredictionCache( int megabytes, double resolution ) :
+	resolution_( resolution ),
+	shards_( new Shard[ SHARDS ] ),
+	hits_( 0 ),
+	misses_( 0 )
+{
+	if ( megabytes < 0 || resolution < 0 ) {
+		throw invalid_argument( "Error: cache size and resolution cannot be negative" );
+	}
+
+	size_t entries = (size_t)megabytes*1024*1024 / BYTES_PER_ENTRY;
+	shard_capacity_ = max( (size_t)1, entries / SHARDS );
+	for ( int ii = 0; ii < SHARDS; ++ii ) {
+		shards_[ ii ].entries.reserve( shard_capacity_ );
+		shards_[ ii ].next = 0;
+	}
+}
+
+PredictionCachePtr PredictionCache::get( ErrorXOptions const & options ) {
+	string key = signature( options );
+
+	lock_guard<mutex> lock( caches_mutex() );
+	map<string,PredictionCachePtr> & shared = caches();
+
+	map<string,PredictionCachePtr>::const_iterator it = shared.find( key );
+	if ( it != shared.end() ) return it->second;
+
+	PredictionCachePtr cache( new PredictionCache( options.cache_size(), options.cache_resolution() ));
+	shared[ key ] = cache;
+	return cache;
+}
+
+void PredictionCache::clear() {
+	lock_guard<mutex> lock( caches_mutex() );
+	caches().clear();
+}
+
+PredictionCache::Key PredictionCache::key( double const * row, int cols ) const {
+	Key key = { 0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL };
+	for ( int ii = 0; ii < cols; ++ii ) {
+		uint64_t bits;
+		if ( resolution_ > 0 ) {
+			bits = (uint64_t)(int64_t)llround( row[ ii ] / resolution_ );
+		} else {
+			// -0.0 and 0.0 give the same prediction
+			double value = ( row[ ii ] == 0 ) ? 0.0 : row[ ii ];
+			memcpy( &bits, &value, sizeof( bits ));
+		}
+		key.first = mix( key.first ^ bits );
+		key.second = mix( key.second + bits*0xff51afd7ed558ccdULL );
+	}
+	return key;
+}
+
+PredictionCache::Shard & PredictionCache::shard( Key const & key ) const {
+	// the map buckets on the low bits, so pick the shard from the high ones
+	return shards_[ key.first >> 58 ];
+}
+
+bool PredictionCache::find( Key const & key, double & value ) const {
+	Shard & s = shard( key );
+	{
+		lock_guard<mutex> lock( s.lock );
+		unordered_map<Key,double,KeyHash>::const_iterator it = s.entries.find( key );
+		if ( it != s.entries.end() ) {
+			value = it->second;
+			++hits_;
+			return true;
+		}
+	}
+	++misses_;
+	return false;
+}
+
+void PredictionCache::insert( Key const & key, double value ) {
+	Shard & s = shard( key );
+	lock_guard<mutex> lock( s.lock );
+	if ( !s.entries.insert( make_pair( key, value )).second ) return;
+
+	if ( s.order.size() < shard_capacity_ ) {
+		s.order.push_back( key );
+		return;
+	}
+
+	// full, so the oldest entry makes room
+	s.entries.erase( s.order[ s.next ] );
+	s.order[ s.next ] = key;
+	s.next = ( s.next+1 ) % shard_capacity_;
+}
+
+long PredictionCache::hits() const { return hits_; }
+long PredictionCache::misses() const { return misses_; }
+
+double PredictionCache::hit_rate() const {
+	long lookups = hits_ + misses_;
+	return ( lookups == 0 ) ? 0.0 : (double)hits_ / lookups;
+}
+
+size_t PredictionCache::size() const {
+	size_t entries = 0;
+	for ( int ii = 0; ii < SHARDS; ++ii ) {
+		lock_guard<mutex> lock( shards_[ ii ].lock );
+		entries += shards_[ ii ].entries.size();
+	}
+	return entries;
+}
+
+size_t PredictionCache::capacity() const { return shard_capacity_*SHARDS; }
+
+} // namespace errorx
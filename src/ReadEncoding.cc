@@ -0,0 +1,156 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file ReadEncoding.cc
+@brief Validates and encodes a whole read in one pass
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "ReadEncoding.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define ERRORX_SSE2_ENCODING
+#endif
+
+using namespace std;
+
+namespace errorx {
+namespace encoding {
+
+namespace {
+
+// PHRED scores from a printable quality string fall in [0,94),
+// so their error probabilities are computed once and reused
+const int PROBABILITY_TABLE_SIZE = 94;
+
+struct EncodingTables {
+	int8_t nt_code[ 256 ];
+	double probability[ PROBABILITY_TABLE_SIZE ];
+
+	EncodingTables() {
+		fill( nt_code, nt_code+256, -1 );
+		for ( int ii = 0; NUCLEOTIDES[ ii ] != '\0'; ++ii ) {
+			nt_code[ (unsigned char)NUCLEOTIDES[ ii ] ] = ii;
+		}
+
+		for ( int ii = 0; ii < PROBABILITY_TABLE_SIZE; ++ii ) {
+			probability[ ii ] = util::phred_to_realspace( ii );
+		}
+	}
+};
+
+EncodingTables const & tables() {
+	static const EncodingTables encoding_tables;
+	return encoding_tables;
+}
+
+} // namespace
+
+int nt_code( char nt ) {
+	return tables().nt_code[ (unsigned char)nt ];
+}
+
+int encode_nucleotides( char const * sequence, int length, int8_t * codes ) {
+	int ii = 0;
+
+#ifdef ERRORX_SSE2_ENCODING
+	const __m128i a   = _mm_set1_epi8( 'A' );
+	const __m128i t   = _mm_set1_epi8( 'T' );
+	const __m128i c   = _mm_set1_epi8( 'C' );
+	const __m128i g   = _mm_set1_epi8( 'G' );
+	const __m128i n   = _mm_set1_epi8( 'N' );
+	const __m128i gap = _mm_set1_epi8( '-' );
+
+	for ( ; ii+16 <= length; ii += 16 ) {
+		__m128i x = _mm_loadu_si128( (__m128i const *)( sequence+ii ));
+		__m128i is_a   = _mm_cmpeq_epi8( x, a );
+		__m128i is_t   = _mm_cmpeq_epi8( x, t );
+		__m128i is_c   = _mm_cmpeq_epi8( x, c );
+		__m128i is_g   = _mm_cmpeq_epi8( x, g );
+		__m128i is_n   = _mm_cmpeq_epi8( x, n );
+		__m128i is_gap = _mm_cmpeq_epi8( x, gap );
+
+		__m128i valid = _mm_or_si128(
+			_mm_or_si128( _mm_or_si128( is_a, is_t ), _mm_or_si128( is_c, is_g )),
+			_mm_or_si128( is_n, is_gap ));
+
+		// the scalar loop below finds the exact position
+		if ( _mm_movemask_epi8( valid ) != 0xFFFF ) break;
+
+		// each comparison is all ones where it matched, so masking
+		// it with the code of its nucleotide builds the codes
+		__m128i code = _mm_or_si128(
+			_mm_or_si128(
+				_mm_and_si128( is_t, _mm_set1_epi8( 1 )),
+				_mm_and_si128( is_c, _mm_set1_epi8( 2 ))),
+			_mm_or_si128(
+				_mm_or_si128(
+					_mm_and_si128( is_g, _mm_set1_epi8( 3 )),
+					_mm_and_si128( is_n, _mm_set1_epi8( 4 ))),
+				_mm_and_si128( is_gap, _mm_set1_epi8( 5 ))));
+		_mm_storeu_si128( (__m128i *)( codes+ii ), code );
+	}
+#endif
+
+	int8_t const * table = tables().nt_code;
+	for ( ; ii < length; ++ii ) {
+		int8_t code = table[ (unsigned char)sequence[ ii ]];
+		if ( code < 0 ) return ii;
+		codes[ ii ] = code;
+	}
+	return -1;
+}
+
+void encode_nucleotides( string const & sequence, int8_t * codes, string const & name ) {
+	int invalid = encode_nucleotides( sequence.data(), sequence.size(), codes );
+	if ( invalid >= 0 ) {
+		throw invalid_argument("Error: "+string(1, sequence[ invalid ])+" at position "+
+			to_string( invalid+1 )+" of the "+name+" is not a valid nucleotide. "
+			"Please make sure you are inputting DNA sequences for correction.");
+	}
+}
+
+void decode_phred( char const * quality, int length, int * phred ) {
+	int ii = 0;
+
+#ifdef ERRORX_SSE2_ENCODING
+	// characters are sign-extended like (int)char, so
+	// every score matches the scalar decoding
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i offset = _mm_set1_epi16( 33 );
+
+	for ( ; ii+16 <= length; ii += 16 ) {
+		__m128i x = _mm_loadu_si128( (__m128i const *)( quality+ii ));
+		__m128i sign = _mm_cmplt_epi8( x, zero );
+
+		__m128i low  = _mm_sub_epi16( _mm_unpacklo_epi8( x, sign ), offset );
+		__m128i high = _mm_sub_epi16( _mm_unpackhi_epi8( x, sign ), offset );
+		__m128i low_sign  = _mm_srai_epi16( low, 15 );
+		__m128i high_sign = _mm_srai_epi16( high, 15 );
+
+		__m128i * out = (__m128i *)( phred+ii );
+		_mm_storeu_si128( out,   _mm_unpacklo_epi16( low, low_sign ));
+		_mm_storeu_si128( out+1, _mm_unpackhi_epi16( low, low_sign ));
+		_mm_storeu_si128( out+2, _mm_unpacklo_epi16( high, high_sign ));
+		_mm_storeu_si128( out+3, _mm_unpackhi_epi16( high, high_sign ));
+	}
+#endif
+
+	for ( ; ii < length; ++ii ) {
+		phred[ ii ] = (int)quality[ ii ] - 33;
+	}
+}
+
+double error_probability( int phred ) {
+	if ( phred < PROBABILITY_TABLE_SIZE ) return tables().probability[ phred ];
+	return util::phred_to_realspace( phred );
+}
+
+} // namespace encoding
+} // namespace errorx
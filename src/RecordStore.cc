@@ -0,0 +1,303 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file RecordStore.cc
+@brief Column store that holds the data of many SequenceRecords
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "RecordStore.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "constants.hh"
+
+using namespace std;
+
+namespace errorx {
+
+RecordStore::RecordStore() :
+	size_( 0 ),
+	capacity_( 0 ),
+	block_size_( 0 ),
+	block_used_( 0 ),
+	arena_bytes_( 0 )
+{}
+
+RecordStore::~RecordStore() {}
+
+char * RecordStore::allocate( size_t bytes, size_t align ) {
+	lock_guard<mutex> lock( arena_lock_ );
+
+	size_t offset = ( block_used_ + align - 1 ) / align * align;
+	if ( blocks_.empty() || offset + bytes > block_size_ ) {
+		add_block( bytes );
+		offset = 0;
+	}
+
+	block_used_ = offset + bytes;
+	return blocks_.back().get() + offset;
+}
+
+void RecordStore::reserve( size_t bytes ) {
+	lock_guard<mutex> lock( arena_lock_ );
+	if ( !blocks_.empty() && block_used_ + bytes <= block_size_ ) return;
+	add_block( bytes );
+}
+
+void RecordStore::add_block( size_t bytes ) {
+	size_t next = ( blocks_.empty() ) ?
+		constants::ARENA_BLOCK_MIN :
+		min( block_size_*2, (size_t)constants::ARENA_BLOCK_MAX );
+	next = max( next, bytes );
+
+	blocks_.push_back( unique_ptr<char[]>( new char[ next ] ));
+	block_size_ = next;
+	block_used_ = 0;
+	arena_bytes_ += next;
+}
+
+void RecordStore::assign( Cell & cell, char const * data, int length, size_t align ) {
+	if ( length > cell.capacity ) {
+		cell.data = allocate( length, align );
+		cell.capacity = length;
+	}
+	if ( length > 0 ) memcpy( cell.data, data, length );
+	cell.length = length;
+}
+
+RecordStore::Cell & RecordStore::cell( int column, int row ) {
+	return cells_[ column*capacity_ + row ];
+}
+
+RecordStore::Cell const & RecordStore::cell( int column, int row ) const {
+	return cells_[ column*capacity_ + row ];
+}
+
+uint64_t & RecordStore::flag_word( Flag column, int row ) {
+	return flags_[ column*( ( capacity_+63 )/64 ) + row/64 ];
+}
+
+uint64_t RecordStore::flag_word( Flag column, int row ) const {
+	return flags_[ column*( ( capacity_+63 )/64 ) + row/64 ];
+}
+
+int RecordStore::add_row() {
+	// like a vector, the columns double when they're full. A store
+	// of one row has room for just that row
+	if ( size_ == capacity_ ) {
+		int capacity = max( 1, capacity_*2 );
+		int words = ( capacity+63 )/64;
+		int old_words = ( capacity_+63 )/64;
+
+		vector<Cell> cells( ( N_TEXT+1 )*capacity );
+		vector<double> numbers( N_NUMBER*capacity );
+		vector<int> integers( N_INTEGER*capacity );
+		vector<uint64_t> flags( N_FLAG*words, 0 );
+
+		for ( int ii = 0; ii <= N_TEXT; ++ii ) {
+			copy_n( cells_.begin() + ii*capacity_, size_, cells.begin() + ii*capacity );
+		}
+		for ( int ii = 0; ii < N_NUMBER; ++ii ) {
+			copy_n( numbers_.begin() + ii*capacity_, size_, numbers.begin() + ii*capacity );
+		}
+		for ( int ii = 0; ii < N_INTEGER; ++ii ) {
+			copy_n( integers_.begin() + ii*capacity_, size_, integers.begin() + ii*capacity );
+		}
+		for ( int ii = 0; ii < N_FLAG; ++ii ) {
+			copy_n( flags_.begin() + ii*old_words, old_words, flags.begin() + ii*words );
+		}
+
+		cells_.swap( cells );
+		numbers_.swap( numbers );
+		integers_.swap( integers );
+		flags_.swap( flags );
+		capacity_ = capacity;
+	}
+
+	int row = size_++;
+	Cell empty = { nullptr, 0, 0 };
+	for ( int ii = 0; ii <= N_TEXT; ++ii ) cell( ii, row ) = empty;
+	for ( int ii = 0; ii < N_NUMBER; ++ii ) numbers_[ ii*capacity_ + row ] = -1;
+	for ( int ii = 0; ii < N_INTEGER; ++ii ) integers_[ ii*capacity_ + row ] = 0;
+	for ( int ii = 0; ii < N_FLAG; ++ii ) flag( (Flag)ii, row, false );
+	return row;
+}
+
+int RecordStore::add( AbSequence const & sequence ) {
+	int row = add_row();
+
+	// in the order of the Text columns
+	string const * values[ N_TEXT ] = {
+		&sequence.sequenceID_,
+		&sequence.v_gene_, &sequence.d_gene_, &sequence.j_gene_,
+		&sequence.v_gl_nts_, &sequence.d_gl_nts_, &sequence.j_gl_nts_,
+		&sequence.chain_, &sequence.strand_,
+		&sequence.phred_, &sequence.phred_trimmed_,
+		&sequence.full_nt_sequence_, &sequence.full_gl_nt_sequence_, &sequence.full_aa_sequence_,
+		&sequence.cdr1_nt_sequence_, &sequence.cdr1_aa_sequence_,
+		&sequence.cdr2_nt_sequence_, &sequence.cdr2_aa_sequence_,
+		&sequence.cdr3_nt_sequence_, &sequence.cdr3_aa_sequence_,
+		&sequence.full_nt_sequence_corrected_, &sequence.full_aa_sequence_corrected_,
+		&sequence.failure_reason_
+	};
+
+	size_t bytes = 0;
+	for ( int ii = 0; ii < N_TEXT; ++ii ) bytes += values[ ii ]->size();
+	reserve( bytes );
+	for ( int ii = 0; ii < N_TEXT; ++ii ) text( (Text)ii, row, *values[ ii ] );
+
+	number( V_IDENTITY, row, sequence.v_identity_ );
+	number( D_IDENTITY, row, sequence.d_identity_ );
+	number( J_IDENTITY, row, sequence.j_identity_ );
+	number( V_EVALUE, row, sequence.v_evalue_ );
+	number( D_EVALUE, row, sequence.d_evalue_ );
+	number( J_EVALUE, row, sequence.j_evalue_ );
+
+	integer( GL_START, row, sequence.gl_start_ );
+	integer( TRANSLATION_FRAME, row, sequence.translation_frame_ );
+
+	flag( GOOD, row, sequence.good_ );
+	flag( PRODUCTIVE, row, sequence.productive_ );
+	flag( HAS_V, row, sequence.hasV_ );
+	flag( HAS_D, row, sequence.hasD_ );
+	flag( HAS_J, row, sequence.hasJ_ );
+
+	return row;
+}
+
+int RecordStore::add( RecordStore const & other, int row ) {
+	// other can be this store. Cells are copied by value and the
+	// arena never moves, so the source stays valid as rows are added
+	int new_row = add_row();
+
+	size_t bytes = other.cell( PREDICTIONS, row ).length*sizeof(double) + alignof(double);
+	for ( int ii = 0; ii < N_TEXT; ++ii ) bytes += max( other.cell( ii, row ).length, 0 );
+	reserve( bytes );
+
+	for ( int ii = 0; ii < N_TEXT; ++ii ) {
+		Cell source = other.cell( ii, row );
+		assign( cell( ii, new_row ), source.data, source.length, 1 );
+	}
+	for ( int ii = 0; ii < N_NUMBER; ++ii ) {
+		number( (Number)ii, new_row, other.number( (Number)ii, row ));
+	}
+	for ( int ii = 0; ii < N_INTEGER; ++ii ) {
+		integer( (Integer)ii, new_row, other.integer( (Integer)ii, row ));
+	}
+	for ( int ii = 0; ii < N_FLAG; ++ii ) {
+		flag( (Flag)ii, new_row, other.flag( (Flag)ii, row ));
+	}
+
+	Cell source = other.cell( PREDICTIONS, row );
+	Cell & target = cell( PREDICTIONS, new_row );
+	assign( target, source.data, source.length*sizeof(double), alignof(double) );
+	target.length = source.length;
+
+	return new_row;
+}
+
+AbSequence RecordStore::sequence( int row ) const {
+	AbSequence sequence;
+
+	sequence.sequenceID_ = text( SEQUENCE_ID, row );
+	sequence.v_gene_ = text( V_GENE, row );
+	sequence.d_gene_ = text( D_GENE, row );
+	sequence.j_gene_ = text( J_GENE, row );
+	sequence.v_gl_nts_ = text( V_GL_NTS, row );
+	sequence.d_gl_nts_ = text( D_GL_NTS, row );
+	sequence.j_gl_nts_ = text( J_GL_NTS, row );
+	sequence.chain_ = text( CHAIN, row );
+	sequence.strand_ = text( STRAND, row );
+	sequence.phred_ = text( PHRED, row );
+	sequence.phred_trimmed_ = text( PHRED_TRIMMED, row );
+	sequence.full_nt_sequence_ = text( FULL_NT, row );
+	sequence.full_gl_nt_sequence_ = text( FULL_GL_NT, row );
+	sequence.full_aa_sequence_ = text( FULL_AA, row );
+	sequence.cdr1_nt_sequence_ = text( CDR1_NT, row );
+	sequence.cdr1_aa_sequence_ = text( CDR1_AA, row );
+	sequence.cdr2_nt_sequence_ = text( CDR2_NT, row );
+	sequence.cdr2_aa_sequence_ = text( CDR2_AA, row );
+	sequence.cdr3_nt_sequence_ = text( CDR3_NT, row );
+	sequence.cdr3_aa_sequence_ = text( CDR3_AA, row );
+	sequence.full_nt_sequence_corrected_ = text( FULL_NT_CORRECTED, row );
+	sequence.full_aa_sequence_corrected_ = text( FULL_AA_CORRECTED, row );
+	sequence.failure_reason_ = text( FAILURE_REASON, row );
+
+	sequence.v_identity_ = number( V_IDENTITY, row );
+	sequence.d_identity_ = number( D_IDENTITY, row );
+	sequence.j_identity_ = number( J_IDENTITY, row );
+	sequence.v_evalue_ = number( V_EVALUE, row );
+	sequence.d_evalue_ = number( D_EVALUE, row );
+	sequence.j_evalue_ = number( J_EVALUE, row );
+
+	sequence.gl_start_ = integer( GL_START, row );
+	sequence.translation_frame_ = integer( TRANSLATION_FRAME, row );
+
+	sequence.good_ = flag( GOOD, row );
+	sequence.productive_ = flag( PRODUCTIVE, row );
+	sequence.hasV_ = flag( HAS_V, row );
+	sequence.hasD_ = flag( HAS_D, row );
+	sequence.hasJ_ = flag( HAS_J, row );
+
+	return sequence;
+}
+
+string RecordStore::text( Text column, int row ) const {
+	Cell const & text = cell( column, row );
+	if ( text.length < 0 ) return "N/A";
+	return string( text.data, text.length );
+}
+
+char const * RecordStore::data( Text column, int row ) const { return cell( column, row ).data; }
+int RecordStore::length( Text column, int row ) const { return cell( column, row ).length; }
+double RecordStore::number( Number column, int row ) const { return numbers_[ column*capacity_ + row ]; }
+int RecordStore::integer( Integer column, int row ) const { return integers_[ column*capacity_ + row ]; }
+
+bool RecordStore::flag( Flag column, int row ) const {
+	return ( flag_word( column, row ) >> ( row%64 )) & 1;
+}
+
+vector<double> RecordStore::predictions( int row ) const {
+	Cell const & predictions = cell( PREDICTIONS, row );
+	double const * values = reinterpret_cast<double const *>( predictions.data );
+	return vector<double>( values, values + predictions.length );
+}
+
+void RecordStore::text( Text column, int row, string const & value ) {
+	Cell & text = cell( column, row );
+	if ( value == "N/A" ) {
+		text.length = -1;
+	} else {
+		assign( text, value.data(), value.size(), 1 );
+	}
+}
+
+void RecordStore::number( Number column, int row, double value ) { numbers_[ column*capacity_ + row ] = value; }
+void RecordStore::integer( Integer column, int row, int value ) { integers_[ column*capacity_ + row ] = value; }
+
+void RecordStore::flag( Flag column, int row, bool value ) {
+	uint64_t bit = (uint64_t)1 << ( row%64 );
+	if ( value ) flag_word( column, row ) |= bit;
+	else flag_word( column, row ) &= ~bit;
+}
+
+void RecordStore::predictions( int row, vector<double> const & values ) {
+	// capacity is kept in bytes, and length in doubles
+	Cell & predictions = cell( PREDICTIONS, row );
+	assign( predictions, reinterpret_cast<char const *>( values.data() ),
+		values.size()*sizeof(double), alignof(double) );
+	predictions.length = values.size();
+}
+
+int RecordStore::size() const { return size_; }
+
+size_t RecordStore::arena_bytes() const {
+	lock_guard<mutex> lock( arena_lock_ );
+	return arena_bytes_;
+}
+
+} // namespace errorx
@@ -18,6 +18,7 @@ ErrorPredictor to do the actual transformation and prediction.
 
 #include "SequenceFeatures.hh"
 #include "SequenceRecord.hh"
+#include "ReadEncoding.hh"
 #include "util.hh"
 #include "constants.hh"
 
@@ -39,7 +40,7 @@ SequenceFeatures::SequenceFeatures( SequenceRecord const & record, int position
 
 
 	// Get an array of PHRED scores as int, not char
-	string phred_string = record.sequence().quality_string_trimmed();
+	string phred_string = record.quality_string();
 	vector<int> phred_array = vector<int>( phred_string.size() );
 
 	if ( full_nt_sequence.size() != phred_array.size() ) {
@@ -50,9 +51,7 @@ SequenceFeatures::SequenceFeatures( SequenceRecord const & record, int position
 	}
 
 	// decode quality string into an array of integer values
-	for ( int ii = 0; ii < phred_string.size(); ++ii ) {
-		phred_array[ii] = decode( phred_string[ ii ], 33 );
-	}
+	encoding::decode_phred( phred_string.data(), phred_string.size(), phred_array.data() );
 	// get a window of quality scores around the position of interest
 	quality_window_     = get_window( phred_array, position, window );
 	// calculate average phred scores in global and local scope
@@ -134,33 +133,33 @@ vector<int> SequenceFeatures::get_window( vector<int> const & array, int positio
 	return vector<int>( new_array.begin()+start, new_array.begin()+end+1 );
 }
 
-vector<int> SequenceFeatures::nt_to_binary( char nt ) const {
-	vector<int> array = {0,0,0,0,0,0};
-	vector<char> nts = {'A','T','C','G','N','-'};
-
+int SequenceFeatures::nt_index( char nt ) {
 	// X is used internally to denote when a window goes past the end
 	// or before the beginning of a sequence
-	if ( nt == 'X' ) return array;
-	if ( find( nts.begin(), nts.end(), nt )==nts.end() ) {
+	if ( nt == 'X' ) return -1;
+
+	int index = encoding::nt_code( nt );
+	if ( index < 0 ) {
 		throw invalid_argument("Error: "+string(1, nt)+" is not a valid nucleotide. "
 			"Please make sure you are inputting DNA sequences for correction.");
-	};
-
-	int index = distance( nts.begin(),
-				find( nts.begin(), nts.end(), nt ));
+	}
+	return index;
+}
 
-	array[ index ] = 1;
+vector<int> SequenceFeatures::nt_to_binary( char nt ) const {
+	vector<int> array = {0,0,0,0,0,0};
+	int index = nt_index( nt );
+	if ( index >= 0 ) array[ index ] = 1;
 	return array;
 }
 
 // Calculate binary encoding of nt sequences
 vector<int> SequenceFeatures::encode_sequence( string const & sequence ) const {
-	vector<int> bin_array;
-	vector<int> local_bin_array;
+	vector<int> bin_array( sequence.length()*6, 0 );
 
 	for ( int ii = 0; ii < sequence.length(); ++ii ) {
-		local_bin_array = nt_to_binary( sequence[ii] );
-		bin_array.insert( bin_array.end(), local_bin_array.begin(), local_bin_array.end() );
+		int index = nt_index( sequence[ii] );
+		if ( index >= 0 ) bin_array[ ii*6 + index ] = 1;
 	}
 	return bin_array;
 }
@@ -176,37 +175,43 @@ vector<double> SequenceFeatures::get_feature_vector() const {
 	 */
 
 
-	vector<double> feature_vector = {
-			global_GC_pct_,
-			local_GC_pct_,
-			global_quality_avg_ / 40.0, 
-			local_quality_avg_ / 40.0 
-		};
+	vector<double> feature_vector( constants::N_FEATURES );
+	fill_row( feature_vector.data() );
+	return feature_vector;
+}
 
-	feature_vector.insert( feature_vector.end(),
-			sequence_window_binary_.begin() + 24,
-			sequence_window_binary_.end()   - 24
-			);
+void SequenceFeatures::fill_row( double * row ) const { fill( row ); }
+void SequenceFeatures::fill_row( float * row ) const { fill( row ); }
+
+template <typename T>
+void SequenceFeatures::fill( T * row ) const {
+	// every value is computed in double and rounded once,
+	// so a float row always matches the double row
+	row[ 0 ] = global_GC_pct_;
+	row[ 1 ] = local_GC_pct_;
+	row[ 2 ] = global_quality_avg_ / 40.0;
+	row[ 3 ] = local_quality_avg_ / 40.0;
+
+	// only the innermost 9 positions of the window are encoded,
+	// which skips the outer 4 positions, or 24 binary values, per side
+	const int inner = 54;
+	int const * nt = sequence_window_binary_.data() + 24;
+	int const * gl = gl_sequence_window_binary_.data() + 24;
+	for ( int ii = 0; ii < inner; ++ii ) {
+		row[ 4+ii ]  = nt[ ii ];
+		row[ 67+ii ] = gl[ ii ];
+	}
 
-	for ( int ii = 4; ii < quality_window_.size() - 4; ++ii ) {
+	for ( int ii = 0; ii < 9; ++ii ) {
 		// if the window extends before the beginning or after the end
 		// of the sequence, its placeholder value is -1
-		if ( quality_window_[ ii ] >= 0 ) {
-			feature_vector.push_back( quality_window_[ ii ] / 40.0 );
-		} else {
-			feature_vector.push_back( quality_window_[ ii ] );
-		}
+		int phred = quality_window_[ ii+4 ];
+		row[ 58+ii ] = ( phred >= 0 ) ? phred / 40.0 : (double)phred;
 	}
 
-	feature_vector.insert( feature_vector.end(),
-			gl_sequence_window_binary_.begin() + 24,
-			gl_sequence_window_binary_.end()   - 24
-			);
-
-	feature_vector.push_back( is_germline_ );
-	feature_vector.push_back( local_SHM_ );
-	feature_vector.push_back( global_SHM_ );
-	return feature_vector;
+	row[ 121 ] = is_germline_;
+	row[ 122 ] = local_SHM_;
+	row[ 123 ] = global_SHM_;
 }
 
 // Returns pair consisting of (GC_pct, SHM)
@@ -222,10 +227,6 @@ pair<double,double> SequenceFeatures::calculate_metrics( string const & sequence
 	return pair<double,double> ( gc_pct, shm_pct );
 }
 
-int SequenceFeatures::decode( char qual, int base ) {
-	return (int)qual - base;
-}
-
 bool SequenceFeatures::is_germline() const { return is_germline_; }
 vector<int> SequenceFeatures::quality_window() const { return quality_window_; }
 
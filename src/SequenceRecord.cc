@@ -20,6 +20,7 @@ or directly from a SequenceQuery.
 #include "constants.hh"
 #include "util.hh"
 #include "AbSequence.hh"
+#include "FeatureExtractor.hh"
 
 #include <boost/lexical_cast.hpp>
 
@@ -27,87 +28,124 @@ using namespace std;
 
 namespace errorx {
 
+namespace {
+
+// gene name without the allele, as tokenizing on "*" gives it
+string noallele( string const & gene ) {
+	string trimmed = util::trim( gene );
+	return trimmed.substr( 0, trimmed.find( '*' ));
+}
+
+} // namespace
+
 SequenceRecord::SequenceRecord() :
-	sequence_(),
-	n_errors_( 0 )
+	store_( make_shared<RecordStore>() ),
+	row_( store_->add( AbSequence() ))
 {}
 
 SequenceRecord::~SequenceRecord() {}
 
 
+// make_shared puts the store and its count in one allocation
 SequenceRecord::SequenceRecord(SequenceRecord const & other) :
-	sequence_( other.sequence_ ),
-	n_errors_( other.n_errors_ ),
-	predicted_errors_all_( other.predicted_errors_all_ )
+	store_( make_shared<RecordStore>() ),
+	row_( store_->add( *other.store_, other.row_ ))
 {}
 
+SequenceRecord & SequenceRecord::operator=( SequenceRecord const & other ) {
+	if ( this != &other ) {
+		RecordStorePtr store = make_shared<RecordStore>();
+		row_ = store->add( *other.store_, other.row_ );
+		store_ = store;
+	}
+	return *this;
+}
+
+SequenceRecord::SequenceRecord( RecordStorePtr const & store, int row ) :
+	store_( store ),
+	row_( row )
+{
+	if ( row < 0 || row >= store->size() ) {
+		throw out_of_range(
+				"Error: index out of bounds. Requested row "+
+				to_string(row) + " and only " +
+				to_string(store->size()) + " rows exist."
+		);
+	}
+}
+
 SequenceRecord::SequenceRecord( SequenceQuery & query ) : 
-	sequence_(),
-	n_errors_( 0 )
+	store_( make_shared<RecordStore>() )
 {
-	sequence_.sequenceID( query.sequenceID() );
-	sequence_.full_nt_sequence( query.sequence() );
-	sequence_.full_gl_nt_sequence( query.germline_sequence() );
-	sequence_.quality_string_trimmed( query.phred_string() );
+	AbSequence sequence;
+	sequence.sequenceID( query.sequenceID() );
+	sequence.full_nt_sequence( query.sequence() );
+	sequence.full_gl_nt_sequence( query.germline_sequence() );
+	sequence.quality_string_trimmed( query.phred_string() );
 
+	row_ = store_->add( sequence );
 }
 
 SequenceRecord::SequenceRecord( AbSequence const & sequence ) :
-	sequence_( sequence ),
-	n_errors_( 0 )
+	store_( make_shared<RecordStore>() ),
+	row_( store_->add( sequence ))
 {}
 
-SequenceRecord::SequenceRecord( vector<string> const & items ) {
+SequenceRecord::SequenceRecord( vector<string> const & items ) :
+	store_( make_shared<RecordStore>() )
+{
 	if ( items.size() != util::get_labels().size() ) {
 		throw invalid_argument( "AbSequence built from an incorrect items vector" );
 	}
 
-	sequence_.sequenceID_ = items[0];
-	sequence_.v_gene_     = items[1];
-	sequence_.v_identity_ = ( items[2]=="N/A" ) ? -1 : stod( items[2] );
-	sequence_.v_evalue_   = ( items[3]=="N/A" ) ? -1 : stod( items[3] );
+	AbSequence sequence;
+	sequence.sequenceID_ = items[0];
+	sequence.v_gene_     = items[1];
+	sequence.v_identity_ = ( items[2]=="N/A" ) ? -1 : stod( items[2] );
+	sequence.v_evalue_   = ( items[3]=="N/A" ) ? -1 : stod( items[3] );
 
-	sequence_.d_gene_     = items[4];
-	sequence_.d_identity_ = ( items[5]=="N/A" ) ? -1 : stod( items[5] );
-	sequence_.d_evalue_   = ( items[6]=="N/A" ) ? -1 : stod( items[6] );
+	sequence.d_gene_     = items[4];
+	sequence.d_identity_ = ( items[5]=="N/A" ) ? -1 : stod( items[5] );
+	sequence.d_evalue_   = ( items[6]=="N/A" ) ? -1 : stod( items[6] );
 
-	sequence_.j_gene_     = items[7];
-	sequence_.j_identity_ = ( items[8]=="N/A" ) ? -1 : stod( items[8] );
-	sequence_.j_evalue_   = ( items[9]=="N/A" ) ? -1 : stod( items[9] );
+	sequence.j_gene_     = items[7];
+	sequence.j_identity_ = ( items[8]=="N/A" ) ? -1 : stod( items[8] );
+	sequence.j_evalue_   = ( items[9]=="N/A" ) ? -1 : stod( items[9] );
 
-	sequence_.strand_     = items[10];
-	sequence_.chain_      = items[11];
-	sequence_.productive_ = (items[12]=="True");
+	sequence.strand_     = items[10];
+	sequence.chain_      = items[11];
+	sequence.productive_ = (items[12]=="True");
 	
-	sequence_.cdr1_nt_sequence_ = items[13];
-	sequence_.cdr1_aa_sequence_ = items[14];
+	sequence.cdr1_nt_sequence_ = items[13];
+	sequence.cdr1_aa_sequence_ = items[14];
 
-	sequence_.cdr2_nt_sequence_ = items[15];
-	sequence_.cdr2_aa_sequence_ = items[16];
+	sequence.cdr2_nt_sequence_ = items[15];
+	sequence.cdr2_aa_sequence_ = items[16];
 
 
-	sequence_.cdr3_nt_sequence_ = items[17];
-	sequence_.cdr3_aa_sequence_ = items[18];
+	sequence.cdr3_nt_sequence_ = items[17];
+	sequence.cdr3_aa_sequence_ = items[18];
 
-	sequence_.full_nt_sequence_ = items[19];
-	sequence_.full_gl_nt_sequence_ = items[20];
-	sequence_.phred_trimmed_ = items[21];
-	sequence_.full_aa_sequence_ = items[22];
+	sequence.full_nt_sequence_ = items[19];
+	sequence.full_gl_nt_sequence_ = items[20];
+	sequence.phred_trimmed_ = items[21];
+	sequence.full_aa_sequence_ = items[22];
 
-	sequence_.full_nt_sequence_corrected_ = items[23];
-	sequence_.full_aa_sequence_corrected_ = items[24];
+	sequence.full_nt_sequence_corrected_ = items[23];
+	sequence.full_aa_sequence_corrected_ = items[24];
 
-	n_errors_ = ( items[25]=="N/A" ) ? -1 : stoi( items[25] );
+	sequence.hasV_ = ( sequence.v_gene_!="N/A" );
+	sequence.hasD_ = ( sequence.d_gene_!="N/A" );
+	sequence.hasJ_ = ( sequence.j_gene_!="N/A" );
 
-	sequence_.hasV_ = ( sequence_.v_gene_!="N/A" );
-	sequence_.hasD_ = ( sequence_.d_gene_!="N/A" );
-	sequence_.hasJ_ = ( sequence_.j_gene_!="N/A" );
+	row_ = store_->add( sequence );
+	store_->integer( RecordStore::N_ERRORS, row_, ( items[25]=="N/A" ) ? -1 : stoi( items[25] ));
 }
 
 bool SequenceRecord::operator==( SequenceRecord const & other ) const {
-	return sequence_==other.sequence_ && 
-			n_errors_==other.n_errors_ &&
-			predicted_errors_all_==other.predicted_errors_all_;
+	return sequence()==other.sequence() && 
+			n_errors()==other.n_errors() &&
+			store_->predictions( row_ )==other.store_->predictions( other.row_ );
 }
 
 bool SequenceRecord::operator!=( SequenceRecord const & other ) const {
@@ -119,48 +157,53 @@ bool SequenceRecord::equals( shared_ptr<SequenceRecord> const & other ) const {
 }
 
 void SequenceRecord::print() const {
-	sequence_.print();
+	sequence().print();
 }
 
 vector<string> SequenceRecord::get_summary( bool fulldata/*=1*/ ) const {
+	RecordStore const & store = *store_;
+	bool hasV = store.flag( RecordStore::HAS_V, row_ );
+	bool hasD = store.flag( RecordStore::HAS_D, row_ );
+	bool hasJ = store.flag( RecordStore::HAS_J, row_ );
+
 	if ( fulldata ) {
 		return vector<string> {
-			sequence_.sequenceID(),
-			sequence_.v_gene(),
-			sequence_.v_identity_fmt(),
-			sequence_.v_evalue_fmt(),
-			sequence_.d_gene(),
-			sequence_.d_identity_fmt(),
-			sequence_.d_evalue_fmt(),
-			sequence_.j_gene(),
-			sequence_.j_identity_fmt(),
-			sequence_.j_evalue_fmt(),
-			sequence_.strand(),
-			sequence_.chain(),
-			sequence_.productive_fmt(),
-			sequence_.cdr1_nt_sequence(),
-			sequence_.cdr1_aa_sequence(),
-			sequence_.cdr2_nt_sequence(),
-			sequence_.cdr2_aa_sequence(),
-			sequence_.cdr3_nt_sequence(),
-			sequence_.cdr3_aa_sequence(),
-			sequence_.full_nt_sequence(),
-			sequence_.full_gl_nt_sequence(),
-			sequence_.quality_string_trimmed(),
-			sequence_.full_aa_sequence(),
-			sequence_.full_nt_sequence_corrected(),
-			sequence_.full_aa_sequence_corrected(),
-			to_string( n_errors_ )
+			sequenceID(),
+			v_gene(),
+			(hasV) ? util::rounded_string( store.number( RecordStore::V_IDENTITY, row_ )) : "N/A",
+			(hasV) ? util::to_scientific( store.number( RecordStore::V_EVALUE, row_ )) : "N/A",
+			d_gene(),
+			(hasD) ? util::rounded_string( store.number( RecordStore::D_IDENTITY, row_ )) : "N/A",
+			(hasD) ? util::to_scientific( store.number( RecordStore::D_EVALUE, row_ )) : "N/A",
+			j_gene(),
+			(hasJ) ? util::rounded_string( store.number( RecordStore::J_IDENTITY, row_ )) : "N/A",
+			(hasJ) ? util::to_scientific( store.number( RecordStore::J_EVALUE, row_ )) : "N/A",
+			store.text( RecordStore::STRAND, row_ ),
+			chain(),
+			(productive()) ? "True" : "False",
+			shown( RecordStore::CDR1_NT ),
+			shown( RecordStore::CDR1_AA ),
+			shown( RecordStore::CDR2_NT ),
+			shown( RecordStore::CDR2_AA ),
+			shown( RecordStore::CDR3_NT ),
+			shown( RecordStore::CDR3_AA ),
+			full_nt_sequence(),
+			full_gl_nt_sequence(),
+			quality_string(),
+			full_aa_sequence(),
+			full_nt_sequence_corrected(),
+			full_aa_sequence_corrected(),
+			to_string( n_errors() )
 		};
 	} else {
 		return vector<string> {
-			sequence_.sequenceID(),
-			sequence_.v_gene(),
-			sequence_.d_gene(),
-			sequence_.j_gene(),
-			sequence_.full_nt_sequence(),
-			sequence_.full_nt_sequence_corrected(),
-			to_string( n_errors_ )
+			sequenceID(),
+			v_gene(),
+			d_gene(),
+			j_gene(),
+			full_nt_sequence(),
+			full_nt_sequence_corrected(),
+			to_string( n_errors() )
 		};
 	}
 }
@@ -169,91 +212,122 @@ vector<string> SequenceRecord::get_summary( bool fulldata/*=1*/ ) const {
 void SequenceRecord::correct_sequence(
 		ErrorPredictor const & predictor,
 		ErrorXOptions const & options ) {
+	ErrorPredictor::Workspace workspace;
+	correct_sequence( predictor, workspace, options );
+}
+
+void SequenceRecord::correct_sequence(
+		ErrorPredictor const & predictor,
+		ErrorPredictor::Workspace & workspace,
+		ErrorXOptions const & options ) {
 	if ( !isGood() ) return;
 
-	predict_errors( predictor, options );
+	predict_errors( predictor, workspace, options );
+	apply_predictions( options );
+}
 
-	int position;
-	double probability;
-	string full_nt_sequence_corrected = sequence_.full_nt_sequence();
-	n_errors_ = 0;
+void SequenceRecord::correct_sequence(
+		SequenceRecord const & duplicate,
+		ErrorXOptions const & options ) {
+	if ( !isGood() ) return;
+
+	store_->predictions( row_, duplicate.store_->predictions( duplicate.row_ ));
+	apply_predictions( options );
+}
 
-	for ( int ii = 0; ii < predicted_errors_all_.size(); ++ii ) {
-		position = predicted_errors_all_[ ii ].first;
-		probability = predicted_errors_all_[ ii ].second;
+void SequenceRecord::apply_predictions( ErrorXOptions const & options ) {
+	vector<double> probabilities = store_->predictions( row_ );
+	string full_nt_sequence_corrected = full_nt_sequence();
+	int n_errors = 0;
 
-		if ( probability > options.error_threshold() ) {
-			full_nt_sequence_corrected[ position ] = options.correction();
-			++n_errors_;
+	for ( int ii = 0; ii < probabilities.size(); ++ii ) {
+		if ( probabilities[ ii ] > options.error_threshold() ) {
+			full_nt_sequence_corrected[ ii ] = options.correction();
+			++n_errors;
 		}
 	}
 
-	sequence_.full_nt_sequence_corrected( full_nt_sequence_corrected );
+	store_->integer( RecordStore::N_ERRORS, row_, n_errors );
+	store_->text( RecordStore::FULL_NT_CORRECTED, row_, full_nt_sequence_corrected );
 
-	if ( sequence_.full_aa_sequence() != "N/A" ) {
+	if ( full_aa_sequence() != "N/A" ) {
 
-		sequence_.full_aa_sequence_corrected( 
-			util::translate( full_nt_sequence_corrected, sequence_.translation_frame() )
+		store_->text( RecordStore::FULL_AA_CORRECTED, row_,
+			util::translate( full_nt_sequence_corrected, translation_frame() )
 		);
 	}
 }
 
 void SequenceRecord::predict_errors( ErrorPredictor const & predictor,
+		ErrorPredictor::Workspace & workspace,
 		ErrorXOptions const & options ) {
 
-	// just in case it's been used before
-	predicted_errors_all_.clear();
-		
-	for ( int ii = 0; ii < sequence_.full_nt_sequence().length(); ++ii ) {
-		SequenceFeatures features( *this, ii );
-		double error_probability = predictor.apply_model( features );
-		predicted_errors_all_.push_back( pair<int,double>( ii, error_probability ));
-	}
+	// compute features for the whole read in one pass, then
+	// submit it to the network in one batch
+	FeatureExtractor features( *this );
+
+	vector<double> predictions( features.length() );
+	predictor.apply_model_batch( features, predictions.data(), workspace );
+	store_->predictions( row_, predictions );
 }
 
 vector<vector<double>> SequenceRecord::get_features( ErrorPredictor const & predictor,
 		ErrorXOptions const & options ) {
 
+	FeatureExtractor features( *this );
 	vector<vector<double>> features_2d;
 
-	for ( int ii = 0; ii < sequence_.full_nt_sequence().length(); ++ii ) {
-		SequenceFeatures features( *this, ii );
-
-		features_2d.push_back( features.get_feature_vector() );
+	for ( int ii = 0; ii < features.length(); ++ii ) {
+		features_2d.push_back( features.get_feature_vector( ii ) );
 	}
 	return features_2d;
 }
 
-AbSequence SequenceRecord::sequence() const { return sequence_; }
-bool SequenceRecord::isGood() const { return sequence_.isGood(); }
-vector<pair<int,double>> SequenceRecord::get_predicted_errors() const { return predicted_errors_all_; }
-string SequenceRecord::full_nt_sequence() const { return sequence_.full_nt_sequence(); }
-string SequenceRecord::full_gl_nt_sequence() const { return sequence_.full_gl_nt_sequence(); }
-string SequenceRecord::full_nt_sequence_corrected() const { return sequence_.full_nt_sequence_corrected(); }
-int SequenceRecord::n_errors() const { return n_errors_; }
-string SequenceRecord::sequenceID() const { return sequence_.sequenceID(); }
-string SequenceRecord::cdr3_aa_sequence() const { return sequence_.cdr3_aa_sequence(); }
-string SequenceRecord::full_aa_sequence() const { return sequence_.full_aa_sequence(); }
-string SequenceRecord::full_aa_sequence_corrected() const { return sequence_.full_aa_sequence_corrected(); }
-string SequenceRecord::v_gene() const { return sequence_.v_gene(); }
-string SequenceRecord::d_gene() const { return sequence_.d_gene(); }
-string SequenceRecord::j_gene() const { return sequence_.j_gene(); }
-
-string SequenceRecord::v_gene_noallele() const {
-	vector<string> tokens = util::tokenize_string<string>( v_gene(), "*" );
-	return tokens[0];
+shared_ptr<SequenceRecord> SequenceRecord::copy_to( RecordStorePtr const & store ) const {
+	return shared_ptr<SequenceRecord>( new SequenceRecord( store, store->add( *store_, row_ )));
+}
+
+void SequenceRecord::move_to( RecordStorePtr const & store ) {
+	row_ = store->add( *store_, row_ );
+	store_ = store;
 }
 
-string SequenceRecord::d_gene_noallele() const {
-	vector<string> tokens = util::tokenize_string<string>( d_gene(), "*" );
-	return tokens[0];
+RecordStorePtr const & SequenceRecord::store() const { return store_; }
+int SequenceRecord::row() const { return row_; }
+
+string SequenceRecord::shown( RecordStore::Text column ) const {
+	if ( store_->length( column, row_ ) <= 0 ) return "N/A";
+	else return store_->text( column, row_ );
 }
 
-string SequenceRecord::j_gene_noallele() const {
-	vector<string> tokens = util::tokenize_string<string>( j_gene(), "*" );
-	return tokens[0];
+AbSequence SequenceRecord::sequence() const { return store_->sequence( row_ ); }
+bool SequenceRecord::isGood() const { return store_->flag( RecordStore::GOOD, row_ ); }
+
+vector<pair<int,double>> SequenceRecord::get_predicted_errors() const {
+	vector<double> probabilities = store_->predictions( row_ );
+	vector<pair<int,double>> predicted_errors;
+	for ( int ii = 0; ii < probabilities.size(); ++ii ) {
+		predicted_errors.push_back( pair<int,double>( ii, probabilities[ii] ));
+	}
+	return predicted_errors;
 }
 
+string SequenceRecord::full_nt_sequence() const { return shown( RecordStore::FULL_NT ); }
+string SequenceRecord::full_gl_nt_sequence() const { return shown( RecordStore::FULL_GL_NT ); }
+string SequenceRecord::full_nt_sequence_corrected() const { return shown( RecordStore::FULL_NT_CORRECTED ); }
+int SequenceRecord::n_errors() const { return store_->integer( RecordStore::N_ERRORS, row_ ); }
+string SequenceRecord::sequenceID() const { return store_->text( RecordStore::SEQUENCE_ID, row_ ); }
+string SequenceRecord::cdr3_aa_sequence() const { return shown( RecordStore::CDR3_AA ); }
+string SequenceRecord::full_aa_sequence() const { return shown( RecordStore::FULL_AA ); }
+string SequenceRecord::full_aa_sequence_corrected() const { return shown( RecordStore::FULL_AA_CORRECTED ); }
+string SequenceRecord::v_gene() const { return store_->text( RecordStore::V_GENE, row_ ); }
+string SequenceRecord::d_gene() const { return store_->text( RecordStore::D_GENE, row_ ); }
+string SequenceRecord::j_gene() const { return store_->text( RecordStore::J_GENE, row_ ); }
+
+string SequenceRecord::v_gene_noallele() const { return noallele( v_gene() ); }
+string SequenceRecord::d_gene_noallele() const { return noallele( d_gene() ); }
+string SequenceRecord::j_gene_noallele() const { return noallele( j_gene() ); }
+
 string SequenceRecord::clonotype() const {
 	return v_gene_noallele() + "_" + 
 		   cdr3_aa_sequence() + "_" + 
@@ -261,30 +335,32 @@ string SequenceRecord::clonotype() const {
 }
 
 bool SequenceRecord::valid_clonotype() const {
-	return sequence_.v_gene() != "N/A" && 
-		   sequence_.cdr3_aa_sequence() != "N/A" &&
-		   sequence_.j_gene() != "N/A";
+	// a length of -1 is "N/A", and an empty CDR3 is shown as "N/A"
+	return store_->length( RecordStore::V_GENE, row_ ) >= 0 &&
+		   store_->length( RecordStore::CDR3_AA, row_ ) > 0 &&
+		   store_->length( RecordStore::J_GENE, row_ ) >= 0;
 }
 
-double SequenceRecord::v_identity() const { return sequence_.v_identity(); }
-double SequenceRecord::d_identity() const { return sequence_.d_identity(); }
-double SequenceRecord::j_identity() const { return sequence_.j_identity(); }
-string SequenceRecord::chain() const { return sequence_.chain(); }
-bool SequenceRecord::productive() const { return sequence_.productive(); }
-string SequenceRecord::quality_string() const { return sequence_.quality_string_trimmed(); }
-int SequenceRecord::gl_start() const { return sequence_.gl_start(); }
+double SequenceRecord::v_identity() const { return store_->number( RecordStore::V_IDENTITY, row_ ); }
+double SequenceRecord::d_identity() const { return store_->number( RecordStore::D_IDENTITY, row_ ); }
+double SequenceRecord::j_identity() const { return store_->number( RecordStore::J_IDENTITY, row_ ); }
+string SequenceRecord::chain() const { return store_->text( RecordStore::CHAIN, row_ ); }
+bool SequenceRecord::productive() const { return store_->flag( RecordStore::PRODUCTIVE, row_ ); }
+string SequenceRecord::quality_string() const { return shown( RecordStore::PHRED_TRIMMED ); }
+int SequenceRecord::gl_start() const { return store_->integer( RecordStore::GL_START, row_ ); }
+int SequenceRecord::translation_frame() const { return store_->integer( RecordStore::TRANSLATION_FRAME, row_ ); }
 
-void SequenceRecord::full_nt_sequence( string const & seq ) { sequence_.full_nt_sequence(seq); }
+void SequenceRecord::full_nt_sequence( string const & seq ) { store_->text( RecordStore::FULL_NT, row_, seq ); }
 void SequenceRecord::full_nt_sequence_corrected( string const & seq ) 
-{ sequence_.full_nt_sequence_corrected(seq); }
+{ store_->text( RecordStore::FULL_NT_CORRECTED, row_, seq ); }
 
-void SequenceRecord::full_aa_sequence( string const & seq ) { sequence_.full_aa_sequence(seq); }
+void SequenceRecord::full_aa_sequence( string const & seq ) { store_->text( RecordStore::FULL_AA, row_, seq ); }
 void SequenceRecord::full_aa_sequence_corrected( string const & seq ) 
-{ sequence_.full_aa_sequence_corrected(seq); }
+{ store_->text( RecordStore::FULL_AA_CORRECTED, row_, seq ); }
 
-void SequenceRecord::v_gene( string const & vgene ) { sequence_.v_gene( vgene ); }
-void SequenceRecord::j_gene( string const & jgene ) { sequence_.j_gene( jgene ); }
-void SequenceRecord::cdr3_aa_sequence( string const & cdr3_aa_sequence ) { sequence_.cdr3_aa_sequence( cdr3_aa_sequence ); }
+void SequenceRecord::v_gene( string const & vgene ) { store_->text( RecordStore::V_GENE, row_, vgene ); }
+void SequenceRecord::j_gene( string const & jgene ) { store_->text( RecordStore::J_GENE, row_, jgene ); }
+void SequenceRecord::cdr3_aa_sequence( string const & cdr3_aa_sequence ) { store_->text( RecordStore::CDR3_AA, row_, cdr3_aa_sequence ); }
 
 
 } // namespace errorx
@@ -14,8 +14,10 @@ settings for processing, and ErrorPredictor that does the error correction itsel
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <chrono>
 #include <thread>
+#include <unordered_map>
 #include <mutex>
 #include <functional>
 #include <algorithm>
@@ -24,20 +26,38 @@ settings for processing, and ErrorPredictor that does the error correction itsel
 #include "SequenceRecords.hh"
 #include "SequenceQuery.hh"
 #include "SequenceRecord.hh"
+#include "RecordStore.hh"
 #include "ErrorPredictor.hh"
 #include "SequenceFeatures.hh"
 #include "util.hh"
 #include "constants.hh"
 #include "ClonotypeGroup.hh"
+#include "TaskScheduler.hh"
 #include "exceptions.hh"
 
 using namespace std;
 
 namespace errorx {
 
+namespace {
+
+// the fields a SequenceRecord built from a query has
+AbSequence query_sequence( SequenceQuery & query ) {
+	AbSequence sequence;
+	sequence.sequenceID( query.sequenceID() );
+	sequence.full_nt_sequence( query.sequence() );
+	sequence.full_gl_nt_sequence( query.germline_sequence() );
+	sequence.quality_string_trimmed( query.phred_string() );
+	return sequence;
+}
+
+} // namespace
+
 SequenceRecords::SequenceRecords( ErrorXOptions const & options ) :
+	store_( new RecordStore ),
 	options_( new ErrorXOptions( options )),
-	predictor_( new ErrorPredictor( options ))
+	predictor_( new ErrorPredictor( options )),
+	unique_records_( 0 )
 {}
 
 SequenceRecords::~SequenceRecords() {
@@ -47,12 +67,14 @@ SequenceRecords::~SequenceRecords() {
 }
 
 
-SequenceRecords::SequenceRecords( SequenceRecords const & other ) {
+SequenceRecords::SequenceRecords( SequenceRecords const & other ) :
+	store_( new RecordStore ),
+	unique_records_( other.unique_records_ ),
+	worker_stats_( other.worker_stats_ )
+{
 	// make deep copy of everything
 	for ( int ii = 0; ii < other.size(); ++ii ) {
-		records_.push_back( 
-			SequenceRecordPtr( new SequenceRecord( *other.get(ii) ))
-		);
+		records_.push_back( other.get(ii)->copy_to( store_ ));
 	}
 
 	options_ = ErrorXOptionsPtr( new ErrorXOptions( *other.options_ ));
@@ -67,7 +89,10 @@ SequenceRecords::SequenceRecords( SequenceRecords const & other ) {
 	// then count clonotypes again after the fact.
 }
 
-SequenceRecords::SequenceRecords( vector<SequenceRecordsPtr> const & others ) {
+SequenceRecords::SequenceRecords( vector<SequenceRecordsPtr> const & others ) :
+	store_( new RecordStore ),
+	unique_records_( 0 )
+{
 	if ( others.size() == 0 ) {
 		throw invalid_argument( "Error: trying to create a SequenceRecords object from an empty vector" );
 	}
@@ -76,9 +101,7 @@ SequenceRecords::SequenceRecords( vector<SequenceRecordsPtr> const & others ) {
 	for ( int ii = 0; ii < others.size(); ++ii ) {
 		for ( int jj = 0; jj < others[ii]->size(); ++jj ) {
 
-			records_.push_back( 
-				SequenceRecordPtr( new SequenceRecord( *(others[ii]->get(jj)) ))
-			);
+			records_.push_back( others[ii]->get(jj)->copy_to( store_ ));
 		}
 	}
 
@@ -90,13 +113,14 @@ SequenceRecords::SequenceRecords( vector<SequenceRecordsPtr> const & others ) {
 }
 
 SequenceRecords::SequenceRecords( vector<SequenceRecordPtr> const & record_vector, 
-	ErrorXOptions const & options ) {
+	ErrorXOptions const & options ) :
+	store_( new RecordStore ),
+	unique_records_( 0 )
+{
 
 	// make deep copy of everything
 	for ( int ii = 0; ii < record_vector.size(); ++ii ) {
-		records_.push_back( 
-			SequenceRecordPtr( new SequenceRecord( *record_vector[ii] ))
-		);
+		records_.push_back( record_vector[ii]->copy_to( store_ ));
 	}
 	options_ = ErrorXOptionsPtr( new ErrorXOptions( options ));
 	predictor_ = ErrorPredictorPtr( new ErrorPredictor( options ));
@@ -126,7 +150,6 @@ bool SequenceRecords::equals( unique_ptr<SequenceRecords> const & other ) const
 
 void SequenceRecords::import_from_tsv() {
 	ios_base::sync_with_stdio( false );
-	string line;
 	ifstream file( options_->infile() );
 
 	if ( !file.good() ) {
@@ -134,7 +157,14 @@ void SequenceRecords::import_from_tsv() {
 		return;
 	}
 
-	while ( getline (file, line) ) {
+	import_from_tsv( file );
+}
+
+int SequenceRecords::import_from_tsv( istream & file, int max_records/*=-1*/ ) {
+	string line;
+	int count = 0;
+
+	while ( count != max_records && getline (file, line) ) {
 		// if empty line, just keep going
 		if ( util::trim(line) == "" ) {
 			continue;
@@ -149,27 +179,34 @@ void SequenceRecords::import_from_tsv() {
 				"(SequenceID Full_sequence Germline_sequence Quality) "
 				"separated by tabs with no header.\n\n"
 				"Offending line:\n"+line );
-			return;
+			return count;
 		}
 
 		SequenceQuery query( tokens[0], tokens[1], tokens[2], tokens[3] );
-		SequenceRecordPtr ptr( new SequenceRecord( query ));
-		add_record( ptr );
+		add_record( query_sequence( query ));
+		count++;
 	}
+	return count;
 }
 
 void SequenceRecords::import_from_list( vector<SequenceQuery> & queries ) {
 
 	for ( int ii = 0; ii < queries.size(); ++ii ) {	
-		SequenceRecordPtr ptr( new SequenceRecord( queries[ii] ));
-		add_record( ptr );
+		add_record( query_sequence( queries[ii] ));
 	}
 }
 
 void SequenceRecords::add_record( SequenceRecordPtr & record ) {
+	if ( record->store() != store_ ) record->move_to( store_ );
 	records_.push_back( record );
 }
 
+void SequenceRecords::add_record( AbSequence const & sequence ) {
+	records_.push_back( 
+		SequenceRecordPtr( new SequenceRecord( store_, store_->add( sequence )))
+	);
+}
+
 vector<SequenceRecordPtr> SequenceRecords::get_records() const { return records_; }
 
 SequenceRecordPtr SequenceRecords::get( int i ) const {
@@ -193,9 +230,12 @@ double SequenceRecords::estimate_error_rate() const {
  	double precision = constants::OPTIMIZED_PRECISION;
 
 	for ( int ii = 0; ii < records_.size(); ++ii ) {
- 		if ( records_[ ii ]->isGood() ) {
-			total_bases += records_[ ii ]->full_nt_sequence().size();
- 			total_errors += records_[ ii ]->n_errors();
+		SequenceRecord const & record = *records_[ ii ];
+ 		if ( record.isGood() ) {
+			// an empty sequence is counted as "N/A", as it's shown
+			int length = record.store()->length( RecordStore::FULL_NT, record.row() );
+			total_bases += ( length > 0 ) ? length : 3;
+ 			total_errors += record.n_errors();
 		}
  	}
  	if ( options_->verbose() > 0 ) {
@@ -255,148 +295,173 @@ void SequenceRecords::write_summary() const {
 		throw invalid_argument( options_->outfile()+" is not a valid file." );
 		return;
 	}
+	write_labels( outfile );
+	write_rows( outfile );
+	outfile.close();
+}
+
+void SequenceRecords::write_labels( ostream & outfile ) {
 	vector<string> summary_labels = util::get_labels();
-	vector<vector<string>> summary_data = get_summary();
 
 	for ( int ii = 0; ii < summary_labels.size(); ++ii ) {
 		outfile << summary_labels[ ii ] << "\t";
 	}
 	outfile << "\n";
-	for ( int ii = 0; ii < summary_data.size(); ++ii ) {
-		for ( int jj = 0; jj < summary_data[ii].size(); ++jj ) {
-			outfile << summary_data[ ii ][ jj ] << "\t";
-		}
-		outfile << "\n";
-	}
-	outfile.close();
 }
 
-void SequenceRecords::correct_sequences_threaded( 
-	SequenceRecordsPtr & records, 
-	function<void(int,int)>* increment,
-	mutex* m, 
-	int total ) {
-	// update in increments of 10
-	int incrementAmount = 10;
-	
-	for ( int ii = 0; ii < records->size(); ++ii ) {
-		try {
-			SequenceRecordPtr current_record = records->get( ii );
-			current_record->correct_sequence( 
-				*(records->predictor_), 
-				*(records->options_) );
-
-			
-			if ( ii%incrementAmount == 0 ) {
-				// lock mutex on this level so I don't have to
-				// lock it in my callback fxn
-				m->lock();
-				(*increment)( incrementAmount, total );
-				m->unlock();
-			}
+void SequenceRecords::write_rows( ostream & outfile ) const {
+	for ( int ii = 0; ii < records_.size(); ++ii ) {
+		if ( !records_[ ii ]->isGood() ) continue;
 
-		} catch ( exception & e ) {
-			throw BadInputException( "record could not be processed - exception caught : "+records->get(ii)->sequenceID()+"\n\n"+e.what() );
+		vector<string> row = records_[ ii ]->get_summary( /*fulldata=*/1 );
+		for ( int jj = 0; jj < row.size(); ++jj ) {
+			outfile << row[ jj ] << "\t";
 		}
+		outfile << "\n";
 	}
 }
 
-vector<SequenceRecordsPtr> SequenceRecords::chunk_records() {
-	// If there is only one thread, I don't need to split into chunks
-	if ( options_->nthreads() == 1 ) {
-		// Make a deep copy of this and return it
-		SequenceRecordsPtr ptr( new SequenceRecords( records_, *options_ ));
-		vector<SequenceRecordsPtr> records_array;
-		records_array.push_back( std::move(ptr) );
-
-		return records_array;
-	} else {
-		// Split records_ into chunks 
-		// Shallow copy of pointers
-		vector<vector<SequenceRecordPtr>> split_vectors = 
-			util::split_vector<SequenceRecordPtr>( records_, options_->nthreads() );
-
-		// Make an array to hold SequenceRecords
-		vector<SequenceRecordsPtr> records_array( options_->nthreads() );
+void SequenceRecords::mock_correct_sequences() {
+	vector<SequenceRecordPtr>::const_iterator it;
+	for ( it = records_.begin(); it != records_.end(); ++it ) {
+		(*it)->full_nt_sequence_corrected( (*it)->full_nt_sequence() );
+		(*it)->full_aa_sequence_corrected( (*it)->full_aa_sequence() );
+	}
+}
 
-		for ( int ii = 0; ii < options_->nthreads(); ++ii ) {
-			// Make a new SequenceRecords object containing only its chunk
-			// this is a deep copy so the old records are no longer needed
+vector<SequenceRecordPtr> SequenceRecords::collapse_duplicates( vector<int> & group ) const {
+	vector<SequenceRecordPtr> unique;
+	group.assign( records_.size(), 0 );
 
-			records_array[ii] = SequenceRecordsPtr( new SequenceRecords( split_vectors[ii], *options_ ));
+	// records by a hash of their reads, and the hash of each read
+	// is checked against the full strings on a match
+	unordered_map<size_t,vector<int>> buckets;
+	hash<string> hasher;
+	for ( int ii = 0; ii < records_.size(); ++ii ) {
+		SequenceRecord const & record = *records_[ ii ];
+		size_t key = hasher( record.full_nt_sequence() );
+		key = key*31 + hasher( record.full_gl_nt_sequence() );
+		key = key*31 + hasher( record.quality_string() );
+		key = key*31 + record.isGood();
+
+		vector<int> & candidates = buckets[ key ];
+		int match = -1;
+		for ( int jj = 0; jj < candidates.size() && match < 0; ++jj ) {
+			SequenceRecord const & other = *unique[ candidates[ jj ]];
+			if ( other.full_nt_sequence() == record.full_nt_sequence() &&
+					other.full_gl_nt_sequence() == record.full_gl_nt_sequence() &&
+					other.quality_string() == record.quality_string() &&
+					other.isGood() == record.isGood() ) {
+				match = candidates[ jj ];
+			}
 		}
 
-		return records_array;
+		if ( match < 0 ) {
+			match = unique.size();
+			unique.push_back( records_[ ii ] );
+			candidates.push_back( match );
+		}
+		group[ ii ] = match;
 	}
+	return unique;
 }
 
-void SequenceRecords::mock_correct_sequences() {
-	vector<SequenceRecordPtr>::const_iterator it;
-	for ( it = records_.begin(); it != records_.end(); ++it ) {
-		(*it)->full_nt_sequence_corrected( (*it)->full_nt_sequence() );
-		(*it)->full_aa_sequence_corrected( (*it)->full_aa_sequence() );
-	}
+double SequenceRecords::dedup_ratio() const {
+	return ( unique_records_ == 0 ) ? 1.0 : (double)size() / unique_records_;
 }
 
-void SequenceRecords::correct_sequences( SequenceRecordsPtr & records ) {
-	int nthreads = records->options_->nthreads();
-	int total_records = records->size();
+vector<TaskScheduler::WorkerStats> const & SequenceRecords::worker_stats() const {
+	return worker_stats_;
+}
 
-	// Set up a callback function for each thread to update its progress
-	function<void(int,int)> increment = records->options_->increment();
-	function<void(void)> finish = records->options_->finish();
-	function<void(string)> message = records->options_->message();
-	function<void(void)> reset = records->options_->reset();
+void SequenceRecords::correct_sequences( SequenceRecordsPtr & records, bool report/*=true*/ ) {
+	// hardware_concurrency can report 0 if it doesn't know
+	int nthreads = max( 1, records->options_->nthreads() );
 
-	// get chunked SequenceRecords
-	// this will deep copy the original pointers in records_
-	vector<SequenceRecordsPtr> chunked_records = records->chunk_records();
+	// identical reads get identical predictions, so only the first
+	// of each group is corrected and the rest copy its result
+	vector<int> group;
+	vector<SequenceRecordPtr> unique = records->collapse_duplicates( group );
+	int total_records = unique.size();
 
-	// delete the original record
-	records.release();
-	
-	vector<unique_ptr<thread>> threads( nthreads );
+	// Set up a callback function for each thread to update its progress
+	function<void(int,int)> increment = [](int,int) {};
+	function<void(void)> finish = []() {};
+	function<void(string)> message = [](string) {};
+	function<void(void)> reset = []() {};
+	if ( report ) {
+		increment = records->options_->increment();
+		finish = records->options_->finish();
+		message = records->options_->message();
+		reset = records->options_->reset();
+	}
+
+	// workers share the predictor and the options, which are only
+	// read. Each worker has its own scratch memory for inference
+	ErrorPredictor const & predictor = *records->predictor_;
+	unique_ptr<ErrorPredictor::Workspace[]> workspaces( new ErrorPredictor::Workspace[ nthreads ] );
+	ErrorXOptions const & options = *records->options_;
 
 	// Set up a mutex to coordinate between threads
-	mutex* m = new mutex;
+	mutex m;
 
 	reset();
 	message( "Correcting sequences..." );
 
-	for ( int ii = 0; ii < nthreads; ++ii ) {
-		threads[ii] = unique_ptr<thread>( new std::thread(
-				&SequenceRecords::correct_sequences_threaded,
-				ref(chunked_records[ii]),
-				&increment,
-				m,
-				ref(total_records)
-				));
-	}
-
+	// workers correct the shared records in place over ranges of
+	// indices, so nothing is copied and the output keeps the input
+	// order however the batches are scheduled
+	TaskScheduler scheduler( nthreads, constants::RECORD_BATCH, options.executor() );
+	scheduler.run( total_records, [&]( int worker, int begin, int end ) {
+		for ( int ii = begin; ii < end; ++ii ) {
+			try {
+				unique[ ii ]->correct_sequence( predictor, workspaces[ worker ], options );
+			} catch ( exception & e ) {
+				throw BadInputException( "record could not be processed - exception caught : "+unique[ii]->sequenceID()+"\n\n"+e.what() );
+			}
+		}
 
-	// Wait for all threads to finish
-	for ( int ii = 0; ii < nthreads; ++ii ) {
-		threads[ii]->join();
-  	}
+		// lock mutex on this level so I don't have to
+		// lock it in my callback fxn
+		lock_guard<mutex> lock( m );
+		increment( end-begin, total_records );
+	});
+	records->worker_stats_ = scheduler.stats();
 
   	// Update to where all records are done
   	finish();
-  	cout << endl;
+  	if ( report ) cout << endl;
+
+	if ( report && records->options_->verbose() > 1 ) {
+		for ( int ii = 0; ii < nthreads; ++ii ) {
+			TaskScheduler::WorkerStats const & stats = records->worker_stats_[ ii ];
+			ostringstream line;
+			line.precision( 3 );
+			line << fixed << "Thread " << ii << ": busy " << stats.busy_seconds << " s, idle "
+				 << stats.idle_seconds << " s, " << stats.batches << " batches, "
+				 << stats.stolen << " stolen";
+			message( line.str() );
+		}
+	}
 
-  	// I'm done with mutex now
-  	delete m;
+	// fan the corrections back out to every record, in the original order.
+	// The first record of each group is the one that was corrected
+	for ( int ii = 0; ii < records->size(); ++ii ) {
+		SequenceRecordPtr const & representative = unique[ group[ ii ]];
+		if ( records->records_[ ii ] != representative ) {
+			records->records_[ ii ]->correct_sequence( *representative, options );
+		}
+	}
 
-	// Now I need to collect all the chunked SequenceRecords into the parent
-	records = SequenceRecordsPtr( new SequenceRecords( chunked_records ));
+	records->unique_records_ = total_records;
+	if ( records->size() > total_records ) {
+		message( to_string( records->size() )+" records had "+to_string( total_records )+
+			" distinct reads, each corrected once" );
+	}
 
-	// Delete the threads that I used, along with the chunked records
-	// All copies made were deep copies so this won't affect the merged records object
-	
-	// UPDATE: this may be unnecessary now that I use unique ptrs
-	for ( int ii = 0; ii < nthreads; ++ii ) {
-		threads[ii].release();
-		chunked_records[ii].release(); 
-	} 
+	// clonotypes are grouped by corrected sequence, so
+	// they're counted again the next time they're needed
+	records->clonotypes_.clear();
 }
 
 void SequenceRecords::write_features() {
@@ -466,25 +531,24 @@ map<string,vector<int>> SequenceRecords::cdr_lengths() {
 
 	vector<SequenceRecordPtr>::const_iterator it;
 
+	// lengths are read from the store's columns, so no
+	// sequence is copied. Empty and "N/A" loops are skipped
 	for ( it = records_.begin(); it != records_.end(); ++it ) {
 		if ( !(*it)->isGood() ) continue;
 
-		if ( (*it)->sequence().cdr1_aa_sequence() != "N/A" ) {
-			cdr1_lengths.push_back( 
-				(*it)->sequence().cdr1_aa_sequence().size() 
-				);
+		RecordStore const & store = *(*it)->store();
+		int row = (*it)->row();
+
+		if ( store.length( RecordStore::CDR1_AA, row ) > 0 ) {
+			cdr1_lengths.push_back( store.length( RecordStore::CDR1_AA, row ));
 		}
 
-		if ( (*it)->sequence().cdr2_aa_sequence() != "N/A" ) {
-			cdr2_lengths.push_back( 
-				(*it)->sequence().cdr2_aa_sequence().size() 
-				);
+		if ( store.length( RecordStore::CDR2_AA, row ) > 0 ) {
+			cdr2_lengths.push_back( store.length( RecordStore::CDR2_AA, row ));
 		}
 
-		if ( (*it)->sequence().cdr3_aa_sequence() != "N/A" ) {
-			cdr3_lengths.push_back( 
-				(*it)->sequence().cdr3_aa_sequence().size() 
-				);
+		if ( store.length( RecordStore::CDR3_AA, row ) > 0 ) {
+			cdr3_lengths.push_back( store.length( RecordStore::CDR3_AA, row ));
 		}
 	}
 
@@ -691,4 +755,6 @@ map<string,int> SequenceRecords::vjgene_counts() {
 
 ErrorXOptionsPtr SequenceRecords::get_options() const { return ErrorXOptionsPtr(new ErrorXOptions( *options_ )); }
 
+RecordStorePtr SequenceRecords::store() const { return store_; }
+
 } // namespace errorx
@@ -0,0 +1,341 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file StreamingPipeline.cc
+@brief Streams an input file through ErrorX one chunk at a time
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "StreamingPipeline.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "IGBlastParser.hh"
+#include "constants.hh"
+#include "exceptions.hh"
+#include "util.hh"
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+namespace errorx {
+
+StreamingPipeline::StreamingPipeline( ErrorXOptions const & options ) :
+	options_( new ErrorXOptions( options )),
+	// IGBlast is slow and single chunks don't use every thread,
+	// so two chunks are annotated at once
+	annotators_( options.format() != "tsv" && options.nthreads() > 1 ? 2 : 1 ),
+	// enough for every stage to hold a chunk with every queue full
+	window_( annotators_ + 2 + 3*constants::STREAM_QUEUE ),
+	read_queue_( constants::STREAM_QUEUE ),
+	annotated_queue_( constants::STREAM_QUEUE ),
+	corrected_queue_( constants::STREAM_QUEUE ),
+	annotating_( 0 ),
+	in_flight_( 0 ),
+	failed_( false ),
+	chunks_( 0 ),
+	reads_( 0 ),
+	max_buffered_( 0 )
+{
+	if ( options.chunk_size() < 1 ) {
+		throw invalid_argument( "Error: streaming needs a chunk_size of at least one read" );
+	}
+}
+
+void StreamingPipeline::run() {
+	ofstream outfile( options_->outfile() );
+	if ( !outfile.good() ) {
+		throw invalid_argument( options_->outfile()+" is not a valid file." );
+	}
+
+	// annotators run IGBlast at the same time, and setenv is not
+	// thread-safe, so its environment is set before they start
+	if ( options_->format() != "tsv" ) IGBlastParser::set_environment( *options_ );
+
+	// stages wait on their queues for the whole run, so they get
+	// threads of their own rather than holding executor threads.
+	// Correcting a chunk still runs on the executor
+	annotating_ = annotators_;
+	vector<thread> stages;
+	stages.push_back( thread( &StreamingPipeline::run_stage, this, [this]{ read(); }));
+	for ( int ii = 0; ii < annotators_; ++ii ) {
+		stages.push_back( thread( &StreamingPipeline::run_stage, this, [this]{ annotate(); }));
+	}
+	stages.push_back( thread( &StreamingPipeline::run_stage, this, [this]{ correct(); }));
+
+	run_stage( [this, &outfile]{ write( outfile ); });
+	for ( int ii = 0; ii < stages.size(); ++ii ) stages[ ii ].join();
+
+	outfile.close();
+	if ( error_ ) rethrow_exception( error_ );
+
+	if ( options_->verbose() > 1 ) {
+		options_->message()( "Streamed "+to_string( reads_ )+" reads in "+to_string( chunks_ )+
+			" chunks, at most "+to_string( max_buffered_ )+" waiting to be written" );
+	}
+}
+
+void StreamingPipeline::run_stage( function<void()> const & stage ) {
+	try {
+		stage();
+	} catch ( ... ) {
+		{
+			lock_guard<mutex> lock( error_lock_ );
+			if ( !error_ ) error_ = current_exception();
+		}
+		{
+			lock_guard<mutex> lock( slots_lock_ );
+			failed_ = true;
+		}
+		slot_free_.notify_all();
+
+		// wake every stage waiting on a queue so they all stop
+		read_queue_.clear();
+		annotated_queue_.clear();
+		corrected_queue_.clear();
+	}
+}
+
+bool StreamingPipeline::acquire_slot() {
+	unique_lock<mutex> lock( slots_lock_ );
+	slot_free_.wait( lock, [this]{ return failed_ || in_flight_ < window_; });
+	if ( failed_ ) return false;
+	in_flight_++;
+	return true;
+}
+
+void StreamingPipeline::release_slot() {
+	{
+		lock_guard<mutex> lock( slots_lock_ );
+		in_flight_--;
+	}
+	slot_free_.notify_one();
+}
+
+void StreamingPipeline::read() {
+	ios_base::sync_with_stdio( false );
+	ifstream file( options_->infile() );
+	if ( !file.good() ) {
+		throw BadFileException( "Error: file " + options_->infile() + " does not exist." );
+	}
+	next_header_.clear();
+	read_ids_.clear();
+
+	for ( int index = 0; ; ++index ) {
+		if ( !acquire_slot() ) return;
+
+		ChunkPtr chunk( new Chunk );
+		chunk->index = index;
+		if ( !read_chunk( file, *chunk )) {
+			release_slot();
+			break;
+		}
+		if ( !read_queue_.push( move( chunk ))) return;
+	}
+	read_queue_.close();
+}
+
+bool StreamingPipeline::read_chunk( istream & file, Chunk & chunk ) {
+	chunk.reads = read_chunk( file, chunk.text, chunk.qualities );
+	return chunk.reads > 0;
+}
+
+int StreamingPipeline::read_chunk( istream & file, string & text,
+		unordered_map<string,string> & qualities ) {
+	string format = options_->format();
+	int chunk_size = options_->chunk_size();
+	string line;
+	int reads = 0;
+
+	if ( format == "tsv" ) {
+		// parsed by the annotator, which skips empty lines too
+		while ( reads < chunk_size && getline( file, line )) {
+			if ( util::trim( line ) == "" ) continue;
+			text += line+"\n";
+			reads++;
+		}
+	} else if ( format == "fastq" ) {
+		// same checks and names as ErrorXOptions::fastq_to_fasta.
+		// The names are forgotten between chunks once there are
+		// too many, so memory stays bounded
+		if ( read_ids_.size() >= (size_t)constants::STREAM_READ_IDS ) {
+			read_ids_.clear();
+		}
+		string sequenceID, sequence, sequenceID2, qualityStr;
+		while ( reads < chunk_size && getline( file, sequenceID )) {
+			if ( !getline( file, sequence ) || !getline( file, sequenceID2 ) ||
+				 !getline( file, qualityStr ) ||
+				 sequenceID.substr( 0, 1 ) != "@" ||
+				 sequenceID2.substr( 0, 1 ) != "+" ) {
+				throw BadFileException( "File "+options_->infile()+" could not be parsed as format "+format+". Please check to make sure it's properly formed and try again" );
+			}
+			vector<string> tokens = util::tokenize_string<string>( sequenceID, " \t" );
+			sequenceID = tokens[0].substr(1, tokens[0].length());
+
+			// suffixes below the stored one are all taken, so each
+			// duplicate picks up where the last one stopped
+			string new_seq_id = sequenceID;
+			unordered_map<string,int>::iterator seen = read_ids_.find( sequenceID );
+			if ( seen != read_ids_.end() ) {
+				int counter = seen->second;
+				do {
+					new_seq_id = sequenceID + "_" + to_string( counter );
+					counter++;
+				} while ( read_ids_.count( new_seq_id ));
+				read_ids_[ sequenceID ] = counter;
+			}
+			read_ids_[ new_seq_id ] = 1;
+
+			text += ">"+new_seq_id+"\n"+sequence+"\n";
+			qualities[ new_seq_id ] = qualityStr;
+			reads++;
+		}
+	} else {
+		// a read can span several lines, so it ends at the next header
+		if ( !next_header_.empty() ) {
+			text += next_header_+"\n";
+			reads++;
+			next_header_.clear();
+		}
+		while ( getline( file, line )) {
+			if ( line.substr( 0, 1 ) == ">" ) {
+				if ( reads == chunk_size ) {
+					next_header_ = line;
+					break;
+				}
+				reads++;
+			}
+			text += line+"\n";
+		}
+	}
+
+	return reads;
+}
+
+void StreamingPipeline::annotate() {
+	ChunkPtr chunk;
+	while ( read_queue_.pop( chunk )) {
+		if ( options_->format() == "tsv" ) {
+			chunk->records = SequenceRecordsPtr( new SequenceRecords( *options_ ));
+			istringstream text( chunk->text );
+			chunk->records->import_from_tsv( text );
+		} else {
+			blast_chunk( *chunk );
+		}
+		chunk->text.clear();
+		chunk->qualities.clear();
+
+		if ( !annotated_queue_.push( move( chunk ))) return;
+	}
+
+	// the last annotator to finish ends the queue
+	if ( --annotating_ == 0 ) annotated_queue_.close();
+}
+
+void StreamingPipeline::blast_chunk( Chunk & chunk ) {
+	// chunks go next to the input, as the FASTA from
+	// fastq_to_fasta does, and are deleted once parsed
+	namespace fs = boost::filesystem;
+	fs::path inpath( options_->infile() );
+	string infasta = ( inpath.parent_path()/inpath.stem() ).string() +
+		".chunk"+to_string( chunk.index )+".fasta";
+
+	ofstream outfasta( infasta );
+	if ( !outfasta.good() ) {
+		throw BadFileException( "Error: could not write "+infasta );
+	}
+	outfasta << chunk.text;
+	outfasta.close();
+
+	ErrorXOptions options( *options_ );
+	options.infasta( infasta );
+	options.quality_map( chunk.qualities );
+	options.num_queries( chunk.reads );
+	// annotators run IGBlast at the same time, so they split the threads
+	options.nthreads( max( 1, options_->nthreads()/annotators_ ));
+
+	IGBlastParser parser;
+	try {
+		parser.blast( options, /*progress=*/false );
+		// correcting a chunk uses every thread again
+		options.nthreads( options_->nthreads() );
+		chunk.records = parser.parse_output( options );
+	} catch ( ... ) {
+		remove( infasta.c_str() );
+		remove( options.igblast_output().c_str() );
+		throw;
+	}
+	remove( infasta.c_str() );
+	remove( options.igblast_output().c_str() );
+}
+
+void StreamingPipeline::correct() {
+	ChunkPtr chunk;
+	while ( annotated_queue_.pop( chunk )) {
+		// FASTA has no quality scores, so it's only annotated
+		if ( options_->format() == "fasta" ) {
+			chunk->records->mock_correct_sequences();
+		} else {
+			SequenceRecords::correct_sequences( chunk->records, /*report=*/false );
+		}
+
+		if ( !corrected_queue_.push( move( chunk ))) return;
+	}
+	corrected_queue_.close();
+}
+
+void StreamingPipeline::write( ostream & outfile ) {
+	function<void(int,int)> increment = options_->increment();
+	function<void(void)> finish = options_->finish();
+	function<void(string)> message = options_->message();
+	function<void(void)> reset = options_->reset();
+	int total = options_->num_queries();
+
+	reset();
+	message( "Correcting sequences..." );
+	increment( 0, total );
+
+	SequenceRecords::write_labels( outfile );
+
+	// chunks that arrive before the one due next wait here
+	map<int,ChunkPtr> pending;
+	int next = 0;
+
+	ChunkPtr chunk;
+	while ( corrected_queue_.pop( chunk )) {
+		int index = chunk->index;
+		pending[ index ] = move( chunk );
+		max_buffered_ = max( max_buffered_, (int)pending.size()-1 );
+
+		while ( !pending.empty() && pending.begin()->first == next ) {
+			Chunk & ready = *pending.begin()->second;
+			ready.records->write_rows( outfile );
+			increment( ready.reads, total );
+			reads_ += ready.reads;
+			chunks_++;
+
+			pending.erase( pending.begin() );
+			next++;
+			release_slot();
+		}
+	}
+
+	finish();
+	cout << endl;
+}
+
+int StreamingPipeline::chunks() const { return chunks_; }
+int StreamingPipeline::reads() const { return reads_; }
+int StreamingPipeline::max_buffered() const { return max_buffered_; }
+int StreamingPipeline::window() const { return window_; }
+
+} // namespace errorx
@@ -0,0 +1,174 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file TaskScheduler.cc
+@brief Work-stealing scheduler for a range of independent items
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "TaskScheduler.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+namespace errorx {
+
+namespace {
+
+// shared between a run and the jobs it queued, so a job that
+// starts after the run has returned finds it cancelled
+struct RunState {
+	mutex lock;
+	condition_variable done;
+	int active;
+	bool cancelled;
+};
+
+} // namespace
+
+TaskScheduler::TaskScheduler( int nthreads, int batch_size, ExecutorPtr const & executor ) :
+	nthreads_( nthreads ),
+	batch_size_( batch_size ),
+	executor_( executor ),
+	failed_( false )
+{
+	if ( nthreads < 1 || batch_size < 1 ) {
+		throw invalid_argument( "Error: a scheduler needs at least one thread "
+			"and at least one item per batch" );
+	}
+	queues_ = unique_ptr<WorkerQueue[]>( new WorkerQueue[ nthreads_ ] );
+}
+
+void TaskScheduler::run( int items, function<void(int,int,int)> const & task ) {
+	WorkerStats empty = { 0, 0, 0, 0 };
+	stats_.assign( nthreads_, empty );
+	failed_ = false;
+	error_ = exception_ptr();
+
+	// each worker starts with a contiguous share of the batches,
+	// so without stealing the split is the same as before
+	int nbatches = ( items + batch_size_ - 1 ) / batch_size_;
+	for ( int ii = 0; ii < nthreads_; ++ii ) {
+		int first = (long)nbatches*ii / nthreads_;
+		int last  = (long)nbatches*( ii+1 ) / nthreads_;
+
+		queues_[ ii ].batches.clear();
+		for ( int jj = first; jj < last; ++jj ) {
+			Batch batch = { jj*batch_size_, min( items, ( jj+1 )*batch_size_ ) };
+			queues_[ ii ].batches.push_back( batch );
+		}
+	}
+
+	if ( executor_ ) {
+		run_on_executor( task );
+	} else {
+		vector<thread> threads;
+		for ( int ii = 1; ii < nthreads_; ++ii ) {
+			threads.push_back( thread( &TaskScheduler::work, this, ii, cref( task )));
+		}
+		work( 0, task );
+		for ( int ii = 0; ii < threads.size(); ++ii ) threads[ ii ].join();
+	}
+
+	if ( error_ ) rethrow_exception( error_ );
+}
+
+void TaskScheduler::run_on_executor( function<void(int,int,int)> const & task ) {
+	shared_ptr<RunState> state( new RunState );
+	state->active = 0;
+	state->cancelled = false;
+
+	function<void(int,int,int)> const * shared_task = &task;
+	for ( int ii = 1; ii < nthreads_; ++ii ) {
+		executor_->submit( [this, state, shared_task, ii]() {
+			{
+				lock_guard<mutex> lock( state->lock );
+				if ( state->cancelled ) return;
+				state->active++;
+			}
+			work( ii, *shared_task );
+			{
+				lock_guard<mutex> lock( state->lock );
+				state->active--;
+			}
+			state->done.notify_all();
+		});
+	}
+
+	work( 0, task );
+
+	// every batch has been taken by now, so only wait on
+	// the workers that are still finishing theirs
+	unique_lock<mutex> lock( state->lock );
+	state->cancelled = true;
+	state->done.wait( lock, [&state]{ return state->active == 0; });
+}
+
+void TaskScheduler::work( int worker, function<void(int,int,int)> const & task ) {
+	typedef chrono::steady_clock clock;
+	clock::time_point start = clock::now();
+	WorkerStats & stats = stats_[ worker ];
+
+	Batch batch;
+	bool stolen;
+	while ( !failed_ && next_batch( worker, batch, stolen )) {
+		clock::time_point begin = clock::now();
+		try {
+			task( worker, batch.begin, batch.end );
+		} catch ( ... ) {
+			lock_guard<mutex> lock( error_lock_ );
+			if ( !error_ ) error_ = current_exception();
+			failed_ = true;
+		}
+		stats.busy_seconds += chrono::duration<double>( clock::now() - begin ).count();
+		stats.batches++;
+		stats.stolen += stolen;
+	}
+
+	// a worker is idle from the time it runs out of batches, as
+	// well as while it waits on a queue
+	double total = chrono::duration<double>( clock::now() - start ).count();
+	stats.idle_seconds = max( 0.0, total - stats.busy_seconds );
+}
+
+bool TaskScheduler::next_batch( int worker, Batch & batch, bool & stolen ) {
+	{
+		WorkerQueue & own = queues_[ worker ];
+		lock_guard<mutex> lock( own.lock );
+		if ( !own.batches.empty() ) {
+			batch = own.batches.front();
+			own.batches.pop_front();
+			stolen = false;
+			return true;
+		}
+	}
+
+	// take the batch the victim would have reached last
+	for ( int ii = 1; ii < nthreads_; ++ii ) {
+		WorkerQueue & victim = queues_[ ( worker+ii ) % nthreads_ ];
+		lock_guard<mutex> lock( victim.lock );
+		if ( !victim.batches.empty() ) {
+			batch = victim.batches.back();
+			victim.batches.pop_back();
+			stolen = true;
+			return true;
+		}
+	}
+
+	// no worker adds batches while running, so once
+	// every queue is empty there is nothing left to do
+	return false;
+}
+
+vector<TaskScheduler::WorkerStats> const & TaskScheduler::stats() const { return stats_; }
+int TaskScheduler::nthreads() const { return nthreads_; }
+int TaskScheduler::batch_size() const { return batch_size_; }
+
+} // namespace errorx
@@ -16,6 +16,7 @@ or a std::vector of SequenceQuery objects
 #include "ErrorPredictor.hh"
 #include "ErrorXOptions.hh"
 #include "SequenceRecords.hh"
+#include "StreamingPipeline.hh"
 #include "util.hh"
 #include "exceptions.hh"
 
@@ -110,7 +111,33 @@ SequenceRecordsPtr run_protocol( vector<SequenceQuery> & queries,
 }
 
 
+void run_protocol_stream( ErrorXOptions & options ) {
+
+	// Register control-C signal
+	util::register_signal();
+
+	options.validate();
+	options.trial( 0 ); // For now, take out license checking. Free for everyone!
+	// options.trial( !util::valid_license() );
+	options.count_queries();
+
+	// Trial version only allows querying a limited number of sequences
+	if ( options.trial() && 
+		 options.num_queries() > constants::FREE_QUERIES ) {
+		throw InvalidLicenseException();
+	}
+
+	StreamingPipeline pipeline( options );
+	pipeline.run();
+}
+
+
 void run_protocol_write( ErrorXOptions & options ) {
+	if ( options.chunk_size() > 0 ) {
+		run_protocol_stream( options );
+		return;
+	}
+
 	SequenceRecordsPtr records = run_protocol( options );
 	records->write_summary();
 	records.release();
@@ -150,8 +150,6 @@ errorx::SequenceRecordsPtr get_corrected_records( JNIEnv* env,
 		queries.push_back( query );
 	}
 
-	errorx::ErrorPredictor predictor( options );
-
 	try {
 		errorx::SequenceRecordsPtr records = run_protocol( queries, options );
 		return records;	
@@ -221,8 +221,6 @@ SequenceRecordsPtr submit_query( vector<string> & sequences,
 		queries.push_back( query );
 	}
 
-	ErrorPredictor predictor( options );
-
 	try {
 		SequenceRecordsPtr records = run_protocol( queries, options );
 		return records;
@@ -0,0 +1,120 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/AlignedBuffer.cc
+@brief Fixed-size array of values aligned to a cache line
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/AlignedBuffer.hh"
+
+#include <algorithm>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+namespace keras {
+
+template <typename T>
+AlignedArray<T>::AlignedArray() :
+	data_( nullptr ),
+	size_( 0 ),
+	capacity_( 0 )
+{}
+
+template <typename T>
+AlignedArray<T>::AlignedArray( size_t size ) :
+	data_( nullptr ),
+	size_( 0 ),
+	capacity_( 0 )
+{
+	assign( size, 0.0 );
+}
+
+template <typename T>
+AlignedArray<T>::AlignedArray( AlignedArray const & other ) :
+	data_( nullptr ),
+	size_( 0 ),
+	capacity_( 0 )
+{
+	allocate( other.size_ );
+	size_ = other.size_;
+	copy( other.data_, other.data_+other.size_, data_ );
+}
+
+template <typename T>
+AlignedArray<T> & AlignedArray<T>::operator=( AlignedArray const & other ) {
+	if ( this == &other ) return *this;
+	if ( other.size_ > capacity_ ) allocate( other.size_ );
+	size_ = other.size_;
+	copy( other.data_, other.data_+other.size_, data_ );
+	return *this;
+}
+
+template <typename T> AlignedArray<T>::~AlignedArray() { release(); }
+
+template <typename T>
+void AlignedArray<T>::assign( size_t size, T value ) {
+	if ( size > capacity_ ) allocate( size );
+	size_ = size;
+	fill( data_, data_+size_, value );
+}
+
+template <typename T>
+void AlignedArray<T>::resize( size_t size ) {
+	if ( size > capacity_ ) allocate( size );
+	size_ = size;
+}
+
+template <typename T>
+void AlignedArray<T>::allocate( size_t capacity ) {
+	release();
+	if ( capacity == 0 ) return;
+
+	void * ptr = nullptr;
+#if defined(_WIN32) || defined(_WIN64)
+	ptr = _aligned_malloc( capacity*sizeof(T), ALIGNMENT );
+#else
+	if ( posix_memalign( &ptr, ALIGNMENT, capacity*sizeof(T) ) != 0 ) ptr = nullptr;
+#endif
+	if ( ptr == nullptr ) throw bad_alloc();
+
+	data_ = static_cast<T*>( ptr );
+	capacity_ = capacity;
+}
+
+template <typename T>
+void AlignedArray<T>::release() {
+	if ( data_ != nullptr ) {
+#if defined(_WIN32) || defined(_WIN64)
+		_aligned_free( data_ );
+#else
+		free( data_ );
+#endif
+	}
+	data_ = nullptr;
+	size_ = 0;
+	capacity_ = 0;
+}
+
+template <typename T> T * AlignedArray<T>::data() { return data_; }
+template <typename T> T const * AlignedArray<T>::data() const { return data_; }
+template <typename T> size_t AlignedArray<T>::size() const { return size_; }
+
+template <typename T> T & AlignedArray<T>::operator[]( size_t index ) { return data_[ index ]; }
+template <typename T> T AlignedArray<T>::operator[]( size_t index ) const { return data_[ index ]; }
+
+// the only element types used by the kernels
+template class AlignedArray<double>;
+template class AlignedArray<float>;
+template class AlignedArray<int8_t>;
+template class AlignedArray<int32_t>;
+
+} // namespace keras
@@ -0,0 +1,585 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/DenseKernels.cc
+@brief Portable dense kernel and runtime selection of SIMD variants
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/DenseKernels.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+
+using namespace std;
+
+namespace keras {
+namespace kernels {
+
+namespace {
+
+// exp and tanh are called through these so activation loops stay scalar.
+// Under -Ofast glibc supplies vectorized versions that round differently,
+// which would make a sample's result depend on its position in a batch
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+double scalar_exp( double x ) { return exp( x ); }
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+double scalar_tanh( double x ) { return tanh( x ); }
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+float scalar_exp( float x ) { return expf( x ); }
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+float scalar_tanh( float x ) { return tanhf( x ); }
+
+template <typename T>
+void activate_impl( T * y, int n, Activation activation ) {
+	if ( activation == RELU ) {
+		for ( int k = 0; k < n; ++k ) {
+			if ( y[k] < 0 ) y[k] = 0;
+		}
+	} else if ( activation == SIGMOID ) {
+		for ( int k = 0; k < n; ++k ) {
+			y[k] = 1/(1+scalar_exp(-y[k]));
+		}
+	} else if ( activation == TANH ) {
+		for ( int k = 0; k < n; ++k ) {
+			y[k] = scalar_tanh(y[k]);
+		}
+	}
+}
+
+} // namespace
+
+void activate_block( double * y, int n, Activation activation ) { activate_impl( y, n, activation ); }
+void activate_block( float * y, int n, Activation activation ) { activate_impl( y, n, activation ); }
+
+namespace {
+
+// 2^n for a whole number n, built from its exponent bits
+inline double pow2( double n ) {
+	int64_t bits = ( (int64_t)n + 1023 ) << 52;
+	double result;
+	memcpy( &result, &bits, sizeof( result ));
+	return result;
+}
+
+inline float pow2( float n ) {
+	int32_t bits = ( (int32_t)n + 127 ) << 23;
+	float result;
+	memcpy( &result, &bits, sizeof( result ));
+	return result;
+}
+
+// The SIMD variants repeat these steps one vector at a time.
+// max and min are written so a NaN input passes through
+inline double fast_exp( double x ) {
+	x = min( max( x, -FAST_EXP_MAX ), FAST_EXP_MAX );
+	double n = floor( x*FAST_EXP_LOG2E + 0.5 );
+	double r = x - n*FAST_EXP_LN2_HI;
+	r = r - n*FAST_EXP_LN2_LO;
+	double p = FAST_EXP_COEFFS[ FAST_EXP_DEGREE ];
+	for ( int k = FAST_EXP_DEGREE-1; k >= 0; --k ) p = p*r + FAST_EXP_COEFFS[ k ];
+	return p*pow2( n );
+}
+
+inline float fast_exp( float x ) {
+	x = min( max( x, -FAST_EXPF_MAX ), FAST_EXPF_MAX );
+	float n = floorf( x*FAST_EXPF_LOG2E + 0.5f );
+	float r = x - n*FAST_EXPF_LN2_HI;
+	r = r - n*FAST_EXPF_LN2_LO;
+	float p = (float)FAST_EXP_COEFFS[ FAST_EXPF_DEGREE ];
+	for ( int k = FAST_EXPF_DEGREE-1; k >= 0; --k ) p = p*r + (float)FAST_EXP_COEFFS[ k ];
+	return p*pow2( n );
+}
+
+template <typename T>
+void normalize_impl( T * y, int rows, int cols ) {
+	for ( int r = 0; r < rows; ++r ) {
+		T * row = y + (size_t)r*cols;
+		T sum = 0;
+		for ( int k = 0; k < cols; ++k ) sum += row[k];
+		for ( int k = 0; k < cols; ++k ) row[k] /= sum;
+	}
+}
+
+template <typename T>
+void fast_activation_impl( T * y, int rows, int cols, Activation activation ) {
+	size_t size = (size_t)rows*cols;
+	if ( activation == RELU ) {
+		for ( size_t k = 0; k < size; ++k ) {
+			if ( y[k] < 0 ) y[k] = 0;
+		}
+	} else if ( activation == SIGMOID ) {
+		for ( size_t k = 0; k < size; ++k ) {
+			y[k] = 1/(1+fast_exp(-1*y[k]));
+		}
+	} else if ( activation == TANH ) {
+		for ( size_t k = 0; k < size; ++k ) {
+			y[k] = 2/(1+fast_exp(-2*y[k])) - 1;
+		}
+	} else if ( activation == SOFTMAX ) {
+		for ( size_t k = 0; k < size; ++k ) y[k] = fast_exp( y[k] );
+		normalize_rows( y, rows, cols );
+	}
+}
+
+} // namespace
+
+void normalize_rows( double * y, int rows, int cols ) { normalize_impl( y, rows, cols ); }
+void normalize_rows( float * y, int rows, int cols ) { normalize_impl( y, rows, cols ); }
+
+void fast_activation_generic( double * y, int rows, int cols, Activation activation ) {
+	fast_activation_impl( y, rows, cols, activation );
+}
+
+void fast_activation_generic_f32( float * y, int rows, int cols, Activation activation ) {
+	fast_activation_impl( y, rows, cols, activation );
+}
+
+int padded_neurons( int neurons ) {
+	return ( neurons + PANEL_WIDTH - 1 ) / PANEL_WIDTH * PANEL_WIDTH;
+}
+
+namespace {
+
+template <typename T>
+void pack_panels( double const * weights, int inputs, int neurons, T * packed ) {
+	int panels = padded_neurons( neurons ) / PANEL_WIDTH;
+
+	for ( int p = 0; p < panels; ++p ) {
+		for ( int j = 0; j < inputs; ++j ) {
+			T * dest = packed + ( (size_t)p*inputs + j )*PANEL_WIDTH;
+			for ( int c = 0; c < PANEL_WIDTH; ++c ) {
+				int k = p*PANEL_WIDTH + c;
+				dest[c] = ( k < neurons ) ? (T)weights[ (size_t)j*neurons + k ] : 0;
+			}
+		}
+	}
+}
+
+template <typename T>
+void dense_generic_impl( T const * input, int rows, int inputs,
+	T const * weights, T const * bias, int neurons, T * output,
+	Activation activation ) {
+
+	// Rows are processed in tiles that stay in cache, and each tile is
+	// swept by a 4-row x 1-panel register block
+	const int row_tile = 64;
+	const int mr = 4;
+	const int nr = PANEL_WIDTH;
+
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			int kn = min( nr, neurons-k0 );
+			const T * panel = weights + (size_t)k0*inputs;
+
+			int r = r0;
+			for ( ; r+mr <= r_end; r += mr ) {
+				T acc[ mr ][ nr ] = {};
+				const T * x0 = input + (size_t)(r  )*inputs;
+				const T * x1 = input + (size_t)(r+1)*inputs;
+				const T * x2 = input + (size_t)(r+2)*inputs;
+				const T * x3 = input + (size_t)(r+3)*inputs;
+
+				for ( int j = 0; j < inputs; ++j ) {
+					const T * w = panel + (size_t)j*nr;
+					T p0 = x0[j], p1 = x1[j], p2 = x2[j], p3 = x3[j];
+					for ( int c = 0; c < kn; ++c ) {
+						acc[0][c] += w[c] * p0;
+						acc[1][c] += w[c] * p1;
+						acc[2][c] += w[c] * p2;
+						acc[3][c] += w[c] * p3;
+					}
+				}
+
+				for ( int m = 0; m < mr; ++m ) {
+					T * y = output + (size_t)(r+m)*neurons + k0;
+					for ( int c = 0; c < kn; ++c ) y[c] = acc[m][c] + bias[k0+c];
+					if ( activation != LINEAR ) activate_block( y, kn, activation );
+				}
+			}
+
+			// leftover rows that don't fill a full register block
+			for ( ; r < r_end; ++r ) {
+				T acc[ nr ] = {};
+				const T * x = input + (size_t)r*inputs;
+
+				for ( int j = 0; j < inputs; ++j ) {
+					const T * w = panel + (size_t)j*nr;
+					T p = x[j];
+					for ( int c = 0; c < kn; ++c ) acc[c] += w[c] * p;
+				}
+
+				T * y = output + (size_t)r*neurons + k0;
+				for ( int c = 0; c < kn; ++c ) y[c] = acc[c] + bias[k0+c];
+				if ( activation != LINEAR ) activate_block( y, kn, activation );
+			}
+		}
+	}
+}
+
+} // namespace
+
+void pack_weights( double const * weights, int inputs, int neurons, double * packed ) {
+	pack_panels( weights, inputs, neurons, packed );
+}
+
+void pack_weights( double const * weights, int inputs, int neurons, float * packed ) {
+	pack_panels( weights, inputs, neurons, packed );
+}
+
+void dense_generic( double const * input, int rows, int inputs,
+	double const * weights, double const * bias, int neurons, double * output,
+	Activation activation ) {
+	dense_generic_impl( input, rows, inputs, weights, bias, neurons, output, activation );
+}
+
+void dense_generic_f32( float const * input, int rows, int inputs,
+	float const * weights, float const * bias, int neurons, float * output,
+	Activation activation ) {
+	dense_generic_impl( input, rows, inputs, weights, bias, neurons, output, activation );
+}
+
+void sparse_dense_generic( int const * row_start, int const * columns,
+	double const * values, int rows, int inputs, double const * weights,
+	double const * bias, int neurons, double * output,
+	Activation activation ) {
+
+	for ( int r = 0; r < rows; ++r ) {
+		int begin = row_start[r], end = row_start[r+1];
+
+		for ( int k0 = 0; k0 < neurons; k0 += PANEL_WIDTH ) {
+			int kn = min( PANEL_WIDTH, neurons-k0 );
+			const double * panel = weights + (size_t)k0*inputs;
+			double acc[ PANEL_WIDTH ] = {};
+
+			for ( int e = begin; e < end; ++e ) {
+				const double * w = panel + (size_t)columns[e]*PANEL_WIDTH;
+				double p = values[e];
+				for ( int c = 0; c < kn; ++c ) acc[c] += w[c] * p;
+			}
+
+			double * y = output + (size_t)r*neurons + k0;
+			for ( int c = 0; c < kn; ++c ) y[c] = acc[c] + bias[k0+c];
+			if ( activation != LINEAR ) activate_block( y, kn, activation );
+		}
+	}
+}
+
+namespace {
+
+bool zero_block( double const * w ) {
+	for ( int c = 0; c < PANEL_WIDTH; ++c ) {
+		if ( w[c] != 0 ) return false;
+	}
+	return true;
+}
+
+} // namespace
+
+int count_blocks( double const * packed, int inputs, int neurons ) {
+	int blocks = 0;
+	size_t total = (size_t)inputs*padded_neurons( neurons ) / PANEL_WIDTH;
+	for ( size_t b = 0; b < total; ++b ) {
+		if ( !zero_block( packed + b*PANEL_WIDTH )) ++blocks;
+	}
+	return blocks;
+}
+
+void pack_blocks( double const * packed, int inputs, int neurons,
+	int * block_start, int * block_inputs, double * blocks ) {
+
+	int panels = padded_neurons( neurons ) / PANEL_WIDTH;
+	int b = 0;
+	for ( int p = 0; p < panels; ++p ) {
+		block_start[p] = b;
+		for ( int j = 0; j < inputs; ++j ) {
+			double const * w = packed + ( (size_t)p*inputs + j )*PANEL_WIDTH;
+			if ( zero_block( w )) continue;
+			block_inputs[b] = j;
+			copy( w, w+PANEL_WIDTH, blocks + (size_t)b*PANEL_WIDTH );
+			++b;
+		}
+	}
+	block_start[ panels ] = b;
+}
+
+void block_sparse_generic( double const * input, int rows, int inputs,
+	int const * block_start, int const * block_inputs, double const * blocks,
+	double const * bias, int neurons, double * output, Activation activation ) {
+
+	// same tiling as dense_generic, with the loop over
+	// inputs replaced by the stored blocks of the panel
+	const int row_tile = 64;
+	const int mr = 4;
+	const int nr = PANEL_WIDTH;
+
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			int kn = min( nr, neurons-k0 );
+			int begin = block_start[ k0/nr ], end = block_start[ k0/nr + 1 ];
+
+			int r = r0;
+			for ( ; r+mr <= r_end; r += mr ) {
+				double acc[ mr ][ nr ] = {};
+				const double * x0 = input + (size_t)(r  )*inputs;
+				const double * x1 = input + (size_t)(r+1)*inputs;
+				const double * x2 = input + (size_t)(r+2)*inputs;
+				const double * x3 = input + (size_t)(r+3)*inputs;
+
+				for ( int b = begin; b < end; ++b ) {
+					const double * w = blocks + (size_t)b*nr;
+					int j = block_inputs[b];
+					double p0 = x0[j], p1 = x1[j], p2 = x2[j], p3 = x3[j];
+					for ( int c = 0; c < kn; ++c ) {
+						acc[0][c] += w[c] * p0;
+						acc[1][c] += w[c] * p1;
+						acc[2][c] += w[c] * p2;
+						acc[3][c] += w[c] * p3;
+					}
+				}
+
+				for ( int m = 0; m < mr; ++m ) {
+					double * y = output + (size_t)(r+m)*neurons + k0;
+					for ( int c = 0; c < kn; ++c ) y[c] = acc[m][c] + bias[k0+c];
+					if ( activation != LINEAR ) activate_block( y, kn, activation );
+				}
+			}
+
+			for ( ; r < r_end; ++r ) {
+				double acc[ nr ] = {};
+				const double * x = input + (size_t)r*inputs;
+
+				for ( int b = begin; b < end; ++b ) {
+					const double * w = blocks + (size_t)b*nr;
+					double p = x[ block_inputs[b] ];
+					for ( int c = 0; c < kn; ++c ) acc[c] += w[c] * p;
+				}
+
+				double * y = output + (size_t)r*neurons + k0;
+				for ( int c = 0; c < kn; ++c ) y[c] = acc[c] + bias[k0+c];
+				if ( activation != LINEAR ) activate_block( y, kn, activation );
+			}
+		}
+	}
+}
+
+int padded_inputs_int8( int inputs ) {
+	return ( inputs + INT8_GROUP - 1 ) / INT8_GROUP * INT8_GROUP;
+}
+
+void pack_weights_int8( int8_t const * weights, int inputs, int neurons, int8_t * packed ) {
+	int panels = padded_neurons( neurons ) / PANEL_WIDTH;
+	int groups = padded_inputs_int8( inputs ) / INT8_GROUP;
+
+	for ( int p = 0; p < panels; ++p ) {
+		for ( int g = 0; g < groups; ++g ) {
+			int8_t * dest = packed + ( (size_t)p*groups + g )*PANEL_WIDTH*INT8_GROUP;
+			for ( int c = 0; c < PANEL_WIDTH; ++c ) {
+				for ( int t = 0; t < INT8_GROUP; ++t ) {
+					int k = p*PANEL_WIDTH + c;
+					int j = g*INT8_GROUP + t;
+					dest[ c*INT8_GROUP + t ] = ( k < neurons && j < inputs ) ?
+						weights[ (size_t)j*neurons + k ] : 0;
+				}
+			}
+		}
+	}
+}
+
+void dense_int8_generic( int8_t const * input, int rows, int inputs,
+	int8_t const * weights, int32_t const * weight_sums, float const * scale,
+	float const * bias, int neurons, float * output ) {
+
+	int groups = inputs / INT8_GROUP;
+
+	for ( int k0 = 0; k0 < neurons; k0 += PANEL_WIDTH ) {
+		int kn = min( PANEL_WIDTH, neurons-k0 );
+		const int8_t * panel = weights + (size_t)k0*inputs;
+
+		for ( int r = 0; r < rows; ++r ) {
+			int32_t acc[ PANEL_WIDTH ] = {};
+			const int8_t * x = input + (size_t)r*inputs;
+
+			for ( int g = 0; g < groups; ++g ) {
+				const int8_t * w = panel + (size_t)g*PANEL_WIDTH*INT8_GROUP;
+				const int8_t * xg = x + g*INT8_GROUP;
+				for ( int c = 0; c < kn; ++c ) {
+					for ( int t = 0; t < INT8_GROUP; ++t ) {
+						acc[c] += (int32_t)w[ c*INT8_GROUP + t ] * xg[t];
+					}
+				}
+			}
+
+			float * y = output + (size_t)r*neurons + k0;
+			for ( int c = 0; c < kn; ++c ) y[c] = (float)acc[c] * scale[k0+c] + bias[k0+c];
+		}
+	}
+}
+
+namespace {
+
+bool cpu_supports( string const & name ) {
+	if ( name == "generic" ) return true;
+#ifdef KERAS_X86_KERNELS
+	__builtin_cpu_init();
+	if ( name == "avx512vnni" ) return __builtin_cpu_supports( "avx512vnni" ) &&
+		__builtin_cpu_supports( "avx512bw" );
+	if ( name == "avx512" ) return __builtin_cpu_supports( "avx512f" );
+	if ( name == "avx2" )   return __builtin_cpu_supports( "avx2" );
+	if ( name == "sse4.2" ) return __builtin_cpu_supports( "sse4.2" );
+#endif
+	return false;
+}
+
+string select_dense_kernel() {
+	return supported_dense_kernels().front();
+}
+
+} // namespace
+
+DenseKernel dense_kernel( string const & name ) {
+	if ( !cpu_supports( name )) return nullptr;
+#ifdef KERAS_X86_KERNELS
+	if ( name == "avx512" ) return dense_avx512;
+	if ( name == "avx2" )   return dense_avx2;
+	if ( name == "sse4.2" ) return dense_sse42;
+#endif
+	return ( name == "generic" ) ? dense_generic : nullptr;
+}
+
+DenseKernelF dense_kernel_f32( string const & name ) {
+	if ( !cpu_supports( name )) return nullptr;
+#ifdef KERAS_X86_KERNELS
+	if ( name == "avx512" ) return dense_avx512_f32;
+	if ( name == "avx2" )   return dense_avx2_f32;
+	if ( name == "sse4.2" ) return dense_sse42_f32;
+#endif
+	return ( name == "generic" ) ? dense_generic_f32 : nullptr;
+}
+
+vector<string> supported_dense_kernels() {
+	vector<string> names;
+	vector<string> candidates = { "avx512", "avx2", "sse4.2", "generic" };
+	for ( int ii = 0; ii < candidates.size(); ++ii ) {
+		if ( cpu_supports( candidates[ii] )) names.push_back( candidates[ii] );
+	}
+	return names;
+}
+
+SparseDenseKernel sparse_dense_kernel( string const & name ) {
+	if ( !cpu_supports( name )) return nullptr;
+#ifdef KERAS_X86_KERNELS
+	if ( name == "avx512" ) return sparse_dense_avx512;
+	if ( name == "avx2" )   return sparse_dense_avx2;
+	if ( name == "sse4.2" ) return sparse_dense_generic;
+#endif
+	return ( name == "generic" ) ? sparse_dense_generic : nullptr;
+}
+
+BlockSparseKernel block_sparse_kernel( string const & name ) {
+	if ( !cpu_supports( name )) return nullptr;
+#ifdef KERAS_X86_KERNELS
+	if ( name == "avx512" ) return block_sparse_avx512;
+	if ( name == "avx2" )   return block_sparse_avx2;
+	if ( name == "sse4.2" ) return block_sparse_generic;
+#endif
+	return ( name == "generic" ) ? block_sparse_generic : nullptr;
+}
+
+FastActivationKernel fast_activation_kernel( string const & name ) {
+	if ( !cpu_supports( name )) return nullptr;
+#ifdef KERAS_X86_KERNELS
+	if ( name == "avx512" ) return fast_activation_avx512;
+	if ( name == "avx2" )   return fast_activation_avx2;
+	if ( name == "sse4.2" ) return fast_activation_generic;
+#endif
+	return ( name == "generic" ) ? fast_activation_generic : nullptr;
+}
+
+FastActivationKernelF fast_activation_kernel_f32( string const & name ) {
+	if ( !cpu_supports( name )) return nullptr;
+#ifdef KERAS_X86_KERNELS
+	if ( name == "avx512" ) return fast_activation_avx512_f32;
+	if ( name == "avx2" )   return fast_activation_avx2_f32;
+	if ( name == "sse4.2" ) return fast_activation_generic_f32;
+#endif
+	return ( name == "generic" ) ? fast_activation_generic_f32 : nullptr;
+}
+
+DenseKernelInt8 dense_int8_kernel( string const & name ) {
+	if ( !cpu_supports( name )) return nullptr;
+#ifdef KERAS_X86_KERNELS
+	if ( name == "avx512vnni" ) return dense_int8_vnni;
+	if ( name == "avx2" )       return dense_int8_avx2;
+#endif
+	return ( name == "generic" ) ? dense_int8_generic : nullptr;
+}
+
+vector<string> supported_int8_kernels() {
+	vector<string> names;
+	vector<string> candidates = { "avx512vnni", "avx2", "generic" };
+	for ( int ii = 0; ii < candidates.size(); ++ii ) {
+		if ( cpu_supports( candidates[ii] )) names.push_back( candidates[ii] );
+	}
+	return names;
+}
+
+DenseKernelInt8 dense_int8_kernel() {
+	static const DenseKernelInt8 kernel = dense_int8_kernel( supported_int8_kernels().front() );
+	return kernel;
+}
+
+string dense_kernel_name() {
+	static const string name = select_dense_kernel();
+	return name;
+}
+
+DenseKernel dense_kernel() {
+	static const DenseKernel kernel = dense_kernel( dense_kernel_name() );
+	return kernel;
+}
+
+SparseDenseKernel sparse_dense_kernel() {
+	static const SparseDenseKernel kernel = sparse_dense_kernel( dense_kernel_name() );
+	return kernel;
+}
+
+DenseKernelF dense_kernel_f32() {
+	static const DenseKernelF kernel = dense_kernel_f32( dense_kernel_name() );
+	return kernel;
+}
+
+BlockSparseKernel block_sparse_kernel() {
+	static const BlockSparseKernel kernel = block_sparse_kernel( dense_kernel_name() );
+	return kernel;
+}
+
+FastActivationKernel fast_activation_kernel() {
+	static const FastActivationKernel kernel = fast_activation_kernel( dense_kernel_name() );
+	return kernel;
+}
+
+FastActivationKernelF fast_activation_kernel_f32() {
+	static const FastActivationKernelF kernel = fast_activation_kernel_f32( dense_kernel_name() );
+	return kernel;
+}
+
+} // namespace kernels
+} // namespace keras
@@ -0,0 +1,511 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/DenseKernelsAVX2.cc
+@brief AVX2 dense kernel. Compiled with -mavx2, only called
+when cpuid reports AVX2 support
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/DenseKernels.hh"
+
+#ifdef KERAS_X86_KERNELS
+
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+using namespace std;
+
+namespace keras {
+namespace kernels {
+
+namespace {
+
+// write the first n values of a block, for the last panel when the
+// number of neurons isn't a multiple of the panel width, then apply
+// a fused activation while the block is still in cache
+inline void store_block( double * y, __m256d lo, __m256d hi, int n, Activation activation=LINEAR ) {
+	if ( n >= 8 ) {
+		_mm256_storeu_pd( y,   lo );
+		_mm256_storeu_pd( y+4, hi );
+	} else {
+		alignas( 64 ) double tmp[ 8 ];
+		_mm256_store_pd( tmp,   lo );
+		_mm256_store_pd( tmp+4, hi );
+		for ( int c = 0; c < n; ++c ) y[c] = tmp[c];
+	}
+	if ( activation != LINEAR ) activate_block( y, min( n, 8 ), activation );
+}
+
+inline void store_block( float * y, __m256 lo, __m256 hi, int n, Activation activation=LINEAR ) {
+	if ( n >= 16 ) {
+		_mm256_storeu_ps( y,   lo );
+		_mm256_storeu_ps( y+8, hi );
+	} else {
+		alignas( 64 ) float tmp[ 16 ];
+		_mm256_store_ps( tmp,   lo );
+		_mm256_store_ps( tmp+8, hi );
+		for ( int c = 0; c < n; ++c ) y[c] = tmp[c];
+	}
+	if ( activation != LINEAR ) activate_block( y, min( n, 16 ), activation );
+}
+
+} // namespace
+
+void dense_avx2( double const * input, int rows, int inputs,
+	double const * weights, double const * bias, int neurons, double * output,
+	Activation activation ) {
+
+	// 4-row x 8-neuron register block, two 4-wide vectors per row,
+	// repeated across each 16-neuron panel.
+	// Multiply and add are kept separate (no FMA) so results are
+	// identical to the generic kernel
+	const int row_tile = 64;
+	const int mr = 4;
+	const int nr = PANEL_WIDTH;
+	const int sub = 8;
+
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			const double * panel = weights + (size_t)k0*inputs;
+
+			for ( int s = 0; s < nr && k0+s < neurons; s += sub ) {
+				int kn = neurons - k0 - s;
+				__m256d b0 = _mm256_load_pd( bias+k0+s );
+				__m256d b1 = _mm256_load_pd( bias+k0+s+4 );
+
+				int r = r0;
+				for ( ; r+mr <= r_end; r += mr ) {
+					__m256d a00 = _mm256_setzero_pd(), a01 = _mm256_setzero_pd();
+					__m256d a10 = _mm256_setzero_pd(), a11 = _mm256_setzero_pd();
+					__m256d a20 = _mm256_setzero_pd(), a21 = _mm256_setzero_pd();
+					__m256d a30 = _mm256_setzero_pd(), a31 = _mm256_setzero_pd();
+					const double * x0 = input + (size_t)(r  )*inputs;
+					const double * x1 = input + (size_t)(r+1)*inputs;
+					const double * x2 = input + (size_t)(r+2)*inputs;
+					const double * x3 = input + (size_t)(r+3)*inputs;
+
+					for ( int j = 0; j < inputs; ++j ) {
+						const double * w = panel + (size_t)j*nr + s;
+						__m256d w0 = _mm256_load_pd( w );
+						__m256d w1 = _mm256_load_pd( w+4 );
+						__m256d p;
+
+						p = _mm256_broadcast_sd( x0+j );
+						a00 = _mm256_add_pd( a00, _mm256_mul_pd( w0, p ));
+						a01 = _mm256_add_pd( a01, _mm256_mul_pd( w1, p ));
+						p = _mm256_broadcast_sd( x1+j );
+						a10 = _mm256_add_pd( a10, _mm256_mul_pd( w0, p ));
+						a11 = _mm256_add_pd( a11, _mm256_mul_pd( w1, p ));
+						p = _mm256_broadcast_sd( x2+j );
+						a20 = _mm256_add_pd( a20, _mm256_mul_pd( w0, p ));
+						a21 = _mm256_add_pd( a21, _mm256_mul_pd( w1, p ));
+						p = _mm256_broadcast_sd( x3+j );
+						a30 = _mm256_add_pd( a30, _mm256_mul_pd( w0, p ));
+						a31 = _mm256_add_pd( a31, _mm256_mul_pd( w1, p ));
+					}
+
+					double * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm256_add_pd( a00, b0 ), _mm256_add_pd( a01, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm256_add_pd( a10, b0 ), _mm256_add_pd( a11, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm256_add_pd( a20, b0 ), _mm256_add_pd( a21, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm256_add_pd( a30, b0 ), _mm256_add_pd( a31, b1 ), kn, activation );
+				}
+
+				// leftover rows that don't fill a full register block
+				for ( ; r < r_end; ++r ) {
+					__m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+					const double * x = input + (size_t)r*inputs;
+
+					for ( int j = 0; j < inputs; ++j ) {
+						const double * w = panel + (size_t)j*nr + s;
+						__m256d p = _mm256_broadcast_sd( x+j );
+						a0 = _mm256_add_pd( a0, _mm256_mul_pd( _mm256_load_pd( w ),   p ));
+						a1 = _mm256_add_pd( a1, _mm256_mul_pd( _mm256_load_pd( w+4 ), p ));
+					}
+
+					double * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm256_add_pd( a0, b0 ), _mm256_add_pd( a1, b1 ), kn, activation );
+				}
+			}
+		}
+	}
+}
+
+void block_sparse_avx2( double const * input, int rows, int inputs,
+	int const * block_start, int const * block_inputs, double const * blocks,
+	double const * bias, int neurons, double * output, Activation activation ) {
+
+	// same register blocking as dense_avx2, with the loop over
+	// inputs replaced by the stored blocks of the panel
+	const int row_tile = 64;
+	const int mr = 4;
+	const int nr = PANEL_WIDTH;
+	const int sub = 8;
+
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			int begin = block_start[ k0/nr ], end = block_start[ k0/nr + 1 ];
+
+			for ( int s = 0; s < nr && k0+s < neurons; s += sub ) {
+				int kn = neurons - k0 - s;
+				__m256d b0 = _mm256_load_pd( bias+k0+s );
+				__m256d b1 = _mm256_load_pd( bias+k0+s+4 );
+
+				int r = r0;
+				for ( ; r+mr <= r_end; r += mr ) {
+					__m256d a00 = _mm256_setzero_pd(), a01 = _mm256_setzero_pd();
+					__m256d a10 = _mm256_setzero_pd(), a11 = _mm256_setzero_pd();
+					__m256d a20 = _mm256_setzero_pd(), a21 = _mm256_setzero_pd();
+					__m256d a30 = _mm256_setzero_pd(), a31 = _mm256_setzero_pd();
+					const double * x0 = input + (size_t)(r  )*inputs;
+					const double * x1 = input + (size_t)(r+1)*inputs;
+					const double * x2 = input + (size_t)(r+2)*inputs;
+					const double * x3 = input + (size_t)(r+3)*inputs;
+
+					for ( int bb = begin; bb < end; ++bb ) {
+						const double * w = blocks + (size_t)bb*nr + s;
+						int j = block_inputs[bb];
+						__m256d w0 = _mm256_load_pd( w );
+						__m256d w1 = _mm256_load_pd( w+4 );
+						__m256d p;
+
+						p = _mm256_broadcast_sd( x0+j );
+						a00 = _mm256_add_pd( a00, _mm256_mul_pd( w0, p ));
+						a01 = _mm256_add_pd( a01, _mm256_mul_pd( w1, p ));
+						p = _mm256_broadcast_sd( x1+j );
+						a10 = _mm256_add_pd( a10, _mm256_mul_pd( w0, p ));
+						a11 = _mm256_add_pd( a11, _mm256_mul_pd( w1, p ));
+						p = _mm256_broadcast_sd( x2+j );
+						a20 = _mm256_add_pd( a20, _mm256_mul_pd( w0, p ));
+						a21 = _mm256_add_pd( a21, _mm256_mul_pd( w1, p ));
+						p = _mm256_broadcast_sd( x3+j );
+						a30 = _mm256_add_pd( a30, _mm256_mul_pd( w0, p ));
+						a31 = _mm256_add_pd( a31, _mm256_mul_pd( w1, p ));
+					}
+
+					double * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm256_add_pd( a00, b0 ), _mm256_add_pd( a01, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm256_add_pd( a10, b0 ), _mm256_add_pd( a11, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm256_add_pd( a20, b0 ), _mm256_add_pd( a21, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm256_add_pd( a30, b0 ), _mm256_add_pd( a31, b1 ), kn, activation );
+				}
+
+				// leftover rows that don't fill a full register block
+				for ( ; r < r_end; ++r ) {
+					__m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+					const double * x = input + (size_t)r*inputs;
+
+					for ( int bb = begin; bb < end; ++bb ) {
+						const double * w = blocks + (size_t)bb*nr + s;
+						int j = block_inputs[bb];
+						__m256d p = _mm256_broadcast_sd( x+j );
+						a0 = _mm256_add_pd( a0, _mm256_mul_pd( _mm256_load_pd( w ),   p ));
+						a1 = _mm256_add_pd( a1, _mm256_mul_pd( _mm256_load_pd( w+4 ), p ));
+					}
+
+					double * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm256_add_pd( a0, b0 ), _mm256_add_pd( a1, b1 ), kn, activation );
+				}
+			}
+		}
+	}
+}
+
+void dense_avx2_f32( float const * input, int rows, int inputs,
+	float const * weights, float const * bias, int neurons, float * output,
+	Activation activation ) {
+
+	// 4-row x 16-neuron register block, i.e. one panel as two
+	// 8-wide float vectors per row
+	const int row_tile = 64;
+	const int mr = 4;
+	const int nr = PANEL_WIDTH;
+
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			const float * panel = weights + (size_t)k0*inputs;
+			int kn = neurons - k0;
+			__m256 b0 = _mm256_load_ps( bias+k0 );
+			__m256 b1 = _mm256_load_ps( bias+k0+8 );
+
+			int r = r0;
+			for ( ; r+mr <= r_end; r += mr ) {
+				__m256 a00 = _mm256_setzero_ps(), a01 = _mm256_setzero_ps();
+				__m256 a10 = _mm256_setzero_ps(), a11 = _mm256_setzero_ps();
+				__m256 a20 = _mm256_setzero_ps(), a21 = _mm256_setzero_ps();
+				__m256 a30 = _mm256_setzero_ps(), a31 = _mm256_setzero_ps();
+				const float * x0 = input + (size_t)(r  )*inputs;
+				const float * x1 = input + (size_t)(r+1)*inputs;
+				const float * x2 = input + (size_t)(r+2)*inputs;
+				const float * x3 = input + (size_t)(r+3)*inputs;
+
+				for ( int j = 0; j < inputs; ++j ) {
+					const float * w = panel + (size_t)j*nr;
+					__m256 w0 = _mm256_load_ps( w );
+					__m256 w1 = _mm256_load_ps( w+8 );
+					__m256 p;
+
+					p = _mm256_broadcast_ss( x0+j );
+					a00 = _mm256_add_ps( a00, _mm256_mul_ps( w0, p ));
+					a01 = _mm256_add_ps( a01, _mm256_mul_ps( w1, p ));
+					p = _mm256_broadcast_ss( x1+j );
+					a10 = _mm256_add_ps( a10, _mm256_mul_ps( w0, p ));
+					a11 = _mm256_add_ps( a11, _mm256_mul_ps( w1, p ));
+					p = _mm256_broadcast_ss( x2+j );
+					a20 = _mm256_add_ps( a20, _mm256_mul_ps( w0, p ));
+					a21 = _mm256_add_ps( a21, _mm256_mul_ps( w1, p ));
+					p = _mm256_broadcast_ss( x3+j );
+					a30 = _mm256_add_ps( a30, _mm256_mul_ps( w0, p ));
+					a31 = _mm256_add_ps( a31, _mm256_mul_ps( w1, p ));
+				}
+
+				float * y = output + (size_t)r*neurons + k0;
+				store_block( y, _mm256_add_ps( a00, b0 ), _mm256_add_ps( a01, b1 ), kn, activation );
+				y += neurons;
+				store_block( y, _mm256_add_ps( a10, b0 ), _mm256_add_ps( a11, b1 ), kn, activation );
+				y += neurons;
+				store_block( y, _mm256_add_ps( a20, b0 ), _mm256_add_ps( a21, b1 ), kn, activation );
+				y += neurons;
+				store_block( y, _mm256_add_ps( a30, b0 ), _mm256_add_ps( a31, b1 ), kn, activation );
+			}
+
+			// leftover rows that don't fill a full register block
+			for ( ; r < r_end; ++r ) {
+				__m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+				const float * x = input + (size_t)r*inputs;
+
+				for ( int j = 0; j < inputs; ++j ) {
+					const float * w = panel + (size_t)j*nr;
+					__m256 p = _mm256_broadcast_ss( x+j );
+					a0 = _mm256_add_ps( a0, _mm256_mul_ps( _mm256_load_ps( w ),   p ));
+					a1 = _mm256_add_ps( a1, _mm256_mul_ps( _mm256_load_ps( w+8 ), p ));
+				}
+
+				float * y = output + (size_t)r*neurons + k0;
+				store_block( y, _mm256_add_ps( a0, b0 ), _mm256_add_ps( a1, b1 ), kn, activation );
+			}
+		}
+	}
+}
+
+void sparse_dense_avx2( int const * row_start, int const * columns,
+	double const * values, int rows, int inputs, double const * weights,
+	double const * bias, int neurons, double * output,
+	Activation activation ) {
+
+	// one row x one panel at a time, as four 4-wide vectors
+	const int nr = PANEL_WIDTH;
+
+	for ( int r = 0; r < rows; ++r ) {
+		int begin = row_start[r], end = row_start[r+1];
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			const double * panel = weights + (size_t)k0*inputs;
+			int kn = neurons - k0;
+			__m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+			__m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+
+			for ( int e = begin; e < end; ++e ) {
+				const double * w = panel + (size_t)columns[e]*nr;
+				__m256d p = _mm256_set1_pd( values[e] );
+				a0 = _mm256_add_pd( a0, _mm256_mul_pd( _mm256_load_pd( w    ), p ));
+				a1 = _mm256_add_pd( a1, _mm256_mul_pd( _mm256_load_pd( w+4  ), p ));
+				a2 = _mm256_add_pd( a2, _mm256_mul_pd( _mm256_load_pd( w+8  ), p ));
+				a3 = _mm256_add_pd( a3, _mm256_mul_pd( _mm256_load_pd( w+12 ), p ));
+			}
+
+			double * y = output + (size_t)r*neurons + k0;
+			store_block( y,
+				_mm256_add_pd( a0, _mm256_load_pd( bias+k0   )),
+				_mm256_add_pd( a1, _mm256_load_pd( bias+k0+4 )), kn, activation );
+			if ( kn > 8 ) {
+				store_block( y+8,
+					_mm256_add_pd( a2, _mm256_load_pd( bias+k0+8  )),
+					_mm256_add_pd( a3, _mm256_load_pd( bias+k0+12 )), kn-8, activation );
+			}
+		}
+	}
+}
+
+void dense_int8_avx2( int8_t const * input, int rows, int inputs,
+	int8_t const * weights, int32_t const * weight_sums, float const * scale,
+	float const * bias, int neurons, float * output ) {
+
+	// Without VNNI, int8 values are widened to int16 and multiplied
+	// with madd, which sums adjacent pairs. Each 4-neuron chunk of a
+	// panel gives two partial sums per neuron, combined after the loop
+	const int nr = PANEL_WIDTH;
+	int groups = inputs / INT8_GROUP;
+
+	for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+		const int8_t * panel = weights + (size_t)k0*inputs;
+		int kn = neurons - k0;
+		__m256 s0 = _mm256_load_ps( scale+k0 ), s1 = _mm256_load_ps( scale+k0+8 );
+		__m256 b0 = _mm256_load_ps( bias+k0 ),  b1 = _mm256_load_ps( bias+k0+8 );
+
+		for ( int r = 0; r < rows; ++r ) {
+			__m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+			__m256i a2 = _mm256_setzero_si256(), a3 = _mm256_setzero_si256();
+			const int8_t * x = input + (size_t)r*inputs;
+
+			for ( int g = 0; g < groups; ++g ) {
+				int32_t group;
+				memcpy( &group, x + g*INT8_GROUP, sizeof( group ));
+				__m256i xv = _mm256_cvtepi8_epi16( _mm_set1_epi32( group ));
+
+				const int8_t * w = panel + (size_t)g*nr*INT8_GROUP;
+				a0 = _mm256_add_epi32( a0, _mm256_madd_epi16( xv,
+					_mm256_cvtepi8_epi16( _mm_load_si128( (__m128i const *)( w )))));
+				a1 = _mm256_add_epi32( a1, _mm256_madd_epi16( xv,
+					_mm256_cvtepi8_epi16( _mm_load_si128( (__m128i const *)( w+16 )))));
+				a2 = _mm256_add_epi32( a2, _mm256_madd_epi16( xv,
+					_mm256_cvtepi8_epi16( _mm_load_si128( (__m128i const *)( w+32 )))));
+				a3 = _mm256_add_epi32( a3, _mm256_madd_epi16( xv,
+					_mm256_cvtepi8_epi16( _mm_load_si128( (__m128i const *)( w+48 )))));
+			}
+
+			// pairwise sums come out as neurons 0,1,4,5 | 2,3,6,7,
+			// so swap the middle 64-bit elements back into order
+			__m256i lo = _mm256_permute4x64_epi64( _mm256_hadd_epi32( a0, a1 ), _MM_SHUFFLE( 3,1,2,0 ));
+			__m256i hi = _mm256_permute4x64_epi64( _mm256_hadd_epi32( a2, a3 ), _MM_SHUFFLE( 3,1,2,0 ));
+
+			float * y = output + (size_t)r*neurons + k0;
+			store_block( y,
+				_mm256_add_ps( _mm256_mul_ps( _mm256_cvtepi32_ps( lo ), s0 ), b0 ),
+				_mm256_add_ps( _mm256_mul_ps( _mm256_cvtepi32_ps( hi ), s1 ), b1 ), kn );
+		}
+	}
+}
+
+namespace {
+
+// fast exp, the same steps as the generic kernel four or eight
+// values at a time, with 2^n built from its exponent bits
+inline __m256d fast_exp( __m256d x ) {
+	x = _mm256_min_pd( _mm256_set1_pd( FAST_EXP_MAX ),
+		_mm256_max_pd( _mm256_set1_pd( -FAST_EXP_MAX ), x ));
+	__m256d n = _mm256_floor_pd( _mm256_add_pd(
+		_mm256_mul_pd( x, _mm256_set1_pd( FAST_EXP_LOG2E )), _mm256_set1_pd( 0.5 )));
+	__m256d r = _mm256_sub_pd( x, _mm256_mul_pd( n, _mm256_set1_pd( FAST_EXP_LN2_HI )));
+	r = _mm256_sub_pd( r, _mm256_mul_pd( n, _mm256_set1_pd( FAST_EXP_LN2_LO )));
+
+	__m256d p = _mm256_set1_pd( FAST_EXP_COEFFS[ FAST_EXP_DEGREE ] );
+	for ( int k = FAST_EXP_DEGREE-1; k >= 0; --k ) {
+		p = _mm256_add_pd( _mm256_mul_pd( p, r ), _mm256_set1_pd( FAST_EXP_COEFFS[ k ] ));
+	}
+
+	__m256i e = _mm256_cvtepi32_epi64( _mm256_cvtpd_epi32( n ));
+	e = _mm256_slli_epi64( _mm256_add_epi64( e, _mm256_set1_epi64x( 1023 )), 52 );
+	return _mm256_mul_pd( p, _mm256_castsi256_pd( e ));
+}
+
+inline __m256 fast_exp( __m256 x ) {
+	x = _mm256_min_ps( _mm256_set1_ps( FAST_EXPF_MAX ),
+		_mm256_max_ps( _mm256_set1_ps( -FAST_EXPF_MAX ), x ));
+	__m256 n = _mm256_floor_ps( _mm256_add_ps(
+		_mm256_mul_ps( x, _mm256_set1_ps( FAST_EXPF_LOG2E )), _mm256_set1_ps( 0.5f )));
+	__m256 r = _mm256_sub_ps( x, _mm256_mul_ps( n, _mm256_set1_ps( FAST_EXPF_LN2_HI )));
+	r = _mm256_sub_ps( r, _mm256_mul_ps( n, _mm256_set1_ps( FAST_EXPF_LN2_LO )));
+
+	__m256 p = _mm256_set1_ps( (float)FAST_EXP_COEFFS[ FAST_EXPF_DEGREE ] );
+	for ( int k = FAST_EXPF_DEGREE-1; k >= 0; --k ) {
+		p = _mm256_add_ps( _mm256_mul_ps( p, r ), _mm256_set1_ps( (float)FAST_EXP_COEFFS[ k ] ));
+	}
+
+	__m256i e = _mm256_slli_epi32( _mm256_add_epi32( _mm256_cvtps_epi32( n ), _mm256_set1_epi32( 127 )), 23 );
+	return _mm256_mul_ps( p, _mm256_castsi256_ps( e ));
+}
+
+inline __m256d fast_activate( __m256d y, Activation activation ) {
+	const __m256d one = _mm256_set1_pd( 1 );
+	switch ( activation ) {
+	case RELU:
+		return _mm256_max_pd( _mm256_setzero_pd(), y );
+	case SIGMOID:
+		return _mm256_div_pd( one, _mm256_add_pd( one,
+			fast_exp( _mm256_mul_pd( _mm256_set1_pd( -1 ), y ))));
+	case TANH:
+		return _mm256_sub_pd( _mm256_div_pd( _mm256_set1_pd( 2 ), _mm256_add_pd( one,
+			fast_exp( _mm256_mul_pd( _mm256_set1_pd( -2 ), y )))), one );
+	case SOFTMAX:
+		return fast_exp( y );
+	default:
+		return y;
+	}
+}
+
+inline __m256 fast_activate( __m256 y, Activation activation ) {
+	const __m256 one = _mm256_set1_ps( 1 );
+	switch ( activation ) {
+	case RELU:
+		return _mm256_max_ps( _mm256_setzero_ps(), y );
+	case SIGMOID:
+		return _mm256_div_ps( one, _mm256_add_ps( one,
+			fast_exp( _mm256_mul_ps( _mm256_set1_ps( -1 ), y ))));
+	case TANH:
+		return _mm256_sub_ps( _mm256_div_ps( _mm256_set1_ps( 2 ), _mm256_add_ps( one,
+			fast_exp( _mm256_mul_ps( _mm256_set1_ps( -2 ), y )))), one );
+	case SOFTMAX:
+		return fast_exp( y );
+	default:
+		return y;
+	}
+}
+
+inline __m256d load( double const * p ) { return _mm256_loadu_pd( p ); }
+inline __m256 load( float const * p ) { return _mm256_loadu_ps( p ); }
+inline void store( double * p, __m256d v ) { _mm256_storeu_pd( p, v ); }
+inline void store( float * p, __m256 v ) { _mm256_storeu_ps( p, v ); }
+
+// softmax takes exp here and is normalized separately
+template <typename T, typename V>
+void fast_map( T * y, size_t n, Activation activation ) {
+	const int width = sizeof( V )/sizeof( T );
+	size_t k = 0;
+	for ( ; k+width <= n; k += width ) {
+		store( y+k, fast_activate( load( y+k ), activation ));
+	}
+	if ( k < n ) {
+		alignas( 32 ) T tmp[ width ] = {};
+		copy( y+k, y+n, tmp );
+		store( tmp, fast_activate( load( tmp ), activation ));
+		copy( tmp, tmp+(n-k), y+k );
+	}
+}
+
+template <typename T, typename V>
+void fast_activation_rows( T * y, int rows, int cols, Activation activation ) {
+	if ( activation == LINEAR ) return;
+	fast_map<T,V>( y, (size_t)rows*cols, activation );
+	if ( activation == SOFTMAX ) normalize_rows( y, rows, cols );
+}
+
+} // namespace
+
+void fast_activation_avx2( double * y, int rows, int cols, Activation activation ) {
+	fast_activation_rows<double,__m256d>( y, rows, cols, activation );
+}
+
+void fast_activation_avx2_f32( float * y, int rows, int cols, Activation activation ) {
+	fast_activation_rows<float,__m256>( y, rows, cols, activation );
+}
+
+} // namespace kernels
+} // namespace keras
+
+#endif // KERAS_X86_KERNELS
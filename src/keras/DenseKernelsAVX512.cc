@@ -0,0 +1,464 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/DenseKernelsAVX512.cc
+@brief AVX-512 dense kernel. Compiled with -mavx512f, only called
+when cpuid reports AVX-512F support
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/DenseKernels.hh"
+
+#ifdef KERAS_X86_KERNELS
+
+#include <algorithm>
+#include <immintrin.h>
+
+using namespace std;
+
+namespace keras {
+namespace kernels {
+
+namespace {
+
+// write the first n values of a block, for the last panel when the
+// number of neurons isn't a multiple of the panel width, then apply
+// a fused activation while the block is still in cache
+inline void store_block( double * y, __m512d lo, __m512d hi, int n, Activation activation=LINEAR ) {
+	if ( n >= 16 ) {
+		_mm512_storeu_pd( y,   lo );
+		_mm512_storeu_pd( y+8, hi );
+	} else {
+		alignas( 64 ) double tmp[ 16 ];
+		_mm512_store_pd( tmp,   lo );
+		_mm512_store_pd( tmp+8, hi );
+		for ( int c = 0; c < n; ++c ) y[c] = tmp[c];
+	}
+	if ( activation != LINEAR ) activate_block( y, min( n, 16 ), activation );
+}
+
+inline void store_block( float * y, __m512 v, int n, Activation activation=LINEAR ) {
+	if ( n >= 16 ) {
+		_mm512_storeu_ps( y, v );
+	} else {
+		alignas( 64 ) float tmp[ 16 ];
+		_mm512_store_ps( tmp, v );
+		for ( int c = 0; c < n; ++c ) y[c] = tmp[c];
+	}
+	if ( activation != LINEAR ) activate_block( y, min( n, 16 ), activation );
+}
+
+} // namespace
+
+void dense_avx512( double const * input, int rows, int inputs,
+	double const * weights, double const * bias, int neurons, double * output,
+	Activation activation ) {
+
+	// 4-row x 16-neuron register block, i.e. one panel as two 8-wide
+	// vectors per row.
+	// Multiply and add are kept separate (no FMA) so results are
+	// identical to the generic kernel
+	const int row_tile = 64;
+	const int mr = 4;
+	const int nr = PANEL_WIDTH;
+	const int sub = 16;
+
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			const double * panel = weights + (size_t)k0*inputs;
+
+			for ( int s = 0; s < nr && k0+s < neurons; s += sub ) {
+				int kn = neurons - k0 - s;
+				__m512d b0 = _mm512_load_pd( bias+k0+s );
+				__m512d b1 = _mm512_load_pd( bias+k0+s+8 );
+
+				int r = r0;
+				for ( ; r+mr <= r_end; r += mr ) {
+					__m512d a00 = _mm512_setzero_pd(), a01 = _mm512_setzero_pd();
+					__m512d a10 = _mm512_setzero_pd(), a11 = _mm512_setzero_pd();
+					__m512d a20 = _mm512_setzero_pd(), a21 = _mm512_setzero_pd();
+					__m512d a30 = _mm512_setzero_pd(), a31 = _mm512_setzero_pd();
+					const double * x0 = input + (size_t)(r  )*inputs;
+					const double * x1 = input + (size_t)(r+1)*inputs;
+					const double * x2 = input + (size_t)(r+2)*inputs;
+					const double * x3 = input + (size_t)(r+3)*inputs;
+
+					for ( int j = 0; j < inputs; ++j ) {
+						const double * w = panel + (size_t)j*nr + s;
+						__m512d w0 = _mm512_load_pd( w );
+						__m512d w1 = _mm512_load_pd( w+8 );
+						__m512d p;
+
+						p = _mm512_set1_pd( x0[j] );
+						a00 = _mm512_add_pd( a00, _mm512_mul_pd( w0, p ));
+						a01 = _mm512_add_pd( a01, _mm512_mul_pd( w1, p ));
+						p = _mm512_set1_pd( x1[j] );
+						a10 = _mm512_add_pd( a10, _mm512_mul_pd( w0, p ));
+						a11 = _mm512_add_pd( a11, _mm512_mul_pd( w1, p ));
+						p = _mm512_set1_pd( x2[j] );
+						a20 = _mm512_add_pd( a20, _mm512_mul_pd( w0, p ));
+						a21 = _mm512_add_pd( a21, _mm512_mul_pd( w1, p ));
+						p = _mm512_set1_pd( x3[j] );
+						a30 = _mm512_add_pd( a30, _mm512_mul_pd( w0, p ));
+						a31 = _mm512_add_pd( a31, _mm512_mul_pd( w1, p ));
+					}
+
+					double * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm512_add_pd( a00, b0 ), _mm512_add_pd( a01, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm512_add_pd( a10, b0 ), _mm512_add_pd( a11, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm512_add_pd( a20, b0 ), _mm512_add_pd( a21, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm512_add_pd( a30, b0 ), _mm512_add_pd( a31, b1 ), kn, activation );
+				}
+
+				// leftover rows that don't fill a full register block
+				for ( ; r < r_end; ++r ) {
+					__m512d a0 = _mm512_setzero_pd(), a1 = _mm512_setzero_pd();
+					const double * x = input + (size_t)r*inputs;
+
+					for ( int j = 0; j < inputs; ++j ) {
+						const double * w = panel + (size_t)j*nr + s;
+						__m512d p = _mm512_set1_pd( x[j] );
+						a0 = _mm512_add_pd( a0, _mm512_mul_pd( _mm512_load_pd( w ),   p ));
+						a1 = _mm512_add_pd( a1, _mm512_mul_pd( _mm512_load_pd( w+8 ), p ));
+					}
+
+					double * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm512_add_pd( a0, b0 ), _mm512_add_pd( a1, b1 ), kn, activation );
+				}
+			}
+		}
+	}
+}
+
+void block_sparse_avx512( double const * input, int rows, int inputs,
+	int const * block_start, int const * block_inputs, double const * blocks,
+	double const * bias, int neurons, double * output, Activation activation ) {
+
+	// same register blocking as dense_avx512, with the loop over
+	// inputs replaced by the stored blocks of the panel
+	const int row_tile = 64;
+	const int mr = 4;
+	const int nr = PANEL_WIDTH;
+	const int sub = 16;
+
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			int begin = block_start[ k0/nr ], end = block_start[ k0/nr + 1 ];
+
+			for ( int s = 0; s < nr && k0+s < neurons; s += sub ) {
+				int kn = neurons - k0 - s;
+				__m512d b0 = _mm512_load_pd( bias+k0+s );
+				__m512d b1 = _mm512_load_pd( bias+k0+s+8 );
+
+				int r = r0;
+				for ( ; r+mr <= r_end; r += mr ) {
+					__m512d a00 = _mm512_setzero_pd(), a01 = _mm512_setzero_pd();
+					__m512d a10 = _mm512_setzero_pd(), a11 = _mm512_setzero_pd();
+					__m512d a20 = _mm512_setzero_pd(), a21 = _mm512_setzero_pd();
+					__m512d a30 = _mm512_setzero_pd(), a31 = _mm512_setzero_pd();
+					const double * x0 = input + (size_t)(r  )*inputs;
+					const double * x1 = input + (size_t)(r+1)*inputs;
+					const double * x2 = input + (size_t)(r+2)*inputs;
+					const double * x3 = input + (size_t)(r+3)*inputs;
+
+					for ( int bb = begin; bb < end; ++bb ) {
+						const double * w = blocks + (size_t)bb*nr + s;
+						int j = block_inputs[bb];
+						__m512d w0 = _mm512_load_pd( w );
+						__m512d w1 = _mm512_load_pd( w+8 );
+						__m512d p;
+
+						p = _mm512_set1_pd( x0[j] );
+						a00 = _mm512_add_pd( a00, _mm512_mul_pd( w0, p ));
+						a01 = _mm512_add_pd( a01, _mm512_mul_pd( w1, p ));
+						p = _mm512_set1_pd( x1[j] );
+						a10 = _mm512_add_pd( a10, _mm512_mul_pd( w0, p ));
+						a11 = _mm512_add_pd( a11, _mm512_mul_pd( w1, p ));
+						p = _mm512_set1_pd( x2[j] );
+						a20 = _mm512_add_pd( a20, _mm512_mul_pd( w0, p ));
+						a21 = _mm512_add_pd( a21, _mm512_mul_pd( w1, p ));
+						p = _mm512_set1_pd( x3[j] );
+						a30 = _mm512_add_pd( a30, _mm512_mul_pd( w0, p ));
+						a31 = _mm512_add_pd( a31, _mm512_mul_pd( w1, p ));
+					}
+
+					double * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm512_add_pd( a00, b0 ), _mm512_add_pd( a01, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm512_add_pd( a10, b0 ), _mm512_add_pd( a11, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm512_add_pd( a20, b0 ), _mm512_add_pd( a21, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm512_add_pd( a30, b0 ), _mm512_add_pd( a31, b1 ), kn, activation );
+				}
+
+				// leftover rows that don't fill a full register block
+				for ( ; r < r_end; ++r ) {
+					__m512d a0 = _mm512_setzero_pd(), a1 = _mm512_setzero_pd();
+					const double * x = input + (size_t)r*inputs;
+
+					for ( int bb = begin; bb < end; ++bb ) {
+						const double * w = blocks + (size_t)bb*nr + s;
+						int j = block_inputs[bb];
+						__m512d p = _mm512_set1_pd( x[j] );
+						a0 = _mm512_add_pd( a0, _mm512_mul_pd( _mm512_load_pd( w ),   p ));
+						a1 = _mm512_add_pd( a1, _mm512_mul_pd( _mm512_load_pd( w+8 ), p ));
+					}
+
+					double * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm512_add_pd( a0, b0 ), _mm512_add_pd( a1, b1 ), kn, activation );
+				}
+			}
+		}
+	}
+}
+
+void sparse_dense_avx512( int const * row_start, int const * columns,
+	double const * values, int rows, int inputs, double const * weights,
+	double const * bias, int neurons, double * output,
+	Activation activation ) {
+
+	// one row x four panels at a time, so each entry feeds eight
+	// independent accumulators instead of waiting on two
+	const int nr = PANEL_WIDTH;
+	const int np = 4;
+	size_t panel_size = (size_t)nr*inputs;
+
+	for ( int r = 0; r < rows; ++r ) {
+		int begin = row_start[r], end = row_start[r+1];
+		double * y = output + (size_t)r*neurons;
+
+		int k0 = 0;
+		for ( ; k0 + np*nr <= neurons; k0 += np*nr ) {
+			const double * panel = weights + (size_t)k0*inputs;
+			__m512d a0 = _mm512_setzero_pd(), a1 = _mm512_setzero_pd();
+			__m512d a2 = _mm512_setzero_pd(), a3 = _mm512_setzero_pd();
+			__m512d a4 = _mm512_setzero_pd(), a5 = _mm512_setzero_pd();
+			__m512d a6 = _mm512_setzero_pd(), a7 = _mm512_setzero_pd();
+
+			for ( int e = begin; e < end; ++e ) {
+				const double * w = panel + (size_t)columns[e]*nr;
+				__m512d p = _mm512_set1_pd( values[e] );
+				a0 = _mm512_add_pd( a0, _mm512_mul_pd( _mm512_load_pd( w   ), p ));
+				a1 = _mm512_add_pd( a1, _mm512_mul_pd( _mm512_load_pd( w+8 ), p ));
+				w += panel_size;
+				a2 = _mm512_add_pd( a2, _mm512_mul_pd( _mm512_load_pd( w   ), p ));
+				a3 = _mm512_add_pd( a3, _mm512_mul_pd( _mm512_load_pd( w+8 ), p ));
+				w += panel_size;
+				a4 = _mm512_add_pd( a4, _mm512_mul_pd( _mm512_load_pd( w   ), p ));
+				a5 = _mm512_add_pd( a5, _mm512_mul_pd( _mm512_load_pd( w+8 ), p ));
+				w += panel_size;
+				a6 = _mm512_add_pd( a6, _mm512_mul_pd( _mm512_load_pd( w   ), p ));
+				a7 = _mm512_add_pd( a7, _mm512_mul_pd( _mm512_load_pd( w+8 ), p ));
+			}
+
+			double const * bk = bias + k0;
+			_mm512_storeu_pd( y+k0,    _mm512_add_pd( a0, _mm512_load_pd( bk    )));
+			_mm512_storeu_pd( y+k0+8,  _mm512_add_pd( a1, _mm512_load_pd( bk+8  )));
+			_mm512_storeu_pd( y+k0+16, _mm512_add_pd( a2, _mm512_load_pd( bk+16 )));
+			_mm512_storeu_pd( y+k0+24, _mm512_add_pd( a3, _mm512_load_pd( bk+24 )));
+			_mm512_storeu_pd( y+k0+32, _mm512_add_pd( a4, _mm512_load_pd( bk+32 )));
+			_mm512_storeu_pd( y+k0+40, _mm512_add_pd( a5, _mm512_load_pd( bk+40 )));
+			_mm512_storeu_pd( y+k0+48, _mm512_add_pd( a6, _mm512_load_pd( bk+48 )));
+			_mm512_storeu_pd( y+k0+56, _mm512_add_pd( a7, _mm512_load_pd( bk+56 )));
+			if ( activation != LINEAR ) activate_block( y+k0, np*nr, activation );
+		}
+
+		// leftover panels one at a time
+		for ( ; k0 < neurons; k0 += nr ) {
+			const double * panel = weights + (size_t)k0*inputs;
+			__m512d lo = _mm512_setzero_pd(), hi = _mm512_setzero_pd();
+
+			for ( int e = begin; e < end; ++e ) {
+				const double * w = panel + (size_t)columns[e]*nr;
+				__m512d p = _mm512_set1_pd( values[e] );
+				lo = _mm512_add_pd( lo, _mm512_mul_pd( _mm512_load_pd( w   ), p ));
+				hi = _mm512_add_pd( hi, _mm512_mul_pd( _mm512_load_pd( w+8 ), p ));
+			}
+
+			store_block( y+k0,
+				_mm512_add_pd( lo, _mm512_load_pd( bias+k0   )),
+				_mm512_add_pd( hi, _mm512_load_pd( bias+k0+8 )), neurons-k0, activation );
+		}
+	}
+}
+
+void dense_avx512_f32( float const * input, int rows, int inputs,
+	float const * weights, float const * bias, int neurons, float * output,
+	Activation activation ) {
+
+	// 8-row x 16-neuron register block. A panel fits in a single
+	// 16-wide float vector, so more rows share each weight load
+	const int row_tile = 64;
+	const int mr = 8;
+	const int nr = PANEL_WIDTH;
+
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			const float * panel = weights + (size_t)k0*inputs;
+			int kn = neurons - k0;
+			__m512 b = _mm512_load_ps( bias+k0 );
+
+			int r = r0;
+			for ( ; r+mr <= r_end; r += mr ) {
+				__m512 a[ mr ];
+				for ( int m = 0; m < mr; ++m ) a[m] = _mm512_setzero_ps();
+				const float * x = input + (size_t)r*inputs;
+
+				for ( int j = 0; j < inputs; ++j ) {
+					__m512 w = _mm512_load_ps( panel + (size_t)j*nr );
+					for ( int m = 0; m < mr; ++m ) {
+						a[m] = _mm512_add_ps( a[m], _mm512_mul_ps( w, _mm512_set1_ps( x[ (size_t)m*inputs + j ] )));
+					}
+				}
+
+				for ( int m = 0; m < mr; ++m ) {
+					store_block( output + (size_t)(r+m)*neurons + k0, _mm512_add_ps( a[m], b ), kn, activation );
+				}
+			}
+
+			// leftover rows that don't fill a full register block
+			for ( ; r < r_end; ++r ) {
+				__m512 a = _mm512_setzero_ps();
+				const float * x = input + (size_t)r*inputs;
+
+				for ( int j = 0; j < inputs; ++j ) {
+					a = _mm512_add_ps( a, _mm512_mul_ps( _mm512_load_ps( panel + (size_t)j*nr ),
+						_mm512_set1_ps( x[j] )));
+				}
+
+				store_block( output + (size_t)r*neurons + k0, _mm512_add_ps( a, b ), kn, activation );
+			}
+		}
+	}
+}
+
+namespace {
+
+// fast exp, the same steps as the generic kernel eight or sixteen
+// values at a time, with 2^n built from its exponent bits
+inline __m512d fast_exp( __m512d x ) {
+	x = _mm512_min_pd( _mm512_set1_pd( FAST_EXP_MAX ),
+		_mm512_max_pd( _mm512_set1_pd( -FAST_EXP_MAX ), x ));
+	__m512d n = _mm512_roundscale_pd( _mm512_add_pd(
+		_mm512_mul_pd( x, _mm512_set1_pd( FAST_EXP_LOG2E )), _mm512_set1_pd( 0.5 )),
+		_MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC );
+	__m512d r = _mm512_sub_pd( x, _mm512_mul_pd( n, _mm512_set1_pd( FAST_EXP_LN2_HI )));
+	r = _mm512_sub_pd( r, _mm512_mul_pd( n, _mm512_set1_pd( FAST_EXP_LN2_LO )));
+
+	__m512d p = _mm512_set1_pd( FAST_EXP_COEFFS[ FAST_EXP_DEGREE ] );
+	for ( int k = FAST_EXP_DEGREE-1; k >= 0; --k ) {
+		p = _mm512_add_pd( _mm512_mul_pd( p, r ), _mm512_set1_pd( FAST_EXP_COEFFS[ k ] ));
+	}
+
+	__m512i e = _mm512_cvtepi32_epi64( _mm512_cvtpd_epi32( n ));
+	e = _mm512_slli_epi64( _mm512_add_epi64( e, _mm512_set1_epi64( 1023 )), 52 );
+	return _mm512_mul_pd( p, _mm512_castsi512_pd( e ));
+}
+
+inline __m512 fast_exp( __m512 x ) {
+	x = _mm512_min_ps( _mm512_set1_ps( FAST_EXPF_MAX ),
+		_mm512_max_ps( _mm512_set1_ps( -FAST_EXPF_MAX ), x ));
+	__m512 n = _mm512_roundscale_ps( _mm512_add_ps(
+		_mm512_mul_ps( x, _mm512_set1_ps( FAST_EXPF_LOG2E )), _mm512_set1_ps( 0.5f )),
+		_MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC );
+	__m512 r = _mm512_sub_ps( x, _mm512_mul_ps( n, _mm512_set1_ps( FAST_EXPF_LN2_HI )));
+	r = _mm512_sub_ps( r, _mm512_mul_ps( n, _mm512_set1_ps( FAST_EXPF_LN2_LO )));
+
+	__m512 p = _mm512_set1_ps( (float)FAST_EXP_COEFFS[ FAST_EXPF_DEGREE ] );
+	for ( int k = FAST_EXPF_DEGREE-1; k >= 0; --k ) {
+		p = _mm512_add_ps( _mm512_mul_ps( p, r ), _mm512_set1_ps( (float)FAST_EXP_COEFFS[ k ] ));
+	}
+
+	__m512i e = _mm512_slli_epi32( _mm512_add_epi32( _mm512_cvtps_epi32( n ), _mm512_set1_epi32( 127 )), 23 );
+	return _mm512_mul_ps( p, _mm512_castsi512_ps( e ));
+}
+
+inline __m512d fast_activate( __m512d y, Activation activation ) {
+	const __m512d one = _mm512_set1_pd( 1 );
+	switch ( activation ) {
+	case RELU:
+		return _mm512_max_pd( _mm512_setzero_pd(), y );
+	case SIGMOID:
+		return _mm512_div_pd( one, _mm512_add_pd( one,
+			fast_exp( _mm512_mul_pd( _mm512_set1_pd( -1 ), y ))));
+	case TANH:
+		return _mm512_sub_pd( _mm512_div_pd( _mm512_set1_pd( 2 ), _mm512_add_pd( one,
+			fast_exp( _mm512_mul_pd( _mm512_set1_pd( -2 ), y )))), one );
+	case SOFTMAX:
+		return fast_exp( y );
+	default:
+		return y;
+	}
+}
+
+inline __m512 fast_activate( __m512 y, Activation activation ) {
+	const __m512 one = _mm512_set1_ps( 1 );
+	switch ( activation ) {
+	case RELU:
+		return _mm512_max_ps( _mm512_setzero_ps(), y );
+	case SIGMOID:
+		return _mm512_div_ps( one, _mm512_add_ps( one,
+			fast_exp( _mm512_mul_ps( _mm512_set1_ps( -1 ), y ))));
+	case TANH:
+		return _mm512_sub_ps( _mm512_div_ps( _mm512_set1_ps( 2 ), _mm512_add_ps( one,
+			fast_exp( _mm512_mul_ps( _mm512_set1_ps( -2 ), y )))), one );
+	case SOFTMAX:
+		return fast_exp( y );
+	default:
+		return y;
+	}
+}
+
+inline __m512d load( double const * p ) { return _mm512_loadu_pd( p ); }
+inline __m512 load( float const * p ) { return _mm512_loadu_ps( p ); }
+inline void store( double * p, __m512d v ) { _mm512_storeu_pd( p, v ); }
+inline void store( float * p, __m512 v ) { _mm512_storeu_ps( p, v ); }
+
+// softmax takes exp here and is normalized separately
+template <typename T, typename V>
+void fast_map( T * y, size_t n, Activation activation ) {
+	const int width = sizeof( V )/sizeof( T );
+	size_t k = 0;
+	for ( ; k+width <= n; k += width ) {
+		store( y+k, fast_activate( load( y+k ), activation ));
+	}
+	if ( k < n ) {
+		alignas( 64 ) T tmp[ width ] = {};
+		copy( y+k, y+n, tmp );
+		store( tmp, fast_activate( load( tmp ), activation ));
+		copy( tmp, tmp+(n-k), y+k );
+	}
+}
+
+template <typename T, typename V>
+void fast_activation_rows( T * y, int rows, int cols, Activation activation ) {
+	if ( activation == LINEAR ) return;
+	fast_map<T,V>( y, (size_t)rows*cols, activation );
+	if ( activation == SOFTMAX ) normalize_rows( y, rows, cols );
+}
+
+} // namespace
+
+void fast_activation_avx512( double * y, int rows, int cols, Activation activation ) {
+	fast_activation_rows<double,__m512d>( y, rows, cols, activation );
+}
+
+void fast_activation_avx512_f32( float * y, int rows, int cols, Activation activation ) {
+	fast_activation_rows<float,__m512>( y, rows, cols, activation );
+}
+
+} // namespace kernels
+} // namespace keras
+
+#endif // KERAS_X86_KERNELS
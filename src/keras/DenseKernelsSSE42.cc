@@ -0,0 +1,226 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/DenseKernelsSSE42.cc
+@brief SSE4.2 dense kernel. Compiled with -msse4.2, only called
+when cpuid reports SSE4.2 support
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/DenseKernels.hh"
+
+#ifdef KERAS_X86_KERNELS
+
+#include <algorithm>
+#include <nmmintrin.h>
+
+using namespace std;
+
+namespace keras {
+namespace kernels {
+
+namespace {
+
+// write the first n values of a block, for the last panel when the
+// number of neurons isn't a multiple of the panel width, then apply
+// a fused activation while the block is still in cache
+inline void store_block( double * y, __m128d lo, __m128d hi, int n, Activation activation=LINEAR ) {
+	if ( n >= 4 ) {
+		_mm_storeu_pd( y,   lo );
+		_mm_storeu_pd( y+2, hi );
+	} else {
+		alignas( 64 ) double tmp[ 4 ];
+		_mm_store_pd( tmp,   lo );
+		_mm_store_pd( tmp+2, hi );
+		for ( int c = 0; c < n; ++c ) y[c] = tmp[c];
+	}
+	if ( activation != LINEAR ) activate_block( y, min( n, 4 ), activation );
+}
+
+inline void store_block( float * y, __m128 lo, __m128 hi, int n, Activation activation=LINEAR ) {
+	if ( n >= 8 ) {
+		_mm_storeu_ps( y,   lo );
+		_mm_storeu_ps( y+4, hi );
+	} else {
+		alignas( 64 ) float tmp[ 8 ];
+		_mm_store_ps( tmp,   lo );
+		_mm_store_ps( tmp+4, hi );
+		for ( int c = 0; c < n; ++c ) y[c] = tmp[c];
+	}
+	if ( activation != LINEAR ) activate_block( y, min( n, 8 ), activation );
+}
+
+} // namespace
+
+void dense_sse42( double const * input, int rows, int inputs,
+	double const * weights, double const * bias, int neurons, double * output,
+	Activation activation ) {
+
+	// 4-row x 4-neuron register block, two 2-wide vectors per row,
+	// repeated across each 16-neuron panel.
+	// Multiply and add are kept separate (no FMA) so results are
+	// identical to the generic kernel
+	const int row_tile = 64;
+	const int mr = 4;
+	const int nr = PANEL_WIDTH;
+	const int sub = 4;
+
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			const double * panel = weights + (size_t)k0*inputs;
+
+			for ( int s = 0; s < nr && k0+s < neurons; s += sub ) {
+				int kn = neurons - k0 - s;
+				__m128d b0 = _mm_load_pd( bias+k0+s );
+				__m128d b1 = _mm_load_pd( bias+k0+s+2 );
+
+				int r = r0;
+				for ( ; r+mr <= r_end; r += mr ) {
+					__m128d a00 = _mm_setzero_pd(), a01 = _mm_setzero_pd();
+					__m128d a10 = _mm_setzero_pd(), a11 = _mm_setzero_pd();
+					__m128d a20 = _mm_setzero_pd(), a21 = _mm_setzero_pd();
+					__m128d a30 = _mm_setzero_pd(), a31 = _mm_setzero_pd();
+					const double * x0 = input + (size_t)(r  )*inputs;
+					const double * x1 = input + (size_t)(r+1)*inputs;
+					const double * x2 = input + (size_t)(r+2)*inputs;
+					const double * x3 = input + (size_t)(r+3)*inputs;
+
+					for ( int j = 0; j < inputs; ++j ) {
+						const double * w = panel + (size_t)j*nr + s;
+						__m128d w0 = _mm_load_pd( w );
+						__m128d w1 = _mm_load_pd( w+2 );
+						__m128d p;
+
+						p = _mm_set1_pd( x0[j] );
+						a00 = _mm_add_pd( a00, _mm_mul_pd( w0, p ));
+						a01 = _mm_add_pd( a01, _mm_mul_pd( w1, p ));
+						p = _mm_set1_pd( x1[j] );
+						a10 = _mm_add_pd( a10, _mm_mul_pd( w0, p ));
+						a11 = _mm_add_pd( a11, _mm_mul_pd( w1, p ));
+						p = _mm_set1_pd( x2[j] );
+						a20 = _mm_add_pd( a20, _mm_mul_pd( w0, p ));
+						a21 = _mm_add_pd( a21, _mm_mul_pd( w1, p ));
+						p = _mm_set1_pd( x3[j] );
+						a30 = _mm_add_pd( a30, _mm_mul_pd( w0, p ));
+						a31 = _mm_add_pd( a31, _mm_mul_pd( w1, p ));
+					}
+
+					double * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm_add_pd( a00, b0 ), _mm_add_pd( a01, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm_add_pd( a10, b0 ), _mm_add_pd( a11, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm_add_pd( a20, b0 ), _mm_add_pd( a21, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm_add_pd( a30, b0 ), _mm_add_pd( a31, b1 ), kn, activation );
+				}
+
+				// leftover rows that don't fill a full register block
+				for ( ; r < r_end; ++r ) {
+					__m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+					const double * x = input + (size_t)r*inputs;
+
+					for ( int j = 0; j < inputs; ++j ) {
+						const double * w = panel + (size_t)j*nr + s;
+						__m128d p = _mm_set1_pd( x[j] );
+						a0 = _mm_add_pd( a0, _mm_mul_pd( _mm_load_pd( w ),   p ));
+						a1 = _mm_add_pd( a1, _mm_mul_pd( _mm_load_pd( w+2 ), p ));
+					}
+
+					double * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm_add_pd( a0, b0 ), _mm_add_pd( a1, b1 ), kn, activation );
+				}
+			}
+		}
+	}
+}
+
+void dense_sse42_f32( float const * input, int rows, int inputs,
+	float const * weights, float const * bias, int neurons, float * output,
+	Activation activation ) {
+
+	// same blocking as dense_sse42, with 4-wide float vectors
+	const int row_tile = 64;
+	const int mr = 4;
+	const int nr = PANEL_WIDTH;
+	const int sub = 8;
+
+	for ( int r0 = 0; r0 < rows; r0 += row_tile ) {
+		int r_end = min( rows, r0+row_tile );
+
+		for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+			const float * panel = weights + (size_t)k0*inputs;
+
+			for ( int s = 0; s < nr && k0+s < neurons; s += sub ) {
+				int kn = neurons - k0 - s;
+				__m128 b0 = _mm_load_ps( bias+k0+s );
+				__m128 b1 = _mm_load_ps( bias+k0+s+4 );
+
+				int r = r0;
+				for ( ; r+mr <= r_end; r += mr ) {
+					__m128 a00 = _mm_setzero_ps(), a01 = _mm_setzero_ps();
+					__m128 a10 = _mm_setzero_ps(), a11 = _mm_setzero_ps();
+					__m128 a20 = _mm_setzero_ps(), a21 = _mm_setzero_ps();
+					__m128 a30 = _mm_setzero_ps(), a31 = _mm_setzero_ps();
+					const float * x0 = input + (size_t)(r  )*inputs;
+					const float * x1 = input + (size_t)(r+1)*inputs;
+					const float * x2 = input + (size_t)(r+2)*inputs;
+					const float * x3 = input + (size_t)(r+3)*inputs;
+
+					for ( int j = 0; j < inputs; ++j ) {
+						const float * w = panel + (size_t)j*nr + s;
+						__m128 w0 = _mm_load_ps( w );
+						__m128 w1 = _mm_load_ps( w+4 );
+						__m128 p;
+
+						p = _mm_set1_ps( x0[j] );
+						a00 = _mm_add_ps( a00, _mm_mul_ps( w0, p ));
+						a01 = _mm_add_ps( a01, _mm_mul_ps( w1, p ));
+						p = _mm_set1_ps( x1[j] );
+						a10 = _mm_add_ps( a10, _mm_mul_ps( w0, p ));
+						a11 = _mm_add_ps( a11, _mm_mul_ps( w1, p ));
+						p = _mm_set1_ps( x2[j] );
+						a20 = _mm_add_ps( a20, _mm_mul_ps( w0, p ));
+						a21 = _mm_add_ps( a21, _mm_mul_ps( w1, p ));
+						p = _mm_set1_ps( x3[j] );
+						a30 = _mm_add_ps( a30, _mm_mul_ps( w0, p ));
+						a31 = _mm_add_ps( a31, _mm_mul_ps( w1, p ));
+					}
+
+					float * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm_add_ps( a00, b0 ), _mm_add_ps( a01, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm_add_ps( a10, b0 ), _mm_add_ps( a11, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm_add_ps( a20, b0 ), _mm_add_ps( a21, b1 ), kn, activation );
+					y += neurons;
+					store_block( y, _mm_add_ps( a30, b0 ), _mm_add_ps( a31, b1 ), kn, activation );
+				}
+
+				// leftover rows that don't fill a full register block
+				for ( ; r < r_end; ++r ) {
+					__m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+					const float * x = input + (size_t)r*inputs;
+
+					for ( int j = 0; j < inputs; ++j ) {
+						const float * w = panel + (size_t)j*nr + s;
+						__m128 p = _mm_set1_ps( x[j] );
+						a0 = _mm_add_ps( a0, _mm_mul_ps( _mm_load_ps( w ),   p ));
+						a1 = _mm_add_ps( a1, _mm_mul_ps( _mm_load_ps( w+4 ), p ));
+					}
+
+					float * y = output + (size_t)r*neurons + k0 + s;
+					store_block( y, _mm_add_ps( a0, b0 ), _mm_add_ps( a1, b1 ), kn, activation );
+				}
+			}
+		}
+	}
+}
+
+} // namespace kernels
+} // namespace keras
+
+#endif // KERAS_X86_KERNELS
@@ -0,0 +1,113 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/DenseKernelsVNNI.cc
+@brief AVX-512 VNNI int8 dense kernel. Compiled with -mavx512vnni,
+only called when cpuid reports AVX-512 VNNI and BW support
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/DenseKernels.hh"
+
+#ifdef KERAS_X86_KERNELS
+
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+using namespace std;
+
+namespace keras {
+namespace kernels {
+
+namespace {
+
+// write the first n values of a block, for the last panel
+// when the number of neurons isn't a multiple of the panel width
+inline void store_block( float * y, __m512 v, int n ) {
+	if ( n >= 16 ) {
+		_mm512_storeu_ps( y, v );
+		return;
+	}
+	alignas( 64 ) float tmp[ 16 ];
+	_mm512_store_ps( tmp, v );
+	for ( int c = 0; c < n; ++c ) y[c] = tmp[c];
+}
+
+inline __m512i broadcast_group( int8_t const * x ) {
+	int32_t group;
+	memcpy( &group, x, sizeof( group ));
+	return _mm512_set1_epi32( group );
+}
+
+} // namespace
+
+void dense_int8_vnni( int8_t const * input, int rows, int inputs,
+	int8_t const * weights, int32_t const * weight_sums, float const * scale,
+	float const * bias, int neurons, float * output ) {
+
+	// vpdpbusd multiplies unsigned by signed bytes, so inputs are
+	// shifted by 128 to make them unsigned and 128 * (sum of weights)
+	// is taken back off afterwards. 4-row x 16-neuron register block,
+	// one panel per vector
+	const int mr = 4;
+	const int nr = PANEL_WIDTH;
+	int groups = inputs / INT8_GROUP;
+	const __m512i shift = _mm512_set1_epi32( (int32_t)0x80808080 );
+
+	for ( int k0 = 0; k0 < neurons; k0 += nr ) {
+		const int8_t * panel = weights + (size_t)k0*inputs;
+		int kn = neurons - k0;
+		__m512 s = _mm512_load_ps( scale+k0 );
+		__m512 b = _mm512_load_ps( bias+k0 );
+		__m512i offset = _mm512_slli_epi32( _mm512_load_si512( weight_sums+k0 ), 7 );
+
+		int r = 0;
+		for ( ; r+mr <= rows; r += mr ) {
+			__m512i a0 = _mm512_setzero_si512(), a1 = _mm512_setzero_si512();
+			__m512i a2 = _mm512_setzero_si512(), a3 = _mm512_setzero_si512();
+			const int8_t * x0 = input + (size_t)(r  )*inputs;
+			const int8_t * x1 = input + (size_t)(r+1)*inputs;
+			const int8_t * x2 = input + (size_t)(r+2)*inputs;
+			const int8_t * x3 = input + (size_t)(r+3)*inputs;
+
+			for ( int g = 0; g < groups; ++g ) {
+				__m512i w = _mm512_load_si512( panel + (size_t)g*nr*INT8_GROUP );
+				int j = g*INT8_GROUP;
+				a0 = _mm512_dpbusd_epi32( a0, _mm512_xor_si512( broadcast_group( x0+j ), shift ), w );
+				a1 = _mm512_dpbusd_epi32( a1, _mm512_xor_si512( broadcast_group( x1+j ), shift ), w );
+				a2 = _mm512_dpbusd_epi32( a2, _mm512_xor_si512( broadcast_group( x2+j ), shift ), w );
+				a3 = _mm512_dpbusd_epi32( a3, _mm512_xor_si512( broadcast_group( x3+j ), shift ), w );
+			}
+
+			float * y = output + (size_t)r*neurons + k0;
+			store_block( y, _mm512_add_ps( _mm512_mul_ps( _mm512_cvtepi32_ps( _mm512_sub_epi32( a0, offset )), s ), b ), kn );
+			y += neurons;
+			store_block( y, _mm512_add_ps( _mm512_mul_ps( _mm512_cvtepi32_ps( _mm512_sub_epi32( a1, offset )), s ), b ), kn );
+			y += neurons;
+			store_block( y, _mm512_add_ps( _mm512_mul_ps( _mm512_cvtepi32_ps( _mm512_sub_epi32( a2, offset )), s ), b ), kn );
+			y += neurons;
+			store_block( y, _mm512_add_ps( _mm512_mul_ps( _mm512_cvtepi32_ps( _mm512_sub_epi32( a3, offset )), s ), b ), kn );
+		}
+
+		// leftover rows that don't fill a full register block
+		for ( ; r < rows; ++r ) {
+			__m512i a = _mm512_setzero_si512();
+			const int8_t * x = input + (size_t)r*inputs;
+
+			for ( int g = 0; g < groups; ++g ) {
+				__m512i w = _mm512_load_si512( panel + (size_t)g*nr*INT8_GROUP );
+				a = _mm512_dpbusd_epi32( a, _mm512_xor_si512( broadcast_group( x + g*INT8_GROUP ), shift ), w );
+			}
+
+			store_block( output + (size_t)r*neurons + k0,
+				_mm512_add_ps( _mm512_mul_ps( _mm512_cvtepi32_ps( _mm512_sub_epi32( a, offset )), s ), b ), kn );
+		}
+	}
+}
+
+} // namespace kernels
+} // namespace keras
+
+#endif // KERAS_X86_KERNELS
@@ -0,0 +1,288 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/EmbeddedModel.cc
+@brief Production model compiled into the library
+@details Built with ERRORX_EMBEDDED_MODEL defined by make embedded,
+which first writes EmbeddedModelData.inc next to this file. This file
+defines the weights and the generic variant of the kernels, and the
+AVX2 and AVX-512 variants are in files of their own.
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/EmbeddedModel.hh"
+#include "keras/EmbeddedModelKernels.hh"
+#include "keras/FixedDense.hh"
+#include "keras/LayerActivation.hh"
+#include "keras/LayerDense.hh"
+
+#include "exceptions.hh"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace keras {
+
+#ifdef ERRORX_EMBEDDED_MODEL
+
+namespace embedded {
+
+using namespace kernels;
+
+// defines LAYOUT, INPUTS, OUTPUTS, MAX_WIDTH, LAYER_COUNT,
+// LAYERS and run( input, rows, output, buffer0, buffer1 ).
+// The weights are only defined here
+#define EMBEDDED_MODEL_WEIGHTS
+#include "EmbeddedModelData.inc"
+
+void run_dense_generic( double const * input, int rows, double * output,
+	double * buffer0, double * buffer1 ) {
+	run( input, rows, output, buffer0, buffer1 );
+}
+
+void run_sparse_generic( SparseBatch const & input, int rows, double * output,
+	double * buffer0, double * buffer1 ) {
+	run( input, rows, output, buffer0, buffer1 );
+}
+
+} // namespace embedded
+
+namespace {
+
+// the same instruction set as the dynamic kernels
+string select_isa() {
+	string name = kernels::dense_kernel_name();
+	return ( name == "avx512" || name == "avx2" ) ? name : "generic";
+}
+
+embedded::DenseRun dense_run() {
+	static const embedded::DenseRun run =
+#ifdef KERAS_X86_KERNELS
+		( EmbeddedModel::isa() == "avx512" ) ? embedded::run_dense_avx512 :
+		( EmbeddedModel::isa() == "avx2" ) ? embedded::run_dense_avx2 :
+#endif
+		embedded::run_dense_generic;
+	return run;
+}
+
+embedded::SparseRun sparse_run() {
+	static const embedded::SparseRun run =
+#ifdef KERAS_X86_KERNELS
+		( EmbeddedModel::isa() == "avx512" ) ? embedded::run_sparse_avx512 :
+		( EmbeddedModel::isa() == "avx2" ) ? embedded::run_sparse_avx2 :
+#endif
+		embedded::run_sparse_generic;
+	return run;
+}
+
+} // namespace
+
+bool EmbeddedModel::available() { return true; }
+string EmbeddedModel::layout() { return embedded::LAYOUT; }
+
+string EmbeddedModel::isa() {
+	static const string name = select_isa();
+	return name;
+}
+
+KerasModelConstPtr EmbeddedModel::model() {
+	// built on first use, thread-safe in C++11
+	static KerasModelConstPtr model;
+	static once_flag built;
+	call_once( built, [] {
+		vector<Layer*> layers;
+		for ( int ii = 0; ii < embedded::LAYER_COUNT; ++ii ) {
+			embedded::EmbeddedLayer const & source = embedded::LAYERS[ ii ];
+			LayerDense * dense = new LayerDense();
+			dense->set_weights( source.weights, source.bias, source.inputs, source.neurons );
+			layers.push_back( dense );
+			if ( source.activation[ 0 ] != '\0' ) {
+				layers.push_back( new LayerActivation( source.activation ));
+			}
+		}
+		shared_ptr<KerasModel> built_model( new KerasModel() );
+		built_model->set_layers( layers );
+		model = built_model;
+	});
+	return model;
+}
+
+bool EmbeddedModel::matches( KerasModel const & model ) {
+	// the embedded layers take exp with libm
+	if ( model.activation_mode() != kernels::EXACT ) return false;
+	if ( &model == EmbeddedModel::model().get() ) return true;
+
+	int l = 0;
+	for ( int ii = 0; ii < embedded::LAYER_COUNT; ++ii ) {
+		embedded::EmbeddedLayer const & source = embedded::LAYERS[ ii ];
+		LayerDense const * dense = ( l < model.no_layers() ) ?
+			dynamic_cast<LayerDense const *>( model.layer( l++ )) : nullptr;
+		if ( dense == nullptr ) return false;
+
+		LayerDense::WeightsView weights = dense->weights();
+		if ( weights.inputs() != source.inputs || weights.neurons() != source.neurons ) return false;
+		for ( int jj = 0; jj < source.inputs; ++jj ) {
+			for ( int kk = 0; kk < source.neurons; ++kk ) {
+				if ( weights( jj, kk ) != source.weights[ (size_t)jj*source.neurons + kk ] ) return false;
+			}
+		}
+		for ( int kk = 0; kk < source.neurons; ++kk ) {
+			if ( dense->bias( kk ) != source.bias[ kk ] ) return false;
+		}
+
+		if ( source.activation[ 0 ] != '\0' ) {
+			LayerActivation const * activation = ( l < model.no_layers() ) ?
+				dynamic_cast<LayerActivation const *>( model.layer( l++ )) : nullptr;
+			if ( activation == nullptr || activation->activation_type() != source.activation ) return false;
+		}
+	}
+	return l == model.no_layers();
+}
+
+void EmbeddedModel::compute_output_batch( double const * input, int rows,
+		double * output, InferenceContext & context ) {
+
+	if ( rows == 0 ) return;
+	context.reserve( (size_t)rows*embedded::MAX_WIDTH );
+	dense_run()( input, rows, output, context.buffer( 0 ), context.buffer( 1 ));
+}
+
+void EmbeddedModel::compute_output_batch( SparseBatch const & input,
+		double * output, InferenceContext & context ) {
+
+	if ( input.rows() == 0 ) return;
+	context.reserve( (size_t)input.rows()*embedded::MAX_WIDTH );
+	sparse_run()( input, input.rows(), output, context.buffer( 0 ), context.buffer( 1 ));
+}
+
+#else
+
+namespace {
+
+void not_embedded() {
+	throw ObjectNotInitialized(
+		"Error: this build of ErrorX has no embedded model. "
+		"Build with make embedded to include one." );
+}
+
+} // namespace
+
+bool EmbeddedModel::available() { return false; }
+string EmbeddedModel::layout() { return ""; }
+string EmbeddedModel::isa() { return ""; }
+
+KerasModelConstPtr EmbeddedModel::model() {
+	not_embedded();
+	return KerasModelConstPtr();
+}
+
+bool EmbeddedModel::matches( KerasModel const & model ) { return false; }
+
+void EmbeddedModel::compute_output_batch( double const * input, int rows,
+		double * output, InferenceContext & context ) {
+	not_embedded();
+}
+
+void EmbeddedModel::compute_output_batch( SparseBatch const & input,
+		double * output, InferenceContext & context ) {
+	not_embedded();
+}
+
+#endif // ERRORX_EMBEDDED_MODEL
+
+void EmbeddedModel::write_source( KerasModel const & model, ostream & out ) {
+	// group layers into dense layers with their activations
+	vector<LayerDense const *> dense;
+	vector<string> activations;
+	for ( int ii = 0; ii < model.no_layers(); ++ii ) {
+		Layer const * layer = model.layer( ii );
+		if ( LayerDense const * d = dynamic_cast<LayerDense const *>( layer )) {
+			dense.push_back( d );
+			activations.push_back( "" );
+			continue;
+		}
+
+		LayerActivation const * activation = dynamic_cast<LayerActivation const *>( layer );
+		if ( activation == nullptr || dense.empty() || !activations.back().empty() ||
+				activation->activation() == kernels::SOFTMAX ) {
+			throw InvalidLayer( "Error: only dense layers, each followed by at most one "
+				"element-wise activation, can be embedded. Layer "+to_string(ii)+
+				" is "+layer->get_name() );
+		}
+		activations.back() = activation->activation_type();
+	}
+	if ( dense.empty() ) {
+		throw InvalidLayer( "Error: a model needs at least one dense layer to be embedded" );
+	}
+
+	string layout = to_string( dense[ 0 ]->get_input_cols() );
+	int max_width = dense[ 0 ]->get_input_cols();
+	for ( int ii = 0; ii < dense.size(); ++ii ) {
+		layout += "-"+to_string( dense[ ii ]->get_output_units() );
+		max_width = max( max_width, (int)dense[ ii ]->get_output_units() );
+	}
+
+	out.precision( numeric_limits<double>::max_digits10 );
+	out << "// Generated by errorx_model embed, do not edit\n\n";
+	out << "const char * const LAYOUT = \"" << layout << "\";\n";
+	out << "const int INPUTS = " << dense[ 0 ]->get_input_cols() << ";\n";
+	out << "const int OUTPUTS = " << dense.back()->get_output_units() << ";\n";
+	out << "const int MAX_WIDTH = " << max_width << ";\n";
+	out << "const int LAYER_COUNT = " << dense.size() << ";\n\n";
+
+	// declared for every variant of the kernels, and defined once
+	for ( int ii = 0; ii < dense.size(); ++ii ) {
+		out << "alignas(64) extern const double DENSE" << ii << "_WEIGHTS[];\n";
+		out << "alignas(64) extern const double DENSE" << ii << "_BIAS[];\n";
+	}
+	out << "\n#ifdef EMBEDDED_MODEL_WEIGHTS\n";
+	for ( int ii = 0; ii < dense.size(); ++ii ) {
+		LayerDense::WeightsView weights = dense[ ii ]->weights();
+		out << "alignas(64) const double DENSE" << ii << "_WEIGHTS[] = {\n";
+		for ( int jj = 0; jj < weights.inputs(); ++jj ) {
+			out << "\t";
+			for ( int kk = 0; kk < weights.neurons(); ++kk ) out << weights( jj, kk ) << ",";
+			out << "\n";
+		}
+		out << "};\n";
+
+		out << "alignas(64) const double DENSE" << ii << "_BIAS[] = {\n\t";
+		for ( int kk = 0; kk < weights.neurons(); ++kk ) out << dense[ ii ]->bias( kk ) << ",";
+		out << "\n};\n\n";
+	}
+	out << "#endif\n\n";
+
+	out << "const EmbeddedLayer LAYERS[] = {\n";
+	for ( int ii = 0; ii < dense.size(); ++ii ) {
+		out << "\t{ " << dense[ ii ]->get_input_cols() << ", " << dense[ ii ]->get_output_units()
+			<< ", DENSE" << ii << "_WEIGHTS, DENSE" << ii << "_BIAS, \"" << activations[ ii ] << "\" },\n";
+	}
+	out << "};\n\n";
+
+	// layers alternate between the two scratch buffers, and the last
+	// one writes to output. Each variant has its own copy of run
+	out << "namespace {\n\n"
+		<< "template <typename Input>\n"
+		<< "void run( Input const & input, int rows, double * output, double * buffer0, double * buffer1 ) {\n";
+	for ( int ii = 0; ii < dense.size(); ++ii ) {
+		kernels::Activation activation = activations[ ii ].empty() ? kernels::LINEAR :
+			LayerActivation( activations[ ii ] ).activation();
+		string names[] = { "LINEAR", "RELU", "SIGMOID", "TANH", "SOFTMAX" };
+
+		string in = ( ii == 0 ) ? "input" : (( ii % 2 == 1 ) ? "buffer0" : "buffer1" );
+		string result = ( ii+1 == dense.size() ) ? "output" : (( ii % 2 == 0 ) ? "buffer0" : "buffer1" );
+
+		out << "\tfixed_dense<" << dense[ ii ]->get_input_cols() << "," << dense[ ii ]->get_output_units()
+			<< "," << names[ activation ] << ">( " << in << ", rows, DENSE" << ii << "_WEIGHTS, DENSE"
+			<< ii << "_BIAS, " << result << " );\n";
+	}
+	out << "}\n\n} // namespace\n";
+}
+
+} // namespace keras
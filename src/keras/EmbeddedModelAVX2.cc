@@ -0,0 +1,37 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/EmbeddedModelAVX2.cc
+@brief AVX2 variant of the embedded model. Compiled with -mavx2,
+only called when cpuid reports AVX2 support
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/EmbeddedModelKernels.hh"
+
+#if defined(ERRORX_EMBEDDED_MODEL) && defined(KERAS_X86_KERNELS)
+
+#include "keras/FixedDense.hh"
+
+namespace keras {
+namespace embedded {
+
+using namespace kernels;
+
+#include "EmbeddedModelData.inc"
+
+void run_dense_avx2( double const * input, int rows, double * output,
+	double * buffer0, double * buffer1 ) {
+	run( input, rows, output, buffer0, buffer1 );
+}
+
+void run_sparse_avx2( SparseBatch const & input, int rows, double * output,
+	double * buffer0, double * buffer1 ) {
+	run( input, rows, output, buffer0, buffer1 );
+}
+
+} // namespace embedded
+} // namespace keras
+
+#endif // ERRORX_EMBEDDED_MODEL && KERAS_X86_KERNELS
@@ -0,0 +1,37 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/EmbeddedModelAVX512.cc
+@brief AVX-512 variant of the embedded model. Compiled with -mavx512f,
+only called when cpuid reports AVX-512 support
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/EmbeddedModelKernels.hh"
+
+#if defined(ERRORX_EMBEDDED_MODEL) && defined(KERAS_X86_KERNELS)
+
+#include "keras/FixedDense.hh"
+
+namespace keras {
+namespace embedded {
+
+using namespace kernels;
+
+#include "EmbeddedModelData.inc"
+
+void run_dense_avx512( double const * input, int rows, double * output,
+	double * buffer0, double * buffer1 ) {
+	run( input, rows, output, buffer0, buffer1 );
+}
+
+void run_sparse_avx512( SparseBatch const & input, int rows, double * output,
+	double * buffer0, double * buffer1 ) {
+	run( input, rows, output, buffer0, buffer1 );
+}
+
+} // namespace embedded
+} // namespace keras
+
+#endif // ERRORX_EMBEDDED_MODEL && KERAS_X86_KERNELS
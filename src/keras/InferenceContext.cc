@@ -0,0 +1,39 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/InferenceContext.cc
+@brief Reusable scratch memory for running a KerasModel
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/InferenceContext.hh"
+
+namespace keras {
+
+InferenceContext::InferenceContext() {}
+
+void InferenceContext::reserve( size_t values ) {
+	if ( values <= capacity() ) return;
+	buffers_[ 0 ].resize( values );
+	buffers_[ 1 ].resize( values );
+}
+
+void InferenceContext::reserve_f32( size_t values ) {
+	if ( values <= buffers_f32_[ 0 ].size() ) return;
+	buffers_f32_[ 0 ].resize( values );
+	buffers_f32_[ 1 ].resize( values );
+}
+
+void InferenceContext::reserve_int8( size_t values ) {
+	if ( values <= buffer_int8_.size() ) return;
+	buffer_int8_.resize( values );
+}
+
+double * InferenceContext::buffer( int index ) { return buffers_[ index ].data(); }
+float * InferenceContext::buffer_f32( int index ) { return buffers_f32_[ index ].data(); }
+int8_t * InferenceContext::buffer_int8() { return buffer_int8_.data(); }
+
+size_t InferenceContext::capacity() const { return buffers_[ 0 ].size(); }
+
+} // namespace keras
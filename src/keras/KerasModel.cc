@@ -12,6 +12,7 @@ Code contained herein is proprietary and confidential.
 #include "keras/Layer.hh"
 #include "keras/LayerActivation.hh"
 #include "keras/LayerDense.hh"
+#include "keras/ModelFile.hh"
 
 #include "ErrorXOptions.hh"
 #include "exceptions.hh"
@@ -22,6 +23,7 @@ Code contained herein is proprietary and confidential.
 #include <iostream>
 #include <string>
 #include <vector>
+#include <algorithm>
 
 #include <boost/filesystem.hpp>
 
@@ -30,31 +32,62 @@ using namespace std;
 namespace keras {
 
 KerasModel::KerasModel( errorx::ErrorXOptions const & options ) :
+	layers_cnt_( 0 ),
+	max_width_( 0 ),
+	activation_mode_( kernels::EXACT ),
 	verbose_( options.verbose() )
 {
-	namespace fs = boost::filesystem;
-	fs::path base( options.errorx_base() );
-	string model_path = (base / "model.nnet").string();
-
-	load_weights( model_path );
+	load_weights( options.model_file() );
+	if ( options.activations() == "fast" ) activation_mode( kernels::FAST );
 }
 
 
 KerasModel::KerasModel( string const & file ) :
+	layers_cnt_( 0 ),
+	max_width_( 0 ),
+	activation_mode_( kernels::EXACT ),
 	verbose_( 1 )
 {
 	load_weights( file );
 }
 
 KerasModel::KerasModel() :
+	layers_cnt_( 0 ),
+	max_width_( 0 ),
+	activation_mode_( kernels::EXACT ),
 	verbose_( 1 )
 {}
 
 KerasModel::KerasModel( KerasModel const & other ) :
 	layers_cnt_( other.layers_cnt_ ),
-	layers_( other.layers_ ),
+	max_width_( other.max_width_ ),
+	activation_mode_( other.activation_mode_ ),
 	verbose_( other.verbose_ )
-{}
+{
+	// each model owns its layers, so copy them rather than the pointers
+	for ( int ii = 0; ii < other.layers_.size(); ++ii ) {
+		layers_.push_back( other.layers_[ ii ]->clone() );
+	}
+	compile();
+}
+
+KerasModel & KerasModel::operator=( KerasModel const & other ) {
+	if ( this == &other ) return *this;
+
+	vector<Layer*> layers;
+	for ( int ii = 0; ii < other.layers_.size(); ++ii ) {
+		layers.push_back( other.layers_[ ii ]->clone() );
+	}
+	for ( int ii = 0; ii < layers_.size(); ++ii ) delete layers_[ ii ];
+
+	layers_ = layers;
+	layers_cnt_ = other.layers_cnt_;
+	activation_mode_ = other.activation_mode_;
+	verbose_ = other.verbose_;
+	compile();
+
+	return *this;
+}
 
 KerasModel::~KerasModel() {
 	for ( uint i = 0; i < layers_.size(); ++i ) {
@@ -80,21 +113,109 @@ vector<double> KerasModel::compute_output( DataChunk* dc ) const {
 			);
 	}
 
-	DataChunk* inp = dc;
-	DataChunk* out = 0;
-	for ( uint l = 0; l < layers_.size(); ++l ) {
-		out = layers_[l]->compute_output( inp );
+	InferenceContext context;
+	vector<double> output( get_output_length() );
+	compute_output_batch( dc->get_1d().data(), 1, output.data(), context );
+
+	return output;
+}
+
+vector<double> KerasModel::compute_output_batch( vector<double> const & input, int rows ) const {
+
+	if ( layers_.empty() ) {
+		throw ObjectNotInitialized( 
+			"Error: compute_output was called for a KerasModel "
+			"that was never initialized. Please initialize object "
+			"using load_weights or load_weights_from_string before "
+			"computing output.");
+	}
+
+	if ( input.size() != (size_t)rows*get_input_cols() ) {
+		throw BadModel(
+			"Error: input dimensions do not match. Model takes "
+			"data with "+to_string(get_input_cols())+" dimensions "
+			"and batch has "+to_string(input.size())+" values "
+			"for "+to_string(rows)+" rows"
+			);
+	}
+
+	InferenceContext context;
+	vector<double> output( (size_t)rows*get_output_length() );
+	compute_output_batch( input.data(), rows, output.data(), context );
 
-		if ( inp != dc ) delete inp;
-		//delete inp;
-		inp = 0L;
-		inp = out;
+	return output;
+}
+
+void KerasModel::compute_output_batch( double const * input, int rows,
+		double * output, InferenceContext & context ) const {
+
+	if ( layers_.empty() ) {
+		throw ObjectNotInitialized( 
+			"Error: compute_output was called for a KerasModel "
+			"that was never initialized. Please initialize object "
+			"using load_weights or load_weights_from_string before "
+			"computing output.");
 	}
 
-	vector<double> flat_out = out->get_1d();
-	delete out;
+	if ( rows == 0 ) return;
+	context.reserve( (size_t)rows*max_width_ );
 
-	return flat_out;
+	run_plan( 0, input, rows, get_input_cols(), output,
+		context.buffer( 0 ), context.buffer( 1 ));
+}
+
+void KerasModel::compute_output_batch( SparseBatch const & input,
+		double * output, InferenceContext & context ) const {
+
+	if ( layers_.empty() ) {
+		throw ObjectNotInitialized( 
+			"Error: compute_output was called for a KerasModel "
+			"that was never initialized. Please initialize object "
+			"using load_weights or load_weights_from_string before "
+			"computing output.");
+	}
+
+	if ( !sparse_input() ) {
+		throw BadModel( "Error: sparse input needs a model whose first layer is Dense" );
+	}
+
+	int rows = input.rows();
+	if ( rows == 0 ) return;
+
+	Step const & first = plan_[ 0 ];
+	if ( plan_.size() == 1 ) {
+		first.dense->compute_output_sparse( input, output, first.activation );
+		return;
+	}
+
+	// the first step fills buffer 0 and the rest run as usual
+	context.reserve( (size_t)rows*max_width_ );
+	first.dense->compute_output_sparse( input, context.buffer( 0 ), first.activation );
+
+	run_plan( 1, (double const *)context.buffer( 0 ), rows, first.output_units,
+		output, context.buffer( 0 ), context.buffer( 1 ));
+}
+
+bool KerasModel::sparse_input() const {
+	return !layers_.empty() && dynamic_cast<LayerDense const *>( layers_[ 0 ] ) != nullptr;
+}
+
+void KerasModel::compute_output_batch( float const * input, int rows,
+		float * output, InferenceContext & context ) const {
+
+	if ( layers_.empty() ) {
+		throw ObjectNotInitialized( 
+			"Error: compute_output was called for a KerasModel "
+			"that was never initialized. Please initialize object "
+			"using load_weights or load_weights_from_string before "
+			"computing output.");
+	}
+
+	if ( rows == 0 ) return;
+	context.reserve_f32( (size_t)rows*max_width_ );
+
+	run_plan( 0, input, rows, get_input_cols(), output,
+		context.buffer_f32( 0 ), context.buffer_f32( 1 ));
 }
 
 uint KerasModel::get_input_rows() const { 
@@ -119,6 +240,15 @@ uint KerasModel::get_input_cols() const {
 	return layers_[ 0 ]->get_input_cols(); 
 }
 
+int KerasModel::no_steps() const { return plan_.size(); }
+
+kernels::ActivationMode KerasModel::activation_mode() const { return activation_mode_; }
+
+void KerasModel::activation_mode( kernels::ActivationMode mode ) {
+	activation_mode_ = mode;
+	compile();
+}
+
 int KerasModel::get_output_length() const {
 	if ( layers_.empty() ) {
 		throw ObjectNotInitialized( 
@@ -135,6 +265,14 @@ int KerasModel::get_output_length() const {
 void KerasModel::load_weights( string const & infile ) {
 
 	if ( verbose_ > 1 ) cout << "Reading model from " << infile << endl;
+
+	// binary models are mapped and used as-is, without parsing
+	if ( model_file::is_binary_file( infile )) {
+		MappedFile mapped( infile );
+		load_weights_from_buffer( mapped.data(), mapped.size() );
+		return;
+	}
+
 	ifstream fin( infile.c_str() );
 	
 	if ( !fin.good()) {
@@ -147,10 +285,107 @@ void KerasModel::load_weights( string const & infile ) {
 }
 
 void KerasModel::load_weights_from_string( string const & input_string ) {
+	if ( model_file::is_binary( input_string.data(), input_string.size() )) {
+		load_weights_from_buffer( input_string.data(), input_string.size() );
+		return;
+	}
+
 	istringstream fin( input_string );
 	load_weights_from_stream( fin );
 }
 
+void KerasModel::load_weights_from_buffer( char const * data, size_t size ) {
+	// read first so a bad model leaves the current one untouched
+	set_layers( model_file::read( data, size ));
+}
+
+void KerasModel::set_layers( vector<Layer*> const & layers ) {
+	for ( int ii = 0; ii < layers_.size(); ++ii ) delete layers_[ ii ];
+	layers_ = layers;
+	layers_cnt_ = layers_.size();
+
+	if ( verbose_ > 1 ) cout << "Layers " << layers_cnt_ << endl;
+	compile();
+}
+
+void KerasModel::compile() {
+	// size scratch buffers for the widest layer
+	max_width_ = layers_.empty() ? 0 : layers_[ 0 ]->get_input_cols();
+	for ( int ii = 0; ii < layers_.size(); ++ii ) {
+		max_width_ = max( max_width_, (int)layers_[ ii ]->get_output_units() );
+	}
+
+	for ( int ii = 0; ii < layers_.size(); ++ii ) {
+		LayerActivation * activation = dynamic_cast<LayerActivation *>( layers_[ ii ] );
+		if ( activation != nullptr ) activation->mode( activation_mode_ );
+	}
+
+	plan_.clear();
+	for ( int ii = 0; ii < layers_.size(); ++ii ) {
+		Step step;
+		step.layer = layers_[ ii ];
+		step.dense = dynamic_cast<LayerDense const *>( layers_[ ii ] );
+		step.activation = kernels::LINEAR;
+
+		// an element-wise activation right after a dense layer runs
+		// inside the dense kernel, saving a pass over the outputs.
+		// The dense kernels take exp with libm, so in FAST mode only
+		// relu is fused and the rest run vectorized on their own
+		if ( step.dense != nullptr && ii+1 < layers_.size() ) {
+			LayerActivation const * next = dynamic_cast<LayerActivation const *>( layers_[ ii+1 ] );
+			if ( next != nullptr && next->activation() != kernels::SOFTMAX &&
+					( activation_mode_ == kernels::EXACT || next->activation() == kernels::RELU )) {
+				step.activation = next->activation();
+				++ii;
+			}
+		}
+
+		step.in_place = step.layer->in_place();
+		step.output_units = step.layer->get_output_units();
+		plan_.push_back( step );
+	}
+}
+
+// Run the plan from step first onwards over the batch. The last step
+// that can't run in place writes straight to output, and any activations
+// after it run in place on output. Before that, steps alternate between
+// the two scratch buffers. Input may already be buffer0
+template <typename T>
+void KerasModel::run_plan( int first, T const * input, int rows, int cols,
+		T * output, T * buffer0, T * buffer1 ) const {
+
+	int last_out = -1;
+	for ( int s = first; s < plan_.size(); ++s ) {
+		if ( !plan_[s].in_place ) last_out = s;
+	}
+
+	T const * inp = input;
+	// buffer holding the data, null while still in input
+	T * current = ( input == buffer0 ) ? buffer0 : nullptr;
+
+	for ( int s = first; s < plan_.size(); ++s ) {
+		Step const & step = plan_[s];
+		T * out;
+
+		if ( s >= last_out ) {
+			out = output;
+		} else if ( step.in_place && current != nullptr ) {
+			out = current;
+		} else {
+			out = ( current == buffer0 ) ? buffer1 : buffer0;
+		}
+
+		if ( step.dense != nullptr ) {
+			step.dense->compute_output_fused( inp, out, rows, step.activation );
+		} else {
+			step.layer->compute_output_batch( inp, out, rows, cols );
+		}
+
+		if ( step.output_units > 0 ) cols = step.output_units;
+		inp = current = out;
+	}
+}
+
 void KerasModel::load_weights_from_stream( istream & fin ) {
 	// Clear all data if previously set
 	layers_cnt_ = 0;
@@ -190,6 +425,8 @@ void KerasModel::load_weights_from_stream( istream & fin ) {
 		tmp_str = "";
 	}
 
+	compile();
+
 	// Check if there are more layers in the file - if so the 
 	// number at the top is probably wrong
 	fin >> tmp_str;
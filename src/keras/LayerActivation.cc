@@ -11,6 +11,7 @@ Code contained herein is proprietary and confidential.
 #include "keras/LayerActivation.hh"
 #include "keras/DataChunk2D.hh"
 #include "keras/DataChunkFlat.hh"
+#include "keras/DenseKernels.hh"
 
 #include "exceptions.hh"
 
@@ -19,16 +20,91 @@ Code contained herein is proprietary and confidential.
 #include <istream>
 #include <iostream>
 #include <math.h>
+#include <algorithm>
 
 using namespace std;
 
 namespace keras {
 
+namespace {
+
+// softmax uses its own exp; the element-wise activations are shared
+// with the fused dense kernels so both paths round the same way
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+double scalar_exp( double x ) { return exp( x ); }
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+float scalar_exp( float x ) { return expf( x ); }
+
+// shared by the double and single precision paths
+template <typename T>
+void activate( kernels::Activation activation, T const * input, T * output,
+	int rows, int cols ) {
+
+	// activations work in place, so only copy when asked
+	// to write to a different buffer
+	size_t size = (size_t)rows*cols;
+	if ( input != output ) copy( input, input+size, output );
+
+	// activations are element-wise except for softmax, which
+	// is normalized within each row
+	T * y = output;
+
+	if ( activation == kernels::SOFTMAX ) {
+		for ( int r = 0; r < rows; ++r ) {
+			T * row = y + (size_t)r*cols;
+			T sum = 0.0;
+			for ( int k = 0; k < cols; ++k ) {
+				row[k] = scalar_exp(row[k]);
+				sum += row[k];
+			}
+			for ( int k = 0; k < cols; ++k ) {
+				row[k] /= sum;
+			}
+		}
+	} else {
+		kernels::activate_block( y, size, activation );
+	}
+}
+
+kernels::Activation resolve( string const & activation_type ) {
+	if ( activation_type == "relu" ) return kernels::RELU;
+	if ( activation_type == "softmax" ) return kernels::SOFTMAX;
+	if ( activation_type == "sigmoid" ) return kernels::SIGMOID;
+	if ( activation_type == "tanh" ) return kernels::TANH;
+	throw InvalidLayer( "Activation : "+activation_type );
+}
+
+} // namespace
+
 LayerActivation::LayerActivation() : 
-	Layer( "Activation" ) 
+	Layer( "Activation" ),
+	activation_( kernels::LINEAR ),
+	mode_( kernels::EXACT )
+	{}
+
+LayerActivation::LayerActivation( string const & activation_type ) :
+	Layer( "Activation" ),
+	activation_type_( activation_type ),
+	activation_( resolve( activation_type ) ),
+	mode_( kernels::EXACT )
 	{}
 
-void LayerActivation::load_weights( istream & fin ) { fin >> activation_type_; }
+string const & LayerActivation::activation_type() const { return activation_type_; }
+kernels::Activation LayerActivation::activation() const { return activation_; }
+kernels::ActivationMode LayerActivation::mode() const { return mode_; }
+void LayerActivation::mode( kernels::ActivationMode mode ) { mode_ = mode; }
+
+void LayerActivation::load_weights( istream & fin ) {
+	fin >> activation_type_;
+	activation_ = resolve( activation_type_ );
+}
+
+Layer* LayerActivation::clone() const { return new LayerActivation( *this ); }
 
 DataChunk* LayerActivation::compute_output( DataChunk* dc ) { 
 
@@ -55,34 +131,14 @@ DataChunk* LayerActivation::compute_output( DataChunk* dc ) {
 		*/
 
 	} else if ( dc->get_data_dim() == 1 ) { // flat data, use 1D
-		vector<double> y = dc->get_1d();
-		if ( activation_type_ == "relu" ) {
-			for ( uint k = 0; k < y.size(); ++k ) {
-				if ( y[k] < 0) y[k] = 0;
-			}
-		} else if ( activation_type_ == "softmax" ) {
-			double sum = 0.0;
-			for ( uint k = 0; k < y.size(); ++k ) {
-				y[k] = exp(y[k]);
-				sum += y[k];
-			}
-			for ( uint k = 0; k < y.size(); ++k ) {
-				y[k] /= sum;
-			}
-		} else if ( activation_type_ == "sigmoid" ) {
-			for ( uint k = 0; k < y.size(); ++k ) {
-				y[k] = 1/(1+exp(-y[k]));
-			}
-		} else if ( activation_type_ == "tanh" ) {
-			for ( uint k = 0; k < y.size(); ++k ) {
-				y[k] = tanh(y[k]);
-			}
-		} else {
-			throw InvalidLayer( "Activation : "+activation_type_ );
+		vector<double> const & in = dc->get_1d();
+		keras::DataChunkFlat *out = new DataChunkFlat( in.size() );
+		try {
+			compute_output_batch( in.data(), out->get_1d_rw().data(), 1, in.size() );
+		} catch ( ... ) {
+			delete out;
+			throw;
 		}
-
-		keras::DataChunk *out = new DataChunkFlat();
-		out->set_data( y );
 		return out;
 	} 
 
@@ -91,6 +147,28 @@ DataChunk* LayerActivation::compute_output( DataChunk* dc ) {
 	return dc;
 }
 
+void LayerActivation::compute_output_batch( double const * input, double * output,
+	int rows, int cols ) const {
+	if ( mode_ == kernels::FAST ) {
+		if ( input != output ) copy( input, input+(size_t)rows*cols, output );
+		kernels::fast_activation_kernel()( output, rows, cols, activation_ );
+		return;
+	}
+	activate( activation_, input, output, rows, cols );
+}
+
+void LayerActivation::compute_output_batch( float const * input, float * output,
+	int rows, int cols ) const {
+	if ( mode_ == kernels::FAST ) {
+		if ( input != output ) copy( input, input+(size_t)rows*cols, output );
+		kernels::fast_activation_kernel_f32()( output, rows, cols, activation_ );
+		return;
+	}
+	activate( activation_, input, output, rows, cols );
+}
+
+bool LayerActivation::in_place() const { return true; }
+
 uint LayerActivation::get_input_rows() const { return 0; } // look for the value in the preceding layer
 uint LayerActivation::get_input_cols() const { return 0; } // same as for rows
 uint LayerActivation::get_output_units() const { return 0; }
@@ -10,11 +10,13 @@ Code contained herein is proprietary and confidential.
 #include "keras/LayerDense.hh"
 #include "keras/DataChunkFlat.hh"
 #include "keras/DataChunk2D.hh"
+#include "keras/DenseKernels.hh"
 
 #include "util.hh"
 
 #include <istream>
 #include <iostream>
+#include <algorithm>
 
 #include <boost/lexical_cast.hpp>
 
@@ -23,10 +25,74 @@ using namespace errorx;
 
 namespace keras {
 
+namespace {
+
+// read the blocks of a pruned layer into a row-major matrix
+void read_blocks( istream & fin, int inputs, int neurons, vector<double> & weights ) {
+	string keyword;
+	int count = -1;
+	fin >> keyword >> count;
+	if ( keyword != "blocks" || count < 0 ) {
+		throw BadModel( "Error: bad block count in dense layer. Expected blocks N "
+			"after the number of inputs and neurons" );
+	}
+
+	weights.assign( (size_t)inputs*neurons, 0.0 );
+	vector<bool> seen( (size_t)inputs*kernels::padded_neurons( neurons )/kernels::PANEL_WIDTH, false );
+	for ( int b = 0; b < count; ++b ) {
+		int input = -1, panel = -1;
+		char tmp_char = ' ';
+		fin >> input >> panel >> tmp_char;
+		int k0 = panel*kernels::PANEL_WIDTH;
+		if ( !fin || input < 0 || input >= inputs || panel < 0 || k0 >= neurons ) {
+			throw BadModel( "Error: bad block "+to_string(b)+" in dense layer. Blocks "
+				"start with an input below "+to_string(inputs)+" and a panel below "+
+				to_string(kernels::padded_neurons( neurons )/kernels::PANEL_WIDTH) );
+		}
+		if ( tmp_char != '[' ) {
+			throw BadModel(
+			"Error: bad data in neuron weights. Make sure all blocks "
+			"begin with [ and end with ]" );
+		}
+		size_t index = (size_t)input*kernels::padded_neurons( neurons )/kernels::PANEL_WIDTH + panel;
+		if ( seen[ index ] ) {
+			throw BadModel( "Error: block for input "+to_string(input)+" and panel "+
+				to_string(panel)+" is listed twice" );
+		}
+		seen[ index ] = true;
+
+		string tmp_double;
+		int kn = min( kernels::PANEL_WIDTH, neurons-k0 );
+		for ( int c = 0; c < kn; ++c ) {
+			fin >> tmp_double;
+			if ( !util::isdouble(tmp_double) ) {
+				throw BadModel("bad value: "+tmp_double+" needs to be a double");
+			}
+			weights[ (size_t)input*neurons + k0 + c ] = boost::lexical_cast<double>(tmp_double);
+		}
+
+		fin >> tmp_char;
+		if ( tmp_char != ']' ) {
+			throw BadModel(
+			"Error: bad data in neuron weights. Make sure all blocks "
+			"begin with [ and end with ]" );
+		}
+	}
+}
+
+} // namespace
+
+const double LayerDense::MAX_BLOCK_DENSITY = 0.75;
+
 LayerDense::LayerDense() : 
-	Layer( "Dense" ) 
+	Layer( "Dense" ),
+	stored_blocks_( 0 ),
+	input_cnt_( 0 ),
+	neurons_( 0 )
 	{}
 
+Layer* LayerDense::clone() const { return new LayerDense( *this ); }
+
 void LayerDense::load_weights( istream & fin ) {
 	fin >> input_cnt_ >> neurons_;
 	// double tmp_double;
@@ -34,9 +100,17 @@ void LayerDense::load_weights( istream & fin ) {
 
 	string tmp_double;
 
+	// read row-major, then pack for the kernels at the end
+	vector<double> weights;
+	vector<double> bias;
+
+	// pruned layers list their non-zero blocks instead of every row
+	fin >> ws;
+	bool listed_blocks = ( fin.peek() == 'b' );
+	if ( listed_blocks ) read_blocks( fin, input_cnt_, neurons_, weights );
+
 	// iterate through input dimension
-	for ( int i = 0; i < input_cnt_; ++i ) {
-		vector<double> tmp_n;
+	for ( int i = 0; !listed_blocks && i < input_cnt_; ++i ) {
 		fin >> tmp_char; // for '['
 		
 		// check that data truly starts here like it should
@@ -55,7 +129,7 @@ void LayerDense::load_weights( istream & fin ) {
 			if ( !util::isdouble(tmp_double) ) {
 				throw BadModel("bad value: "+tmp_double+" needs to be a double");
 			}
-			tmp_n.push_back( 
+			weights.push_back( 
 				boost::lexical_cast<double>(tmp_double) 
 				);
 		}
@@ -69,8 +143,6 @@ void LayerDense::load_weights( istream & fin ) {
 			"its own line"
 			);
 		}
-
-		weights_.push_back( tmp_n );
 	}
 
 	fin >> tmp_char; // for '['
@@ -86,7 +158,7 @@ void LayerDense::load_weights( istream & fin ) {
 	for ( int n = 0; n < neurons_; ++n ) {
 		fin >> tmp_double;
 		if ( !util::isdouble(tmp_double) ) throw BadModel();
-		bias_.push_back( 
+		bias.push_back( 
 			boost::lexical_cast<double>(tmp_double) 
 			);
 	}
@@ -98,54 +170,141 @@ void LayerDense::load_weights( istream & fin ) {
 		"its own line"
 		);
 	}
+
+	set_weights( weights.data(), bias.data(), input_cnt_, neurons_ );
 }
 
+void LayerDense::set_weights( double const * weights, double const * bias,
+	int inputs, int neurons ) {
 
-DataChunk* LayerDense::compute_output( DataChunk* dc ) {
+	input_cnt_ = inputs;
+	neurons_ = neurons;
 
-	int size = weights_[0].size();
-	int size8 = size >> 3;
-	keras::DataChunkFlat* out = new DataChunkFlat( size, 0 );
-	double * y_ret = out->get_1d_rw().data();
+	// pack into a single aligned buffer in the layout the kernels read
+	int padded = kernels::padded_neurons( neurons_ );
+	weights_.assign( (size_t)input_cnt_*padded, 0.0 );
+	kernels::pack_weights( weights, input_cnt_, neurons_, weights_.data() );
 
-	vector<double> const & im = dc->get_1d();
+	bias_.assign( padded, 0.0 );
+	copy( bias, bias+neurons_, bias_.data() );
 
-	for ( int j = 0; j < weights_.size(); ++j ) { // iter over input
-		const double * w = weights_[j].data();
-		double p = im[j];
-		int k = 0;
-		for ( int i = 0; i < size8; ++i ) { // iter over neurons
-			y_ret[k]   += w[k]	 * p;			// vectorize if you can
-			y_ret[k+1] += w[k+1] * p;
-			y_ret[k+2] += w[k+2] * p;
-			y_ret[k+3] += w[k+3] * p;
-			y_ret[k+4] += w[k+4] * p;
-			y_ret[k+5] += w[k+5] * p;
-			y_ret[k+6] += w[k+6] * p;
-			y_ret[k+7] += w[k+7] * p;
-			k += 8;
-		}
-		while ( k < size ) { y_ret[k] += w[k] * p; ++k; }
-	}
-	for ( int i = 0; i < size; ++i ) { // add biases
-		y_ret[i] += bias_[i];
+	weights_f32_.assign( (size_t)input_cnt_*padded, 0.0f );
+	kernels::pack_weights( weights, input_cnt_, neurons_, weights_f32_.data() );
+
+	bias_f32_.assign( padded, 0.0f );
+	copy( bias, bias+neurons_, bias_f32_.data() );
+
+	// pruned layers skip their zero blocks in double precision
+	stored_blocks_ = kernels::count_blocks( weights_.data(), input_cnt_, neurons_ );
+	block_start_.clear();
+	block_inputs_.clear();
+	blocks_.assign( 0, 0.0 );
+	if ( block_sparse() ) {
+		block_start_.resize( padded/kernels::PANEL_WIDTH + 1 );
+		block_inputs_.resize( max( stored_blocks_, 1 ));
+		blocks_.assign( (size_t)max( stored_blocks_, 1 )*kernels::PANEL_WIDTH, 0.0 );
+		kernels::pack_blocks( weights_.data(), input_cnt_, neurons_,
+			block_start_.data(), block_inputs_.data(), blocks_.data() );
 	}
+}
+
+DataChunk* LayerDense::compute_output( DataChunk* dc ) {
+
+	keras::DataChunkFlat* out = new DataChunkFlat( neurons_, 0 );
+	vector<double> const & im = dc->get_1d();
+
+	kernels::dense_kernel()( im.data(), 1, input_cnt_,
+		weights_.data(), bias_.data(), neurons_, out->get_1d_rw().data(), kernels::LINEAR );
 
 	return out;
 }
 
+void LayerDense::compute_output_batch( double const * input, double * output,
+	int rows, int cols ) const {
+	compute_output_fused( input, output, rows, kernels::LINEAR );
+}
+
+void LayerDense::compute_output_batch( float const * input, float * output,
+	int rows, int cols ) const {
+	compute_output_fused( input, output, rows, kernels::LINEAR );
+}
+
+void LayerDense::compute_output_fused( double const * input, double * output,
+	int rows, kernels::Activation activation ) const {
+
+	// output (rows x neurons) = activation( input (rows x inputs) * weights + bias ),
+	// using the SIMD kernel selected for this CPU
+	if ( rows == 0 ) return;
+
+	if ( block_sparse() ) {
+		kernels::block_sparse_kernel()( input, rows, input_cnt_, block_start_.data(),
+			block_inputs_.data(), blocks_.data(), bias_.data(), neurons_, output, activation );
+		return;
+	}
+
+	kernels::dense_kernel()( input, rows, input_cnt_,
+		weights_.data(), bias_.data(), neurons_, output, activation );
+}
+
+void LayerDense::compute_output_fused( float const * input, float * output,
+	int rows, kernels::Activation activation ) const {
+
+	if ( rows == 0 ) return;
+
+	kernels::dense_kernel_f32()( input, rows, input_cnt_,
+		weights_f32_.data(), bias_f32_.data(), neurons_, output, activation );
+}
+
+void LayerDense::compute_output_sparse( SparseBatch const & input, double * output,
+	kernels::Activation activation ) const {
+
+	if ( input.rows() == 0 ) return;
+
+	kernels::sparse_dense_kernel()( input.row_start(), input.columns(), input.values(),
+		input.rows(), input_cnt_, weights_.data(), bias_.data(), neurons_, output, activation );
+}
+
 uint LayerDense::get_input_rows() const { return 1; } // flat, just one row
 uint LayerDense::get_input_cols() const { return input_cnt_; }
 uint LayerDense::get_output_units() const { return neurons_; }
 
 void LayerDense::print_weights() { 
-	for ( int ii = 0; ii < weights_.size(); ++ii ) {
-		for ( int jj = 0; jj < weights_[ii].size(); ++jj ) {
-			cout << ii << "," << jj << " : " << weights_[ ii ][ jj ] << endl;
+	WeightsView view = weights();
+	for ( int ii = 0; ii < view.inputs(); ++ii ) {
+		for ( int jj = 0; jj < view.neurons(); ++jj ) {
+			cout << ii << "," << jj << " : " << view( ii, jj ) << endl;
 		}
 	}
 }
 
+LayerDense::WeightsView LayerDense::weights() const {
+	return WeightsView( weights_.data(), input_cnt_, neurons_ );
+}
+
+double LayerDense::bias( int neuron ) const { return bias_[ neuron ]; }
+
+double LayerDense::block_density() const {
+	int total = input_cnt_*kernels::padded_neurons( neurons_ )/kernels::PANEL_WIDTH;
+	return ( total == 0 ) ? 1.0 : (double)stored_blocks_/total;
+}
+
+bool LayerDense::block_sparse() const { return block_density() <= MAX_BLOCK_DENSITY; }
+
+LayerDense::WeightsView::WeightsView( double const * packed, int inputs, int neurons ) :
+	packed_( packed ),
+	inputs_( inputs ),
+	neurons_( neurons )
+{}
+
+double LayerDense::WeightsView::operator()( int input, int neuron ) const {
+	int panel = neuron / kernels::PANEL_WIDTH;
+	int column = neuron % kernels::PANEL_WIDTH;
+	return packed_[ ( (size_t)panel*inputs_ + input )*kernels::PANEL_WIDTH + column ];
+}
+
+int LayerDense::WeightsView::inputs() const { return inputs_; }
+int LayerDense::WeightsView::neurons() const { return neurons_; }
+
 
 } // namespace keras
 
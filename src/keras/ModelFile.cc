@@ -0,0 +1,334 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/ModelFile.cc
+@brief Binary container for Keras models
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/ModelFile.hh"
+#include "keras/KerasModel.hh"
+#include "keras/LayerDense.hh"
+#include "keras/LayerActivation.hh"
+
+#include "exceptions.hh"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/crc.hpp>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KERAS_USE_MMAP
+#endif
+
+using namespace std;
+
+namespace keras {
+
+namespace {
+
+const char MAGIC[ 8 ] = { 'E','R','R','X','N','N','B','\0' };
+const size_t NAME_SIZE = 28;
+
+bool little_endian() {
+	const unsigned short one = 1;
+	return *reinterpret_cast<unsigned char const *>( &one ) == 1;
+}
+
+// integers are assembled byte by byte so they read the same on any host
+unsigned long long get_uint( char const * p, int bytes ) {
+	unsigned long long value = 0;
+	for ( int ii = bytes-1; ii >= 0; --ii ) {
+		value = ( value << 8 ) | (unsigned char)p[ ii ];
+	}
+	return value;
+}
+
+void put_uint( char * p, unsigned long long value, int bytes ) {
+	for ( int ii = 0; ii < bytes; ++ii ) {
+		p[ ii ] = (char)( value & 0xff );
+		value >>= 8;
+	}
+}
+
+unsigned crc32( char const * data, size_t size ) {
+	boost::crc_32_type crc;
+	crc.process_bytes( data, size );
+	return crc.checksum();
+}
+
+// convert stored little-endian values to doubles. On a little-endian
+// host a double blob is a straight copy
+void decode_values( char const * data, int value_bytes, size_t count, double * out ) {
+	if ( value_bytes == 8 && little_endian() ) {
+		memcpy( out, data, count*sizeof(double) );
+		return;
+	}
+	if ( value_bytes != 4 && value_bytes != 8 ) {
+		throw BadModel( "Error: unsupported value size "+to_string(value_bytes) );
+	}
+
+	for ( size_t ii = 0; ii < count; ++ii ) {
+		char bytes[ 8 ] = {};
+		for ( int b = 0; b < value_bytes; ++b ) {
+			int from = little_endian() ? b : value_bytes-1-b;
+			bytes[ b ] = data[ ii*value_bytes + from ];
+		}
+		if ( value_bytes == 8 ) {
+			double value;
+			memcpy( &value, bytes, 8 );
+			out[ ii ] = value;
+		} else {
+			float value;
+			memcpy( &value, bytes, 4 );
+			out[ ii ] = value;
+		}
+	}
+}
+
+void encode_value( double value, int value_bytes, string & out ) {
+	char bytes[ 8 ];
+	if ( value_bytes == 8 ) {
+		memcpy( bytes, &value, 8 );
+	} else {
+		float narrow = (float)value;
+		memcpy( bytes, &narrow, 4 );
+	}
+	for ( int b = 0; b < value_bytes; ++b ) {
+		out.push_back( bytes[ little_endian() ? b : value_bytes-1-b ] );
+	}
+}
+
+} // namespace
+
+namespace model_file {
+
+bool is_binary( char const * data, size_t size ) {
+	return size >= sizeof( MAGIC ) && memcmp( data, MAGIC, sizeof( MAGIC )) == 0;
+}
+
+bool is_binary_file( string const & file ) {
+	ifstream fin( file.c_str(), ios::binary );
+	char magic[ sizeof( MAGIC ) ];
+	if ( !fin.read( magic, sizeof( magic ))) return 0;
+	return is_binary( magic, sizeof( magic ));
+}
+
+vector<Layer*> read( char const * data, size_t size ) {
+
+	if ( !is_binary( data, size ) || size < HEADER_SIZE ) {
+		throw BadModel( "Error: not a binary ErrorX model" );
+	}
+
+	unsigned version = get_uint( data+8, 4 );
+	if ( version != VERSION ) {
+		throw BadModel( "Error: binary model has version "+to_string(version)+
+			", expected "+to_string(VERSION) );
+	}
+
+	size_t layer_count = get_uint( data+12, 4 );
+	if ( get_uint( data+16, 8 ) != size ) {
+		throw BadModel( "Error: binary model is truncated or has trailing data" );
+	}
+
+	char const * table = data + HEADER_SIZE;
+	if ( layer_count > ( size-HEADER_SIZE ) / ENTRY_SIZE ) {
+		throw BadModel( "Error: binary model layer table is out of bounds" );
+	}
+	if ( crc32( table, layer_count*ENTRY_SIZE ) != get_uint( data+24, 4 )) {
+		throw BadModel( "Error: binary model layer table is corrupt" );
+	}
+
+	vector<Layer*> layers;
+	try {
+		for ( size_t ii = 0; ii < layer_count; ++ii ) {
+			char const * entry = table + ii*ENTRY_SIZE;
+			unsigned type = get_uint( entry, 4 );
+			int value_bytes = get_uint( entry+4, 4 );
+			size_t inputs = get_uint( entry+8, 4 );
+			size_t neurons = get_uint( entry+12, 4 );
+			unsigned long long offset = get_uint( entry+16, 8 );
+			unsigned long long bytes = get_uint( entry+24, 8 );
+
+			if ( offset > size || bytes > size-offset ) {
+				throw BadModel( "Error: data for layer "+to_string(ii)+" is out of bounds" );
+			}
+			if ( crc32( data+offset, bytes ) != get_uint( entry+32, 4 )) {
+				throw BadModel( "Error: data for layer "+to_string(ii)+" is corrupt" );
+			}
+
+			if ( type == DENSE ) {
+				if ( value_bytes != 4 && value_bytes != 8 ) {
+					throw BadModel( "Error: unsupported value size "+to_string(value_bytes)+
+						" for layer "+to_string(ii) );
+				}
+				size_t count = inputs*neurons + neurons;
+				if ( bytes != count*value_bytes ) {
+					throw BadModel( "Error: data size for layer "+to_string(ii)+
+						" does not match its dimensions" );
+				}
+
+				vector<double> values( count );
+				decode_values( data+offset, value_bytes, count, values.data() );
+
+				LayerDense* layer = new LayerDense();
+				layers.push_back( layer );
+				layer->set_weights( values.data(), values.data() + inputs*neurons,
+					inputs, neurons );
+
+			} else if ( type == ACTIVATION ) {
+				char const * name = entry+36;
+				layers.push_back( new LayerActivation( string( name, strnlen( name, NAME_SIZE ))));
+
+			} else {
+				throw BadModel( "Error: unknown type "+to_string(type)+" for layer "+to_string(ii) );
+			}
+		}
+	} catch ( ... ) {
+		for ( size_t ii = 0; ii < layers.size(); ++ii ) delete layers[ ii ];
+		throw;
+	}
+
+	return layers;
+}
+
+void write( KerasModel const & model, ostream & out, int value_bytes ) {
+
+	if ( value_bytes != 4 && value_bytes != 8 ) {
+		throw invalid_argument( "Error: binary models store 4 or 8 byte values, not "+
+			to_string(value_bytes) );
+	}
+
+	int layer_count = model.no_layers();
+	string header( HEADER_SIZE + layer_count*ENTRY_SIZE, '\0' );
+	string blobs;
+
+	for ( int ii = 0; ii < layer_count; ++ii ) {
+		char * entry = &header[ HEADER_SIZE + ii*ENTRY_SIZE ];
+		Layer const * layer = model.layer( ii );
+
+		if ( LayerDense const * dense = dynamic_cast<LayerDense const *>( layer )) {
+			LayerDense::WeightsView weights = dense->weights();
+
+			// every blob starts on an aligned offset
+			while (( header.size()+blobs.size() ) % ALIGNMENT ) blobs.push_back( '\0' );
+			size_t offset = header.size()+blobs.size();
+			size_t start = blobs.size();
+
+			for ( int jj = 0; jj < weights.inputs(); ++jj ) {
+				for ( int kk = 0; kk < weights.neurons(); ++kk ) {
+					encode_value( weights( jj, kk ), value_bytes, blobs );
+				}
+			}
+			for ( int kk = 0; kk < weights.neurons(); ++kk ) {
+				encode_value( dense->bias( kk ), value_bytes, blobs );
+			}
+
+			put_uint( entry, DENSE, 4 );
+			put_uint( entry+4, value_bytes, 4 );
+			put_uint( entry+8, weights.inputs(), 4 );
+			put_uint( entry+12, weights.neurons(), 4 );
+			put_uint( entry+16, offset, 8 );
+			put_uint( entry+24, blobs.size()-start, 8 );
+			put_uint( entry+32, crc32( blobs.data()+start, blobs.size()-start ), 4 );
+
+		} else if ( LayerActivation const * activation = dynamic_cast<LayerActivation const *>( layer )) {
+			string const & name = activation->activation_type();
+			if ( name.size() >= NAME_SIZE ) {
+				throw InvalidLayer( "Activation "+name );
+			}
+
+			put_uint( entry, ACTIVATION, 4 );
+			put_uint( entry+16, header.size(), 8 );
+			put_uint( entry+32, crc32( nullptr, 0 ), 4 );
+			memcpy( entry+36, name.data(), name.size() );
+
+		} else {
+			throw InvalidLayer( layer->get_name() );
+		}
+	}
+
+	memcpy( &header[ 0 ], MAGIC, sizeof( MAGIC ));
+	put_uint( &header[ 8 ], VERSION, 4 );
+	put_uint( &header[ 12 ], layer_count, 4 );
+	put_uint( &header[ 16 ], header.size()+blobs.size(), 8 );
+	put_uint( &header[ 24 ], crc32( header.data()+HEADER_SIZE, layer_count*ENTRY_SIZE ), 4 );
+
+	out.write( header.data(), header.size() );
+	out.write( blobs.data(), blobs.size() );
+}
+
+void write( KerasModel const & model, string const & file, int value_bytes ) {
+	// build the whole file in memory first, so that converting a
+	// model in place never truncates it before it's been read
+	ostringstream buffer;
+	write( model, buffer, value_bytes );
+
+	ofstream out( file.c_str(), ios::binary );
+	if ( !out.good() ) {
+		throw invalid_argument( "Error: cannot write to file "+file );
+	}
+	string const & contents = buffer.str();
+	out.write( contents.data(), contents.size() );
+}
+
+} // namespace model_file
+
+MappedFile::MappedFile( string const & file ) :
+	data_( nullptr ),
+	size_( 0 ),
+	mapped_( 0 )
+{
+#ifdef KERAS_USE_MMAP
+	int fd = open( file.c_str(), O_RDONLY );
+	if ( fd < 0 ) {
+		throw invalid_argument( "Error: file "+file+" does not exist." );
+	}
+
+	struct stat st;
+	if ( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+		void * ptr = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( ptr != MAP_FAILED ) {
+			data_ = static_cast<char const *>( ptr );
+			size_ = st.st_size;
+			mapped_ = 1;
+		}
+	}
+	close( fd );
+
+	if ( mapped_ ) return;
+#endif
+
+	// no mmap on this platform, or it failed: read the file instead
+	ifstream fin( file.c_str(), ios::binary );
+	if ( !fin.good() ) {
+		throw invalid_argument( "Error: file "+file+" does not exist." );
+	}
+	contents_.assign( istreambuf_iterator<char>( fin ), istreambuf_iterator<char>() );
+	data_ = contents_.data();
+	size_ = contents_.size();
+}
+
+MappedFile::~MappedFile() {
+#ifdef KERAS_USE_MMAP
+	if ( mapped_ ) {
+		munmap( const_cast<char*>( data_ ), size_ );
+	}
+#endif
+}
+
+char const * MappedFile::data() const { return data_; }
+size_t MappedFile::size() const { return size_; }
+
+} // namespace keras
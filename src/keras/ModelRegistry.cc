@@ -0,0 +1,131 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/ModelRegistry.cc
+@brief Process-wide cache of loaded Keras models
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/ModelRegistry.hh"
+#include "keras/KerasModel.hh"
+#include "keras/EmbeddedModel.hh"
+#include "ErrorXOptions.hh"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+namespace keras {
+
+namespace {
+
+// function-local statics so the registry is safe to use
+// during static initialization of other translation units
+mutex & registry_mutex() {
+	static mutex m;
+	return m;
+}
+
+map<string,KerasModelConstPtr> & registry_models() {
+	static map<string,KerasModelConstPtr> models;
+	return models;
+}
+
+// fast-activation copies, keyed by the exact model they were made from
+map<KerasModel const *,KerasModelConstPtr> & registry_fast() {
+	static map<KerasModel const *,KerasModelConstPtr> models;
+	return models;
+}
+
+map<string,QuantizedModelConstPtr> & registry_quantized() {
+	static map<string,QuantizedModelConstPtr> models;
+	return models;
+}
+
+} // namespace
+
+KerasModelConstPtr ModelRegistry::get( string const & file, int verbose ) {
+	namespace fs = boost::filesystem;
+
+	// key on the resolved path so that different spellings of
+	// the same file don't load it twice. A missing file is left
+	// as-is and KerasModel reports the error
+	boost::system::error_code ec;
+	fs::path canonical = fs::canonical( fs::path( file ), ec );
+	string key = ec ? file : canonical.string();
+
+	lock_guard<mutex> lock( registry_mutex() );
+	map<string,KerasModelConstPtr> & models = registry_models();
+
+	map<string,KerasModelConstPtr>::const_iterator it = models.find( key );
+	if ( it != models.end() ) return it->second;
+
+	shared_ptr<KerasModel> model( new KerasModel() );
+	model->verbose( verbose );
+	model->load_weights( key );
+
+	models[ key ] = model;
+	return model;
+}
+
+KerasModelConstPtr ModelRegistry::get( errorx::ErrorXOptions const & options ) {
+	namespace fs = boost::filesystem;
+	string file = options.model_file();
+
+	// builds with the model compiled in don't need the file
+	KerasModelConstPtr model = ( EmbeddedModel::available() && !fs::exists( file )) ?
+		EmbeddedModel::model() : get( file, options.verbose() );
+	if ( options.activations() == "exact" ) return model;
+
+	lock_guard<mutex> lock( registry_mutex() );
+	map<KerasModel const *,KerasModelConstPtr> & models = registry_fast();
+
+	map<KerasModel const *,KerasModelConstPtr>::const_iterator it = models.find( model.get() );
+	if ( it != models.end() ) return it->second;
+
+	shared_ptr<KerasModel> fast( new KerasModel( *model ));
+	fast->activation_mode( kernels::FAST );
+
+	models[ model.get() ] = fast;
+	return fast;
+}
+
+QuantizedModelConstPtr ModelRegistry::get_quantized( errorx::ErrorXOptions const & options ) {
+	namespace fs = boost::filesystem;
+	fs::path base( options.errorx_base() );
+	string calibration = (base / "model.calib").string();
+
+	// load the model first, get takes the lock itself
+	KerasModelConstPtr model = get( options );
+
+	lock_guard<mutex> lock( registry_mutex() );
+	map<string,QuantizedModelConstPtr> & models = registry_quantized();
+
+	map<string,QuantizedModelConstPtr>::const_iterator it = models.find( calibration );
+	if ( it != models.end() && it->second->model() == model ) return it->second;
+
+	QuantizedModelConstPtr quantized( new QuantizedModel(
+		model, QuantizedModel::read_calibration( calibration )));
+
+	models[ calibration ] = quantized;
+	return quantized;
+}
+
+int ModelRegistry::size() {
+	lock_guard<mutex> lock( registry_mutex() );
+	return registry_models().size();
+}
+
+void ModelRegistry::clear() {
+	lock_guard<mutex> lock( registry_mutex() );
+	registry_models().clear();
+	registry_fast().clear();
+	registry_quantized().clear();
+}
+
+} // namespace keras
@@ -0,0 +1,253 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/QuantizedModel.cc
+@brief Int8 quantized version of a KerasModel
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/QuantizedModel.hh"
+#include "keras/LayerDense.hh"
+
+#include "exceptions.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace keras {
+
+namespace {
+
+const int INT8_MAX_VALUE = 127;
+
+int8_t quantize( float value, float scale ) {
+	long q = lrintf( value*scale );
+	return (int8_t)max( -(long)INT8_MAX_VALUE, min( (long)INT8_MAX_VALUE, q ));
+}
+
+// quantize a block of rows, padding each row with zeros
+// up to a whole number of int8 groups
+void quantize_rows( float const * input, int rows, int cols, int padded,
+		float scale, int8_t * output ) {
+	for ( int r = 0; r < rows; ++r ) {
+		float const * x = input + (size_t)r*cols;
+		int8_t * q = output + (size_t)r*padded;
+		for ( int jj = 0; jj < cols; ++jj ) q[ jj ] = quantize( x[ jj ], scale );
+		for ( int jj = cols; jj < padded; ++jj ) q[ jj ] = 0;
+	}
+}
+
+} // namespace
+
+QuantizedModel::DenseLayer::DenseLayer() :
+	input_scale( 0 ),
+	inputs( 0 ),
+	padded_inputs( 0 ),
+	neurons( 0 )
+{}
+
+QuantizedModel::QuantizedModel( KerasModelConstPtr model, vector<float> const & ranges ) :
+	model_( model ),
+	ranges_( ranges ),
+	dense_( model->no_layers() ),
+	kernel_( kernels::dense_int8_kernel() ),
+	max_width_( model->get_input_cols() ),
+	max_padded_( 0 )
+{
+	int range_index = 0;
+	for ( int l = 0; l < model_->no_layers(); ++l ) {
+		Layer const * layer = model_->layer( l );
+		max_width_ = max( max_width_, (int)layer->get_output_units() );
+
+		LayerDense const * dense = dynamic_cast<LayerDense const *>( layer );
+		if ( dense == nullptr ) continue;
+
+		if ( range_index >= ranges_.size() ) {
+			throw BadModel( "Error: calibration has "+to_string(ranges_.size())+
+				" ranges, but the model has more dense layers" );
+		}
+		float range = ranges_[ range_index++ ];
+
+		LayerDense::WeightsView weights = dense->weights();
+		DenseLayer & q = dense_[ l ];
+		q.inputs = weights.inputs();
+		q.neurons = weights.neurons();
+		q.padded_inputs = kernels::padded_inputs_int8( q.inputs );
+		max_padded_ = max( max_padded_, q.padded_inputs );
+
+		float input_step = ( range > 0 ) ? range / INT8_MAX_VALUE : 1;
+		q.input_scale = 1 / input_step;
+
+		int padded = kernels::padded_neurons( q.neurons );
+		q.weight_sums.assign( padded, 0 );
+		q.scale.assign( padded, 0 );
+		q.bias.assign( padded, 0 );
+
+		// one scale per neuron, so a neuron with small weights
+		// keeps its resolution next to one with large weights
+		vector<int8_t> quantized( (size_t)q.inputs*q.neurons );
+		for ( int kk = 0; kk < q.neurons; ++kk ) {
+			double largest = 0;
+			for ( int jj = 0; jj < q.inputs; ++jj ) {
+				largest = max( largest, fabs( weights( jj, kk )));
+			}
+			float weight_step = ( largest > 0 ) ? largest / INT8_MAX_VALUE : 1;
+
+			for ( int jj = 0; jj < q.inputs; ++jj ) {
+				int8_t value = quantize( weights( jj, kk ), 1 / weight_step );
+				quantized[ (size_t)jj*q.neurons + kk ] = value;
+				q.weight_sums[ kk ] += value;
+			}
+			q.scale[ kk ] = input_step * weight_step;
+			q.bias[ kk ] = dense->bias( kk );
+		}
+
+		q.weights.resize( (size_t)q.padded_inputs*padded );
+		kernels::pack_weights_int8( quantized.data(), q.inputs, q.neurons, q.weights.data() );
+	}
+
+	if ( range_index != ranges_.size() ) {
+		throw BadModel( "Error: calibration has "+to_string(ranges_.size())+
+			" ranges, but the model has "+to_string(range_index)+" dense layers" );
+	}
+}
+
+void QuantizedModel::compute_output_batch( float const * input, int rows,
+		float * output, InferenceContext & context ) const {
+
+	if ( rows == 0 ) return;
+	context.reserve_f32( (size_t)rows*max_width_ );
+	context.reserve_int8( (size_t)rows*max_padded_ );
+
+	float * buffer0 = context.buffer_f32( 0 );
+	float * buffer1 = context.buffer_f32( 1 );
+	int8_t * quantized = context.buffer_int8();
+
+	// buffers are used the same way as in KerasModel, with
+	// dense layers swapped for the int8 kernel
+	int layers = model_->no_layers();
+	int last_out = -1;
+	for ( int l = 0; l < layers; ++l ) {
+		if ( !model_->layer( l )->in_place() ) last_out = l;
+	}
+
+	int cols = get_input_cols();
+	float const * inp = input;
+	float * current = nullptr;
+
+	for ( int l = 0; l < layers; ++l ) {
+		Layer const * layer = model_->layer( l );
+		float * out;
+
+		if ( l >= last_out ) {
+			out = output;
+		} else if ( layer->in_place() && current != nullptr ) {
+			out = current;
+		} else {
+			out = ( current == buffer0 ) ? buffer1 : buffer0;
+		}
+
+		DenseLayer const & q = dense_[ l ];
+		if ( q.neurons > 0 ) {
+			quantize_rows( inp, rows, cols, q.padded_inputs, q.input_scale, quantized );
+			kernel_( quantized, rows, q.padded_inputs, q.weights.data(), q.weight_sums.data(),
+				q.scale.data(), q.bias.data(), q.neurons, out );
+		} else {
+			layer->compute_output_batch( inp, out, rows, cols );
+		}
+
+		if ( layer->get_output_units() > 0 ) cols = layer->get_output_units();
+		inp = current = out;
+	}
+}
+
+int QuantizedModel::get_input_cols() const { return model_->get_input_cols(); }
+int QuantizedModel::get_output_length() const { return model_->get_output_length(); }
+
+KerasModelConstPtr QuantizedModel::model() const { return model_; }
+vector<float> const & QuantizedModel::ranges() const { return ranges_; }
+
+vector<float> QuantizedModel::calibrate( KerasModel const & model,
+		vector<double> const & input, int rows, double percentile ) {
+
+	if ( percentile <= 0 || percentile > 100 ) {
+		throw invalid_argument( "Error: percentile must be above 0 and at most 100" );
+	}
+	if ( rows <= 0 || input.size() != (size_t)rows*model.get_input_cols() ) {
+		throw invalid_argument( "Error: calibration needs at least one row of "+
+			to_string(model.get_input_cols())+" features" );
+	}
+
+	vector<float> ranges;
+	vector<double> current( input ), next;
+	int cols = model.get_input_cols();
+
+	for ( int l = 0; l < model.no_layers(); ++l ) {
+		Layer const * layer = model.layer( l );
+
+		if ( dynamic_cast<LayerDense const *>( layer ) != nullptr ) {
+			vector<double> magnitudes( current.size() );
+			for ( size_t ii = 0; ii < current.size(); ++ii ) magnitudes[ ii ] = fabs( current[ ii ] );
+
+			size_t rank = min( magnitudes.size()-1,
+				(size_t)ceil( percentile / 100 * magnitudes.size() ) - 1 );
+			nth_element( magnitudes.begin(), magnitudes.begin()+rank, magnitudes.end() );
+			ranges.push_back( magnitudes[ rank ] );
+		}
+
+		int out_cols = ( layer->get_output_units() > 0 ) ? layer->get_output_units() : cols;
+		next.resize( (size_t)rows*out_cols );
+		layer->compute_output_batch( current.data(), next.data(), rows, cols );
+		current.swap( next );
+		cols = out_cols;
+	}
+
+	return ranges;
+}
+
+vector<float> QuantizedModel::read_calibration( string const & file ) {
+	ifstream fin( file.c_str() );
+	if ( !fin.good() ) {
+		throw invalid_argument( "Error: file "+file+" does not exist." );
+	}
+
+	string tag;
+	int count = -1;
+	fin >> tag >> count;
+	if ( tag != "calibration" || count < 0 ) {
+		throw BadModel( "Error: "+file+" is not a calibration file" );
+	}
+
+	vector<float> ranges;
+	for ( int ii = 0; ii < count; ++ii ) {
+		int layer;
+		float range;
+		if ( !( fin >> tag >> layer >> range ) || tag != "dense" ) {
+			throw BadModel( "Error: calibration file "+file+" has "+to_string(ii)+
+				" ranges, expected "+to_string(count) );
+		}
+		ranges.push_back( range );
+	}
+	return ranges;
+}
+
+void QuantizedModel::write_calibration( vector<float> const & ranges, string const & file ) {
+	ofstream out( file.c_str() );
+	if ( !out.good() ) {
+		throw invalid_argument( "Error: cannot write to file "+file );
+	}
+
+	out.precision( numeric_limits<float>::max_digits10 );
+	out << "calibration " << ranges.size() << "\n";
+	for ( int ii = 0; ii < ranges.size(); ++ii ) {
+		out << "dense " << ii << " " << ranges[ ii ] << "\n";
+	}
+}
+
+} // namespace keras
@@ -0,0 +1,38 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file keras/SparseBatch.cc
+@brief Batch of mostly-zero input rows in compressed sparse row form
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include "keras/SparseBatch.hh"
+
+using namespace std;
+
+namespace keras {
+
+SparseBatch::SparseBatch() :
+	row_start_( 1, 0 )
+{}
+
+void SparseBatch::clear() {
+	row_start_.resize( 1 );
+	columns_.clear();
+	values_.clear();
+}
+
+void SparseBatch::add( int column, double value ) {
+	columns_.push_back( column );
+	values_.push_back( value );
+}
+
+void SparseBatch::end_row() { row_start_.push_back( columns_.size() ); }
+
+int SparseBatch::rows() const { return row_start_.size()-1; }
+int const * SparseBatch::row_start() const { return row_start_.data(); }
+int const * SparseBatch::columns() const { return columns_.data(); }
+double const * SparseBatch::values() const { return values_.data(); }
+
+} // namespace keras
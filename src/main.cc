@@ -16,7 +16,9 @@ Code contained herein is proprietary and confidential.
 #include "errorx.hh"
 #include "IGBlastParser.hh"
 #include "ErrorPredictor.hh"
+#include "PredictionCache.hh"
 #include "ErrorXOptions.hh"
+#include "Executor.hh"
 #include "SequenceRecords.hh"
 #include "util.hh"
 #include "constants.hh"
@@ -53,6 +55,25 @@ int main( int argc, char* argv[] ) {
 		"2: output progress and debugging messages\n"
 		"(default=1)")
 		("allow-nonproductive", program_options::bool_switch()->default_value(false), "Allow nonproductive and out-of-frame sequences to be included? (default=No)")
+		("precision", program_options::value<string>()->default_value("double"), "Numeric precision for the neural network. Valid entries are double, single or int8. "
+				"Single and int8 are faster, but error probabilities differ slightly from double. (Default=double)")
+		("activations", program_options::value<string>()->default_value("exact"), "How the neural network evaluates sigmoid, tanh and softmax. Valid entries are exact or fast. "
+				"Fast uses a vectorized approximation of exp, and error probabilities differ from exact by about 1e-14. (Default=exact)")
+		("screen-model", program_options::value<string>(), "Small model, e.g. from errorx_model screen, that scores every base first. "
+				"Only bases it scores between screen-lower and screen-upper go through the full neural network. (Default=none)")
+		("screen-lower", program_options::value<double>()->default_value(0.05), "Screen probability below which a base is called correct without the full network. (Default=0.05)")
+		("screen-upper", program_options::value<double>()->default_value(1), "Screen probability above which a base is called an error without the full network. (Default=1, never)")
+		("screen-validate", program_options::bool_switch()->default_value(false), "Also run the full network on the bases the screen called, "
+				"and report how often the two disagree (default=No)")
+		("cache", program_options::bool_switch()->default_value(false), "Reuse the prediction for feature windows that were already seen, "
+				"e.g. in reads from the same clone (default=No)")
+		("cache-size", program_options::value<int>()->default_value(64), "Memory for the prediction cache in megabytes (Default=64)")
+		("cache-resolution", program_options::value<double>()->default_value(0), "Round features to a multiple of this before looking them up in the cache, "
+				"so near-identical windows share a prediction. 0 only reuses exact matches, which leaves predictions unchanged. (Default=0)")
+		("chunk-size", program_options::value<int>()->default_value(0), "Stream the input through in chunks of this many reads, so memory use stays about the same "
+				"however large the input is. For FASTQ, duplicate IDs are renamed using up to the last 250,000 "
+				"read names, so a duplicate further back can get a different name than without chunks. "
+				"0 reads the whole input at once. (Default=0)")
 		("license", program_options::value<string>(), "License key to activate full version of ErrorX")
 		;
 
@@ -117,8 +138,43 @@ int main( int argc, char* argv[] ) {
 
 		options.allow_nonproductive( vm["allow-nonproductive"].as<bool>());
 
+		options.precision( vm["precision"].as<string>());
+
+		options.activations( vm["activations"].as<string>());
+
+		if ( vm.count("screen-model") ) options.screen_model( vm["screen-model"].as<string>());
+
+		options.screen_lower( vm["screen-lower"].as<double>());
+
+		options.screen_upper( vm["screen-upper"].as<double>());
+
+		options.screen_validate( vm["screen-validate"].as<bool>());
+
+		options.prediction_cache( vm["cache"].as<bool>());
+
+		options.cache_size( vm["cache-size"].as<int>());
+
+		options.cache_resolution( vm["cache-resolution"].as<double>());
+
+		options.chunk_size( vm["chunk-size"].as<int>());
+
 		run_protocol_write( options );
 
+		if ( options.screen_validate() && options.verbose() > 0 ) {
+			ErrorPredictor::CascadeCounts counts = ErrorPredictor::cascade_counts();
+			cout << "Screen called " << counts.screened << " of " << counts.screened+counts.forwarded
+				 << " bases, the full network disagreed on " << counts.disagreements << endl;
+		}
+
+		if ( options.prediction_cache() && options.verbose() > 1 ) {
+			PredictionCachePtr cache = PredictionCache::get( options );
+			cout << "Prediction cache: " << cache->hits() << " hits, " << cache->misses()
+				 << " misses, " << cache->size() << " rows stored" << endl;
+		}
+
+		// join the pool threads before exit rather than in static destructors
+		Executor::shutdown_shared();
+
 		return 0;
 	} catch ( program_options::unknown_option & exc) {
 		cout << "Error: "<< exc.what() << endl;
@@ -132,6 +188,7 @@ int main( int argc, char* argv[] ) {
 	} catch ( std::exception & e ) {
 		// cout << "Exception encountered..." << endl;
 		cout << e.what() << endl;
+		Executor::shutdown_shared();
 		return 1;
 	}
 }
@@ -0,0 +1,811 @@
+/** Copyright (C) EndeavorBio, Inc. - All Rights Reserved
+Unauthorized copying of this file, via any medium is strictly prohibited
+Code contained herein is proprietary and confidential.
+
+@file model_tool.cc
+@brief Offline tools for ErrorX model files
+@author Alex Sevy (alex@endeavorbio.com)
+*/
+
+#include <iostream>
+#include <fstream>
+#include <exception>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "keras/KerasModel.hh"
+#include "keras/Layer.hh"
+#include "keras/LayerActivation.hh"
+#include "keras/LayerDense.hh"
+#include "keras/EmbeddedModel.hh"
+#include "keras/ModelFile.hh"
+#include "keras/QuantizedModel.hh"
+
+#include "errorx.hh"
+#include "ErrorPredictor.hh"
+#include "ErrorXOptions.hh"
+#include "FeatureExtractor.hh"
+#include "PredictionCache.hh"
+#include "SequenceRecords.hh"
+#include "constants.hh"
+#include "util.hh"
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+namespace {
+
+const string USAGE =
+	"Usage: errorx_model <command> [options]\n"
+	"Commands:\n"
+	"  convert <in> <out>  convert a model.nnet text model to the binary format\n"
+	"  info <model>        print the layers of a text or binary model\n"
+	"  compare [files]     compare predictions of a faster inference mode\n"
+	"                      against the default double-precision model\n"
+	"  calibrate [files]   find int8 input ranges from real feature rows\n"
+	"  embed <in> <out>    write a model as C++ source to compile into the library\n"
+	"  prune <in> <out>    zero the smallest weight blocks of a model, for speed\n"
+	"  screen [files]      fit a small screening model to run before the full one\n";
+
+int convert( vector<string> const & args ) {
+	using namespace boost;
+
+	program_options::options_description desc( "convert options" );
+	desc.add_options()
+		("help,h", "produce help message")
+		("float", program_options::bool_switch()->default_value(false),
+			"store weights as 32-bit floats instead of doubles. Predictions "
+			"will no longer match the text model exactly (default=No)")
+		("files", program_options::value<vector<string>>(), "input and output files")
+		;
+
+	program_options::positional_options_description positional;
+	positional.add( "files", 2 );
+
+	program_options::variables_map vm;
+	program_options::store( program_options::command_line_parser( args ).
+			options( desc ).positional( positional ).run(), vm );
+	program_options::notify( vm );
+
+	if ( vm.count( "help" ) || !vm.count( "files" ) || vm["files"].as<vector<string>>().size() != 2 ) {
+		cout << "Usage: errorx_model convert [--float] model.nnet model.nnb\n" << desc << "\n";
+		return 1;
+	}
+
+	vector<string> files = vm["files"].as<vector<string>>();
+	keras::KerasModel model;
+	model.verbose( 0 );
+	model.load_weights( files[ 0 ] );
+
+	keras::model_file::write( model, files[ 1 ], vm["float"].as<bool>() ? 4 : 8 );
+
+	// read the result back so a bad conversion is caught here
+	keras::KerasModel check;
+	check.verbose( 0 );
+	check.load_weights( files[ 1 ] );
+
+	cout << "Wrote " << files[ 1 ] << " with " << check.no_layers() << " layers" << endl;
+	return 0;
+}
+
+int info( vector<string> const & args ) {
+	if ( args.size() != 1 ) {
+		cout << "Usage: errorx_model info model.nnet" << endl;
+		return 1;
+	}
+
+	keras::KerasModel model;
+	model.verbose( 0 );
+	model.load_weights( args[ 0 ] );
+
+	cout << args[ 0 ] << ": " << ( keras::model_file::is_binary_file( args[ 0 ] ) ? "binary" : "text" )
+		 << " model, " << model.get_input_cols() << " inputs, "
+		 << model.get_output_length() << " outputs" << endl;
+
+	for ( int ii = 0; ii < model.no_layers(); ++ii ) {
+		keras::Layer const * layer = model.layer( ii );
+		cout << "layer " << ii << " " << layer->get_name();
+
+		if ( keras::LayerActivation const * activation =
+				dynamic_cast<keras::LayerActivation const *>( layer )) {
+			cout << " " << activation->activation_type();
+		} else {
+			cout << " " << layer->get_input_cols() << " x " << layer->get_output_units();
+		}
+
+		keras::LayerDense const * dense = dynamic_cast<keras::LayerDense const *>( layer );
+		if ( dense != nullptr && dense->block_density() < 1 ) {
+			cout << ", " << 100*dense->block_density() << "% of weight blocks stored";
+		}
+		cout << endl;
+	}
+	return 0;
+}
+
+// run the full protocol on a file and collect the error
+// probability of every base, by sequence ID
+map<string,vector<double>> predict( string const & file, errorx::ErrorXOptions options ) {
+	string extension = boost::filesystem::path( file ).extension().string();
+	options.infile( file );
+	options.format( extension.empty() ? "" : extension.substr( 1 ));
+
+	errorx::SequenceRecordsPtr records = errorx::run_protocol( options );
+
+	map<string,vector<double>> predictions;
+	for ( int ii = 0; ii < records->size(); ++ii ) {
+		errorx::SequenceRecordPtr record = records->get( ii );
+		vector<pair<int,double>> errors = record->get_predicted_errors();
+
+		vector<double> & probabilities = predictions[ record->sequenceID() ];
+		for ( int jj = 0; jj < errors.size(); ++jj ) {
+			probabilities.push_back( errors[ jj ].second );
+		}
+	}
+	return predictions;
+}
+
+// test data bundled with ErrorX, used when no files are given.
+// Files ending in _out.tsv are ErrorX output, not input
+vector<string> default_files( string const & errorx_base ) {
+	namespace fs = boost::filesystem;
+	vector<string> files;
+	fs::path base( errorx_base );
+	fs::path testing = base / "unit_test" / "testing";
+	if ( fs::is_directory( testing )) {
+		for ( fs::directory_iterator it( testing ); it != fs::directory_iterator(); ++it ) {
+			string name = it->path().filename().string();
+			string extension = it->path().extension().string();
+			bool output = name.size() >= 8 && name.compare( name.size()-8, 8, "_out.tsv" ) == 0;
+			if ( extension == ".fastq" || ( extension == ".tsv" && !output )) {
+				files.push_back( it->path().string() );
+			}
+		}
+	}
+	sort( files.begin(), files.end() );
+	files.push_back(( base / "documentation" / "ExampleSequences.fastq" ).string() );
+	files.push_back(( base / "documentation" / "ExampleSequences.tsv" ).string() );
+	return files;
+}
+
+int compare( vector<string> const & args ) {
+	using namespace boost;
+
+	program_options::options_description desc( "compare options" );
+	desc.add_options()
+		("help,h", "produce help message")
+		("precision", program_options::value<string>()->default_value("single"),
+			"precision to compare against double, single or int8 (default=single)")
+		("activations", program_options::value<string>()->default_value("exact"),
+			"activations to compare against exact, exact or fast (default=exact)")
+		("model", program_options::value<string>(),
+			"model to compare against the one in errorx-base, e.g. from errorx_model prune")
+		("screen", program_options::value<string>(),
+			"screening model to run before the full one, e.g. from errorx_model screen")
+		("screen-lower", program_options::value<double>()->default_value(0.05),
+			"screen probability below which a base is called correct (default=0.05)")
+		("screen-upper", program_options::value<double>()->default_value(1),
+			"screen probability above which a base is called an error (default=1, never)")
+		("cache", program_options::bool_switch()->default_value(false),
+			"reuse predictions of feature rows that were already seen (default=No)")
+		("cache-resolution", program_options::value<double>()->default_value(0),
+			"round features to a multiple of this for the cache, 0 for exact matches (default=0)")
+		("errorx-base", program_options::value<string>(),
+			"ErrorX install directory with model.nnet and IGBlast (default=location of this binary)")
+		("species,s", program_options::value<string>()->default_value("human"), "species for IGBLAST search (default=human)")
+		("nthreads,n", program_options::value<int>()->default_value(-1), "number of threads, -1 for all (default=-1)")
+		("files", program_options::value<vector<string>>(),
+			"fastq, fasta or tsv files. Defaults to the test data in unit_test/testing "
+			"and documentation/ExampleSequences.* under errorx-base")
+		;
+
+	program_options::positional_options_description positional;
+	positional.add( "files", -1 );
+
+	program_options::variables_map vm;
+	program_options::store( program_options::command_line_parser( args ).
+			options( desc ).positional( positional ).run(), vm );
+	program_options::notify( vm );
+
+	if ( vm.count( "help" )) {
+		cout << "Usage: errorx_model compare [--precision single] [--activations exact] [--model pruned.nnet] [--screen screen.nnet] [--cache] [files]\n" << desc << "\n";
+		return 1;
+	}
+
+	errorx::ErrorXOptions reference;
+	reference.verbose( 0 );
+	reference.species( vm["species"].as<string>() );
+	reference.nthreads( vm["nthreads"].as<int>() );
+	if ( vm.count( "errorx-base" )) reference.errorx_base( vm["errorx-base"].as<string>() );
+
+	errorx::ErrorXOptions variant( reference );
+	variant.precision( vm["precision"].as<string>() );
+	variant.activations( vm["activations"].as<string>() );
+	if ( vm.count( "model" )) variant.model_file( vm["model"].as<string>() );
+	if ( vm.count( "screen" )) variant.screen_model( vm["screen"].as<string>() );
+	variant.screen_lower( vm["screen-lower"].as<double>() );
+	variant.screen_upper( vm["screen-upper"].as<double>() );
+	variant.prediction_cache( vm["cache"].as<bool>() );
+	variant.cache_resolution( vm["cache-resolution"].as<double>() );
+
+	vector<string> files;
+	if ( vm.count( "files" )) {
+		files = vm["files"].as<vector<string>>();
+	} else {
+		files = default_files( reference.errorx_base() );
+	}
+
+	double threshold = reference.error_threshold();
+	double max_delta = 0;
+	long bases = 0;
+	int flips = 0;
+	int failed = 0;
+	// wall time of the whole protocol, IGBlast included for fastq files.
+	// Models are loaded up front so neither side pays for reading them
+	errorx::ErrorPredictor load_reference( reference ), load_variant( variant );
+	chrono::duration<double> reference_time( 0 ), variant_time( 0 );
+	errorx::ErrorPredictor::reset_cascade_counts();
+
+	for ( int ii = 0; ii < files.size(); ++ii ) {
+		map<string,vector<double>> expected, actual;
+		try {
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			expected = predict( files[ ii ], reference );
+			chrono::steady_clock::time_point middle = chrono::steady_clock::now();
+			actual = predict( files[ ii ], variant );
+			variant_time += chrono::steady_clock::now() - middle;
+			reference_time += middle - start;
+		} catch ( std::exception & e ) {
+			cout << files[ ii ] << ": failed: " << e.what() << endl;
+			++failed;
+			continue;
+		}
+
+		double file_delta = 0;
+		int file_flips = 0;
+		for ( map<string,vector<double>>::const_iterator it = expected.begin(); it != expected.end(); ++it ) {
+			vector<double> const & other = actual[ it->first ];
+			if ( other.size() != it->second.size() ) {
+				cout << files[ ii ] << ": " << it->first << " has a different length" << endl;
+				++failed;
+				continue;
+			}
+
+			for ( int jj = 0; jj < other.size(); ++jj ) {
+				double a = it->second[ jj ], b = other[ jj ];
+				file_delta = max( file_delta, fabs( a-b ));
+				++bases;
+
+				if (( a > threshold ) != ( b > threshold )) {
+					++file_flips;
+					cout << files[ ii ] << ": " << it->first << " position " << jj
+						 << " flips: " << a << " vs " << b << endl;
+				}
+			}
+		}
+
+		cout << files[ ii ] << ": " << expected.size() << " sequences, max delta "
+			 << file_delta << ", " << file_flips << " flipped calls" << endl;
+		max_delta = max( max_delta, file_delta );
+		flips += file_flips;
+	}
+
+	cout << "Total: " << bases << " bases, max delta " << max_delta
+		 << ", " << flips << " flipped calls, " << failed << " failures" << endl;
+	cout << "Time: reference " << reference_time.count() << " s, variant "
+		 << variant_time.count() << " s" << endl;
+	if ( vm.count( "screen" )) {
+		errorx::ErrorPredictor::CascadeCounts counts = errorx::ErrorPredictor::cascade_counts();
+		cout << "Screen: called " << counts.screened << " of " << counts.screened+counts.forwarded
+			 << " non-germline positions without the full network" << endl;
+	}
+	if ( variant.prediction_cache() ) {
+		errorx::PredictionCachePtr cache = errorx::PredictionCache::get( variant );
+		cout << "Cache: " << 100*cache->hit_rate() << "% of " << cache->hits()+cache->misses()
+			 << " lookups hit, " << cache->size() << " rows stored" << endl;
+	}
+
+	return ( flips > 0 || failed > 0 ) ? 1 : 0;
+}
+
+// features of every non-germline position, the rows the
+// network actually sees, from at most max_rows positions
+vector<double> feature_rows( errorx::ErrorXOptions options, vector<string> const & files, int max_rows ) {
+	namespace fs = boost::filesystem;
+	int cols = errorx::constants::N_FEATURES;
+	vector<double> rows;
+	for ( int ii = 0; ii < files.size() && rows.size() < (size_t)max_rows*cols; ++ii ) {
+		string extension = fs::path( files[ ii ] ).extension().string();
+		options.infile( files[ ii ] );
+		options.format( extension.empty() ? "" : extension.substr( 1 ));
+
+		errorx::SequenceRecordsPtr records;
+		try {
+			records = errorx::run_protocol( options );
+		} catch ( std::exception & e ) {
+			cout << files[ ii ] << ": failed: " << e.what() << endl;
+			continue;
+		}
+
+		size_t before = rows.size() / cols;
+		for ( int jj = 0; jj < records->size() && rows.size() < (size_t)max_rows*cols; ++jj ) {
+			errorx::FeatureExtractor features( *records->get( jj ));
+			vector<int> const & positions = features.mismatch_positions();
+			for ( int kk = 0; kk < positions.size() && rows.size() < (size_t)max_rows*cols; ++kk ) {
+				rows.resize( rows.size()+cols );
+				features.fill_row( positions[ kk ], &rows[ rows.size()-cols ] );
+			}
+		}
+		cout << files[ ii ] << ": " << rows.size()/cols - before << " feature rows" << endl;
+	}
+	return rows;
+}
+
+int calibrate( vector<string> const & args ) {
+	using namespace boost;
+
+	program_options::options_description desc( "calibrate options" );
+	desc.add_options()
+		("help,h", "produce help message")
+		("errorx-base", program_options::value<string>(),
+			"ErrorX install directory with model.nnet and IGBlast (default=location of this binary)")
+		("out,o", program_options::value<string>(),
+			"calibration file to write (default=model.calib under errorx-base)")
+		("percentile", program_options::value<double>()->default_value(99.99),
+			"percentile of absolute layer inputs to cover, larger values are clipped (default=99.99)")
+		("max-rows", program_options::value<int>()->default_value(100000),
+			"largest number of feature rows to sample (default=100000)")
+		("species,s", program_options::value<string>()->default_value("human"), "species for IGBLAST search (default=human)")
+		("nthreads,n", program_options::value<int>()->default_value(-1), "number of threads, -1 for all (default=-1)")
+		("files", program_options::value<vector<string>>(),
+			"fastq, fasta or tsv files. Defaults to the test data in unit_test/testing "
+			"and documentation/ExampleSequences.* under errorx-base")
+		;
+
+	program_options::positional_options_description positional;
+	positional.add( "files", -1 );
+
+	program_options::variables_map vm;
+	program_options::store( program_options::command_line_parser( args ).
+			options( desc ).positional( positional ).run(), vm );
+	program_options::notify( vm );
+
+	if ( vm.count( "help" )) {
+		cout << "Usage: errorx_model calibrate [--out model.calib] [files]\n" << desc << "\n";
+		return 1;
+	}
+
+	errorx::ErrorXOptions options;
+	options.verbose( 0 );
+	options.species( vm["species"].as<string>() );
+	options.nthreads( vm["nthreads"].as<int>() );
+	if ( vm.count( "errorx-base" )) options.errorx_base( vm["errorx-base"].as<string>() );
+
+	namespace fs = boost::filesystem;
+	fs::path base( options.errorx_base() );
+
+	vector<string> files;
+	if ( vm.count( "files" )) {
+		files = vm["files"].as<vector<string>>();
+	} else {
+		files = default_files( options.errorx_base() );
+	}
+
+	int cols = errorx::constants::N_FEATURES;
+	vector<double> rows = feature_rows( options, files, vm["max-rows"].as<int>() );
+	if ( rows.empty() ) {
+		cout << "No feature rows to calibrate from" << endl;
+		return 1;
+	}
+
+	keras::KerasModel model( options );
+	vector<float> ranges = keras::QuantizedModel::calibrate(
+		model, rows, rows.size()/cols, vm["percentile"].as<double>() );
+
+	string out = vm.count( "out" ) ? vm["out"].as<string>() : ( base / "model.calib" ).string();
+	keras::QuantizedModel::write_calibration( ranges, out );
+
+	cout << "Wrote " << out << " from " << rows.size()/cols << " rows:";
+	for ( int ii = 0; ii < ranges.size(); ++ii ) cout << " " << ranges[ ii ];
+	cout << endl;
+	return 0;
+}
+
+int embed( vector<string> const & args ) {
+	if ( args.size() != 2 ) {
+		cout << "Usage: errorx_model embed model.nnet src/keras/EmbeddedModelData.inc" << endl;
+		return 1;
+	}
+
+	keras::KerasModel model;
+	model.verbose( 0 );
+	model.load_weights( args[ 0 ] );
+
+	ofstream out( args[ 1 ].c_str() );
+	if ( !out.good() ) {
+		cout << "Error: cannot write to file " << args[ 1 ] << endl;
+		return 1;
+	}
+	keras::EmbeddedModel::write_source( model, out );
+
+	cout << "Wrote " << args[ 1 ] << " with " << model.no_layers() << " layers" << endl;
+	return 0;
+}
+
+// write a model in the text format, listing only the stored
+// blocks of dense layers that run block-sparse
+void write_text( keras::KerasModel const & model, ostream & out ) {
+	using namespace keras;
+
+	out.precision( numeric_limits<double>::max_digits10 );
+	out << "layers " << model.no_layers() << "\n";
+	for ( int ii = 0; ii < model.no_layers(); ++ii ) {
+		Layer const * layer = model.layer( ii );
+		out << "layer " << ii << " " << layer->get_name() << "\n";
+
+		if ( LayerActivation const * activation = dynamic_cast<LayerActivation const *>( layer )) {
+			out << activation->activation_type() << "\n";
+			continue;
+		}
+
+		LayerDense const * dense = dynamic_cast<LayerDense const *>( layer );
+		if ( dense == nullptr ) throw InvalidLayer( "Error: cannot write layer "+layer->get_name() );
+
+		LayerDense::WeightsView weights = dense->weights();
+		int inputs = weights.inputs(), neurons = weights.neurons();
+		if ( dense->block_sparse() ) {
+			// blocks in input order, each with the panel it belongs to
+			vector<pair<int,int>> blocks;
+			for ( int jj = 0; jj < inputs; ++jj ) {
+				for ( int k0 = 0; k0 < neurons; k0 += kernels::PANEL_WIDTH ) {
+					bool zero = true;
+					for ( int kk = k0; kk < min( neurons, k0+kernels::PANEL_WIDTH ); ++kk ) {
+						if ( weights( jj, kk ) != 0 ) zero = false;
+					}
+					if ( !zero ) blocks.push_back( make_pair( jj, k0/kernels::PANEL_WIDTH ));
+				}
+			}
+
+			out << inputs << " " << neurons << " blocks " << blocks.size() << "\n";
+			for ( int bb = 0; bb < blocks.size(); ++bb ) {
+				int k0 = blocks[ bb ].second*kernels::PANEL_WIDTH;
+				out << blocks[ bb ].first << " " << blocks[ bb ].second << " [";
+				for ( int kk = k0; kk < min( neurons, k0+kernels::PANEL_WIDTH ); ++kk ) {
+					out << " " << weights( blocks[ bb ].first, kk );
+				}
+				out << " ]\n";
+			}
+		} else {
+			out << inputs << " " << neurons << "\n";
+			for ( int jj = 0; jj < inputs; ++jj ) {
+				out << "[";
+				for ( int kk = 0; kk < neurons; ++kk ) out << " " << weights( jj, kk );
+				out << " ]\n";
+			}
+		}
+
+		out << "[";
+		for ( int kk = 0; kk < neurons; ++kk ) out << " " << dense->bias( kk );
+		out << " ]\n";
+	}
+}
+
+// zero the given fraction of a layer's weight blocks, smallest
+// L2 norm first. A block is one input's weights for one panel
+keras::LayerDense * prune_layer( keras::LayerDense const & dense, double sparsity ) {
+	using namespace keras;
+
+	LayerDense::WeightsView view = dense.weights();
+	int inputs = view.inputs(), neurons = view.neurons();
+	int panels = kernels::padded_neurons( neurons )/kernels::PANEL_WIDTH;
+
+	vector<double> weights( (size_t)inputs*neurons ), bias( neurons );
+	vector<double> norms( (size_t)inputs*panels, 0.0 );
+	for ( int jj = 0; jj < inputs; ++jj ) {
+		for ( int kk = 0; kk < neurons; ++kk ) {
+			double w = view( jj, kk );
+			weights[ (size_t)jj*neurons + kk ] = w;
+			norms[ (size_t)jj*panels + kk/kernels::PANEL_WIDTH ] += w*w;
+		}
+	}
+	for ( int kk = 0; kk < neurons; ++kk ) bias[ kk ] = dense.bias( kk );
+
+	vector<int> order( norms.size() );
+	for ( int ii = 0; ii < order.size(); ++ii ) order[ ii ] = ii;
+	stable_sort( order.begin(), order.end(),
+		[&norms]( int a, int b ) { return norms[ a ] < norms[ b ]; } );
+
+	size_t pruned = (size_t)( sparsity*order.size() );
+	for ( size_t ii = 0; ii < pruned; ++ii ) {
+		int jj = order[ ii ] / panels;
+		int k0 = order[ ii ] % panels * kernels::PANEL_WIDTH;
+		for ( int kk = k0; kk < min( neurons, k0+kernels::PANEL_WIDTH ); ++kk ) {
+			weights[ (size_t)jj*neurons + kk ] = 0;
+		}
+	}
+
+	LayerDense * layer = new LayerDense();
+	layer->set_weights( weights.data(), bias.data(), inputs, neurons );
+	return layer;
+}
+
+int prune( vector<string> const & args ) {
+	using namespace boost;
+
+	program_options::options_description desc( "prune options" );
+	desc.add_options()
+		("help,h", "produce help message")
+		("sparsity", program_options::value<double>()->default_value(0.5),
+			"fraction of weight blocks to zero in each layer, between 0 and 1 (default=0.5)")
+		("prune-output", program_options::bool_switch()->default_value(false),
+			"also prune the last dense layer, which is left as-is by default (default=No)")
+		("files", program_options::value<vector<string>>(), "input and output files")
+		;
+
+	program_options::positional_options_description positional;
+	positional.add( "files", 2 );
+
+	program_options::variables_map vm;
+	program_options::store( program_options::command_line_parser( args ).
+			options( desc ).positional( positional ).run(), vm );
+	program_options::notify( vm );
+
+	if ( vm.count( "help" ) || !vm.count( "files" ) || vm["files"].as<vector<string>>().size() != 2 ) {
+		cout << "Usage: errorx_model prune [--sparsity 0.5] model.nnet pruned.nnet\n" << desc << "\n";
+		return 1;
+	}
+
+	double sparsity = vm["sparsity"].as<double>();
+	if ( sparsity < 0 || sparsity > 1 ) {
+		throw invalid_argument( "Error: sparsity must be between 0 and 1" );
+	}
+
+	vector<string> files = vm["files"].as<vector<string>>();
+	keras::KerasModel model;
+	model.verbose( 0 );
+	model.load_weights( files[ 0 ] );
+
+	int last_dense = -1;
+	for ( int ii = 0; ii < model.no_layers(); ++ii ) {
+		if ( dynamic_cast<keras::LayerDense const *>( model.layer( ii )) != nullptr ) last_dense = ii;
+	}
+
+	vector<keras::Layer*> layers;
+	for ( int ii = 0; ii < model.no_layers(); ++ii ) {
+		keras::LayerDense const * dense = dynamic_cast<keras::LayerDense const *>( model.layer( ii ));
+		if ( dense == nullptr || ( ii == last_dense && !vm["prune-output"].as<bool>() )) {
+			layers.push_back( model.layer( ii )->clone() );
+			continue;
+		}
+
+		keras::LayerDense * pruned = prune_layer( *dense, sparsity );
+		layers.push_back( pruned );
+		cout << "layer " << ii << " Dense " << pruned->get_input_cols() << " x "
+			 << pruned->get_output_units() << ": " << 100*pruned->block_density()
+			 << "% of weight blocks kept" << ( pruned->block_sparse() ? ", block-sparse" : "" ) << endl;
+	}
+
+	keras::KerasModel result;
+	result.verbose( 0 );
+	result.set_layers( layers );
+
+	ofstream out( files[ 1 ].c_str() );
+	if ( !out.good() ) {
+		cout << "Error: cannot write to file " << files[ 1 ] << endl;
+		return 1;
+	}
+	write_text( result, out );
+	out.close();
+
+	cout << "Wrote " << files[ 1 ] << ". Check it with errorx_model compare --model "
+		 << files[ 1 ] << endl;
+	return 0;
+}
+
+// columns the screen looks at: read quality, around the position
+// and overall, and how heavily mutated the read is
+const int SCREEN_COLUMNS[] = { 2, 3, 58, 59, 60, 61, 62, 63, 64, 65, 66, 122, 123 };
+const int N_SCREEN_COLUMNS = sizeof( SCREEN_COLUMNS )/sizeof( int );
+
+// fit a logistic regression over the screen columns to the full
+// network's probabilities, by Newton's method with a small L2
+// penalty. Returns a weight per screen column followed by the bias
+vector<double> fit_screen( vector<double> const & rows, vector<double> const & targets ) {
+	int cols = errorx::constants::N_FEATURES;
+	int m = N_SCREEN_COLUMNS+1;
+	size_t count = targets.size();
+	double l2 = 1e-3*count;
+
+	vector<double> beta( m, 0.0 ), x( m );
+	for ( int iteration = 0; iteration < 100; ++iteration ) {
+		vector<double> gradient( m, 0.0 ), hessian( (size_t)m*m, 0.0 );
+		for ( size_t r = 0; r < count; ++r ) {
+			for ( int c = 0; c < N_SCREEN_COLUMNS; ++c ) x[ c ] = rows[ r*cols + SCREEN_COLUMNS[ c ]];
+			x[ m-1 ] = 1;
+
+			double z = 0;
+			for ( int c = 0; c < m; ++c ) z += beta[ c ]*x[ c ];
+			double p = 1/( 1+exp( -z ));
+			for ( int a = 0; a < m; ++a ) {
+				gradient[ a ] += ( p-targets[ r ] )*x[ a ];
+				for ( int b = 0; b < m; ++b ) hessian[ a*m+b ] += p*( 1-p )*x[ a ]*x[ b ];
+			}
+		}
+		for ( int a = 0; a+1 < m; ++a ) {
+			gradient[ a ] += l2*beta[ a ];
+			hessian[ a*m+a ] += l2;
+		}
+
+		// solve hessian * step = gradient, with partial pivoting
+		for ( int a = 0; a < m; ++a ) {
+			int pivot = a;
+			for ( int b = a+1; b < m; ++b ) {
+				if ( fabs( hessian[ b*m+a ] ) > fabs( hessian[ pivot*m+a ] )) pivot = b;
+			}
+			for ( int c = 0; c < m; ++c ) swap( hessian[ a*m+c ], hessian[ pivot*m+c ] );
+			swap( gradient[ a ], gradient[ pivot ] );
+			for ( int b = a+1; b < m; ++b ) {
+				double factor = hessian[ b*m+a ] / hessian[ a*m+a ];
+				for ( int c = a; c < m; ++c ) hessian[ b*m+c ] -= factor*hessian[ a*m+c ];
+				gradient[ b ] -= factor*gradient[ a ];
+			}
+		}
+		double largest = 0;
+		for ( int a = m-1; a >= 0; --a ) {
+			double step = gradient[ a ];
+			for ( int c = a+1; c < m; ++c ) step -= hessian[ a*m+c ]*gradient[ c ];
+			gradient[ a ] = step / hessian[ a*m+a ];
+			beta[ a ] -= gradient[ a ];
+			largest = max( largest, fabs( gradient[ a ] ));
+		}
+		if ( largest < 1e-10 ) break;
+	}
+	return beta;
+}
+
+int screen( vector<string> const & args ) {
+	using namespace boost;
+
+	program_options::options_description desc( "screen options" );
+	desc.add_options()
+		("help,h", "produce help message")
+		("errorx-base", program_options::value<string>(),
+			"ErrorX install directory with model.nnet and IGBlast (default=location of this binary)")
+		("out,o", program_options::value<string>(),
+			"screening model to write (default=screen.nnet under errorx-base)")
+		("max-rows", program_options::value<int>()->default_value(100000),
+			"largest number of feature rows to fit to (default=100000)")
+		("species,s", program_options::value<string>()->default_value("human"), "species for IGBLAST search (default=human)")
+		("nthreads,n", program_options::value<int>()->default_value(-1), "number of threads, -1 for all (default=-1)")
+		("files", program_options::value<vector<string>>(),
+			"fastq, fasta or tsv files. Defaults to the test data in unit_test/testing "
+			"and documentation/ExampleSequences.* under errorx-base")
+		;
+
+	program_options::positional_options_description positional;
+	positional.add( "files", -1 );
+
+	program_options::variables_map vm;
+	program_options::store( program_options::command_line_parser( args ).
+			options( desc ).positional( positional ).run(), vm );
+	program_options::notify( vm );
+
+	if ( vm.count( "help" )) {
+		cout << "Usage: errorx_model screen [--out screen.nnet] [files]\n" << desc << "\n";
+		return 1;
+	}
+
+	errorx::ErrorXOptions options;
+	options.verbose( 0 );
+	options.species( vm["species"].as<string>() );
+	options.nthreads( vm["nthreads"].as<int>() );
+	if ( vm.count( "errorx-base" )) options.errorx_base( vm["errorx-base"].as<string>() );
+
+	vector<string> files;
+	if ( vm.count( "files" )) {
+		files = vm["files"].as<vector<string>>();
+	} else {
+		files = default_files( options.errorx_base() );
+	}
+
+	int cols = errorx::constants::N_FEATURES;
+	vector<double> rows = feature_rows( options, files, vm["max-rows"].as<int>() );
+	if ( rows.empty() ) {
+		cout << "No feature rows to fit the screen to" << endl;
+		return 1;
+	}
+
+	// the screen learns to reproduce the full network
+	int count = rows.size()/cols;
+	keras::KerasModel model( options );
+	vector<double> targets = model.compute_output_batch( rows, count );
+	vector<double> beta = fit_screen( rows, targets );
+
+	vector<double> weights( cols, 0.0 );
+	for ( int c = 0; c < N_SCREEN_COLUMNS; ++c ) weights[ SCREEN_COLUMNS[ c ]] = beta[ c ];
+	keras::LayerDense * dense = new keras::LayerDense();
+	dense->set_weights( weights.data(), &beta.back(), cols, 1 );
+	vector<keras::Layer*> layers;
+	layers.push_back( dense );
+	layers.push_back( new keras::LayerActivation( "sigmoid" ));
+
+	keras::KerasModel result;
+	result.verbose( 0 );
+	result.set_layers( layers );
+
+	namespace fs = boost::filesystem;
+	string out_file = vm.count( "out" ) ? vm["out"].as<string>() :
+		( fs::path( options.errorx_base() ) / "screen.nnet" ).string();
+	ofstream out( out_file.c_str() );
+	if ( !out.good() ) {
+		cout << "Error: cannot write to file " << out_file << endl;
+		return 1;
+	}
+	write_text( result, out );
+	out.close();
+
+	// how much each margin would screen out, and how often the
+	// screen's call would differ from the network's on these rows
+	vector<double> screened = result.compute_output_batch( rows, count );
+	double threshold = options.error_threshold();
+	double lowers[] = { 0.005, 0.01, 0.02, 0.05, 0.1 };
+	double uppers[] = { 0.9, 0.95, 0.99 };
+	cout << "Wrote " << out_file << " from " << count << " rows" << endl;
+	for ( int ii = 0; ii < 5; ++ii ) {
+		int called = 0, disagree = 0;
+		for ( int r = 0; r < count; ++r ) {
+			if ( screened[ r ] >= lowers[ ii ] ) continue;
+			++called;
+			if ( targets[ r ] > threshold ) ++disagree;
+		}
+		cout << "--screen-lower " << lowers[ ii ] << ": screens " << 100.0*called/count
+			 << "% of positions, " << disagree << " disagree with the full network" << endl;
+	}
+	for ( int ii = 0; ii < 3; ++ii ) {
+		int called = 0, disagree = 0;
+		for ( int r = 0; r < count; ++r ) {
+			if ( screened[ r ] <= uppers[ ii ] ) continue;
+			++called;
+			if ( targets[ r ] <= threshold ) ++disagree;
+		}
+		cout << "--screen-upper " << uppers[ ii ] << ": screens " << 100.0*called/count
+			 << "% of positions, " << disagree << " disagree with the full network" << endl;
+	}
+	cout << "Check it with errorx_model compare --screen " << out_file << endl;
+	return 0;
+}
+
+} // namespace
+
+int main( int argc, char* argv[] ) {
+
+	if ( argc < 2 ) {
+		cout << USAGE;
+		return 1;
+	}
+
+	string command = argv[ 1 ];
+	vector<string> args( argv+2, argv+argc );
+
+	try {
+		if ( command == "convert" ) return convert( args );
+		if ( command == "info" ) return info( args );
+		if ( command == "compare" ) return compare( args );
+		if ( command == "calibrate" ) return calibrate( args );
+		if ( command == "embed" ) return embed( args );
+		if ( command == "prune" ) return prune( args );
+		if ( command == "screen" ) return screen( args );
+	} catch ( std::exception & e ) {
+		cout << e.what() << endl;
+		return 1;
+	}
+
+	cout << USAGE;
+	return 1;
+}
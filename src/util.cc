@@ -96,12 +96,17 @@ bool isdouble( string const & str ) {
 
 /////////// BEGIN Functions for trimming whitespace out of a string ////////////
 
+// the same characters as \s, without building a regex for every line
+static char const * const WHITESPACE = " \t\n\v\f\r";
+
 string ltrim( string const & s ) {
-	return std::regex_replace( s, regex("^\\s+"), string("") );
+	size_t first = s.find_first_not_of( WHITESPACE );
+	return first == string::npos ? string("") : s.substr( first );
 }
 
 string rtrim( string const & s ) {
-	return std::regex_replace( s, regex("\\s+$"), string("") );
+	size_t last = s.find_last_not_of( WHITESPACE );
+	return last == string::npos ? string("") : s.substr( 0, last+1 );
 }
 
 string trim( string const & s ) {
@@ -228,10 +233,18 @@ double phred_avg_realspace( vector<int> const & phred_arr ) {
 
 	for ( int ii = 0; ii < phred_arr.size(); ++ii ) {
 		if ( phred_arr[ii] >= 0 ) {
-			sum += pow(10, (-(float)phred_arr[ii])/10);
+			sum += phred_to_realspace( phred_arr[ii] );
 			count++;
 		}
 	}
+	return phred_avg_from_realspace( sum, count );
+}
+
+double phred_to_realspace( int phred ) {
+	return pow(10, (-(float)phred)/10);
+}
+
+double phred_avg_from_realspace( double sum, int count ) {
 	double avg = float(sum)/float(count);
 	return 10*-log10(avg);
 }
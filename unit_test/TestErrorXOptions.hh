@@ -74,6 +74,55 @@ public:
 		options.allow_nonproductive( 0 );
 		TS_ASSERT_EQUALS( options.allow_nonproductive(), 0 );
 
+		TS_ASSERT_EQUALS( options.precision(), "double" );
+		options.precision( "single" );
+		TS_ASSERT_EQUALS( ErrorXOptions( options ).precision(), "single" );
+		options.precision( "int8" );
+		TS_ASSERT_EQUALS( options.precision(), "int8" );
+		TS_ASSERT_THROWS( 
+			options.precision( "half" ),
+			invalid_argument
+			);
+
+		TS_ASSERT_EQUALS( options.activations(), "exact" );
+		options.activations( "fast" );
+		TS_ASSERT_EQUALS( ErrorXOptions( options ).activations(), "fast" );
+		TS_ASSERT_THROWS( 
+			options.activations( "approximate" ),
+			invalid_argument
+			);
+
+		TS_ASSERT_EQUALS( options.screen_model(), "" );
+		options.screen_lower( 0.1 );
+		options.screen_upper( 0.9 );
+		options.screen_validate( true );
+		ErrorXOptions copy( options );
+		TS_ASSERT_EQUALS( copy.screen_lower(), 0.1 );
+		TS_ASSERT_EQUALS( copy.screen_upper(), 0.9 );
+		TS_ASSERT( copy.screen_validate() );
+		TS_ASSERT_THROWS( 
+			options.screen_upper( -0.5 ),
+			invalid_argument
+			);
+
+		TS_ASSERT( !options.prediction_cache() );
+		TS_ASSERT_EQUALS( options.cache_resolution(), 0 );
+		options.prediction_cache( true );
+		options.cache_size( 16 );
+		TS_ASSERT( ErrorXOptions( options ).prediction_cache() );
+		TS_ASSERT_EQUALS( ErrorXOptions( options ).cache_size(), 16 );
+		TS_ASSERT_THROWS( 
+			options.cache_size( 0 ),
+			invalid_argument
+			);
+
+		// without one of its own, options share the process-wide pool
+		options.nthreads( 2 );
+		TS_ASSERT_EQUALS( options.executor(), Executor::shared( 2 ));
+		ExecutorPtr executor( new Executor( 1 ));
+		options.executor( executor );
+		TS_ASSERT_EQUALS( ErrorXOptions( options ).executor(), executor );
+
 		
 	}
 
@@ -9,9 +9,14 @@
 
 #include "exceptions.hh"
 #include "keras/KerasModel.hh"
+#include "keras/ModelRegistry.hh"
+#include "keras/ModelFile.hh"
 #include "keras/LayerActivation.hh"
 #include "keras/LayerDense.hh"
 #include "keras/DataChunkFlat.hh"
+#include "keras/DenseKernels.hh"
+#include "keras/QuantizedModel.hh"
+#include "keras/EmbeddedModel.hh"
 
 #include "ErrorXOptions.hh"
 
@@ -358,6 +363,701 @@ public:
 
 
 
+	void testBatchOutput(void) {
+		KerasModel model( "../model.nnet" );
+
+		// build a batch of 7 rows so the 4-row blocks have a remainder
+		vector<double> row = dc_->get_1d();
+		vector<double> batch;
+		vector<vector<double>> rows;
+		for ( int ii = 0; ii < 7; ++ii ) {
+			vector<double> current = row;
+			current[ 0 ] += 0.05*ii;
+			current[ 123 ] -= 0.01*ii;
+			rows.push_back( current );
+			batch.insert( batch.end(), current.begin(), current.end() );
+		}
+
+		vector<double> output = model.compute_output_batch( batch, 7 );
+		TS_ASSERT_EQUALS( output.size(), 7 );
+
+		DataChunkFlat chunk;
+		for ( int ii = 0; ii < 7; ++ii ) {
+			chunk.set_data( rows[ii] );
+			TS_ASSERT_EQUALS( output[ ii ], model.compute_output( &chunk )[ 0 ] );
+		}
+		TS_ASSERT_DELTA( output[ 0 ], 0.16386315, pow( 10, -5) );
+
+		// softmax is normalized per row, not over the whole batch
+		model.load_weights_from_string(
+			"layers 2\n"
+			"layer 0 Dense\n"
+			"2 4\n"
+			"[ 0.1  0.2  0.3  0.4 ]\n"
+			"[ 0.5  0.6  0.7  0.8 ]\n"
+			"[ 0.9  0.1  0.11  0.12 ]\n"
+			"layer 1 Activation\n"
+			"softmax" );
+		output = model.compute_output_batch( vector<double>{ 0.5, 0.6, 0.5, 0.6 }, 2 );
+		TS_ASSERT_EQUALS( output.size(), 8 );
+		TS_ASSERT_DELTA( output[0], 0.369722718, pow(10,-9) );
+		TS_ASSERT_DELTA( output[4], 0.369722718, pow(10,-9) );
+		TS_ASSERT_DELTA( output[7], 0.235745613, pow(10,-9) );
+
+		TS_ASSERT_THROWS( model.compute_output_batch( vector<double>{ 0.5, 0.6, 0.5 }, 2 ), BadModel );
+		// softmax isn't element-wise, so it stays a step of its own
+		TS_ASSERT_EQUALS( model.no_steps(), 2 );
+	}
+
+	void testLayerFusion(void) {
+		KerasModel model( "../model.nnet" );
+
+		// each dense layer absorbs the activation after it
+		TS_ASSERT_EQUALS( model.no_layers(), 8 );
+		TS_ASSERT_EQUALS( model.no_steps(), 4 );
+		KerasModel copy( model );
+		TS_ASSERT_EQUALS( copy.no_steps(), 4 );
+
+		vector<double> row = dc_->get_1d();
+		vector<double> batch;
+		for ( int ii = 0; ii < 5; ++ii ) {
+			row[ 0 ] += 0.05*ii;
+			batch.insert( batch.end(), row.begin(), row.end() );
+		}
+
+		// running the layers one at a time gives exactly the same result
+		vector<double> current( batch ), next;
+		int cols = model.get_input_cols();
+		for ( int l = 0; l < model.no_layers(); ++l ) {
+			Layer * layer = model.layer( l );
+			int out_cols = ( layer->get_output_units() > 0 ) ? layer->get_output_units() : cols;
+			next.resize( 5*out_cols );
+			layer->compute_output_batch( current.data(), next.data(), 5, cols );
+			current.swap( next );
+			cols = out_cols;
+		}
+		TS_ASSERT_EQUALS( model.compute_output_batch( batch, 5 ), current );
+
+		// unknown activations are caught when the model is loaded
+		TS_ASSERT_THROWS( model.load_weights_from_string( "layers 1\nlayer 0 Activation\nswish" ),
+			InvalidLayer );
+	}
+
+	void testEmbeddedModel(void) {
+		KerasModel model( "../model.nnet" );
+
+		// the generated source specializes each dense layer on its size
+		ostringstream source;
+		EmbeddedModel::write_source( model, source );
+		TS_ASSERT( source.str().find( "LAYOUT = \"124-256-128-64-1\"" ) != string::npos );
+		TS_ASSERT( source.str().find( "fixed_dense<124,256,RELU>( input," ) != string::npos );
+		TS_ASSERT( source.str().find( "fixed_dense<64,1,SIGMOID>( buffer0," ) != string::npos );
+
+		KerasModel softmax;
+		softmax.load_weights_from_string( "layers 2\nlayer 0 Dense\n1 2\n[ 0.1 0.2 ]\n[ 0 0 ]\n"
+			"layer 1 Activation\nsoftmax" );
+		ostringstream ignored;
+		TS_ASSERT_THROWS( EmbeddedModel::write_source( softmax, ignored ), InvalidLayer );
+		TS_ASSERT( !EmbeddedModel::matches( softmax ));
+
+		InferenceContext context;
+		vector<double> row = dc_->get_1d();
+		double expected, output;
+		model.compute_output_batch( row.data(), 1, &expected, context );
+
+		// regular builds have no model compiled in
+		if ( !EmbeddedModel::available() ) {
+			TS_ASSERT_EQUALS( EmbeddedModel::layout(), "" );
+			TS_ASSERT_EQUALS( EmbeddedModel::isa(), "" );
+			TS_ASSERT( !EmbeddedModel::matches( model ));
+			TS_ASSERT_THROWS( EmbeddedModel::model(), ObjectNotInitialized );
+			TS_ASSERT_THROWS( EmbeddedModel::compute_output_batch( row.data(), 1, &output, context ),
+				ObjectNotInitialized );
+			return;
+		}
+
+		TS_ASSERT( EmbeddedModel::matches( model ));
+		TS_ASSERT( EmbeddedModel::matches( *EmbeddedModel::model() ));
+		EmbeddedModel::compute_output_batch( row.data(), 1, &output, context );
+		TS_ASSERT_EQUALS( output, expected );
+
+		// built for the same instruction set as the dynamic kernels
+		string dynamic = kernels::dense_kernel_name();
+		TS_ASSERT_EQUALS( EmbeddedModel::isa(),
+			( dynamic == "avx512" || dynamic == "avx2" ) ? dynamic : "generic" );
+	}
+
+	void testInferenceContext(void) {
+		KerasModel model( "../model.nnet" );
+
+		vector<double> row = dc_->get_1d();
+		vector<double> batch;
+		for ( int ii = 0; ii < 5; ++ii ) {
+			row[ 1 ] += 0.02;
+			batch.insert( batch.end(), row.begin(), row.end() );
+		}
+		vector<double> expected = model.compute_output_batch( batch, 5 );
+
+		// results land in caller memory and match the allocating version
+		InferenceContext context;
+		vector<double> output( 5 );
+		model.compute_output_batch( batch.data(), 5, output.data(), context );
+		TS_ASSERT_EQUALS( output, expected );
+
+		// buffers are reused for batches that fit
+		double * buffer = context.buffer( 0 );
+		size_t capacity = context.capacity();
+		TS_ASSERT_EQUALS( capacity, 5*256 );
+		model.compute_output_batch( batch.data(), 3, output.data(), context );
+		model.compute_output_batch( batch.data(), 5, output.data(), context );
+		TS_ASSERT_EQUALS( context.buffer( 0 ), buffer );
+		TS_ASSERT_EQUALS( context.capacity(), capacity );
+		TS_ASSERT_EQUALS( output, expected );
+
+		// a model that starts with an activation never writes to its input
+		model.load_weights_from_string(
+			"layers 3\n"
+			"layer 0 Dense\n"
+			"2 2\n"
+			"[ 1 0 ]\n"
+			"[ 0 1 ]\n"
+			"[ 0 0 ]\n"
+			"layer 1 Activation\n"
+			"relu\n"
+			"layer 2 Activation\n"
+			"sigmoid" );
+		vector<double> input = { -1.0, 2.0 };
+		vector<double> result( 2 );
+		model.compute_output_batch( input.data(), 1, result.data(), context );
+		TS_ASSERT_EQUALS( input[0], -1.0 );
+		TS_ASSERT_EQUALS( result[0], 0.5 );
+		TS_ASSERT_DELTA( result[1], 1/(1+exp(-2.0)), pow(10,-12) );
+	}
+
+	void testModelCopy(void) {
+		KerasModel model( "../model.nnet" );
+		vector<double> expected = model.compute_output( dc_ );
+
+		// copies own their layers, so they outlive the original
+		// and can be reloaded without affecting each other
+		KerasModel* original = new KerasModel( model );
+		KerasModel copy( *original );
+		delete original;
+		TS_ASSERT_DIFFERS( copy.layer( 0 ), model.layer( 0 ));
+		TS_ASSERT_EQUALS( copy.compute_output( dc_ ), expected );
+
+		KerasModel assigned;
+		assigned = copy;
+		copy.load_weights_from_string(
+			"layers 1\n"
+			"layer 0 Activation\n"
+			"relu" );
+		TS_ASSERT_EQUALS( copy.no_layers(), 1 );
+		TS_ASSERT_EQUALS( assigned.compute_output( dc_ ), expected );
+	}
+
+	void testModelRegistry(void) {
+		ModelRegistry::clear();
+		TS_ASSERT_EQUALS( ModelRegistry::size(), 0 );
+
+		// different spellings of the same file share one model
+		KerasModelConstPtr model = ModelRegistry::get( "../model.nnet" );
+		KerasModelConstPtr same = ModelRegistry::get( "../unit_test/../model.nnet" );
+		TS_ASSERT_EQUALS( model.get(), same.get() );
+		TS_ASSERT_EQUALS( ModelRegistry::size(), 1 );
+
+		KerasModel reference( "../model.nnet" );
+		TS_ASSERT_EQUALS( model->compute_output( dc_ ), reference.compute_output( dc_ ));
+
+		// missing files are reported and not cached
+		TS_ASSERT_THROWS( ModelRegistry::get( "model.nnet" ), invalid_argument );
+		TS_ASSERT_EQUALS( ModelRegistry::size(), 1 );
+
+		// clearing drops the cache but not models that are in use
+		ModelRegistry::clear();
+		TS_ASSERT_EQUALS( ModelRegistry::size(), 0 );
+		TS_ASSERT_EQUALS( model->compute_output( dc_ ), reference.compute_output( dc_ ));
+		TS_ASSERT_DIFFERS( ModelRegistry::get( "../model.nnet" ).get(), model.get() );
+	}
+
+	void testBinaryModel(void) {
+		KerasModel model( "../model.nnet" );
+		vector<double> expected = model.compute_output( dc_ );
+
+		ostringstream out;
+		model_file::write( model, out );
+		string binary = out.str();
+		TS_ASSERT( model_file::is_binary( binary.data(), binary.size() ));
+
+		// same layers and bit-identical predictions
+		KerasModel loaded;
+		loaded.load_weights_from_string( binary );
+		TS_ASSERT_EQUALS( loaded.no_layers(), model.no_layers() );
+		TS_ASSERT_EQUALS( loaded.compute_output( dc_ ), expected );
+
+		// file format is detected on load
+		string file = "binary_model.nnb";
+		model_file::write( model, file );
+		TS_ASSERT( model_file::is_binary_file( file ));
+		TS_ASSERT( !model_file::is_binary_file( "../model.nnet" ));
+		KerasModel from_file( file );
+		TS_ASSERT_EQUALS( from_file.compute_output( dc_ ), expected );
+		remove( file.c_str() );
+
+		// floats are close but not exact
+		ostringstream float_out;
+		model_file::write( model, float_out, 4 );
+		loaded.load_weights_from_string( float_out.str() );
+		TS_ASSERT_DELTA( loaded.compute_output( dc_ )[0], expected[0], pow(10,-5) );
+		TS_ASSERT_THROWS( model_file::write( model, float_out, 2 ), invalid_argument );
+
+		// corrupt or truncated data is rejected and the
+		// previously loaded model is kept
+		loaded.load_weights_from_string( binary );
+		string corrupt = binary;
+		corrupt[ corrupt.size()-1 ] ^= 1;
+		TS_ASSERT_THROWS( loaded.load_weights_from_string( corrupt ), BadModel );
+		TS_ASSERT_THROWS( loaded.load_weights_from_buffer( binary.data(), binary.size()-8 ), BadModel );
+		corrupt = binary;
+		corrupt[ model_file::HEADER_SIZE ] = 9;
+		TS_ASSERT_THROWS( loaded.load_weights_from_string( corrupt ), BadModel );
+		TS_ASSERT_EQUALS( loaded.compute_output( dc_ ), expected );
+	}
+
+	void testDenseKernels(void) {
+		using namespace kernels;
+
+		vector<string> supported = supported_dense_kernels();
+		TS_ASSERT_EQUALS( supported.back(), "generic" );
+		TS_ASSERT_EQUALS( supported.front(), dense_kernel_name() );
+		TS_ASSERT( dense_kernel( "not_an_isa" ) == nullptr );
+
+		// sizes that leave leftover rows and neurons for every vector width,
+		// and enough rows to span more than one row tile
+		int rows = 70, inputs = 13, neurons = 37;
+		vector<double> input( rows*inputs ), weights( inputs*neurons ), bias( neurons );
+		for ( int ii = 0; ii < input.size(); ++ii )   input[ii]   = sin( ii*0.37 );
+		for ( int ii = 0; ii < weights.size(); ++ii ) weights[ii] = cos( ii*0.11 ) / 3.0;
+		for ( int ii = 0; ii < bias.size(); ++ii )    bias[ii]    = ii*0.01 - 0.2;
+
+		// pack into the aligned panel layout the kernels read
+		int padded = padded_neurons( neurons );
+		TS_ASSERT_EQUALS( padded % PANEL_WIDTH, 0 );
+		AlignedBuffer packed( inputs*padded ), padded_bias( padded );
+		pack_weights( weights.data(), inputs, neurons, packed.data() );
+		copy( bias.begin(), bias.end(), padded_bias.data() );
+
+		// reference result computed directly from the row-major weights
+		vector<double> expected( rows*neurons );
+		for ( int r = 0; r < rows; ++r ) {
+			for ( int k = 0; k < neurons; ++k ) {
+				double acc = 0.0;
+				for ( int j = 0; j < inputs; ++j ) acc += weights[ j*neurons+k ] * input[ r*inputs+j ];
+				expected[ r*neurons+k ] = acc + bias[k];
+			}
+		}
+
+		// every instruction set gives bit-identical results
+		for ( int ii = 0; ii < supported.size(); ++ii ) {
+			vector<double> output( rows*neurons );
+			dense_kernel( supported[ii] )( input.data(), rows, inputs,
+				packed.data(), padded_bias.data(), neurons, output.data(), LINEAR );
+			TS_ASSERT_EQUALS( output, expected );
+		}
+
+		// fused activations match running the activation separately
+		Activation fused[] = { RELU, SIGMOID, TANH };
+		for ( int aa = 0; aa < 3; ++aa ) {
+			vector<double> activated( expected );
+			activate_block( activated.data(), activated.size(), fused[aa] );
+			for ( int ii = 0; ii < supported.size(); ++ii ) {
+				vector<double> output( rows*neurons );
+				dense_kernel( supported[ii] )( input.data(), rows, inputs,
+					packed.data(), padded_bias.data(), neurons, output.data(), fused[aa] );
+				TS_ASSERT_EQUALS( output, activated );
+			}
+		}
+	}
+
+	void testSinglePrecision(void) {
+		using namespace kernels;
+
+		vector<string> supported = supported_dense_kernels();
+		TS_ASSERT( dense_kernel_f32( "not_an_isa" ) == nullptr );
+
+		int rows = 70, inputs = 13, neurons = 37;
+		vector<double> weights( inputs*neurons ), bias( neurons );
+		vector<float> input( rows*inputs );
+		for ( int ii = 0; ii < input.size(); ++ii )   input[ii]   = sin( ii*0.37 );
+		for ( int ii = 0; ii < weights.size(); ++ii ) weights[ii] = cos( ii*0.11 ) / 3.0;
+		for ( int ii = 0; ii < bias.size(); ++ii )    bias[ii]    = ii*0.01 - 0.2;
+
+		int padded = padded_neurons( neurons );
+		AlignedFloatBuffer packed( inputs*padded ), padded_bias( padded );
+		pack_weights( weights.data(), inputs, neurons, packed.data() );
+		copy( bias.begin(), bias.end(), padded_bias.data() );
+
+		// float reference with the same accumulation order
+		vector<float> expected( rows*neurons );
+		for ( int r = 0; r < rows; ++r ) {
+			for ( int k = 0; k < neurons; ++k ) {
+				float acc = 0.0f;
+				for ( int j = 0; j < inputs; ++j ) acc += (float)weights[ j*neurons+k ] * input[ r*inputs+j ];
+				expected[ r*neurons+k ] = acc + (float)bias[k];
+			}
+		}
+
+		// single precision variants agree with each other exactly
+		for ( int ii = 0; ii < supported.size(); ++ii ) {
+			vector<float> output( rows*neurons );
+			dense_kernel_f32( supported[ii] )( input.data(), rows, inputs,
+				packed.data(), padded_bias.data(), neurons, output.data(), LINEAR );
+			TS_ASSERT_EQUALS( output, expected );
+		}
+
+		// the whole model in float stays close to double
+		KerasModel model( "../model.nnet" );
+		vector<double> row = dc_->get_1d();
+		vector<float> row_f32( row.begin(), row.end() );
+		InferenceContext context;
+		double expected_output;
+		float output;
+		model.compute_output_batch( row.data(), 1, &expected_output, context );
+		model.compute_output_batch( row_f32.data(), 1, &output, context );
+		TS_ASSERT_DELTA( output, expected_output, pow(10,-5) );
+	}
+
+	void testFastActivations(void) {
+		using namespace kernels;
+
+		vector<string> supported = supported_dense_kernels();
+		TS_ASSERT( fast_activation_kernel( "not_an_isa" ) == nullptr );
+
+		// enough values to leave a tail for every vector width,
+		// including some far outside the range exp can represent
+		int rows = 7, cols = 13;
+		vector<double> input( rows*cols );
+		for ( int ii = 0; ii < input.size(); ++ii ) input[ii] = 30*sin( ii*0.37 );
+		input[ 5 ] = 1000;
+		input[ 6 ] = -1000;
+		vector<float> input_f32( input.begin(), input.end() );
+
+		Activation activations[] = { RELU, SIGMOID, TANH, SOFTMAX };
+		string names[] = { "relu", "sigmoid", "tanh", "softmax" };
+		for ( int aa = 0; aa < 4; ++aa ) {
+			LayerActivation layer( names[aa] );
+			vector<double> exact( input.size() );
+			vector<float> exact_f32( input.size() );
+			layer.compute_output_batch( input.data(), exact.data(), rows, cols );
+			layer.compute_output_batch( input_f32.data(), exact_f32.data(), rows, cols );
+
+			vector<double> expected( input );
+			vector<float> expected_f32( input_f32 );
+			fast_activation_generic( expected.data(), rows, cols, activations[aa] );
+			fast_activation_generic_f32( expected_f32.data(), rows, cols, activations[aa] );
+
+			// every instruction set gives bit-identical results
+			for ( int ii = 0; ii < supported.size(); ++ii ) {
+				vector<double> output( input );
+				vector<float> output_f32( input_f32 );
+				fast_activation_kernel( supported[ii] )( output.data(), rows, cols, activations[aa] );
+				fast_activation_kernel_f32( supported[ii] )( output_f32.data(), rows, cols, activations[aa] );
+				TS_ASSERT_EQUALS( output, expected );
+				TS_ASSERT_EQUALS( output_f32, expected_f32 );
+			}
+
+			// and stays close to libm, which overflows in softmax
+			for ( int ii = 0; ii < input.size(); ++ii ) {
+				if ( std::isnan( exact[ii] )) continue;
+				TS_ASSERT_DELTA( expected[ii], exact[ii], pow(10,-14) );
+				TS_ASSERT_DELTA( expected_f32[ii], exact_f32[ii], pow(10,-6) );
+			}
+
+			// the layer switches over with its mode
+			layer.mode( FAST );
+			vector<double> output( input.size() );
+			layer.compute_output_batch( input.data(), output.data(), rows, cols );
+			TS_ASSERT_EQUALS( output, expected );
+		}
+
+		// in fast mode only relu is fused, and copies keep the mode
+		KerasModel model( "../model.nnet" );
+		KerasModel fast( model );
+		fast.activation_mode( FAST );
+		TS_ASSERT_EQUALS( fast.no_steps(), 5 );
+		KerasModel copy( fast );
+		TS_ASSERT_EQUALS( copy.activation_mode(), FAST );
+		TS_ASSERT_EQUALS( copy.no_steps(), 5 );
+		TS_ASSERT( !EmbeddedModel::matches( fast ));
+
+		vector<double> row = dc_->get_1d();
+		InferenceContext context;
+		double expected_output, output;
+		model.compute_output_batch( row.data(), 1, &expected_output, context );
+		fast.compute_output_batch( row.data(), 1, &output, context );
+		TS_ASSERT_DELTA( output, expected_output, pow(10,-12) );
+
+		// the registry keeps one fast copy per model
+		ErrorXOptions options;
+		options.errorx_base( ".." );
+		options.activations( "fast" );
+		KerasModelConstPtr shared = ModelRegistry::get( options );
+		TS_ASSERT_EQUALS( shared->activation_mode(), FAST );
+		TS_ASSERT_EQUALS( ModelRegistry::get( options ).get(), shared.get() );
+		options.activations( "exact" );
+		TS_ASSERT_DIFFERS( ModelRegistry::get( options ).get(), shared.get() );
+		TS_ASSERT_EQUALS( ModelRegistry::get( options )->activation_mode(), EXACT );
+	}
+
+	void testSparseInput(void) {
+		using namespace kernels;
+
+		int rows = 9, inputs = 40, neurons = 37;
+		vector<double> weights( inputs*neurons ), bias( neurons ), input( rows*inputs, 0.0 );
+		for ( int ii = 0; ii < weights.size(); ++ii ) weights[ii] = cos( ii*0.11 ) / 3.0;
+		for ( int ii = 0; ii < bias.size(); ++ii )    bias[ii]    = ii*0.01 - 0.2;
+
+		// a few dense columns and a one-hot block per row
+		SparseBatch sparse;
+		for ( int r = 0; r < rows; ++r ) {
+			for ( int j = 0; j < inputs; ++j ) {
+				if ( j < 3 ) input[ r*inputs+j ] = sin( r*0.7+j );
+				else if ( j % 6 == r % 6 ) input[ r*inputs+j ] = 1;
+				if ( input[ r*inputs+j ] != 0 ) sparse.add( j, input[ r*inputs+j ] );
+			}
+			sparse.end_row();
+		}
+
+		int padded = padded_neurons( neurons );
+		AlignedBuffer packed( inputs*padded ), padded_bias( padded );
+		pack_weights( weights.data(), inputs, neurons, packed.data() );
+		copy( bias.begin(), bias.end(), padded_bias.data() );
+
+		vector<double> expected( rows*neurons );
+		dense_generic( input.data(), rows, inputs, packed.data(), padded_bias.data(), neurons,
+			expected.data(), LINEAR );
+
+		// skipping zeros changes nothing, on any instruction set
+		vector<string> supported = supported_dense_kernels();
+		for ( int ii = 0; ii < supported.size(); ++ii ) {
+			vector<double> output( rows*neurons );
+			sparse_dense_kernel( supported[ii] )( sparse.row_start(), sparse.columns(), sparse.values(),
+				rows, inputs, packed.data(), padded_bias.data(), neurons, output.data(), LINEAR );
+			TS_ASSERT_EQUALS( output, expected );
+		}
+
+		// whole model, the first layer sparse and the rest dense
+		KerasModel model( "../model.nnet" );
+		TS_ASSERT( model.sparse_input() );
+		vector<double> row = dc_->get_1d();
+		SparseBatch sparse_row;
+		for ( int j = 0; j < row.size(); ++j ) {
+			if ( row[j] != 0 ) sparse_row.add( j, row[j] );
+		}
+		sparse_row.end_row();
+
+		InferenceContext context;
+		double dense_output, sparse_output;
+		model.compute_output_batch( row.data(), 1, &dense_output, context );
+		model.compute_output_batch( sparse_row, &sparse_output, context );
+		TS_ASSERT_EQUALS( sparse_output, dense_output );
+
+		KerasModel activation_first;
+		activation_first.load_weights_from_string( "layers 1\nlayer 0 Activation\nrelu" );
+		TS_ASSERT( !activation_first.sparse_input() );
+		TS_ASSERT_THROWS( activation_first.compute_output_batch( sparse_row, &sparse_output, context ), BadModel );
+	}
+
+	void testBlockSparse(void) {
+		using namespace kernels;
+
+		// leftover rows and neurons, with whole blocks of weights pruned
+		// and one panel left with no blocks at all
+		int rows = 70, inputs = 13, neurons = 37;
+		vector<double> input( rows*inputs ), weights( inputs*neurons ), bias( neurons );
+		for ( int ii = 0; ii < input.size(); ++ii )   input[ii]   = sin( ii*0.37 );
+		for ( int ii = 0; ii < weights.size(); ++ii ) weights[ii] = cos( ii*0.11 ) / 3.0;
+		for ( int ii = 0; ii < bias.size(); ++ii )    bias[ii]    = ii*0.01 - 0.2;
+		for ( int j = 0; j < inputs; ++j ) {
+			for ( int k = 0; k < neurons; ++k ) {
+				if ( k/PANEL_WIDTH == 1 || ( j+k/PANEL_WIDTH ) % 3 == 0 ) weights[ j*neurons+k ] = 0;
+			}
+		}
+
+		int padded = padded_neurons( neurons );
+		AlignedBuffer packed( inputs*padded ), padded_bias( padded );
+		pack_weights( weights.data(), inputs, neurons, packed.data() );
+		copy( bias.begin(), bias.end(), padded_bias.data() );
+
+		int blocks = count_blocks( packed.data(), inputs, neurons );
+		TS_ASSERT_EQUALS( blocks, 17 );
+		vector<int> block_start( padded/PANEL_WIDTH + 1 ), block_inputs( blocks );
+		AlignedBuffer stored( blocks*PANEL_WIDTH );
+		pack_blocks( packed.data(), inputs, neurons, block_start.data(), block_inputs.data(), stored.data() );
+		TS_ASSERT_EQUALS( block_start[ 1 ], block_start[ 2 ] );
+		TS_ASSERT_EQUALS( block_start.back(), blocks );
+
+		// skipping zero blocks changes nothing, on any instruction set
+		TS_ASSERT( block_sparse_kernel( "not_an_isa" ) == nullptr );
+		vector<string> supported = supported_dense_kernels();
+		Activation activations[] = { LINEAR, RELU, TANH };
+		for ( int aa = 0; aa < 3; ++aa ) {
+			vector<double> expected( rows*neurons );
+			dense_generic( input.data(), rows, inputs, packed.data(), padded_bias.data(), neurons,
+				expected.data(), activations[aa] );
+			for ( int ii = 0; ii < supported.size(); ++ii ) {
+				vector<double> output( rows*neurons );
+				block_sparse_kernel( supported[ii] )( input.data(), rows, inputs, block_start.data(),
+					block_inputs.data(), stored.data(), padded_bias.data(), neurons, output.data(), activations[aa] );
+				TS_ASSERT_EQUALS( output, expected );
+			}
+		}
+
+		// a layer listing its blocks reads the same as the full rows
+		string dense_str = "layers 1\nlayer 0 Dense\n2 20\n"
+			"[ 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 0 0 0 0 ]\n"
+			"[ 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 1 2 3 4 ]\n"
+			"[ 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0.5 ]\n";
+		string block_str = "layers 1\nlayer 0 Dense\n2 20 blocks 2\n"
+			"1 1 [ 1 2 3 4 ]\n"
+			"0 0 [ 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 ]\n"
+			"[ 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0.5 ]\n";
+		KerasModel dense_model, block_model;
+		dense_model.load_weights_from_string( dense_str );
+		block_model.load_weights_from_string( block_str );
+		LayerDense const * layer = dynamic_cast<LayerDense const *>( block_model.layer( 0 ));
+		TS_ASSERT_DELTA( layer->block_density(), 0.5, 1e-12 );
+		TS_ASSERT( layer->block_sparse() );
+		for ( int j = 0; j < 2; ++j ) {
+			for ( int k = 0; k < 20; ++k ) {
+				TS_ASSERT_EQUALS( layer->weights()( j, k ),
+					dynamic_cast<LayerDense const *>( dense_model.layer( 0 ))->weights()( j, k ));
+			}
+		}
+
+		double row[] = { 0.25, -1.5 };
+		vector<double> dense_output( 20 ), block_output( 20 );
+		InferenceContext context;
+		dense_model.compute_output_batch( row, 1, dense_output.data(), context );
+		block_model.compute_output_batch( row, 1, block_output.data(), context );
+		TS_ASSERT_EQUALS( block_output, dense_output );
+
+		// blocks out of range, listed twice or missing their brackets
+		string bad[] = {
+			"layers 1\nlayer 0 Dense\n2 20 blocks 1\n2 0 [ 1 ]\n",
+			"layers 1\nlayer 0 Dense\n2 20 blocks 1\n0 2 [ 1 ]\n",
+			"layers 1\nlayer 0 Dense\n2 20 blocks 2\n1 1 [ 1 2 3 4 ]\n1 1 [ 1 2 3 4 ]\n",
+			"layers 1\nlayer 0 Dense\n2 20 blocks 1\n1 1 1 2 3 4 ]\n",
+			"layers 1\nlayer 0 Dense\n2 20 blocks 1\n1 1 [ 1 2 3 4 5 ]\n",
+			"layers 1\nlayer 0 Dense\n2 20 block 1\n1 1 [ 1 2 3 4 ]\n"
+		};
+		for ( int ii = 0; ii < 6; ++ii ) {
+			KerasModel model;
+			TS_ASSERT_THROWS( model.load_weights_from_string( bad[ii] ), BadModel );
+		}
+	}
+
+	void testInt8(void) {
+		using namespace kernels;
+
+		vector<string> supported = supported_int8_kernels();
+		TS_ASSERT_EQUALS( supported.back(), "generic" );
+		TS_ASSERT( dense_int8_kernel( "not_an_isa" ) == nullptr );
+
+		int rows = 70, inputs = 13, neurons = 37;
+		int padded_in = padded_inputs_int8( inputs );
+		int padded = padded_neurons( neurons );
+		TS_ASSERT_EQUALS( padded_in, 16 );
+
+		vector<int8_t> weights( inputs*neurons );
+		AlignedInt8Buffer input( rows*padded_in );
+		for ( int ii = 0; ii < weights.size(); ++ii ) weights[ii] = (int8_t)( ii*37 % 255 - 127 );
+		for ( int r = 0; r < rows; ++r ) {
+			for ( int j = 0; j < padded_in; ++j ) {
+				input[ r*padded_in+j ] = ( j < inputs ) ? (int8_t)( (r*13+j*7) % 255 - 127 ) : 0;
+			}
+		}
+
+		AlignedInt8Buffer packed( padded_in*padded );
+		AlignedInt32Buffer sums;
+		AlignedFloatBuffer scale, bias;
+		sums.assign( padded, 0 );
+		scale.assign( padded, 0 );
+		bias.assign( padded, 0 );
+		pack_weights_int8( weights.data(), inputs, neurons, packed.data() );
+		for ( int k = 0; k < neurons; ++k ) {
+			for ( int j = 0; j < inputs; ++j ) sums[k] += weights[ j*neurons+k ];
+			scale[k] = 0.001f*( k+1 );
+			bias[k] = k*0.01f - 0.2f;
+		}
+
+		vector<float> expected( rows*neurons );
+		for ( int r = 0; r < rows; ++r ) {
+			for ( int k = 0; k < neurons; ++k ) {
+				int32_t acc = 0;
+				for ( int j = 0; j < inputs; ++j ) acc += weights[ j*neurons+k ] * input[ r*padded_in+j ];
+				expected[ r*neurons+k ] = (float)acc * scale[k] + bias[k];
+			}
+		}
+
+		// integer sums are exact, so every variant matches the reference
+		for ( int ii = 0; ii < supported.size(); ++ii ) {
+			vector<float> output( rows*neurons );
+			dense_int8_kernel( supported[ii] )( input.data(), rows, padded_in, packed.data(),
+				sums.data(), scale.data(), bias.data(), neurons, output.data() );
+			TS_ASSERT_EQUALS( output, expected );
+		}
+
+		// the quantized model stays close to double
+		KerasModelConstPtr model( new KerasModel( "../model.nnet" ));
+		vector<double> row = dc_->get_1d();
+		vector<float> calibrated = QuantizedModel::calibrate( *model, row, 1, 100 );
+		TS_ASSERT_EQUALS( calibrated.size(), 4 );
+
+		QuantizedModel quantized( model, QuantizedModel::read_calibration( "../model.calib" ));
+		vector<float> row_f32( row.begin(), row.end() );
+		InferenceContext context;
+		double expected_output;
+		float output;
+		model->compute_output_batch( row.data(), 1, &expected_output, context );
+		quantized.compute_output_batch( row_f32.data(), 1, &output, context );
+		TS_ASSERT_DELTA( output, expected_output, 0.05 );
+
+		TS_ASSERT_THROWS( QuantizedModel( model, vector<float>( 3, 1 )), BadModel );
+		TS_ASSERT_THROWS( QuantizedModel::calibrate( *model, row, 1, 0 ), invalid_argument );
+	}
+
+	void testPackedWeights(void) {
+		KerasModel model;
+
+		// weights are read back in their original order through the view
+		model.load_weights_from_string(
+			"layers 1\n"
+			"layer 0 Dense\n"
+			"2 3\n"
+			"[ 1 2 3 ]\n"
+			"[ 4 5 6 ]\n"
+			"[ 0.1 0.2 0.3 ]" );
+		LayerDense* layer = dynamic_cast<LayerDense*>( model.layer( 0 ));
+		TS_ASSERT( layer != nullptr );
+
+		LayerDense::WeightsView view = layer->weights();
+		TS_ASSERT_EQUALS( view.inputs(), 2 );
+		TS_ASSERT_EQUALS( view.neurons(), 3 );
+		TS_ASSERT_EQUALS( view( 0, 0 ), 1 );
+		TS_ASSERT_EQUALS( view( 0, 2 ), 3 );
+		TS_ASSERT_EQUALS( view( 1, 1 ), 5 );
+		TS_ASSERT_EQUALS( layer->bias( 2 ), 0.3 );
+
+		// buffers are aligned to a cache line
+		AlignedBuffer buffer( 5 );
+		TS_ASSERT_EQUALS( (size_t)buffer.data() % AlignedBuffer::ALIGNMENT, 0 );
+		TS_ASSERT_EQUALS( buffer[4], 0.0 );
+		AlignedBuffer copied( buffer );
+		TS_ASSERT_DIFFERS( copied.data(), buffer.data() );
+		TS_ASSERT_EQUALS( copied.size(), 5 );
+	}
+
 	void testDataChunks(void) {
 		DataChunkFlat dc_flat;
 		try {
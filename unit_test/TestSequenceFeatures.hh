@@ -11,15 +11,20 @@
 #include <cxxtest/TestSuite.h>
 
 #include "SequenceFeatures.hh"
+#include "FeatureExtractor.hh"
+#include "ReadEncoding.hh"
 #include "SequenceQuery.hh"
 #include "ErrorXOptions.hh"
 #include "ErrorPredictor.hh"
+#include "PredictionCache.hh"
+#include "keras/SparseBatch.hh"
 #include "util.hh"
 #include <string>
 
 #include "SequenceRecord.hh"
 #include "IGBlastParser.hh"
 #include <cmath>
+#include <thread>
 
 using namespace std;
 using namespace errorx;
@@ -124,6 +129,77 @@ public:
 		TS_ASSERT_EQUALS( sf.encode_sequence( "AACTGCTN-XTA" ), test_vector );
 	}
 
+	void testReadEncoding() {
+		// long enough to cover the vector loop and the scalar tail
+		string sequence;
+		for ( int ii = 0; ii < 45; ++ii ) sequence += "ATCGN-"[ (ii*7) % 6 ];
+
+		vector<int8_t> codes( sequence.size() );
+		TS_ASSERT_EQUALS( encoding::encode_nucleotides( sequence.data(), sequence.size(), codes.data() ), -1 );
+		for ( int ii = 0; ii < sequence.size(); ++ii ) {
+			TS_ASSERT_EQUALS( codes[ ii ], SequenceFeatures::nt_index( sequence[ ii ] ));
+		}
+
+		// the first invalid nucleotide is reported, in either loop
+		for ( int bad : { 3, 20, 37, 44 } ) {
+			string invalid = sequence;
+			invalid[ bad ] = 'X';
+			invalid[ 44 ] = 'a';
+			TS_ASSERT_EQUALS( encoding::encode_nucleotides( invalid.data(), invalid.size(), codes.data() ), bad );
+		}
+
+		string invalid = sequence;
+		invalid[ 20 ] = '?';
+		try {
+			encoding::encode_nucleotides( invalid, codes.data(), "sequence of read 1" );
+			TS_FAIL( "invalid nucleotide was accepted" );
+		} catch ( invalid_argument & e ) {
+			TS_ASSERT( string( e.what() ).find( "position 21" ) != string::npos );
+		}
+
+		// same as decoding each character with an offset of 33
+		string quality = quality_string_.substr( 0, 40 ) + " !~";
+		vector<int> phred( quality.size() );
+		encoding::decode_phred( quality.data(), quality.size(), phred.data() );
+		for ( int ii = 0; ii < quality.size(); ++ii ) {
+			TS_ASSERT_EQUALS( phred[ ii ], (int)quality[ ii ] - 33 );
+		}
+
+		for ( int ii = 0; ii < 100; ++ii ) {
+			TS_ASSERT_EQUALS( encoding::error_probability( ii ), util::phred_to_realspace( ii ));
+		}
+
+		// a read with an invalid germline is rejected before any features
+		SequenceQuery bad_gl( "bad_gl", sequence_, gl_sequence_.substr( 0, 30 )+"Z"+gl_sequence_.substr( 31 ), quality_string_ );
+		SequenceRecord bad_gl_record( bad_gl );
+		TS_ASSERT_THROWS( FeatureExtractor extractor( bad_gl_record ), invalid_argument );
+	}
+
+	void testFillRow() {
+		TS_ASSERT_EQUALS( SequenceFeatures::nt_index( 'A' ), 0 );
+		TS_ASSERT_EQUALS( SequenceFeatures::nt_index( '-' ), 5 );
+		TS_ASSERT_EQUALS( SequenceFeatures::nt_index( 'X' ), -1 );
+		TS_ASSERT_THROWS( SequenceFeatures::nt_index( 'a' ), invalid_argument );
+		TS_ASSERT_THROWS( SequenceFeatures::nt_index( (char)200 ), invalid_argument );
+
+		// rows written in place match the single-pass extractor,
+		// and float rows are the double rows rounded once
+		FeatureExtractor extractor( *record_ );
+		for ( int ii = 0; ii < sequence_.size(); ++ii ) {
+			SequenceFeatures sf( *record_, ii );
+
+			double row[ 124 ];
+			float row_f32[ 124 ];
+			sf.fill_row( row );
+			sf.fill_row( row_f32 );
+
+			TS_ASSERT_EQUALS( vector<double>( row, row+124 ), extractor.get_feature_vector( ii ));
+			for ( int jj = 0; jj < 124; ++jj ) {
+				TS_ASSERT_EQUALS( row_f32[ jj ], (float)row[ jj ] );
+			}
+		}
+	}
+
 	void testSequenceWindow() {
 		SequenceFeatures sf = SequenceFeatures( *record_, 2 );
 
@@ -409,6 +485,205 @@ public:
 		TS_ASSERT_EQUALS( shm, 0.25 );
 	}
 
+	void testFeatureExtractor() {
+		FeatureExtractor extractor( *record_ );
+		TS_ASSERT_EQUALS( extractor.length(), sequence_.size() );
+
+		vector<double> matrix;
+		extractor.get_feature_matrix( matrix );
+		TS_ASSERT_EQUALS( matrix.size(), sequence_.size()*124 );
+
+		// every position must match the single-position calculation exactly
+		for ( int ii = 0; ii < sequence_.size(); ++ii ) {
+			SequenceFeatures sf( *record_, ii );
+			vector<double> expected = sf.get_feature_vector();
+			vector<double> row( matrix.begin()+ii*124, matrix.begin()+(ii+1)*124 );
+
+			TS_ASSERT_EQUALS( expected, row );
+			TS_ASSERT_EQUALS( sf.is_germline(), extractor.is_germline( ii ));
+		}
+
+		TS_ASSERT_THROWS( extractor.get_feature_vector( sequence_.size() ), invalid_argument );
+
+		// only non-germline positions are listed for prediction
+		vector<int> mismatches;
+		for ( int ii = 0; ii < sequence_.size(); ++ii ) {
+			if ( sequence_[ii] != gl_sequence_[ii] ) mismatches.push_back( ii );
+		}
+		TS_ASSERT_EQUALS( extractor.mismatch_positions(), mismatches );
+
+		// sparse rows expand back to the dense rows
+		keras::SparseBatch sparse;
+		for ( int ii = 0; ii < sequence_.size(); ++ii ) extractor.fill_row( ii, sparse );
+		TS_ASSERT_EQUALS( sparse.rows(), sequence_.size() );
+		for ( int ii = 0; ii < sparse.rows(); ++ii ) {
+			vector<double> row( 124, 0.0 );
+			for ( int e = sparse.row_start()[ii]; e < sparse.row_start()[ii+1]; ++e ) {
+				if ( e > sparse.row_start()[ii] ) TS_ASSERT_LESS_THAN( sparse.columns()[e-1], sparse.columns()[e] );
+				row[ sparse.columns()[e] ] = sparse.values()[e];
+			}
+			TS_ASSERT_EQUALS( row, vector<double>( matrix.begin()+ii*124, matrix.begin()+(ii+1)*124 ));
+		}
+
+		// same error handling as SequenceFeatures
+		SequenceQuery bad_nt( "bad_nt", "ACGTACGTACGTAC?T", "ACGTACGTACGTACGT", "GGGGGGGGGGGGGGGG" );
+		SequenceRecord bad_nt_record( bad_nt );
+		TS_ASSERT_THROWS( FeatureExtractor extractor( bad_nt_record ), invalid_argument );
+
+		SequenceQuery too_short( "too_short", "ACGTA", "ACGTA", "GGGGG" );
+		SequenceRecord too_short_record( too_short );
+		TS_ASSERT_THROWS( FeatureExtractor extractor( too_short_record ), invalid_argument );
+	}
+
+	void testSharedPredictor() {
+		ErrorXOptions options( "tmp", "tsv" );
+		options.errorx_base( ".." );
+		options.verbose( 0 );
+		ErrorPredictor const predictor( options );
+		FeatureExtractor extractor( *record_ );
+		vector<double> expected = predictor.apply_model_batch( extractor );
+
+		// a reused workspace gives the same predictions
+		ErrorPredictor::Workspace workspace;
+		vector<double> output( extractor.length() );
+		for ( int ii = 0; ii < 2; ++ii ) {
+			predictor.apply_model_batch( extractor, output.data(), workspace );
+			TS_ASSERT_EQUALS( output, expected );
+		}
+
+		// one predictor serves many threads, each with its own workspace
+		int nthreads = 4;
+		vector<vector<double>> results( nthreads, vector<double>( extractor.length() ));
+		vector<thread> threads;
+		for ( int ii = 0; ii < nthreads; ++ii ) {
+			threads.push_back( thread( [&, ii]() {
+				ErrorPredictor::Workspace own;
+				for ( int jj = 0; jj < 20; ++jj ) {
+					predictor.apply_model_batch( extractor, results[ ii ].data(), own );
+				}
+			}));
+		}
+		for ( int ii = 0; ii < nthreads; ++ii ) threads[ ii ].join();
+		for ( int ii = 0; ii < nthreads; ++ii ) TS_ASSERT_EQUALS( results[ ii ], expected );
+	}
+
+	void testCascade() {
+		ErrorXOptions options( "tmp", "tsv" );
+		options.errorx_base( ".." );
+		options.verbose( 0 );
+		ErrorPredictor predictor( options );
+		FeatureExtractor extractor( *record_ );
+		vector<double> expected = predictor.apply_model_batch( extractor );
+		int rows = extractor.mismatch_positions().size();
+		int errors = 0;
+		for ( int ii = 0; ii < expected.size(); ++ii ) {
+			if ( expected[ii] > options.error_threshold() ) ++errors;
+		}
+		TS_ASSERT( errors > 0 );
+
+		// a screen that scores every position close to zero
+		string file = "screen_test.nnet";
+		ofstream out( file );
+		out << "layers 2\nlayer 0 Dense\n124 1 blocks 1\n122 0 [ 1 ]\n[ -10 ]\n"
+			"layer 1 Activation\nsigmoid\n";
+		out.close();
+		options.screen_model( file );
+
+		// margins the screen never meets leave every call to the full network
+		options.screen_lower( 0 );
+		ErrorPredictor::reset_cascade_counts();
+		TS_ASSERT_EQUALS( ErrorPredictor( options ).apply_model_batch( extractor ), expected );
+		TS_ASSERT_EQUALS( ErrorPredictor::cascade_counts().screened, 0 );
+		TS_ASSERT_EQUALS( ErrorPredictor::cascade_counts().forwarded, rows );
+
+		// margins it always meets call everything from the screen,
+		// and validation counts the errors the screen missed
+		options.screen_lower( 0.5 );
+		options.screen_validate( true );
+		ErrorPredictor::reset_cascade_counts();
+		vector<double> screened = ErrorPredictor( options ).apply_model_batch( extractor );
+		for ( int ii = 0; ii < screened.size(); ++ii ) TS_ASSERT_LESS_THAN( screened[ii], 0.5 );
+		ErrorPredictor::CascadeCounts counts = ErrorPredictor::cascade_counts();
+		TS_ASSERT_EQUALS( counts.screened, rows );
+		TS_ASSERT_EQUALS( counts.forwarded, 0 );
+		TS_ASSERT_EQUALS( counts.validated, rows );
+		TS_ASSERT_EQUALS( counts.disagreements, errors );
+
+		options.screen_upper( 0.25 );
+		TS_ASSERT_THROWS( ErrorPredictor predictor( options ), invalid_argument );
+		TS_ASSERT_THROWS( options.screen_lower( 1.5 ), invalid_argument );
+
+		// the screen must take the same features as the full network
+		string bad_file = "screen_bad.nnet";
+		out.open( bad_file );
+		out << "layers 1\nlayer 0 Dense\n2 1\n[ 1 ]\n[ 1 ]\n[ 0 ]\n";
+		out.close();
+		options.screen_upper( 1 );
+		options.screen_model( bad_file );
+		TS_ASSERT_THROWS( ErrorPredictor predictor( options ), keras::BadModel );
+		remove( file.c_str() );
+		remove( bad_file.c_str() );
+	}
+
+	void testPredictionCache() {
+		// keys depend on every value, and on nothing else
+		PredictionCache exact( 1 ), rounded( 1, 0.01 );
+		vector<double> row( raw_vector_ ), nudged( raw_vector_ );
+		nudged[ 0 ] += 1e-9;
+		TS_ASSERT( exact.key( row.data(), row.size() ) == exact.key( raw_vector_.data(), raw_vector_.size() ));
+		TS_ASSERT( !( exact.key( row.data(), row.size() ) == exact.key( nudged.data(), nudged.size() )));
+		TS_ASSERT( rounded.key( row.data(), row.size() ) == rounded.key( nudged.data(), nudged.size() ));
+
+		double value = -1;
+		PredictionCache::Key key = exact.key( row.data(), row.size() );
+		TS_ASSERT( !exact.find( key, value ));
+		exact.insert( key, 0.25 );
+		TS_ASSERT( exact.find( key, value ));
+		TS_ASSERT_EQUALS( value, 0.25 );
+		TS_ASSERT_EQUALS( exact.hits(), 1 );
+		TS_ASSERT_EQUALS( exact.misses(), 1 );
+		TS_ASSERT_DELTA( exact.hit_rate(), 0.5, 1e-12 );
+
+		// bounded, the oldest rows make room for new ones
+		PredictionCache small( 0 );
+		TS_ASSERT_EQUALS( small.capacity(), PredictionCache::SHARDS );
+		for ( int ii = 0; ii < 1000; ++ii ) {
+			row[ 0 ] = ii;
+			small.insert( small.key( row.data(), row.size() ), ii );
+		}
+		TS_ASSERT_EQUALS( small.size(), small.capacity() );
+		row[ 0 ] = 999;
+		TS_ASSERT( small.find( small.key( row.data(), row.size() ), value ));
+		TS_ASSERT_EQUALS( value, 999 );
+		TS_ASSERT_THROWS( PredictionCache bad( -1 ), invalid_argument );
+
+		// predictions with the cache match the ones without, and
+		// predictors with the same settings share it
+		ErrorXOptions options( "tmp", "tsv" );
+		options.errorx_base( ".." );
+		options.verbose( 0 );
+		FeatureExtractor extractor( *record_ );
+		vector<double> expected = ErrorPredictor( options ).apply_model_batch( extractor );
+
+		options.prediction_cache( true );
+		PredictionCache::clear();
+		ErrorPredictor first( options ), second( options );
+		TS_ASSERT_EQUALS( first.apply_model_batch( extractor ), expected );
+		TS_ASSERT_EQUALS( second.apply_model_batch( extractor ), expected );
+		PredictionCachePtr cache = PredictionCache::get( options );
+		int rows = extractor.mismatch_positions().size();
+		TS_ASSERT_EQUALS( cache->hits(), rows );
+		TS_ASSERT_EQUALS( cache->misses(), rows );
+
+		SequenceFeatures features( *record_, raw_vector_position_ );
+		TS_ASSERT_EQUALS( first.apply_model( features ), expected[ raw_vector_position_ ] );
+		TS_ASSERT_EQUALS( cache->hits(), rows+1 );
+
+		options.precision( "single" );
+		TS_ASSERT( PredictionCache::get( options ) != cache );
+		PredictionCache::clear();
+	}
+
 	string sequenceID_;
 	string sequence_;
 	string gl_sequence_;
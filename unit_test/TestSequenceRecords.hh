@@ -3,20 +3,40 @@
 
 #include <cxxtest/TestSuite.h>
 
+#include <atomic>
+#include <cstdlib>
+#include <new>
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 
 #include "ErrorXOptions.hh"
 #include "SequenceRecord.hh"
 #include "SequenceRecords.hh"
+#include "RecordStore.hh"
 #include "AbSequence.hh"
 #include "ClonotypeGroup.hh"
 #include "util.hh"
 #include "errorx.hh"
+#include "StreamingPipeline.hh"
+#include "exceptions.hh"
 
 using namespace std;
 using namespace errorx;
 
+// counts heap allocations, to check how much copying a record costs
+atomic<long> allocations( 0 );
+
+void * operator new( size_t size ) {
+	allocations++;
+	void * memory = malloc( size ? size : 1 );
+	if ( !memory ) throw bad_alloc();
+	return memory;
+}
+
+void operator delete( void * memory ) noexcept { free( memory ); }
+
 class TestSequenceRecords : public CxxTest::TestSuite
 {
 public:
@@ -353,6 +373,243 @@ public:
 		TS_ASSERT_EQUALS( records->unique_aa_sequences( /*int corrected=*/1 ), 1 );
 	}
 
+	void testDeduplication() {
+		ErrorXOptions options( "tmp", "tsv" );
+		options.errorx_base("..");
+		options.nthreads( 2 );
+		options.verbose( 0 );
+
+		string sequence = "CAGATCCAGTTGGTGCAGTCTGGACCTGAGCTGAAGAAGCCTGGAGAGACAGTCAGGATCTCCTGCAAGGCTTCTGGGTATACCTTCACAACTGCTGGAATGCAGTGGGTGCAAAAGATGCCAGGAAAGGGTTTGAAGTGGATTGGCTGGATAAACACCCACTCTGGAGTGCCAAAATATGCAGAAGACTTCAAGGGACGGTTTGTCTTCTCTTTGGAAACCTCTGCCAGCACTGCATATTTACAGATAACGAACCTCAAAAATGAGGACACGGCTACATATTTCGTTGCGAGAGGAGGGGCCGCCTTCTATAGAAACGACGGGGGTGCTATGGACTCCTGGGGTCAAGGAACCTCAGTCACCGTCTCCTCAG";
+		string gl_sequence = "CAGATCCAGTTGGTGCAGTCTGGACCTGAGCTGAAGAAGCCTGGAGAGACAGTCAGGATCTCCTGCAAGGCTTCTGGGTATACCTTCACAACTGCTGGAATGCAGTGGGTGCAAAAGATGCCAGGAAAGGGTTTGAAGTGGATTGGCTGGATAAACACCCACTCTGGAGTGCCAAAATATGCAGAAGACTTCAAGGGACGGTTTGCCTTCTCTTTGGAAACCTCTGCCAGCACTGCATATTTACAGATAAGCAACCTCAAAAATGAGGACACGGCTACGTATTTCTGTGCGAGA--------------------------------TGCTATGGACTACTGGGGTCAAGGAACCTCAGTCACCGTCTCCTCAG";
+		string quality_string = ";=,,=;EE,<C,,8,CC,;;C-CEFGGGGGGGDFGGGGGGGGGGEGFGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGG@FGGGGGGGGFFFFGDFFGGFCEGGGGGGGGGGGGGEEGGGGDFGGGEEFCFCFGGCFFFGGGGGGGGGGGGGGF66DGGGGGCFGGGDG5DGFGFDCDBF9BA8@FFFFFFDAFGFF@?B@33>8;@B4C?CCFFEECE27;;@;@@E333:@CFFF6;DF>(4:1<A#######@@@6C:A;4)7/)CEEFGFFCFGGC7?:9ECDEDGD6GGCFA,DDFF=8EGECC8FF=9,GGGFDGE@E;GGGGGGGGGGGFGGGGG";
+		string variant = sequence;
+		variant[ 100 ] = 'C';
+
+		vector<SequenceQuery> queries;
+		queries.push_back( SequenceQuery( "read1", sequence, gl_sequence, quality_string ));
+		queries.push_back( SequenceQuery( "read2", variant, gl_sequence, quality_string ));
+		queries.push_back( SequenceQuery( "read3", sequence, gl_sequence, quality_string ));
+		queries.push_back( SequenceQuery( "read4", sequence, gl_sequence, quality_string ));
+
+		SequenceRecordsPtr records( new SequenceRecords( options ));
+		records->import_from_list( queries );
+		SequenceRecords::correct_sequences( records );
+
+		// three copies of one read plus a variant
+		TS_ASSERT_EQUALS( records->size(), 4 );
+		TS_ASSERT_DELTA( records->dedup_ratio(), 2.0, 1e-12 );
+
+		TS_ASSERT_EQUALS( records->get(0)->sequenceID(), "read1" );
+		TS_ASSERT_EQUALS( records->get(1)->sequenceID(), "read2" );
+		TS_ASSERT_EQUALS( records->get(2)->sequenceID(), "read3" );
+		TS_ASSERT_EQUALS( records->get(3)->sequenceID(), "read4" );
+
+		// each copy matches a read corrected on its own
+		SequenceQuery query( "single", sequence, gl_sequence, quality_string );
+		SequenceRecord single( query );
+		ErrorPredictor predictor( options );
+		single.correct_sequence( predictor, options );
+
+		for ( int ii : { 0, 2, 3 } ) {
+			SequenceRecordPtr record = records->get( ii );
+			TS_ASSERT_EQUALS( record->full_nt_sequence_corrected(), single.full_nt_sequence_corrected() );
+			TS_ASSERT_EQUALS( record->n_errors(), single.n_errors() );
+
+			vector<pair<int,double>> expected = single.get_predicted_errors();
+			vector<pair<int,double>> actual = record->get_predicted_errors();
+			TS_ASSERT_EQUALS( actual.size(), expected.size() );
+			for ( int jj = 0; jj < expected.size() && jj < actual.size(); ++jj ) {
+				TS_ASSERT_EQUALS( actual[jj].first, expected[jj].first );
+				TS_ASSERT_EQUALS( actual[jj].second, expected[jj].second );
+			}
+		}
+		TS_ASSERT_EQUALS( records->get(1)->full_nt_sequence(), variant );
+	}
+
+	void testStreaming() {
+		string line;
+		ifstream infile( "testing/test.tsv" );
+		getline( infile, line );
+		vector<string> tokens = util::tokenize_string<string>( line, "\t" );
+
+		// ten reads, some of them repeated, so chunks differ in
+		// how long they take to correct
+		ofstream outfile( "stream.tsv" );
+		for ( int ii = 0; ii < 10; ++ii ) {
+			string sequence = tokens[1];
+			if ( ii%3 != 0 ) sequence[ 20+ii ] = sequence[ 20+ii ] == 'A' ? 'C' : 'A';
+			outfile << "read" << ii << "\t" << sequence << "\t" << tokens[2] << "\t" << tokens[3] << "\n";
+		}
+		outfile.close();
+
+		ErrorXOptions options( "stream.tsv", "tsv" );
+		options.errorx_base("..");
+		options.nthreads( 2 );
+		options.verbose( 0 );
+		options.outfile( "whole_out.tsv" );
+		run_protocol_write( options );
+
+		options.chunk_size( 3 );
+		options.outfile( "stream_out.tsv" );
+		options.count_queries();
+		StreamingPipeline pipeline( options );
+		pipeline.run();
+		TS_ASSERT_EQUALS( pipeline.chunks(), 4 );
+		TS_ASSERT_EQUALS( pipeline.reads(), 10 );
+		TS_ASSERT_LESS_THAN( pipeline.max_buffered(), pipeline.window() );
+
+		// the same rows in the same order as correcting everything at once
+		ifstream whole( "whole_out.tsv" );
+		ifstream streamed( "stream_out.tsv" );
+		stringstream whole_text, streamed_text;
+		whole_text << whole.rdbuf();
+		streamed_text << streamed.rdbuf();
+		TS_ASSERT_EQUALS( streamed_text.str(), whole_text.str() );
+		TS_ASSERT_EQUALS( util::count_lines( "stream_out.tsv" ), 11 );
+
+		// a bad line stops every stage instead of leaving them waiting
+		outfile.open( "stream.tsv", ios::app );
+		outfile << "read10\tACGT\n";
+		outfile.close();
+		TS_ASSERT_THROWS( StreamingPipeline( options ).run(), BadFileException );
+
+		TS_ASSERT_THROWS( options.chunk_size( -1 ), invalid_argument );
+
+		remove( "stream.tsv" );
+		remove( "whole_out.tsv" );
+		remove( "stream_out.tsv" );
+	}
+
+	void testStreamingDuplicateIDs() {
+		// read1 comes back in later chunks, so its copies are only
+		// renamed if IDs are kept across chunks, and its later
+		// copies skip suffixes that are already taken
+		ofstream outfile( "stream.fastq" );
+		string ids[] = { "read1", "read2", "read1", "read1_1", "read1", "read1", "read1_2" };
+		for ( int ii = 0; ii < 7; ++ii ) {
+			outfile << "@" << ids[ ii ] << "\nACGT\n+\nIIII\n";
+		}
+		outfile.close();
+
+		ErrorXOptions options( "stream.fastq", "fastq" );
+		options.errorx_base( ".." );
+		options.verbose( 0 );
+		options.chunk_size( 2 );
+		options.fastq_to_fasta();
+
+		StreamingPipeline pipeline( options );
+		ifstream infile( "stream.fastq" );
+		string text;
+		unordered_map<string,string> qualities;
+		vector<int> reads;
+		int chunk_reads;
+		while (( chunk_reads = pipeline.read_chunk( infile, text, qualities )) > 0 ) {
+			reads.push_back( chunk_reads );
+		}
+		TS_ASSERT_EQUALS( reads, vector<int>({ 2, 2, 2, 1 }));
+
+		// the same names as converting the whole file at once
+		ifstream fasta( options.infasta() );
+		stringstream fasta_text;
+		fasta_text << fasta.rdbuf();
+		TS_ASSERT_EQUALS( text, fasta_text.str() );
+		TS_ASSERT_EQUALS( qualities, options.quality_map() );
+		TS_ASSERT_EQUALS( qualities.size(), 7 );
+		TS_ASSERT( qualities.count( "read1_1_1" ));
+		TS_ASSERT( qualities.count( "read1_3" ));
+		TS_ASSERT( qualities.count( "read1_2_1" ));
+
+		remove( "stream.fastq" );
+		remove( options.infasta().c_str() );
+	}
+
+	void testRecordCopyAllocations() {
+		string line;
+		ifstream infile( "testing/test.tsv" );
+		getline( infile, line );
+		vector<string> tokens = util::tokenize_string<string>( line, "\t" );
+		SequenceQuery query( tokens[0], tokens[1], tokens[2], tokens[3] );
+		SequenceRecord record( query );
+		record.store()->predictions( record.row(), vector<double>( tokens[1].size(), 0.5 ));
+
+		// the store with its count, one array for each type of
+		// column, and one block of the arena with the list of blocks
+		long before = allocations;
+		SequenceRecord copy( record );
+		TS_ASSERT_LESS_THAN_EQUALS( allocations-before, 7 );
+		TS_ASSERT_EQUALS( copy.store()->size(), 1 );
+		TS_ASSERT_EQUALS( copy, record );
+		TS_ASSERT_EQUALS( copy.store()->predictions( 0 ), record.store()->predictions( record.row() ));
+
+		before = allocations;
+		copy = record;
+		TS_ASSERT_LESS_THAN_EQUALS( allocations-before, 7 );
+	}
+
+	void testRecordStore() {
+		RecordStore store;
+		AbSequence sequence;
+		sequence.sequenceID( "read0" );
+		sequence.full_nt_sequence( "ACTGACTGAC" );
+		sequence.quality_string_trimmed( "##########" );
+
+		for ( int ii = 0; ii < 100; ++ii ) TS_ASSERT_EQUALS( store.add( sequence ), ii );
+		TS_ASSERT_EQUALS( store.size(), 100 );
+		TS_ASSERT( store.sequence( 99 )==sequence );
+
+		// "N/A" takes no space, and is kept apart from ""
+		TS_ASSERT_EQUALS( store.length( RecordStore::V_GENE, 0 ), -1 );
+		TS_ASSERT_EQUALS( store.text( RecordStore::V_GENE, 0 ), "N/A" );
+		TS_ASSERT_EQUALS( store.length( RecordStore::CDR3_AA, 0 ), 0 );
+		TS_ASSERT_EQUALS( store.text( RecordStore::CDR3_AA, 0 ), "" );
+		TS_ASSERT_EQUALS( string( store.data( RecordStore::FULL_NT, 5 ), 10 ), "ACTGACTGAC" );
+
+		// flags of rows past the first word
+		store.flag( RecordStore::GOOD, 70, false );
+		TS_ASSERT( !store.flag( RecordStore::GOOD, 70 ));
+		TS_ASSERT( store.flag( RecordStore::GOOD, 69 ));
+		TS_ASSERT( store.flag( RecordStore::GOOD, 71 ));
+
+		// a value that doesn't grow is written over the old one
+		size_t bytes = store.arena_bytes();
+		store.text( RecordStore::FULL_NT, 3, "ACTG" );
+		store.text( RecordStore::FULL_NT, 3, "ACTGACTG" );
+		TS_ASSERT_EQUALS( store.arena_bytes(), bytes );
+		TS_ASSERT_EQUALS( store.text( RecordStore::FULL_NT, 3 ), "ACTGACTG" );
+		TS_ASSERT_EQUALS( store.text( RecordStore::FULL_NT, 4 ), "ACTGACTGAC" );
+
+		vector<double> predictions = { 0.1, 0.9, 0.0 };
+		store.predictions( 3, predictions );
+		store.integer( RecordStore::N_ERRORS, 3, 1 );
+		TS_ASSERT_EQUALS( store.add( store, 3 ), 100 );
+		TS_ASSERT_EQUALS( store.predictions( 100 ), predictions );
+		TS_ASSERT_EQUALS( store.integer( RecordStore::N_ERRORS, 100 ), 1 );
+		TS_ASSERT_EQUALS( store.text( RecordStore::FULL_NT, 100 ), "ACTGACTG" );
+		TS_ASSERT( store.predictions( 0 ).empty() );
+
+		// records added to a collection move into its store, and
+		// copies of the collection get a store of their own
+		ErrorXOptions options( "test.fastq", "fastq" );
+		options.errorx_base( ".." );
+		SequenceRecordsPtr records( new SequenceRecords( options ));
+		SequenceRecordPtr record( new SequenceRecord( sequence ));
+		SequenceRecord copy( *record );
+		records->add_record( record );
+		records->add_record( sequence );
+		TS_ASSERT( record->store()==records->store() );
+		TS_ASSERT_EQUALS( records->store()->size(), 2 );
+		TS_ASSERT( *record==copy );
+		TS_ASSERT( *records->get( 1 )==copy );
+
+		record->v_gene( "IGHV3-23*01" );
+		TS_ASSERT_EQUALS( records->get( 0 )->v_gene_noallele(), "IGHV3-23" );
+		TS_ASSERT_EQUALS( copy.v_gene(), "N/A" );
+
+		SequenceRecords records_copy( *records );
+		TS_ASSERT( records_copy.store()!=records->store() );
+		TS_ASSERT( records_copy==*records );
+	}
+
 
 	void testAASomaticVariants() {
 
@@ -12,12 +12,18 @@
 
 #include "util.hh"
 #include "exceptions.hh"
+#include "TaskScheduler.hh"
+#include "Executor.hh"
+#include "BoundedQueue.hh"
 
 #include <iostream>
 #include <string>
 #include <vector>
 #include <map>
 #include <functional>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 using namespace std;
 using namespace errorx;
@@ -146,6 +152,13 @@ public:
 		util::write_license( inf_cipher );
 	}
 
+	void testTrim() {
+		TS_ASSERT_EQUALS( util::trim( " \tread1\tACGT \r\n" ), "read1\tACGT" );
+		TS_ASSERT_EQUALS( util::trim( "ACGT" ), "ACGT" );
+		TS_ASSERT_EQUALS( util::trim( " \t\n" ), "" );
+		TS_ASSERT_EQUALS( util::trim( "" ), "" );
+	}
+
 	void testTokenize() {
 
 		vector<int> output2 = { 1,2,3,4,5 };
@@ -453,6 +466,136 @@ public:
 		// check that D does not map to A
 		TS_ASSERT_EQUALS( it, cmap.end() );
 	}
+
+	void testTaskScheduler() {
+		TS_ASSERT_THROWS( TaskScheduler( 0, 4 ), invalid_argument );
+		TS_ASSERT_THROWS( TaskScheduler( 4, 0 ), invalid_argument );
+
+		// all the slow items land in worker 0's share, so the
+		// other workers have to steal to finish
+		TaskScheduler scheduler( 4, 3 );
+		vector<atomic<int>> visits( 101 );
+		for ( int ii = 0; ii < visits.size(); ++ii ) visits[ ii ] = 0;
+		vector<int> workers( 101, -1 );
+
+		scheduler.run( 101, [&]( int worker, int begin, int end ) {
+			for ( int ii = begin; ii < end; ++ii ) {
+				if ( ii < 24 ) this_thread::sleep_for( chrono::milliseconds( 5 ));
+				visits[ ii ]++;
+				workers[ ii ] = worker;
+			}
+		});
+
+		for ( int ii = 0; ii < visits.size(); ++ii ) TS_ASSERT_EQUALS( visits[ ii ].load(), 1 );
+
+		vector<TaskScheduler::WorkerStats> const & stats = scheduler.stats();
+		TS_ASSERT_EQUALS( stats.size(), 4 );
+		int batches = 0;
+		int stolen = 0;
+		for ( int ii = 0; ii < stats.size(); ++ii ) {
+			batches += stats[ ii ].batches;
+			stolen += stats[ ii ].stolen;
+			TS_ASSERT( stats[ ii ].busy_seconds >= 0 );
+			TS_ASSERT( stats[ ii ].idle_seconds >= 0 );
+		}
+		TS_ASSERT_EQUALS( batches, 34 );
+		TS_ASSERT_LESS_THAN( 0, stolen );
+		TS_ASSERT_DIFFERS( workers[ 23 ], 0 );
+
+		// the first exception stops the run and is rethrown
+		TS_ASSERT_THROWS( scheduler.run( 50, []( int worker, int begin, int end ) {
+			if ( begin == 0 ) throw BadInputException( "bad record" );
+		}), BadInputException );
+
+		// a single worker runs everything on the calling thread
+		TaskScheduler serial( 1, 8 );
+		int total = 0;
+		serial.run( 20, [&]( int worker, int begin, int end ) { total += end-begin; });
+		TS_ASSERT_EQUALS( total, 20 );
+		TS_ASSERT_EQUALS( serial.stats()[0].stolen, 0 );
+	}
+
+	void testBoundedQueue() {
+		BoundedQueue<unique_ptr<int>> queue( 2 );
+		TS_ASSERT_THROWS( BoundedQueue<int>( 0 ), invalid_argument );
+
+		// the producer can't get more than two items ahead
+		atomic<int> pushed( 0 );
+		thread producer( [&]{
+			for ( int ii = 0; ii < 10; ++ii ) {
+				unique_ptr<int> item( new int( ii ));
+				queue.push( move( item ));
+				pushed++;
+			}
+			queue.close();
+		});
+
+		this_thread::sleep_for( chrono::milliseconds( 20 ));
+		TS_ASSERT_LESS_THAN_EQUALS( pushed.load(), 2 );
+
+		unique_ptr<int> item;
+		int expected = 0;
+		while ( queue.pop( item )) {
+			TS_ASSERT_EQUALS( *item, expected );
+			expected++;
+		}
+		producer.join();
+		TS_ASSERT_EQUALS( expected, 10 );
+
+		// nothing more goes in once it's closed
+		unique_ptr<int> late( new int( 10 ));
+		TS_ASSERT( !queue.push( move( late )));
+		TS_ASSERT( late );
+	}
+
+	void testExecutor() {
+		ExecutorPtr executor( new Executor( 2 ));
+		TS_ASSERT_EQUALS( executor->nthreads(), 2 );
+		TS_ASSERT( !Executor::on_worker_thread() );
+
+		atomic<int> count( 0 );
+		vector<future<void>> jobs;
+		for ( int ii = 0; ii < 10; ++ii ) {
+			jobs.push_back( executor->submit( [&count]{
+				if ( Executor::on_worker_thread() ) count++;
+			}));
+		}
+		for ( int ii = 0; ii < jobs.size(); ++ii ) jobs[ ii ].get();
+		TS_ASSERT_EQUALS( count.load(), 10 );
+
+		// exceptions come back through the future
+		future<void> failed = executor->submit( []{ throw BadInputException( "bad record" ); });
+		TS_ASSERT_THROWS( failed.get(), BadInputException );
+
+		// a scheduler on the executor visits every item once, the same
+		// as with its own threads, and runs again on the same pool
+		TaskScheduler scheduler( 4, 3, executor );
+		for ( int run = 0; run < 2; ++run ) {
+			vector<atomic<int>> visits( 50 );
+			for ( int ii = 0; ii < visits.size(); ++ii ) visits[ ii ] = 0;
+			scheduler.run( 50, [&]( int worker, int begin, int end ) {
+				for ( int ii = begin; ii < end; ++ii ) visits[ ii ]++;
+			});
+			for ( int ii = 0; ii < visits.size(); ++ii ) TS_ASSERT_EQUALS( visits[ ii ].load(), 1 );
+		}
+
+		// shutdown runs the jobs already queued, then refuses new ones
+		future<void> queued = executor->submit( [&count]{ count++; });
+		executor->shutdown();
+		executor->shutdown();
+		TS_ASSERT( !executor->running() );
+		queued.get();
+		TS_ASSERT_EQUALS( count.load(), 11 );
+		TS_ASSERT_THROWS( executor->submit( []{} ), runtime_error );
+		TS_ASSERT_THROWS( Executor( 0 ), invalid_argument );
+
+		// shared pools are started again after a shutdown
+		ExecutorPtr shared = Executor::shared( 2 );
+		TS_ASSERT_EQUALS( shared, Executor::shared( 2 ));
+		Executor::shutdown_shared();
+		TS_ASSERT( !shared->running() );
+		TS_ASSERT( Executor::shared( 2 )->running() );
+	}
 };
 
 